@@ -25,14 +25,579 @@
  * @brief Implements mbed TLS platform functions for FreeRTOS.
  */
 
+/* Standard includes. */
+#include <string.h>
+
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
 #include "FreeRTOS_Sockets.h"
 
 /* mbed TLS includes. */
 #include "aws_mbedtls_config.h"
 #include "threading_alt.h"
+#include "mbedtls_freertos_port.h"
 #include "mbedtls/entropy.h"
+#include "mbedtls/ssl.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Size of the arena serving the mbed TLS allocations, in bytes.
+ *
+ * The TLS handshake allocates and frees many blocks of very different sizes,
+ * in the FreeRTOS heap this fragments the memory left to the other tasks. With
+ * a non zero size, mbed TLS allocates from an arena of its own instead, taken
+ * from the RAM given to the FreeRTOS heap. Set it to 0 to use the FreeRTOS
+ * heap, the high water mark reported by mbedtls_platform_get_heap_stats()
+ * helps sizing it.
+ *
+ * The arena is not left empty between connections: the client certificate
+ * parsed by the TLS transport and the sessions it keeps for resumption stay
+ * allocated from one connection to the next. The blocks freed around them are
+ * merged, the largest free block reported by mbedtls_platform_get_heap_stats()
+ * tells how much a handshake can still allocate at once.
+ */
+#ifndef MBEDTLS_FREERTOS_ARENA_SIZE
+    #define MBEDTLS_FREERTOS_ARENA_SIZE    ( 29U * 1024U )
+#endif
+
+/**
+ * @brief Number of blocks of each slab size class.
+ *
+ * Most mbed TLS allocations are small and short lived: bignum limbs, ASN.1
+ * sequences and names, ECP point tables. They are served from fixed size
+ * blocks of 16 to 512 bytes, which takes a block off a list instead of
+ * walking the arena, and only the larger ones and the overflow of a full class
+ * go to the arena or the FreeRTOS heap. Set all of them to 0 to disable the
+ * slabs. The size histogram of MBEDTLS_FREERTOS_ALLOC_PROFILE and the slab
+ * fallbacks of mbedtls_platform_get_heap_stats() help tuning them for the
+ * cipher suites in use.
+ */
+#ifndef MBEDTLS_FREERTOS_SLAB_BLOCKS_16
+    #define MBEDTLS_FREERTOS_SLAB_BLOCKS_16     ( 64U )
+#endif
+#ifndef MBEDTLS_FREERTOS_SLAB_BLOCKS_32
+    #define MBEDTLS_FREERTOS_SLAB_BLOCKS_32     ( 64U )
+#endif
+#ifndef MBEDTLS_FREERTOS_SLAB_BLOCKS_64
+    #define MBEDTLS_FREERTOS_SLAB_BLOCKS_64     ( 32U )
+#endif
+#ifndef MBEDTLS_FREERTOS_SLAB_BLOCKS_128
+    #define MBEDTLS_FREERTOS_SLAB_BLOCKS_128    ( 16U )
+#endif
+#ifndef MBEDTLS_FREERTOS_SLAB_BLOCKS_256
+    #define MBEDTLS_FREERTOS_SLAB_BLOCKS_256    ( 8U )
+#endif
+#ifndef MBEDTLS_FREERTOS_SLAB_BLOCKS_512
+    #define MBEDTLS_FREERTOS_SLAB_BLOCKS_512    ( 4U )
+#endif
+
+#define slabCLASS_COUNT        ( 6U )
+#define slabMIN_BLOCK_SIZE     ( 16U )
+#define slabMAX_BLOCK_SIZE     ( slabMIN_BLOCK_SIZE << ( slabCLASS_COUNT - 1U ) )
+
+#define slabPOOL_SIZE                                   \
+    ( ( 16U * MBEDTLS_FREERTOS_SLAB_BLOCKS_16 ) +       \
+      ( 32U * MBEDTLS_FREERTOS_SLAB_BLOCKS_32 ) +       \
+      ( 64U * MBEDTLS_FREERTOS_SLAB_BLOCKS_64 ) +       \
+      ( 128U * MBEDTLS_FREERTOS_SLAB_BLOCKS_128 ) +     \
+      ( 256U * MBEDTLS_FREERTOS_SLAB_BLOCKS_256 ) +     \
+      ( 512U * MBEDTLS_FREERTOS_SLAB_BLOCKS_512 ) )
+
+/**
+ * @brief Allocations failed since startup.
+ */
+static uint32_t ulFailedAllocations = 0;
+
+#if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+
+/**
+ * @brief Allocation profile since the last call to
+ * mbedtls_platform_reset_alloc_profile(). Updated with the scheduler suspended.
+ */
+    static MbedtlsAllocProfile_t xAllocProfile;
+
+/* With the FreeRTOS heap, the size of an allocation is stored in front of it
+ * so that its release can be accounted. */
+    #define profileHEADER_SIZE    ( 8U )
+#endif
+
+#if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 )
+
+/**
+ * @brief Header of an arena block, free or allocated. Free blocks are kept
+ * in a list sorted by address, so that adjacent ones can be merged.
+ */
+    typedef struct ArenaBlock
+    {
+        struct ArenaBlock * pxNext; /**< @brief Next free block, NULL for an allocated one. */
+        size_t xSize;               /**< @brief Size of the block, including the header. */
+    } ArenaBlock_t;
+
+    #define arenaALIGNMENT      ( 8U )
+    #define arenaHEADER_SIZE    ( ( sizeof( ArenaBlock_t ) + ( arenaALIGNMENT - 1U ) ) & ~( arenaALIGNMENT - 1U ) )
+
+/* A block is only split if the remainder can hold a header and some data. */
+    #define arenaMIN_BLOCK_SIZE    ( arenaHEADER_SIZE * 2U )
+
+/**
+ * @brief The arena, aligned for any mbed TLS structure.
+ */
+    static union
+    {
+        uint64_t ullAlignment;
+        uint8_t ucBytes[ MBEDTLS_FREERTOS_ARENA_SIZE ];
+    } xArena;
+
+/**
+ * @brief Head of the free list, not part of the arena.
+ */
+    static ArenaBlock_t xArenaFreeList = { NULL, 0 };
+
+    static BaseType_t xArenaInitialized = pdFALSE;
+    static size_t xArenaUsed = 0;
+    static size_t xArenaMaxUsed = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Inserts a block in the free list, merging it with its neighbours.
+ * Called with the scheduler suspended.
+ *
+ * @param[in] pxBlock The block.
+ */
+    static void prvArenaInsertFreeBlock( ArenaBlock_t * pxBlock )
+    {
+        ArenaBlock_t * pxIterator = &xArenaFreeList;
+
+        while( ( pxIterator->pxNext != NULL ) && ( pxIterator->pxNext < pxBlock ) )
+        {
+            pxIterator = pxIterator->pxNext;
+        }
+
+        if( ( pxIterator->pxNext != NULL ) &&
+            ( ( ( uint8_t * ) pxBlock + pxBlock->xSize ) == ( uint8_t * ) pxIterator->pxNext ) )
+        {
+            pxBlock->xSize += pxIterator->pxNext->xSize;
+            pxBlock->pxNext = pxIterator->pxNext->pxNext;
+        }
+        else
+        {
+            pxBlock->pxNext = pxIterator->pxNext;
+        }
+
+        if( ( pxIterator != &xArenaFreeList ) &&
+            ( ( ( uint8_t * ) pxIterator + pxIterator->xSize ) == ( uint8_t * ) pxBlock ) )
+        {
+            pxIterator->xSize += pxBlock->xSize;
+            pxIterator->pxNext = pxBlock->pxNext;
+        }
+        else
+        {
+            pxIterator->pxNext = pxBlock;
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Allocates from the arena, first fit.
+ *
+ * @param[in] xSize Size to allocate.
+ *
+ * @return The allocated memory, NULL if the arena has no block large enough.
+ */
+    static void * prvArenaMalloc( size_t xSize )
+    {
+        ArenaBlock_t * pxPrevious;
+        ArenaBlock_t * pxBlock;
+        ArenaBlock_t * pxRemainder;
+        void * pvReturn = NULL;
+
+        if( xSize <= ( MBEDTLS_FREERTOS_ARENA_SIZE - arenaHEADER_SIZE ) )
+        {
+            xSize = ( xSize + arenaHEADER_SIZE + ( arenaALIGNMENT - 1U ) ) & ~( arenaALIGNMENT - 1U );
+
+            vTaskSuspendAll();
+            {
+                if( xArenaInitialized == pdFALSE )
+                {
+                    pxBlock = ( ArenaBlock_t * ) xArena.ucBytes;
+                    pxBlock->pxNext = NULL;
+                    pxBlock->xSize = MBEDTLS_FREERTOS_ARENA_SIZE & ~( arenaALIGNMENT - 1U );
+                    xArenaFreeList.pxNext = pxBlock;
+                    xArenaInitialized = pdTRUE;
+                }
+
+                pxPrevious = &xArenaFreeList;
+                pxBlock = xArenaFreeList.pxNext;
+
+                while( ( pxBlock != NULL ) && ( pxBlock->xSize < xSize ) )
+                {
+                    pxPrevious = pxBlock;
+                    pxBlock = pxBlock->pxNext;
+                }
+
+                if( pxBlock != NULL )
+                {
+                    if( ( pxBlock->xSize - xSize ) >= arenaMIN_BLOCK_SIZE )
+                    {
+                        pxRemainder = ( ArenaBlock_t * ) ( ( uint8_t * ) pxBlock + xSize );
+                        pxRemainder->xSize = pxBlock->xSize - xSize;
+                        pxRemainder->pxNext = pxBlock->pxNext;
+                        pxBlock->xSize = xSize;
+                        pxPrevious->pxNext = pxRemainder;
+                    }
+                    else
+                    {
+                        pxPrevious->pxNext = pxBlock->pxNext;
+                    }
+
+                    pxBlock->pxNext = NULL;
+                    xArenaUsed += pxBlock->xSize;
+
+                    if( xArenaUsed > xArenaMaxUsed )
+                    {
+                        xArenaMaxUsed = xArenaUsed;
+                    }
+
+                    pvReturn = ( uint8_t * ) pxBlock + arenaHEADER_SIZE;
+                }
+            }
+            ( void ) xTaskResumeAll();
+        }
+
+        return pvReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns memory allocated by prvArenaMalloc() to the arena.
+ *
+ * @param[in] pv The memory.
+ */
+    static void prvArenaFree( void * pv )
+    {
+        ArenaBlock_t * pxBlock = ( ArenaBlock_t * ) ( ( uint8_t * ) pv - arenaHEADER_SIZE );
+
+        configASSERT( ( ( uint8_t * ) pxBlock >= xArena.ucBytes ) &&
+                      ( ( uint8_t * ) pxBlock < &( xArena.ucBytes[ MBEDTLS_FREERTOS_ARENA_SIZE ] ) ) );
+        configASSERT( pxBlock->pxNext == NULL );
+
+        vTaskSuspendAll();
+        {
+            xArenaUsed -= pxBlock->xSize;
+            prvArenaInsertFreeBlock( pxBlock );
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+#endif /* if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+#if ( slabPOOL_SIZE > 0 )
+
+/**
+ * @brief A size class, its free blocks are linked through their first word.
+ */
+    typedef struct SlabClass
+    {
+        uint8_t * pucStart; /**< @brief First block of the class in the pool. */
+        uint8_t * pucEnd;   /**< @brief End of the blocks of the class. */
+        void * pvFreeList;  /**< @brief First free block, NULL when the class is full. */
+    } SlabClass_t;
+
+/**
+ * @brief Blocks of all the classes, smallest first.
+ */
+    static union
+    {
+        uint64_t ullAlignment;
+        uint8_t ucBytes[ slabPOOL_SIZE ];
+    } xSlabPool;
+
+    static const uint16_t usSlabBlocks[ slabCLASS_COUNT ] =
+    {
+        MBEDTLS_FREERTOS_SLAB_BLOCKS_16,
+        MBEDTLS_FREERTOS_SLAB_BLOCKS_32,
+        MBEDTLS_FREERTOS_SLAB_BLOCKS_64,
+        MBEDTLS_FREERTOS_SLAB_BLOCKS_128,
+        MBEDTLS_FREERTOS_SLAB_BLOCKS_256,
+        MBEDTLS_FREERTOS_SLAB_BLOCKS_512
+    };
+
+    static SlabClass_t xSlabClasses[ slabCLASS_COUNT ];
+
+    static BaseType_t xSlabInitialized = pdFALSE;
+    static size_t xSlabUsed = 0;
+    static size_t xSlabMaxUsed = 0;
+    static uint32_t ulSlabFallbacks = 0;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Carves the pool into the blocks of each class. Called with the
+ * scheduler suspended.
+ */
+    static void prvSlabInit( void )
+    {
+        uint8_t * pucBlock = xSlabPool.ucBytes;
+        size_t xBlockSize = slabMIN_BLOCK_SIZE;
+        uint32_t ulClass;
+        uint32_t ulBlock;
+
+        for( ulClass = 0; ulClass < slabCLASS_COUNT; ulClass++ )
+        {
+            xSlabClasses[ ulClass ].pucStart = pucBlock;
+            xSlabClasses[ ulClass ].pvFreeList = NULL;
+
+            /* Push the last block first, so that they are handed out in address order. */
+            pucBlock += xBlockSize * usSlabBlocks[ ulClass ];
+            xSlabClasses[ ulClass ].pucEnd = pucBlock;
+
+            for( ulBlock = usSlabBlocks[ ulClass ]; ulBlock > 0U; ulBlock-- )
+            {
+                void ** ppvBlock = ( void ** ) ( xSlabClasses[ ulClass ].pucStart + ( ( ulBlock - 1U ) * xBlockSize ) );
+
+                *ppvBlock = xSlabClasses[ ulClass ].pvFreeList;
+                xSlabClasses[ ulClass ].pvFreeList = ppvBlock;
+            }
+
+            xBlockSize <<= 1;
+        }
+
+        xSlabInitialized = pdTRUE;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Allocates a block of the smallest class holding the size.
+ *
+ * @param[in] xSize Size to allocate, at most slabMAX_BLOCK_SIZE.
+ * @param[out] pxBlockSize Size of the block allocated.
+ *
+ * @return The block, NULL if its class is full.
+ */
+    static void * prvSlabMalloc( size_t xSize,
+                                 size_t * pxBlockSize )
+    {
+        uint32_t ulClass = 0;
+        size_t xBlockSize = slabMIN_BLOCK_SIZE;
+        void * pvReturn;
+
+        while( xBlockSize < xSize )
+        {
+            xBlockSize <<= 1;
+            ulClass++;
+        }
+
+        vTaskSuspendAll();
+        {
+            if( xSlabInitialized == pdFALSE )
+            {
+                prvSlabInit();
+            }
+
+            pvReturn = xSlabClasses[ ulClass ].pvFreeList;
+
+            if( pvReturn != NULL )
+            {
+                xSlabClasses[ ulClass ].pvFreeList = *( ( void ** ) pvReturn );
+                xSlabUsed += xBlockSize;
+
+                if( xSlabUsed > xSlabMaxUsed )
+                {
+                    xSlabMaxUsed = xSlabUsed;
+                }
+            }
+            else
+            {
+                ulSlabFallbacks++;
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        *pxBlockSize = xBlockSize;
+
+        return pvReturn;
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Returns a block to its class.
+ *
+ * @param[in] pv The memory, allocated by prvSlabMalloc() or not.
+ * @param[out] pxBlockSize Size of the block released.
+ *
+ * @return pdTRUE if the memory was a slab block, pdFALSE otherwise.
+ */
+    static BaseType_t prvSlabFree( void * pv,
+                                   size_t * pxBlockSize )
+    {
+        uint8_t * pucBlock = ( uint8_t * ) pv;
+        uint32_t ulClass = 0;
+        size_t xBlockSize = slabMIN_BLOCK_SIZE;
+        BaseType_t xReturn = pdFALSE;
+
+        if( ( pucBlock >= xSlabPool.ucBytes ) && ( pucBlock < &( xSlabPool.ucBytes[ slabPOOL_SIZE ] ) ) )
+        {
+            while( pucBlock >= xSlabClasses[ ulClass ].pucEnd )
+            {
+                xBlockSize <<= 1;
+                ulClass++;
+            }
+
+            configASSERT( ( ( size_t ) ( pucBlock - xSlabClasses[ ulClass ].pucStart ) % xBlockSize ) == 0U );
+
+            vTaskSuspendAll();
+            {
+                *( ( void ** ) pucBlock ) = xSlabClasses[ ulClass ].pvFreeList;
+                xSlabClasses[ ulClass ].pvFreeList = pucBlock;
+                xSlabUsed -= xBlockSize;
+            }
+            ( void ) xTaskResumeAll();
+
+            *pxBlockSize = xBlockSize;
+            xReturn = pdTRUE;
+        }
+
+        return xReturn;
+    }
+
+#endif /* if ( slabPOOL_SIZE > 0 ) */
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Allocates from the arena, or from the FreeRTOS heap without arena.
+ *
+ * @param[in] xSize Size to allocate.
+ * @param[out] pxBlockSize Memory taken by the allocation.
+ *
+ * @return The allocated memory, NULL if there is not enough memory left.
+ */
+static void * prvFallbackMalloc( size_t xSize,
+                                 size_t * pxBlockSize )
+{
+    void * pvReturn;
+
+    #if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 )
+        pvReturn = prvArenaMalloc( xSize );
+
+        if( pvReturn != NULL )
+        {
+            *pxBlockSize = ( ( ArenaBlock_t * ) ( ( uint8_t * ) pvReturn - arenaHEADER_SIZE ) )->xSize;
+        }
+    #elif ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+        pvReturn = pvPortMalloc( xSize + profileHEADER_SIZE );
+
+        if( pvReturn != NULL )
+        {
+            *( ( size_t * ) pvReturn ) = xSize + profileHEADER_SIZE;
+            *pxBlockSize = xSize + profileHEADER_SIZE;
+            pvReturn = ( uint8_t * ) pvReturn + profileHEADER_SIZE;
+        }
+    #else
+        pvReturn = pvPortMalloc( xSize );
+        *pxBlockSize = xSize;
+    #endif /* if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 ) */
+
+    return pvReturn;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Releases memory allocated by prvFallbackMalloc().
+ *
+ * @param[in] pv The memory.
+ *
+ * @return Memory released, only known with the arena or in profiling mode.
+ */
+static size_t prvFallbackFree( void * pv )
+{
+    size_t xBlockSize = 0;
+
+    #if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 )
+        xBlockSize = ( ( ArenaBlock_t * ) ( ( uint8_t * ) pv - arenaHEADER_SIZE ) )->xSize;
+        prvArenaFree( pv );
+    #elif ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+        pv = ( uint8_t * ) pv - profileHEADER_SIZE;
+        xBlockSize = *( ( size_t * ) pv );
+        vPortFree( pv );
+    #else
+        vPortFree( pv );
+    #endif
+
+    return xBlockSize;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+
+/**
+ * @brief Accounts an allocation in the profile.
+ *
+ * @param[in] xSize Size requested by mbed TLS.
+ * @param[in] xBlockSize Memory taken by the allocation.
+ * @param[in] xFromSlab pdTRUE if a slab block was allocated.
+ */
+    static void prvProfileAlloc( size_t xSize,
+                                 size_t xBlockSize,
+                                 BaseType_t xFromSlab )
+    {
+        uint32_t ulBucket = 0;
+
+        while( ( ulBucket < ( MBEDTLS_FREERTOS_PROFILE_BUCKETS - 1U ) ) &&
+               ( xSize > ( ( size_t ) slabMIN_BLOCK_SIZE << ulBucket ) ) )
+        {
+            ulBucket++;
+        }
+
+        vTaskSuspendAll();
+        {
+            xAllocProfile.ulSizeHistogram[ ulBucket ]++;
+            xAllocProfile.ulAllocations++;
+
+            if( xFromSlab == pdTRUE )
+            {
+                xAllocProfile.ulSlabAllocations++;
+            }
+
+            xAllocProfile.xLiveBytes += xBlockSize;
+
+            if( xAllocProfile.xLiveBytes > xAllocProfile.xPeakBytes )
+            {
+                xAllocProfile.xPeakBytes = xAllocProfile.xLiveBytes;
+            }
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Accounts a release in the profile.
+ *
+ * @param[in] xBlockSize Memory released.
+ */
+    static void prvProfileFree( size_t xBlockSize )
+    {
+        vTaskSuspendAll();
+        {
+            xAllocProfile.ulFrees++;
+            xAllocProfile.xLiveBytes -= xBlockSize;
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+#endif /* if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 ) */
 
 /*-----------------------------------------------------------*/
 
@@ -48,7 +613,9 @@ void * mbedtls_platform_calloc( size_t nmemb,
                                 size_t size )
 {
     size_t totalSize = nmemb * size;
+    size_t blockSize = 0;
     void * pBuffer = NULL;
+    BaseType_t fromSlab = pdFALSE;
 
     /* Check that neither nmemb nor size were 0. */
     if( totalSize > 0 )
@@ -56,13 +623,36 @@ void * mbedtls_platform_calloc( size_t nmemb,
         /* Overflow check. */
         if( ( totalSize / size ) == nmemb )
         {
-            pBuffer = pvPortMalloc( totalSize );
+            #if ( slabPOOL_SIZE > 0 )
+                if( totalSize <= slabMAX_BLOCK_SIZE )
+                {
+                    pBuffer = prvSlabMalloc( totalSize, &blockSize );
+                    fromSlab = ( pBuffer != NULL ) ? pdTRUE : pdFALSE;
+                }
+            #endif
+
+            if( pBuffer == NULL )
+            {
+                pBuffer = prvFallbackMalloc( totalSize, &blockSize );
+            }
 
             if( pBuffer != NULL )
             {
                 ( void ) memset( pBuffer, 0x00, totalSize );
+
+                #if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+                    prvProfileAlloc( totalSize, blockSize, fromSlab );
+                #else
+                    ( void ) blockSize;
+                    ( void ) fromSlab;
+                #endif
             }
         }
+
+        if( pBuffer == NULL )
+        {
+            ulFailedAllocations++;
+        }
     }
 
     return pBuffer;
@@ -77,11 +667,110 @@ void * mbedtls_platform_calloc( size_t nmemb,
  */
 void mbedtls_platform_free( void * ptr )
 {
-    vPortFree( ptr );
+    size_t blockSize = 0;
+
+    if( ptr != NULL )
+    {
+        #if ( slabPOOL_SIZE > 0 )
+            if( prvSlabFree( ptr, &blockSize ) == pdFALSE )
+        #endif
+        {
+            blockSize = prvFallbackFree( ptr );
+        }
+
+        #if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+            prvProfileFree( blockSize );
+        #else
+            ( void ) blockSize;
+        #endif
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_platform_get_heap_stats( MbedtlsHeapStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    memset( pxStats, 0, sizeof( MbedtlsHeapStats_t ) );
+
+    #if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 )
+    {
+        ArenaBlock_t * pxBlock;
+
+        pxStats->xArenaSize = MBEDTLS_FREERTOS_ARENA_SIZE;
+
+        vTaskSuspendAll();
+        {
+            pxStats->xUsedBytes = xArenaUsed;
+            pxStats->xMaxUsedBytes = xArenaMaxUsed;
+
+            if( xArenaInitialized == pdFALSE )
+            {
+                pxStats->xLargestFreeBlock = MBEDTLS_FREERTOS_ARENA_SIZE - arenaHEADER_SIZE;
+            }
+
+            for( pxBlock = xArenaFreeList.pxNext; pxBlock != NULL; pxBlock = pxBlock->pxNext )
+            {
+                if( ( pxBlock->xSize - arenaHEADER_SIZE ) > pxStats->xLargestFreeBlock )
+                {
+                    pxStats->xLargestFreeBlock = pxBlock->xSize - arenaHEADER_SIZE;
+                }
+            }
+        }
+        ( void ) xTaskResumeAll();
+    }
+    #endif /* if ( MBEDTLS_FREERTOS_ARENA_SIZE > 0 ) */
+
+    #if ( slabPOOL_SIZE > 0 )
+        pxStats->xSlabSize = slabPOOL_SIZE;
+
+        vTaskSuspendAll();
+        {
+            pxStats->xSlabUsedBytes = xSlabUsed;
+            pxStats->xSlabMaxUsedBytes = xSlabMaxUsed;
+            pxStats->ulSlabFallbacks = ulSlabFallbacks;
+        }
+        ( void ) xTaskResumeAll();
+    #endif
+
+    pxStats->ulFailedAllocations = ulFailedAllocations;
 }
 
 /*-----------------------------------------------------------*/
 
+#if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+
+    void mbedtls_platform_reset_alloc_profile( void )
+    {
+        vTaskSuspendAll();
+        {
+            size_t xLiveBytes = xAllocProfile.xLiveBytes;
+
+            memset( &xAllocProfile, 0, sizeof( MbedtlsAllocProfile_t ) );
+            xAllocProfile.xLiveBytes = xLiveBytes;
+            xAllocProfile.xPeakBytes = xLiveBytes;
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+/*-----------------------------------------------------------*/
+
+    void mbedtls_platform_get_alloc_profile( MbedtlsAllocProfile_t * pxProfile )
+    {
+        configASSERT( pxProfile != NULL );
+
+        vTaskSuspendAll();
+        {
+            *pxProfile = xAllocProfile;
+        }
+        ( void ) xTaskResumeAll();
+    }
+
+#endif /* if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 ) */
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Sends data over FreeRTOS+TCP sockets.
  *
@@ -132,6 +821,45 @@ int mbedtls_platform_recv( void * ctx,
 
 /*-----------------------------------------------------------*/
 
+/**
+ * @brief Receives data from FreeRTOS+TCP socket polled with a short or zero receive timeout.
+ *
+ * FreeRTOS_recv() returns 0 when the receive timeout expires without data, which
+ * mbed TLS would otherwise treat as the peer closing the connection. It is reported
+ * as MBEDTLS_ERR_SSL_WANT_READ instead. Only for an established connection, the
+ * handshake uses mbedtls_platform_recv() so that a silent peer makes it fail.
+ *
+ * @param[in] ctx The network context containing the socket handle.
+ * @param[out] buf Buffer to receive bytes into.
+ * @param[in] len Number of bytes to receive from the network.
+ *
+ * @return Number of bytes received if successful; MBEDTLS_ERR_SSL_WANT_READ if no
+ * data was available; Negative value on error.
+ */
+int mbedtls_platform_recv_poll( void * ctx,
+                                unsigned char * buf,
+                                size_t len )
+{
+    Socket_t socket;
+    BaseType_t recvStatus;
+
+    configASSERT( ctx != NULL );
+    configASSERT( buf != NULL );
+
+    socket = ( Socket_t ) ctx;
+
+    recvStatus = FreeRTOS_recv( socket, buf, len, 0 );
+
+    if( ( recvStatus == 0 ) || ( recvStatus == -pdFREERTOS_ERRNO_EWOULDBLOCK ) )
+    {
+        recvStatus = MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    return ( int ) recvStatus;
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Creates a mutex.
  *
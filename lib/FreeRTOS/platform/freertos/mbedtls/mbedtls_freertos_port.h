@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mbedtls_freertos_port.h
+ * @brief Memory statistics of the mbed TLS platform functions for FreeRTOS.
+ */
+
+#ifndef MBEDTLS_FREERTOS_PORT_H_
+#define MBEDTLS_FREERTOS_PORT_H_
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Set to 1 to profile the mbed TLS allocations, see
+ * mbedtls_platform_get_alloc_profile().
+ */
+#ifndef MBEDTLS_FREERTOS_ALLOC_PROFILE
+    #define MBEDTLS_FREERTOS_ALLOC_PROFILE    ( 0 )
+#endif
+
+/**
+ * @brief Buckets of the allocation size histogram. Bucket 0 counts the sizes up
+ * to 16 bytes, bucket n the sizes above 8 << n up to 16 << n, the last one all
+ * the larger sizes.
+ */
+#define MBEDTLS_FREERTOS_PROFILE_BUCKETS      ( 12U )
+
+/**
+ * @brief Memory used by mbed TLS.
+ */
+typedef struct MbedtlsHeapStats
+{
+    size_t xArenaSize;            /**< @brief Size of the mbed TLS arena, 0 if mbed TLS uses the FreeRTOS heap. */
+    size_t xUsedBytes;            /**< @brief Bytes of the arena in use, including the block headers. */
+    size_t xMaxUsedBytes;         /**< @brief High water mark of xUsedBytes since startup. */
+    size_t xLargestFreeBlock;     /**< @brief Largest allocation the arena can serve now. */
+    size_t xSlabSize;             /**< @brief Size of the slab blocks, 0 without slabs. */
+    size_t xSlabUsedBytes;        /**< @brief Bytes of the slab blocks in use. */
+    size_t xSlabMaxUsedBytes;     /**< @brief High water mark of xSlabUsedBytes since startup. */
+    uint32_t ulSlabFallbacks;     /**< @brief Allocations not served by the slabs as their class was full. */
+    uint32_t ulFailedAllocations; /**< @brief Allocations which returned NULL since startup. */
+} MbedtlsHeapStats_t;
+
+/**
+ * @brief Allocations of mbed TLS since the profile was reset.
+ */
+typedef struct MbedtlsAllocProfile
+{
+    uint32_t ulSizeHistogram[ MBEDTLS_FREERTOS_PROFILE_BUCKETS ]; /**< @brief Allocations per requested size. */
+    uint32_t ulAllocations;                                        /**< @brief Successful allocations. */
+    uint32_t ulSlabAllocations;                                    /**< @brief Allocations served by a slab block. */
+    uint32_t ulFrees;                                              /**< @brief Releases. */
+    size_t xLiveBytes;                                             /**< @brief Memory allocated now, including the headers and slab rounding. */
+    size_t xPeakBytes;                                             /**< @brief High water mark of xLiveBytes since the reset. */
+} MbedtlsAllocProfile_t;
+
+/**
+ * @brief Reports the memory used by mbed TLS.
+ *
+ * @param[out] pxStats The statistics, only ulFailedAllocations is set if mbed TLS
+ * uses the FreeRTOS heap.
+ */
+void mbedtls_platform_get_heap_stats( MbedtlsHeapStats_t * pxStats );
+
+#if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+
+/**
+ * @brief Clears the allocation profile, e.g. before a handshake. The peak
+ * restarts from the memory allocated now.
+ */
+    void mbedtls_platform_reset_alloc_profile( void );
+
+/**
+ * @brief Reports the allocations since mbedtls_platform_reset_alloc_profile().
+ *
+ * @param[out] pxProfile The profile.
+ */
+    void mbedtls_platform_get_alloc_profile( MbedtlsAllocProfile_t * pxProfile );
+
+#endif
+
+#endif /* ifndef MBEDTLS_FREERTOS_PORT_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NETWORK_INTERFACE_LPC54018_H_
+#define NETWORK_INTERFACE_LPC54018_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Counters of the ENET network interface.
+ */
+typedef struct NetworkInterfaceStats
+{
+    uint32_t ulRxFrames;            /**< Frames handed to the IP task. */
+    uint32_t ulRxBytes;             /**< Bytes handed to the IP task. */
+    uint32_t ulRxCopied;            /**< Frames copied out of the receive buffers. */
+    uint32_t ulRxDropped;           /**< Frames dropped for lack of network buffer or IP task event. */
+    uint32_t ulRxInterrupts;        /**< Receive interrupts. */
+    uint32_t ulRxChecksumErrors;    /**< Frames dropped for a bad IP, TCP, UDP or ICMP checksum. */
+    uint32_t ulRxSoftwareChecksums; /**< IPv4 frames the MAC did not check, checked in software. */
+    uint32_t ulRxPriorityFrames;    /**< Frames received on the priority ring. */
+    uint32_t ulTxFrames;            /**< Frames given to the DMA. */
+    uint32_t ulTxBytes;             /**< Bytes given to the DMA. */
+    uint32_t ulTxBusy;              /**< Waits for a free transmit descriptor. */
+    uint32_t ulTxDropped;           /**< Frames not sent. */
+    uint32_t ulTxPriorityFrames;    /**< Frames sent on the priority ring. */
+} NetworkInterfaceStats_t;
+
+/**
+ * @brief Get the counters of the network interface.
+ *
+ * @param[out] pxStats Where to copy the counters.
+ */
+void vNetworkInterfaceGetStats( NetworkInterfaceStats_t * pxStats );
+
+#endif /* NETWORK_INTERFACE_LPC54018_H_ */
@@ -0,0 +1,962 @@
+/*
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file NetworkInterface.c
+ * @brief FreeRTOS+TCP network interface of the LPC54018 ENET.
+ *
+ * With ipconfigZERO_COPY_RX_DRIVER, the receive descriptors are loaded with
+ * network buffers. A received frame is handed to the IP task in the buffer the
+ * DMA wrote it to, and a new network buffer takes its place in the descriptor.
+ * With ipconfigZERO_COPY_TX_DRIVER, the transmit descriptors point to the
+ * network buffers given by the IP task, which are released once the DMA is done
+ * with them. Otherwise, frames are copied between the driver buffers and the
+ * network buffers.
+ *
+ * The MAC checks the IPv4, TCP, UDP and ICMP checksums of received frames and
+ * inserts them in transmitted frames. Frames the MAC did not check, such as IP
+ * fragments, are checked in software before being handed to the IP task.
+ *
+ * The receive interrupt is coalesced over nwRX_INT_FRAMES frames and disabled
+ * while the EMAC task drains the receive ring, whose frames are handed to the
+ * IP task as one chain.
+ *
+ * Two rings are used. The frames of the nwPRIORITY_* traffic classes, such as
+ * the MQTT keepalives and PTP, are sent on the priority ring, which the DMA
+ * serves first. The MAC receives on the priority ring the frames of the
+ * nwPRIORITY_VLAN_PCP_MASK priorities and PTP over Ethernet, which the EMAC
+ * task receives without coalescing, one pass before each pass over the other
+ * ring.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/* FreeRTOS+TCP includes. */
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_IP_Private.h"
+#include "NetworkBufferManagement.h"
+#include "NetworkInterface.h"
+
+/* NXP includes. */
+#include "fsl_enet.h"
+#include "fsl_enet_mdio.h"
+#include "fsl_phy.h"
+#include "fsl_phylan8720a.h"
+
+#include "network_interface_lpc54018.h"
+
+/*-----------------------------------------------------------*/
+
+#define nwPHY_ADDRESS             ( 0x00U )
+
+#define nwRX_DESCRIPTORS          ( 4U )
+#define nwTX_DESCRIPTORS          ( 4U )
+
+/* Ring 0 carries the bulk traffic, the DMA channel 1 has precedence. */
+#define nwRINGS                   ( ENET_RING_NUM_MAX )
+#define nwPRIORITY_RING           ( 1U )
+
+/* Each receive buffer holds a whole frame, a frame spanning several
+ * descriptors could not be handed over without copy. */
+#define nwRX_BUFFER_SIZE          ( ( ENET_FRAME_MAX_FRAMELEN + ENET_BUFF_ALIGNMENT - 1U ) & ~( ENET_BUFF_ALIGNMENT - 1U ) )
+
+#define nwEMAC_TASK_STACK_SIZE    ( 512U )
+#define nwEMAC_TASK_PRIORITY      ( configMAX_PRIORITIES - 1 )
+
+/* Period of the PHY link check. */
+#define nwLINK_CHECK_PERIOD_MS    ( 1000U )
+
+/* Attempts, 1 ms apart, to find a free transmit descriptor. */
+#define nwTX_BUSY_RETRIES         ( 10U )
+
+/* Receive interrupt coalescing: the interrupt is raised every nwRX_INT_FRAMES
+ * descriptors, and nwRX_INT_TIMEOUT_US after the last frame of a burst. */
+#define nwRX_INT_FRAMES           ( 2U )
+#define nwRX_INT_TIMEOUT_US       ( 100U )
+
+/* Traffic classes of the priority ring: VLAN priorities 6 and 7, DSCP CS6,
+ * CS7 and EF, and the ports of MQTT over TLS and of PTP over UDP. */
+#ifndef nwPRIORITY_VLAN_PCP_MASK
+    #define nwPRIORITY_VLAN_PCP_MASK    ( ( 1U << 6 ) | ( 1U << 7 ) )
+#endif
+#ifndef nwPRIORITY_DSCP_MASK
+    #define nwPRIORITY_DSCP_MASK    { 0UL, ( 1UL << ( 46U - 32U ) ) | ( 1UL << ( 48U - 32U ) ) | ( 1UL << ( 56U - 32U ) ) }
+#endif
+#ifndef nwPRIORITY_PORTS
+    #define nwPRIORITY_PORTS    { 8883U, 319U, 320U }
+#endif
+
+/* Notifications of the EMAC task. */
+#define nwEVENT_RX                ( 1UL << 0 )
+#define nwEVENT_TX                ( 1UL << 1 )
+#define nwEVENT_RX_PRIORITY       ( 1UL << 2 )
+
+/* The DMA receives into the Ethernet buffer of the network buffers, 2 bytes past a word boundary with the
+ * default padding of 8 + ipconfigPACKET_FILLER_SIZE bytes, so that the IP header is 32-bit aligned. */
+#if ( ipconfigZERO_COPY_RX_DRIVER != 0 ) && ( ( ( ipBUFFER_PADDING + ipSIZE_OF_ETH_HEADER ) % 4U ) != 0 )
+    #error "The IP header of the network buffers must be 32-bit aligned, keep the default ipconfigBUFFER_PADDING."
+#endif
+
+/*-----------------------------------------------------------*/
+
+static mdio_handle_t xMdioHandle = { .ops = &lpc_enet_ops };
+static phy_handle_t xPhyHandle = { .phyAddr = nwPHY_ADDRESS, .mdioHandle = &xMdioHandle, .ops = &phylan8720a_ops };
+
+SDK_ALIGN( static enet_rx_bd_struct_t xRxDescriptors[ nwRINGS ][ nwRX_DESCRIPTORS ], ENET_BUFF_ALIGNMENT );
+SDK_ALIGN( static enet_tx_bd_struct_t xTxDescriptors[ nwRINGS ][ nwTX_DESCRIPTORS ], ENET_BUFF_ALIGNMENT );
+
+/**
+ * @brief Buffer of each receive descriptor, updated by the driver in zero copy mode.
+ */
+static uint32_t ulRxBuffers[ nwRINGS ][ nwRX_DESCRIPTORS ];
+
+#if ( ipconfigZERO_COPY_RX_DRIVER == 0 )
+    SDK_ALIGN( static uint8_t ucRxBufferData[ nwRINGS ][ nwRX_DESCRIPTORS ][ nwRX_BUFFER_SIZE ], ENET_BUFF_ALIGNMENT );
+#endif
+
+/**
+ * @brief Ports of the traffic sent on the priority ring.
+ */
+static const uint16_t usPriorityPorts[] = nwPRIORITY_PORTS;
+
+/**
+ * @brief Traffic classes sent on the priority ring.
+ */
+static const enet_traffic_class_config_t xTrafficClass =
+{
+    .vlanPrioMask = nwPRIORITY_VLAN_PCP_MASK,
+    .dscpMask     = nwPRIORITY_DSCP_MASK,
+    .ports        = usPriorityPorts,
+    .portNum      = ( uint8_t ) ( sizeof( usPriorityPorts ) / sizeof( usPriorityPorts[ 0 ] ) ),
+    .ptpEnable    = true
+};
+
+#if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+
+/**
+ * @brief Network buffer of each transmit descriptor, released when the frame is sent.
+ */
+    static void * pvTxFrameContexts[ nwRINGS ][ nwTX_DESCRIPTORS ];
+
+/**
+ * @brief Serializes the transmission and the reclaim of the transmit descriptors.
+ */
+    static SemaphoreHandle_t xTxMutex = NULL;
+#else
+
+/**
+ * @brief Frames are copied to the buffer of the next descriptor of their ring,
+ * the driver uses the descriptors in order.
+ */
+    static uint8_t ucTxBufferData[ nwRINGS ][ nwTX_DESCRIPTORS ][ ENET_FRAME_MAX_FRAMELEN ];
+    static uint32_t ulTxBufferIndex[ nwRINGS ];
+#endif
+
+/**
+ * @brief Frames received in a pass over the receive ring.
+ */
+typedef struct RxChain
+{
+    NetworkBufferDescriptor_t * pxHead;
+    NetworkBufferDescriptor_t * pxTail;
+} RxChain_t;
+
+static enet_handle_t xEnetHandle;
+static TaskHandle_t xEMACTaskHandle = NULL;
+static BaseType_t xLinkUp = pdFALSE;
+static NetworkInterfaceStats_t xStats;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief ENET interrupt callback, wakes up the EMAC task.
+ */
+static void prvEnetCallback( ENET_Type * pxBase,
+                             enet_handle_t * pxHandle,
+                             enet_event_t xEvent,
+                             uint8_t ucChannel,
+                             void * pvParam );
+
+/**
+ * @brief Appends a received frame to a chain, unless the frame is not for this host
+ * or has a checksum error.
+ *
+ * @param[in] pxChain The chain.
+ * @param[in] pxBufferDescriptor The network buffer of the frame.
+ * @param[in] ulLength The length of the frame.
+ * @param[in] xChecksum The checksum status reported by the MAC.
+ */
+static void prvChainFrame( RxChain_t * pxChain,
+                           NetworkBufferDescriptor_t * pxBufferDescriptor,
+                           uint32_t ulLength,
+                           enet_rx_checksum_status_t xChecksum );
+
+#if ( ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM != 0 )
+
+/**
+ * @brief Checks the checksums of a frame the MAC did not check, as the IP task
+ * relies on the driver to do so.
+ *
+ * @param[in] pxBufferDescriptor The network buffer of the frame.
+ *
+ * @return kENET_RxChecksumNone if the frame is not IPv4, kENET_RxChecksumOk or kENET_RxChecksumError otherwise.
+ */
+    static enet_rx_checksum_status_t prvCheckChecksums( const NetworkBufferDescriptor_t * pxBufferDescriptor );
+#endif
+
+/**
+ * @brief Hands the frames of a chain to the IP task in one event, and empties the chain.
+ *
+ * @param[in] pxChain The chain.
+ */
+static void prvPassChainToIPTask( RxChain_t * pxChain );
+
+/**
+ * @brief Receive frame callback of ENET_ReadFrames(), appends the frame to the chain
+ * given in pvUserData.
+ *
+ * @return The buffer given back to the descriptor, NULL to keep the one received into.
+ */
+static void * prvRxFrameCallback( ENET_Type * pxBase,
+                                  enet_handle_t * pxHandle,
+                                  uint8_t * pucBuffer,
+                                  uint32_t ulLength,
+                                  enet_rx_checksum_status_t xChecksum,
+                                  uint8_t ucChannel,
+                                  void * pvUserData );
+
+/**
+ * @brief Copies the next frame to a network buffer and appends it to a chain, for
+ * frames spanning several descriptors.
+ *
+ * @param[in] pxChain The chain.
+ * @param[in] ucRing The receive ring.
+ */
+static void prvReadFrameCopy( RxChain_t * pxChain,
+                              uint8_t ucRing );
+
+/**
+ * @brief Hands the frames of one pass over a receive ring to the IP task. The receive
+ * interrupt of the ring is disabled by the ENET callback until the ring is drained.
+ *
+ * @param[in] ucRing The receive ring.
+ *
+ * @return pdTRUE once the ring is drained and its interrupt enabled, pdFALSE otherwise.
+ */
+static BaseType_t prvReceiveFrames( uint8_t ucRing );
+
+/**
+ * @brief Releases the network buffers of the frames sent.
+ */
+#if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+    static void prvTxReclaimCallback( ENET_Type * pxBase,
+                                      enet_handle_t * pxHandle,
+                                      uint8_t ucChannel,
+                                      void * pvContext,
+                                      void * pvUserData );
+#endif
+
+/**
+ * @brief Receives the frames, reclaims the transmit descriptors and checks the link.
+ *
+ * @param[in] pvParameters Unused.
+ */
+static void prvEMACHandlerTask( void * pvParameters );
+
+/**
+ * @brief Initializes the PHY, the MAC and the descriptor rings.
+ *
+ * @return pdPASS on success, pdFAIL otherwise.
+ */
+static BaseType_t prvInitialiseHardware( void );
+
+/**
+ * @brief Applies the speed and duplex negotiated by the PHY to the MAC.
+ *
+ * @return pdTRUE if the link is up, pdFALSE otherwise.
+ */
+static BaseType_t prvUpdateLink( void );
+
+/*-----------------------------------------------------------*/
+
+static void prvEnetCallback( ENET_Type * pxBase,
+                             enet_handle_t * pxHandle,
+                             enet_event_t xEvent,
+                             uint8_t ucChannel,
+                             void * pvParam )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    ( void ) pxHandle;
+    ( void ) pvParam;
+
+    if( xEvent == kENET_RxIntEvent )
+    {
+        /* The EMAC task drains the ring before enabling the interrupt again. */
+        ENET_DisableRxInterrupt( pxBase, ucChannel );
+        xStats.ulRxInterrupts++;
+        xTaskNotifyFromISR( xEMACTaskHandle, ( ucChannel == nwPRIORITY_RING ) ? nwEVENT_RX_PRIORITY : nwEVENT_RX,
+                            eSetBits, &xHigherPriorityTaskWoken );
+    }
+    else if( xEvent == kENET_TxIntEvent )
+    {
+        /* Reclaimed by the EMAC task in zero copy mode, the descriptors
+         * are already reclaimed by the interrupt otherwise. */
+        xTaskNotifyFromISR( xEMACTaskHandle, nwEVENT_TX, eSetBits, &xHigherPriorityTaskWoken );
+    }
+    else
+    {
+        /* Empty else for MISRA 15.7 compliance. */
+    }
+
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+    static void prvTxReclaimCallback( ENET_Type * pxBase,
+                                      enet_handle_t * pxHandle,
+                                      uint8_t ucChannel,
+                                      void * pvContext,
+                                      void * pvUserData )
+    {
+        ( void ) pxBase;
+        ( void ) pxHandle;
+        ( void ) ucChannel;
+        ( void ) pvUserData;
+
+        vReleaseNetworkBufferAndDescriptor( ( NetworkBufferDescriptor_t * ) pvContext );
+    }
+#endif
+
+/*-----------------------------------------------------------*/
+
+#if ( ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM != 0 )
+    static enet_rx_checksum_status_t prvCheckChecksums( const NetworkBufferDescriptor_t * pxBufferDescriptor )
+    {
+        const IPPacket_t * pxIPPacket = ( const IPPacket_t * ) pxBufferDescriptor->pucEthernetBuffer;
+        size_t uxHeaderLength;
+        uint16_t usResult;
+
+        if( ( pxBufferDescriptor->xDataLength < ipSIZE_OF_ETH_HEADER ) ||
+            ( pxIPPacket->xEthernetHeader.usFrameType != ipIPv4_FRAME_TYPE ) )
+        {
+            return kENET_RxChecksumNone;
+        }
+
+        xStats.ulRxSoftwareChecksums++;
+
+        if( pxBufferDescriptor->xDataLength < ( ipSIZE_OF_ETH_HEADER + ipSIZE_OF_IPv4_HEADER ) )
+        {
+            return kENET_RxChecksumError;
+        }
+
+        uxHeaderLength = ( size_t ) ( ( pxIPPacket->xIPHeader.ucVersionHeaderLength & 0x0FU ) << 2 );
+
+        if( ( uxHeaderLength < ipSIZE_OF_IPv4_HEADER ) ||
+            ( ( ipSIZE_OF_ETH_HEADER + uxHeaderLength ) > pxBufferDescriptor->xDataLength ) ||
+            ( usGenerateChecksum( 0U, ( const uint8_t * ) &( pxIPPacket->xIPHeader ), uxHeaderLength ) != ipCORRECT_CRC ) )
+        {
+            return kENET_RxChecksumError;
+        }
+
+        usResult = usGenerateProtocolChecksum( pxBufferDescriptor->pucEthernetBuffer,
+                                               pxBufferDescriptor->xDataLength,
+                                               pdFALSE );
+
+        return ( ( usResult == ipCORRECT_CRC ) || ( usResult == ipUNHANDLED_PROTOCOL ) ) ? kENET_RxChecksumOk : kENET_RxChecksumError;
+    }
+#endif /* if ( ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM != 0 ) */
+
+/*-----------------------------------------------------------*/
+
+static void prvChainFrame( RxChain_t * pxChain,
+                           NetworkBufferDescriptor_t * pxBufferDescriptor,
+                           uint32_t ulLength,
+                           enet_rx_checksum_status_t xChecksum )
+{
+    pxBufferDescriptor->xDataLength = ulLength;
+    pxBufferDescriptor->pxNextBuffer = NULL;
+    xStats.ulRxFrames++;
+    xStats.ulRxBytes += ulLength;
+
+    #if ( ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM != 0 )
+        if( xChecksum == kENET_RxChecksumNone )
+        {
+            /* Not checked by the MAC, e.g. IP fragments or frames read by copy. */
+            xChecksum = prvCheckChecksums( pxBufferDescriptor );
+        }
+    #endif
+
+    if( xChecksum == kENET_RxChecksumError )
+    {
+        xStats.ulRxChecksumErrors++;
+        vReleaseNetworkBufferAndDescriptor( pxBufferDescriptor );
+    }
+    else if( eConsiderFrameForProcessing( pxBufferDescriptor->pucEthernetBuffer ) != eProcessBuffer )
+    {
+        vReleaseNetworkBufferAndDescriptor( pxBufferDescriptor );
+    }
+    else
+    {
+        if( pxChain->pxHead == NULL )
+        {
+            pxChain->pxHead = pxBufferDescriptor;
+        }
+        else
+        {
+            pxChain->pxTail->pxNextBuffer = pxBufferDescriptor;
+        }
+
+        pxChain->pxTail = pxBufferDescriptor;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPassChainToIPTask( RxChain_t * pxChain )
+{
+    NetworkBufferDescriptor_t * pxBufferDescriptor;
+    NetworkBufferDescriptor_t * pxNext;
+    IPStackEvent_t xRxEvent;
+
+    if( pxChain->pxHead != NULL )
+    {
+        xRxEvent.eEventType = eNetworkRxEvent;
+        xRxEvent.pvData = ( void * ) pxChain->pxHead;
+
+        if( xSendEventStructToIPTask( &xRxEvent, 0 ) == pdFALSE )
+        {
+            for( pxBufferDescriptor = pxChain->pxHead; pxBufferDescriptor != NULL; pxBufferDescriptor = pxNext )
+            {
+                pxNext = pxBufferDescriptor->pxNextBuffer;
+                vReleaseNetworkBufferAndDescriptor( pxBufferDescriptor );
+                xStats.ulRxDropped++;
+                iptraceETHERNET_RX_EVENT_LOST();
+            }
+        }
+        else
+        {
+            iptraceNETWORK_INTERFACE_RECEIVE();
+        }
+
+        pxChain->pxHead = NULL;
+        pxChain->pxTail = NULL;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void * prvRxFrameCallback( ENET_Type * pxBase,
+                                  enet_handle_t * pxHandle,
+                                  uint8_t * pucBuffer,
+                                  uint32_t ulLength,
+                                  enet_rx_checksum_status_t xChecksum,
+                                  uint8_t ucChannel,
+                                  void * pvUserData )
+{
+    NetworkBufferDescriptor_t * pxBufferDescriptor;
+    void * pvNewBuffer = NULL;
+
+    #if ( ipconfigZERO_COPY_RX_DRIVER != 0 )
+        NetworkBufferDescriptor_t * pxNewBuffer;
+    #endif
+
+    ( void ) pxBase;
+    ( void ) pxHandle;
+
+    if( ucChannel == nwPRIORITY_RING )
+    {
+        xStats.ulRxPriorityFrames++;
+    }
+
+    #if ( ipconfigZERO_COPY_RX_DRIVER != 0 )
+    {
+        /* Hand over the buffer of the descriptor, a new one takes its place. */
+        pxNewBuffer = pxGetNetworkBufferWithDescriptor( nwRX_BUFFER_SIZE, 0 );
+        pxBufferDescriptor = NULL;
+
+        if( pxNewBuffer != NULL )
+        {
+            pxBufferDescriptor = pxPacketBuffer_to_NetworkBuffer( pucBuffer );
+            configASSERT( pxBufferDescriptor != NULL );
+            pvNewBuffer = pxNewBuffer->pucEthernetBuffer;
+        }
+    }
+    #else
+    {
+        pxBufferDescriptor = pxGetNetworkBufferWithDescriptor( ulLength, 0 );
+
+        if( pxBufferDescriptor != NULL )
+        {
+            memcpy( pxBufferDescriptor->pucEthernetBuffer, pucBuffer, ulLength );
+            xStats.ulRxCopied++;
+        }
+    }
+    #endif /* if ( ipconfigZERO_COPY_RX_DRIVER != 0 ) */
+
+    if( pxBufferDescriptor == NULL )
+    {
+        /* No network buffer, the descriptor keeps its buffer and the frame is dropped. */
+        xStats.ulRxDropped++;
+        iptraceETHERNET_RX_EVENT_LOST();
+    }
+    else
+    {
+        prvChainFrame( ( RxChain_t * ) pvUserData, pxBufferDescriptor, ulLength, xChecksum );
+    }
+
+    return pvNewBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReadFrameCopy( RxChain_t * pxChain,
+                              uint8_t ucRing )
+{
+    NetworkBufferDescriptor_t * pxBufferDescriptor = NULL;
+    uint32_t ulLength;
+    status_t xStatus;
+
+    xStatus = ENET_GetRxFrameSize( ENET, &xEnetHandle, &ulLength, ucRing );
+
+    if( xStatus != kStatus_ENET_RxFrameEmpty )
+    {
+        if( xStatus == kStatus_Success )
+        {
+            pxBufferDescriptor = pxGetNetworkBufferWithDescriptor( ulLength, 0 );
+        }
+
+        if( pxBufferDescriptor == NULL )
+        {
+            /* Error frame or no network buffer, give the descriptors back to the DMA. */
+            ( void ) ENET_ReadFrame( ENET, &xEnetHandle, NULL, 0, ucRing );
+            xStats.ulRxDropped++;
+        }
+        else if( ENET_ReadFrame( ENET, &xEnetHandle, pxBufferDescriptor->pucEthernetBuffer, ulLength, ucRing ) == kStatus_Success )
+        {
+            xStats.ulRxCopied++;
+            prvChainFrame( pxChain, pxBufferDescriptor, ulLength, kENET_RxChecksumNone );
+        }
+        else
+        {
+            vReleaseNetworkBufferAndDescriptor( pxBufferDescriptor );
+            xStats.ulRxDropped++;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvReceiveFrames( uint8_t ucRing )
+{
+    RxChain_t xChain = { NULL, NULL };
+    uint32_t ulFrames;
+    uint32_t ulLength;
+    status_t xStatus;
+    BaseType_t xDrained = pdFALSE;
+
+    /* One pass over the ring, the frames are handed to the IP task in one event. */
+    ulFrames = nwRX_DESCRIPTORS;
+    xStatus = ENET_ReadFrames( ENET, &xEnetHandle, prvRxFrameCallback, &xChain, &ulFrames, ucRing );
+
+    if( xStatus == kStatus_InvalidArgument )
+    {
+        /* The next frame spans several descriptors. */
+        prvReadFrameCopy( &xChain, ucRing );
+    }
+
+    prvPassChainToIPTask( &xChain );
+
+    if( xStatus == kStatus_ENET_RxFrameEmpty )
+    {
+        /* Wait for the next receive interrupt once the ring is drained, unless
+         * a frame came in before the interrupt was enabled. */
+        ENET_EnableRxInterrupt( ENET, ucRing );
+
+        if( ENET_GetRxFrameSize( ENET, &xEnetHandle, &ulLength, ucRing ) == kStatus_ENET_RxFrameEmpty )
+        {
+            xDrained = pdTRUE;
+        }
+        else
+        {
+            ENET_DisableRxInterrupt( ENET, ucRing );
+        }
+    }
+
+    return xDrained;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvEMACHandlerTask( void * pvParameters )
+{
+    uint32_t ulEvents = 0;
+    uint32_t ulNotified;
+    TickType_t xLastLinkCheck = xTaskGetTickCount();
+
+    #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+        uint8_t ucRing;
+    #endif
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        /* Do not block while a receive ring is not drained. */
+        ulNotified = 0;
+        ( void ) xTaskNotifyWait( 0, UINT32_MAX, &ulNotified,
+                                  ( ulEvents != 0U ) ? 0 : pdMS_TO_TICKS( nwLINK_CHECK_PERIOD_MS ) );
+        ulEvents |= ulNotified;
+
+        #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+            if( ( ulEvents & nwEVENT_TX ) != 0U )
+            {
+                ( void ) xSemaphoreTake( xTxMutex, portMAX_DELAY );
+
+                for( ucRing = 0; ucRing < nwRINGS; ucRing++ )
+                {
+                    ENET_ReclaimTxDescriptor( ENET, &xEnetHandle, ucRing );
+                }
+
+                ( void ) xSemaphoreGive( xTxMutex );
+            }
+        #endif
+        ulEvents &= ~nwEVENT_TX;
+
+        /* One pass over the priority ring before each pass over the bulk ring. A flood
+         * of priority frames does not keep the task from the bulk ring and the link check. */
+        if( ( ( ulEvents & nwEVENT_RX_PRIORITY ) != 0U ) && ( prvReceiveFrames( nwPRIORITY_RING ) == pdTRUE ) )
+        {
+            ulEvents &= ~nwEVENT_RX_PRIORITY;
+        }
+
+        if( ( ( ulEvents & nwEVENT_RX ) != 0U ) && ( prvReceiveFrames( 0 ) == pdTRUE ) )
+        {
+            ulEvents &= ~nwEVENT_RX;
+        }
+
+        if( ( xTaskGetTickCount() - xLastLinkCheck ) >= pdMS_TO_TICKS( nwLINK_CHECK_PERIOD_MS ) )
+        {
+            xLastLinkCheck = xTaskGetTickCount();
+
+            if( ( xLinkUp == pdTRUE ) && ( prvUpdateLink() == pdFALSE ) )
+            {
+                /* The IP task calls xNetworkInterfaceInitialise() until the link is back. */
+                FreeRTOS_NetworkDown();
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvUpdateLink( void )
+{
+    bool bLink = false;
+    phy_speed_t xSpeed;
+    phy_duplex_t xDuplex;
+
+    if( ( PHY_GetLinkStatus( &xPhyHandle, &bLink ) == kStatus_Success ) && bLink &&
+        ( PHY_GetLinkSpeedDuplex( &xPhyHandle, &xSpeed, &xDuplex ) == kStatus_Success ) )
+    {
+        if( xLinkUp == pdFALSE )
+        {
+            ENET_SetMII( ENET, ( enet_mii_speed_t ) xSpeed, ( enet_mii_duplex_t ) xDuplex );
+        }
+
+        xLinkUp = pdTRUE;
+    }
+    else
+    {
+        xLinkUp = pdFALSE;
+    }
+
+    return xLinkUp;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvInitialiseHardware( void )
+{
+    enet_config_t xConfig;
+    enet_multiqueue_config_t xMultiQueueConfig = { 0 };
+    enet_buffer_config_t xBufferConfig[ nwRINGS ] = { 0 };
+    phy_config_t xPhyConfig = { 0 };
+    uint32_t ulClockHz = CLOCK_GetFreq( kCLOCK_CoreSysClk );
+    uint32_t ulRing;
+    uint32_t i;
+
+    #if ( ipconfigZERO_COPY_RX_DRIVER != 0 )
+        NetworkBufferDescriptor_t * pxBuffer;
+    #endif
+
+    xMdioHandle.resource.base = ENET;
+    xMdioHandle.resource.csrClock_Hz = ulClockHz;
+
+    xPhyConfig.phyAddr = nwPHY_ADDRESS;
+    xPhyConfig.autoNeg = true;
+
+    if( PHY_Init( &xPhyHandle, &xPhyConfig ) != kStatus_Success )
+    {
+        return pdFAIL;
+    }
+
+    for( ulRing = 0; ulRing < nwRINGS; ulRing++ )
+    {
+        for( i = 0; i < nwRX_DESCRIPTORS; i++ )
+        {
+            #if ( ipconfigZERO_COPY_RX_DRIVER != 0 )
+                /* The descriptors own these network buffers until a frame is received in them. */
+                pxBuffer = pxGetNetworkBufferWithDescriptor( nwRX_BUFFER_SIZE, 0 );
+
+                if( pxBuffer == NULL )
+                {
+                    return pdFAIL;
+                }
+
+                ulRxBuffers[ ulRing ][ i ] = ( uint32_t ) pxBuffer->pucEthernetBuffer;
+            #else
+                ulRxBuffers[ ulRing ][ i ] = ( uint32_t ) ucRxBufferData[ ulRing ][ i ];
+            #endif
+        }
+
+        xBufferConfig[ ulRing ].rxRingLen = nwRX_DESCRIPTORS;
+        xBufferConfig[ ulRing ].txRingLen = nwTX_DESCRIPTORS;
+        xBufferConfig[ ulRing ].txDescStartAddrAlign = &xTxDescriptors[ ulRing ][ 0 ];
+        xBufferConfig[ ulRing ].txDescTailAddrAlign = &xTxDescriptors[ ulRing ][ 0 ];
+        xBufferConfig[ ulRing ].rxDescStartAddrAlign = &xRxDescriptors[ ulRing ][ 0 ];
+        xBufferConfig[ ulRing ].rxDescTailAddrAlign = &xRxDescriptors[ ulRing ][ nwRX_DESCRIPTORS ];
+        xBufferConfig[ ulRing ].rxBufferStartAddr = ulRxBuffers[ ulRing ];
+        xBufferConfig[ ulRing ].rxBuffSizeAlign = nwRX_BUFFER_SIZE;
+
+        #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+            xBufferConfig[ ulRing ].txFrameContextAddr = pvTxFrameContexts[ ulRing ];
+        #endif
+    }
+
+    #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+        xTxMutex = xSemaphoreCreateMutex();
+
+        if( xTxMutex == NULL )
+        {
+            return pdFAIL;
+        }
+    #endif
+
+    /* The DMA serves the transmit channel 1 first, and the MAC the queue 1,
+     * whose frames were classified by the driver with xTrafficClass. */
+    xMultiQueueConfig.dmaTxSche = kENET_FixPri;
+    xMultiQueueConfig.burstLen = kENET_BurstLen1;
+    xMultiQueueConfig.mtltxSche = kENET_txStrPrio;
+    xMultiQueueConfig.mtlrxSche = kENET_rxStrPrio;
+    xMultiQueueConfig.rxqueuePrio[ 0 ] = ( uint8_t ) ~nwPRIORITY_VLAN_PCP_MASK;
+    xMultiQueueConfig.rxqueuePrio[ nwPRIORITY_RING ] = nwPRIORITY_VLAN_PCP_MASK;
+    xMultiQueueConfig.mtlrxQuemap = kENET_StaticDirctMap;
+    xMultiQueueConfig.trafficClass = &xTrafficClass;
+
+    ENET_GetDefaultConfig( &xConfig );
+    xConfig.multiqueueCfg = &xMultiQueueConfig;
+
+    #if ( ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM != 0 )
+        xConfig.specialControl |= kENET_RxChecksumOffloadEnable;
+    #endif
+
+    #if ( ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM != 0 )
+        xConfig.specialControl |= kENET_TxChecksumOffloadEnable;
+    #endif
+    ENET_Init( ENET, &xConfig, ( uint8_t * ) ipLOCAL_MAC_ADDRESS, ulClockHz );
+
+    /* The MAC reset cleared the MDIO clock divider. */
+    MDIO_Init( &xMdioHandle );
+
+    ENET_EnableInterrupts( ENET, kENET_DmaRx | kENET_DmaTx );
+
+    if( ENET_DescriptorInit( ENET, &xConfig, xBufferConfig ) != kStatus_Success )
+    {
+        return pdFAIL;
+    }
+
+    ENET_CreateHandler( ENET, &xEnetHandle, &xConfig, xBufferConfig, prvEnetCallback, NULL );
+
+    /* Only the bulk ring is coalesced, the priority ring raises an interrupt per frame. */
+    ENET_SetRxInterruptCoalescing( ENET, &xEnetHandle, 0, nwRX_INT_FRAMES, nwRX_INT_TIMEOUT_US );
+
+    #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+        ENET_SetTxReclaimCallback( &xEnetHandle, prvTxReclaimCallback );
+    #endif
+
+    /* The EMAC task accesses the peripheral, it has to be privileged. */
+    if( xTaskCreate( prvEMACHandlerTask, "EMAC", nwEMAC_TASK_STACK_SIZE, NULL,
+                     nwEMAC_TASK_PRIORITY | portPRIVILEGE_BIT, &xEMACTaskHandle ) != pdPASS )
+    {
+        return pdFAIL;
+    }
+
+    ENET_StartRxTx( ENET, nwRINGS, nwRINGS );
+
+    return pdPASS;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xNetworkInterfaceInitialise( void )
+{
+    static BaseType_t xHardwareInitialised = pdFALSE;
+
+    if( xHardwareInitialised == pdFALSE )
+    {
+        xHardwareInitialised = prvInitialiseHardware();
+    }
+
+    /* Called again by the IP task until the link is up. */
+    return ( ( xHardwareInitialised == pdPASS ) && ( prvUpdateLink() == pdTRUE ) ) ? pdPASS : pdFAIL;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xNetworkInterfaceOutput( NetworkBufferDescriptor_t * const pxNetworkBuffer,
+                                    BaseType_t xReleaseAfterSend )
+{
+    status_t xStatus = kStatus_Fail;
+    uint32_t ulRetries;
+    uint8_t ucRing;
+
+    #if ( ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM != 0 )
+    {
+        const IPPacket_t * pxIPPacket = ( const IPPacket_t * ) pxNetworkBuffer->pucEthernetBuffer;
+
+        /* The MAC inserts the ICMP checksum only over a zeroed field, while the
+         * IP task updates the checksum of an echo reply in place. */
+        if( ( pxIPPacket->xEthernetHeader.usFrameType == ipIPv4_FRAME_TYPE ) &&
+            ( pxIPPacket->xIPHeader.ucProtocol == ipPROTOCOL_ICMP ) )
+        {
+            ( ( ICMPPacket_t * ) pxNetworkBuffer->pucEthernetBuffer )->xICMPHeader.usChecksum = 0U;
+        }
+    }
+    #endif /* if ( ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM != 0 ) */
+
+    /* The same ring as the one ENET_SendFrame() picks. */
+    ucRing = ENET_GetTxRingId( pxNetworkBuffer->pucEthernetBuffer, &xEnetHandle );
+
+    if( xLinkUp == pdTRUE )
+    {
+        for( ulRetries = 0; ulRetries < nwTX_BUSY_RETRIES; ulRetries++ )
+        {
+            #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+            {
+                /* The stack always hands over the buffer with a zero copy driver. */
+                configASSERT( xReleaseAfterSend != pdFALSE );
+
+                ( void ) xSemaphoreTake( xTxMutex, portMAX_DELAY );
+                ENET_ReclaimTxDescriptor( ENET, &xEnetHandle, ucRing );
+                xStatus = ENET_SendFrameZeroCopy( ENET, &xEnetHandle, pxNetworkBuffer->pucEthernetBuffer,
+                                                  pxNetworkBuffer->xDataLength, pxNetworkBuffer );
+                ( void ) xSemaphoreGive( xTxMutex );
+            }
+            #else
+            {
+                /* The descriptors are reclaimed in the interrupt, so a free descriptor
+                 * means its buffer is no longer read by the DMA. */
+                if( xEnetHandle.txBdRing[ ucRing ].txDescUsed < nwTX_DESCRIPTORS )
+                {
+                    uint8_t * pucBuffer = ucTxBufferData[ ucRing ][ ulTxBufferIndex[ ucRing ] ];
+
+                    memcpy( pucBuffer, pxNetworkBuffer->pucEthernetBuffer, pxNetworkBuffer->xDataLength );
+                    xStatus = ENET_SendFrame( ENET, &xEnetHandle, pucBuffer, pxNetworkBuffer->xDataLength );
+
+                    if( xStatus == kStatus_Success )
+                    {
+                        ulTxBufferIndex[ ucRing ] = ( ulTxBufferIndex[ ucRing ] + 1U ) % nwTX_DESCRIPTORS;
+                    }
+                }
+                else
+                {
+                    xStatus = kStatus_ENET_TxFrameBusy;
+                }
+            }
+            #endif /* if ( ipconfigZERO_COPY_TX_DRIVER != 0 ) */
+
+            if( xStatus != kStatus_ENET_TxFrameBusy )
+            {
+                break;
+            }
+
+            xStats.ulTxBusy++;
+            vTaskDelay( pdMS_TO_TICKS( 1U ) );
+        }
+    }
+
+    if( xStatus == kStatus_Success )
+    {
+        xStats.ulTxFrames++;
+        xStats.ulTxBytes += pxNetworkBuffer->xDataLength;
+
+        if( ucRing == nwPRIORITY_RING )
+        {
+            xStats.ulTxPriorityFrames++;
+        }
+        iptraceNETWORK_INTERFACE_TRANSMIT();
+
+        #if ( ipconfigZERO_COPY_TX_DRIVER != 0 )
+            /* Released by prvTxReclaimCallback() once sent. */
+            xReleaseAfterSend = pdFALSE;
+        #endif
+    }
+    else
+    {
+        xStats.ulTxDropped++;
+    }
+
+    if( xReleaseAfterSend != pdFALSE )
+    {
+        vReleaseNetworkBufferAndDescriptor( pxNetworkBuffer );
+    }
+
+    return ( xStatus == kStatus_Success ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xGetPhyLinkStatus( void )
+{
+    return xLinkUp;
+}
+
+/*-----------------------------------------------------------*/
+
+void vNetworkInterfaceGetStats( NetworkInterfaceStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        *pxStats = xStats;
+    }
+    taskEXIT_CRITICAL();
+}
@@ -90,4 +90,17 @@ void Sockets_Disconnect( Socket_t tcpSocket );
  */
 void Sockets_SetReceiveTimeout( Socket_t tcpSocket, uint32_t timeoutMS );
 
+/**
+ * @brief Set a callback invoked from the IP task on every event of the socket,
+ * such as data received or the connection being closed.
+ *
+ * @note The callback runs in the context of the IP task and must not block.
+ * Requires ipconfigSOCKET_HAS_USER_WAKE_CALLBACK to be set to 1.
+ *
+ * @param[in] tcpSocket The socket descriptor.
+ * @param[in] wakeupCallback The callback, or NULL to remove it.
+ */
+void Sockets_SetWakeupCallback( Socket_t tcpSocket,
+                                SocketWakeupCallback_t wakeupCallback );
+
 #endif /* ifndef FREERTOS_SOCKETS_WRAPPER_H_ */
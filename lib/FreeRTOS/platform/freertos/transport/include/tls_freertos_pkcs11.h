@@ -82,7 +82,8 @@ typedef struct SSLContext
     mbedtls_ssl_context context;          /**< @brief SSL connection context */
     mbedtls_x509_crt_profile certProfile; /**< @brief Certificate security profile for this connection. */
     mbedtls_x509_crt rootCa;              /**< @brief Root CA certificate context. */
-    mbedtls_x509_crt clientCert;          /**< @brief Client certificate context. */
+    mbedtls_x509_crt clientCert;          /**< @brief Client certificate context, unless the credential cache is used. */
+    mbedtls_x509_crt * pClientCert;       /**< @brief Client certificate of the connection, clientCert or the cached one. */
     mbedtls_pk_context privKey;           /**< @brief Client private key context. */
     mbedtls_pk_info_t privKeyInfo;        /**< @brief Client private key info. */
 
@@ -91,6 +92,9 @@ typedef struct SSLContext
     CK_SESSION_HANDLE xP11Session;
     CK_OBJECT_HANDLE xP11PrivateKey;
     CK_KEY_TYPE xKeyType;
+    BaseType_t xCachedCredentials; /**< @brief pdTRUE if the connection holds a reference to the credential cache. */
+    BaseType_t xSessionOffered;    /**< @brief pdTRUE if a cached session was offered to the server. */
+    BaseType_t xSessionResumed;    /**< @brief pdTRUE if the server resumed the offered session. */
 } SSLContext_t;
 
 /**
@@ -166,6 +170,67 @@ TlsTransportStatus_t TLS_FreeRTOS_Connect( NetworkContext_t * pNetworkContext,
                                            uint32_t receiveTimeoutMs,
                                            uint32_t sendTimeoutMs );
 
+/**
+ * @brief Drops the cached client certificate and private key handle.
+ *
+ * The client certificate parsed and the private key found on the first
+ * connection are kept for the following ones, this has to be called when
+ * they are provisioned again. The first connection sets it as the callback
+ * of the PKCS #11 PAL, which calls it when they are saved. Connections using
+ * the old credentials keep them until they are disconnected.
+ */
+void TLS_FreeRTOS_InvalidateCredentials( void );
+
+/**
+ * @brief Drops the cached TLS session of a server, the next connection to it
+ * does a full handshake.
+ *
+ * The session of each successful connection is cached in RAM and offered to the
+ * server on the next connection to the same host name and port, which saves the
+ * key exchange and the certificate verification when the server resumes it.
+ *
+ * @param[in] pHostName The hostname of the server.
+ * @param[in] port The port of the server.
+ */
+void TLS_FreeRTOS_ForgetSession( const char * pHostName,
+                                 uint16_t port );
+
+/**
+ * @brief Drops all cached TLS sessions.
+ */
+void TLS_FreeRTOS_ForgetSessions( void );
+
+/**
+ * @brief Exports the cached TLS session of a server, to be kept across a reset.
+ *
+ * The exported session holds the master secret of the session and has to be
+ * stored like the private key.
+ *
+ * @param[in] pHostName The hostname of the server.
+ * @param[in] port The port of the server.
+ * @param[out] pBuffer Buffer receiving the session.
+ * @param[in] bufferSize Size of the buffer.
+ *
+ * @return Size of the exported session, 0 if there is no session or the buffer
+ * is too small.
+ */
+size_t TLS_FreeRTOS_ExportSession( const char * pHostName,
+                                   uint16_t port,
+                                   uint8_t * pBuffer,
+                                   size_t bufferSize );
+
+/**
+ * @brief Imports a TLS session exported by TLS_FreeRTOS_ExportSession() into
+ * the cache, it is offered on the next connection to the server.
+ *
+ * @param[in] pBuffer The exported session.
+ * @param[in] length Size of the exported session.
+ *
+ * @return pdTRUE if imported, pdFALSE if invalid or out of memory.
+ */
+BaseType_t TLS_FreeRTOS_ImportSession( const uint8_t * pBuffer,
+                                       size_t length );
+
 /**
  * @brief Gracefully disconnect an established TLS connection.
  *
@@ -209,6 +274,37 @@ int32_t TLS_FreeRTOS_send( const NetworkContext_t * pNetworkContext,
                            const void * pBuffer,
                            size_t bytesToSend );
 
+/**
+ * @brief Sets the receive timeout of an established TLS connection.
+ *
+ * From then on, a receive timing out without data is reported by
+ * TLS_FreeRTOS_recv() as 0 bytes received instead of an error, so that the
+ * connection can be polled. The handshake keeps failing on a receive timeout.
+ *
+ * @param[in] pNetworkContext The network context.
+ * @param[in] timeoutMS Receive timeout in milliseconds, 0 to not wait.
+ */
 void TLS_FreeRTOS_SetRecvTimeout( NetworkContext_t * pNetworkContext, uint32_t timeoutMS );
 
+/**
+ * @brief Sets a callback invoked from the IP task when there is activity on the
+ * underlying socket, such as data received or the connection being closed.
+ * Used to wake up a task instead of polling the connection.
+ *
+ * @param[in] pNetworkContext The network context.
+ * @param[in] wakeupCallback The callback, which must not block.
+ */
+void TLS_FreeRTOS_SetWakeupCallback( NetworkContext_t * pNetworkContext,
+                                     SocketWakeupCallback_t wakeupCallback );
+
+/**
+ * @brief Checks if a call to TLS_FreeRTOS_recv() can make progress without waiting.
+ *
+ * @param[in] pNetworkContext The network context.
+ *
+ * @return pdTRUE if there are decrypted bytes buffered by mbed TLS or unread bytes
+ * on the socket, pdFALSE otherwise.
+ */
+BaseType_t TLS_FreeRTOS_IsDataAvailable( NetworkContext_t * pNetworkContext );
+
 #endif /* ifndef TLS_FREERTOS_H_ */
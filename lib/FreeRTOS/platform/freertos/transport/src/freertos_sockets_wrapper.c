@@ -192,3 +192,16 @@ void Sockets_SetReceiveTimeout( Socket_t tcpSocket, uint32_t timeoutMS )
 }
 
 /*-----------------------------------------------------------*/
+
+void Sockets_SetWakeupCallback( Socket_t tcpSocket,
+                                SocketWakeupCallback_t wakeupCallback )
+{
+    /* The callback is passed by value, as expected by FREERTOS_SO_WAKEUP_CALLBACK. */
+    ( void ) FreeRTOS_setsockopt( tcpSocket,
+                                  0,
+                                  FREERTOS_SO_WAKEUP_CALLBACK,
+                                  ( void * ) wakeupCallback,
+                                  sizeof( void * ) );
+}
+
+/*-----------------------------------------------------------*/
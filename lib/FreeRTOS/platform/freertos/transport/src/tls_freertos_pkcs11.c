@@ -45,6 +45,8 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 
 /* FreeRTOS+TCP includes. */
 #include "FreeRTOS_IP.h"
@@ -58,12 +60,15 @@
 
 /* mbedTLS util includes. */
 #include "mbedtls_error.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/platform_util.h"
 
 /* PKCS #11 includes. */
 #include "core_pkcs11_config.h"
 #include "core_pkcs11.h"
 #include "pkcs11.h"
 #include "core_pki_utils.h"
+#include "iot_pkcs11_pal.h"
 
 /* NXP Console Logging. */
 #include "fsl_debug_console.h"
@@ -98,6 +103,120 @@ static const char * pNoLowLevelMbedTlsCodeStr = "<No-Low-Level-Error-Code>";
     ( mbedtls_strerror_lowlevel( mbedTlsCode ) != NULL ) ? \
     mbedtls_strerror_lowlevel( mbedTlsCode ) : pNoLowLevelMbedTlsCodeStr
 
+/**
+ * @brief Number of servers whose TLS session is kept for resumption.
+ */
+#ifndef tlsSESSION_CACHE_ENTRIES
+    #define tlsSESSION_CACHE_ENTRIES    ( 2 )
+#endif
+
+/**
+ * @brief Size of the longest host name of a cached session, including the
+ * terminating zero. Sessions with longer host names are not cached.
+ */
+#ifndef tlsSESSION_HOST_NAME_SIZE
+    #define tlsSESSION_HOST_NAME_SIZE    ( 96 )
+#endif
+
+/**
+ * @brief Time in seconds after which a cached session is no longer offered,
+ * unless the server gave the lifetime of its session ticket.
+ */
+#ifndef tlsSESSION_LIFETIME_S
+    #define tlsSESSION_LIFETIME_S    ( 3600U )
+#endif
+
+/**
+ * @brief Identifies a session exported by TLS_FreeRTOS_ExportSession(), changed
+ * with the layout of #SessionRecord_t.
+ */
+#define tlsSESSION_RECORD_MAGIC    ( 0x544C5331UL )
+
+/**
+ * @brief Upper bound of the lifetime of a session, in seconds. Servers do not
+ * issue tickets for longer, it also bounds the lifetime of imported sessions.
+ */
+#define tlsSESSION_LIFETIME_MAX_S    ( 604800U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief States of the credential cache.
+ */
+typedef enum CredentialCacheState
+{
+    credentialCacheEMPTY = 0, /**< @brief Nothing cached. */
+    credentialCacheBUSY,      /**< @brief A connection is loading or freeing the credentials. */
+    credentialCacheVALID,     /**< @brief Credentials can be used by new connections. */
+    credentialCacheSTALE      /**< @brief Invalidated, freed when the last connection using them ends. */
+} CredentialCacheState_t;
+
+/**
+ * @brief Client credentials shared by all connections, so that a reconnection
+ * neither reads and parses the client certificate nor searches the private key.
+ *
+ * The state and the user count are changed in critical sections, the
+ * certificate is parsed or freed outside of them by the connection which
+ * moved the cache to credentialCacheBUSY.
+ */
+typedef struct CredentialCache
+{
+    mbedtls_x509_crt clientCert;     /**< @brief Parsed client certificate. */
+    CK_OBJECT_HANDLE xP11PrivateKey; /**< @brief Handle of the device private key. */
+    CK_KEY_TYPE xKeyType;            /**< @brief Type of the device private key. */
+    UBaseType_t uxUsers;             /**< @brief Connections using clientCert. */
+    CredentialCacheState_t xState;   /**< @brief State of the cache. */
+} CredentialCache_t;
+
+/**
+ * @brief The credential cache, a zeroed certificate context is an initialized one.
+ */
+static CredentialCache_t xCredentialCache;
+
+/**
+ * @brief TLS session of a server, offered for resumption on the next connection
+ * to the same host name and port. Unused if the host name is empty.
+ */
+typedef struct SessionCacheEntry
+{
+    char cHostName[ tlsSESSION_HOST_NAME_SIZE ]; /**< @brief Host name of the server. */
+    uint16_t usPort;                             /**< @brief Port of the server. */
+    TickType_t xSavedTime;                       /**< @brief Tick count when the session was saved. */
+    TickType_t xLifetime;                        /**< @brief Lifetime of the session in ticks. */
+    mbedtls_ssl_session session;                 /**< @brief The session, without the peer certificate. */
+} SessionCacheEntry_t;
+
+/**
+ * @brief Layout of an exported session, followed by the host name and the
+ * session ticket. Only meant to be imported by the same firmware.
+ */
+typedef struct SessionRecord
+{
+    uint32_t ulMagic;
+    uint16_t usPort;
+    uint8_t ucHostNameLength;
+    uint8_t ucIdLength;
+    int32_t lCiphersuite;
+    uint32_t ulVerifyResult;
+    uint32_t ulLifetimeS;
+    uint16_t usTicketLength;
+    uint8_t ucMflCode;
+    uint8_t ucEncryptThenMac;
+    uint8_t ucId[ 32 ];
+    uint8_t ucMaster[ 48 ];
+} SessionRecord_t;
+
+/**
+ * @brief Sessions cached for resumption, guarded by xSessionCacheMutex.
+ */
+static SessionCacheEntry_t xSessionCache[ tlsSESSION_CACHE_ENTRIES ];
+
+/**
+ * @brief Mutex of the session cache, created on first use.
+ */
+static SemaphoreHandle_t xSessionCacheMutex = NULL;
+static StaticSemaphore_t xSessionCacheMutexBuffer;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -119,6 +238,7 @@ static void sslContextFree( SSLContext_t * pSslContext );
  *
  * @param[in] pNetworkContext Network context.
  * @param[in] pHostName Remote host name, used for server name indication.
+ * @param[in] port Remote port, identifies the cached session with the host name.
  * @param[in] pNetworkCredentials TLS setup parameters.
  *
  * @return #TLS_TRANSPORT_SUCCESS, #TLS_TRANSPORT_INSUFFICIENT_MEMORY, #TLS_TRANSPORT_INVALID_CREDENTIALS,
@@ -126,6 +246,7 @@ static void sslContextFree( SSLContext_t * pSslContext );
  */
 static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
                                       const char * pHostName,
+                                      uint16_t port,
                                       const NetworkCredentials_t * pNetworkCredentials );
 
 /**
@@ -176,6 +297,106 @@ static CK_RV readCertificateIntoContext( SSLContext_t * pSslContext,
  */
 static CK_RV initializeClientKeys( SSLContext_t * pxCtx );
 
+/**
+ * @brief Sets up the mbedTLS private key context of a connection, for the
+ * private key handle and type in the context.
+ *
+ * @param[in] pxCtx Caller context.
+ *
+ * @return Zero on success.
+ */
+static CK_RV initializePrivateKeyContext( SSLContext_t * pxCtx );
+
+/**
+ * @brief Sets up the client certificate and private key of a connection,
+ * from the credential cache if valid, otherwise from the PKCS #11 module.
+ * The first connection finding the cache empty fills it.
+ *
+ * @param[in] pxCtx Caller context.
+ *
+ * @return Zero on success.
+ */
+static CK_RV acquireClientCredentials( SSLContext_t * pxCtx );
+
+/**
+ * @brief Releases the reference of a connection to the credential cache.
+ *
+ * @param[in] pxCtx Caller context.
+ */
+static void releaseClientCredentials( SSLContext_t * pxCtx );
+
+/**
+ * @brief Takes the session cache mutex, created on first use.
+ */
+static void sessionCacheLock( void );
+
+/**
+ * @brief Gives the session cache mutex.
+ */
+static void sessionCacheUnlock( void );
+
+/**
+ * @brief Finds the cached session of a server, dropping it if expired. Called
+ * with the session cache locked.
+ *
+ * @param[in] pHostName Host name of the server.
+ * @param[in] port Port of the server.
+ *
+ * @return The cache entry, NULL if none.
+ */
+static SessionCacheEntry_t * sessionCacheFind( const char * pHostName,
+                                               uint16_t port );
+
+/**
+ * @brief Empties a session cache entry. Called with the session cache locked.
+ *
+ * @param[in] pxEntry The cache entry.
+ */
+static void sessionCacheClear( SessionCacheEntry_t * pxEntry );
+
+/**
+ * @brief Stores a session in the entry of the server, or in a free or the
+ * oldest entry. The entry takes over the allocations of the session.
+ *
+ * @param[in] pHostName Host name of the server.
+ * @param[in] port Port of the server.
+ * @param[in] pxSession The session.
+ * @param[in] xLifetime Lifetime of the session in ticks.
+ */
+static void sessionCacheStore( const char * pHostName,
+                               uint16_t port,
+                               mbedtls_ssl_session * pxSession,
+                               TickType_t xLifetime );
+
+/**
+ * @brief Offers the cached session of the server, if any, in the ClientHello.
+ *
+ * @param[in] pSslContext Caller TLS context.
+ * @param[in] pHostName Host name of the server.
+ * @param[in] port Port of the server.
+ */
+static void restoreSession( SSLContext_t * pSslContext,
+                            const char * pHostName,
+                            uint16_t port );
+
+/**
+ * @brief Caches the session of an established connection for the next one.
+ *
+ * @param[in] pSslContext Caller TLS context.
+ * @param[in] pHostName Host name of the server.
+ * @param[in] port Port of the server.
+ */
+static void saveSession( SSLContext_t * pSslContext,
+                         const char * pHostName,
+                         uint16_t port );
+
+/**
+ * @brief Frees the cached certificate, called by the connection which moved
+ * the cache from credentialCacheVALID or credentialCacheSTALE without users
+ * to credentialCacheBUSY.
+ */
+static void freeCachedCredentials( void );
+
 /**
  * @brief Sign a cryptographic hash with the private key.
  *
@@ -229,6 +450,10 @@ static void sslContextInit( SSLContext_t * pSslContext )
     mbedtls_x509_crt_init( &( pSslContext->rootCa ) );
     mbedtls_x509_crt_init( &( pSslContext->clientCert ) );
     mbedtls_ssl_init( &( pSslContext->context ) );
+    pSslContext->pClientCert = &( pSslContext->clientCert );
+    pSslContext->xCachedCredentials = pdFALSE;
+    pSslContext->xSessionOffered = pdFALSE;
+    pSslContext->xSessionResumed = pdFALSE;
 
     xInitializePkcs11Session( &( pSslContext->xP11Session ) );
     C_GetFunctionList( &( pSslContext->pxP11FunctionList ) );
@@ -243,6 +468,7 @@ static void sslContextFree( SSLContext_t * pSslContext )
     mbedtls_x509_crt_free( &( pSslContext->rootCa ) );
     mbedtls_x509_crt_free( &( pSslContext->clientCert ) );
     mbedtls_ssl_config_free( &( pSslContext->config ) );
+    releaseClientCredentials( pSslContext );
 
     pSslContext->pxP11FunctionList->C_CloseSession( pSslContext->xP11Session );
 }
@@ -251,6 +477,7 @@ static void sslContextFree( SSLContext_t * pSslContext )
 
 static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
                                       const char * pHostName,
+                                      uint16_t port,
                                       const NetworkCredentials_t * pNetworkCredentials )
 {
     TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
@@ -303,6 +530,12 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
         mbedtls_ssl_conf_cert_profile( &( pNetworkContext->sslContext.config ),
                                        &( pNetworkContext->sslContext.certProfile ) );
 
+        #if defined( MBEDTLS_SSL_SESSION_TICKETS )
+            /* Ask for a session ticket, resumed without server side state. */
+            mbedtls_ssl_conf_session_tickets( &( pNetworkContext->sslContext.config ),
+                                              MBEDTLS_SSL_SESSION_TICKETS_ENABLED );
+        #endif
+
         /* Parse the server root CA certificate into the SSL context. */
         mbedtlsError = mbedtls_x509_crt_parse( &( pNetworkContext->sslContext.rootCa ),
                                                pNetworkCredentials->pRootCa,
@@ -326,35 +559,18 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
 
     if( returnStatus == TLS_TRANSPORT_SUCCESS )
     {
-        /* Setup the client private key. */
-        xResult = initializeClientKeys( &( pNetworkContext->sslContext ) );
+        /* Setup the client private key and certificate. */
+        xResult = acquireClientCredentials( &( pNetworkContext->sslContext ) );
 
         if( xResult != CKR_OK )
         {
-            LogError( ( "Failed to setup key handling by PKCS #11." ) );
-
             returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
         }
         else
         {
-            /* Setup the client certificate. */
-            xResult = readCertificateIntoContext( &( pNetworkContext->sslContext ),
-                                                  pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
-                                                  CKO_CERTIFICATE,
-                                                  &( pNetworkContext->sslContext.clientCert ) );
-
-            if( xResult != CKR_OK )
-            {
-                LogError( ( "Failed to get certificate from PKCS #11 module." ) );
-
-                returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
-            }
-            else
-            {
-                ( void ) mbedtls_ssl_conf_own_cert( &( pNetworkContext->sslContext.config ),
-                                                    &( pNetworkContext->sslContext.clientCert ),
-                                                    &( pNetworkContext->sslContext.privKey ) );
-            }
+            ( void ) mbedtls_ssl_conf_own_cert( &( pNetworkContext->sslContext.config ),
+                                                pNetworkContext->sslContext.pClientCert,
+                                                &( pNetworkContext->sslContext.privKey ) );
         }
     }
 
@@ -425,6 +641,12 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
         }
     }
 
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        /* Offer the session of the previous connection to the server. */
+        restoreSession( &( pNetworkContext->sslContext ), pHostName, port );
+    }
+
     #ifdef MBEDTLS_DEBUG_C
 
         /* If mbedTLS is being compiled with debug support, assume that the
@@ -452,14 +674,34 @@ static TlsTransportStatus_t tlsSetup( NetworkContext_t * pNetworkContext,
         }
     }
 
+    if( returnStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        /* Cached sessions have no peer certificate, a resumed handshake does
+         * not receive one while a full handshake does. */
+        if( ( pNetworkContext->sslContext.xSessionOffered == pdTRUE ) &&
+            ( mbedtls_ssl_get_peer_cert( &( pNetworkContext->sslContext.context ) ) == NULL ) )
+        {
+            pNetworkContext->sslContext.xSessionResumed = pdTRUE;
+        }
+
+        saveSession( &( pNetworkContext->sslContext ), pHostName, port );
+    }
+
     if( returnStatus != TLS_TRANSPORT_SUCCESS )
     {
+        if( pNetworkContext->sslContext.xSessionOffered == pdTRUE )
+        {
+            /* Do not offer the session again, it may be the cause of the failure. */
+            TLS_FreeRTOS_ForgetSession( pHostName, port );
+        }
+
         sslContextFree( &( pNetworkContext->sslContext ) );
     }
     else
     {
-        LogInfo( ( "(Network connection %p) TLS handshake successful.",
-                   pNetworkContext ) );
+        LogInfo( ( "(Network connection %p) TLS handshake successful%s.",
+                   pNetworkContext,
+                   ( pNetworkContext->sslContext.xSessionResumed == pdTRUE ) ? ", session resumed" : "" ) );
     }
 
     return returnStatus;
@@ -589,7 +831,6 @@ static CK_RV initializeClientKeys( SSLContext_t * pxCtx )
     CK_SLOT_ID * pxSlotIds = NULL;
     CK_ULONG xCount = 0;
     CK_ATTRIBUTE xTemplate[ 2 ];
-    mbedtls_pk_type_t xKeyAlgo = ( mbedtls_pk_type_t ) ~0;
 
     /* Get the PKCS #11 module/token slot count. */
     if( CKR_OK == xResult )
@@ -654,6 +895,24 @@ static CK_RV initializeClientKeys( SSLContext_t * pxCtx )
                                                                  1 );
     }
 
+    if( xResult == CKR_OK )
+    {
+        xResult = initializePrivateKeyContext( pxCtx );
+    }
+
+    /* Free memory. */
+    vPortFree( pxSlotIds );
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static CK_RV initializePrivateKeyContext( SSLContext_t * pxCtx )
+{
+    CK_RV xResult = CKR_OK;
+    mbedtls_pk_type_t xKeyAlgo = ( mbedtls_pk_type_t ) ~0;
+
     /* Map the PKCS #11 key type to an mbedTLS algorithm. */
     if( xResult == CKR_OK )
     {
@@ -683,8 +942,607 @@ static CK_RV initializeClientKeys( SSLContext_t * pxCtx )
         pxCtx->privKey.pk_ctx = pxCtx;
     }
 
-    /* Free memory. */
-    vPortFree( pxSlotIds );
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static CK_RV acquireClientCredentials( SSLContext_t * pxCtx )
+{
+    CK_RV xResult = CKR_OK;
+    BaseType_t xLoadCache = pdFALSE;
+
+    taskENTER_CRITICAL();
+    {
+        if( xCredentialCache.xState == credentialCacheVALID )
+        {
+            xCredentialCache.uxUsers++;
+            pxCtx->xCachedCredentials = pdTRUE;
+            pxCtx->pClientCert = &( xCredentialCache.clientCert );
+            pxCtx->xP11PrivateKey = xCredentialCache.xP11PrivateKey;
+            pxCtx->xKeyType = xCredentialCache.xKeyType;
+        }
+        else if( xCredentialCache.xState == credentialCacheEMPTY )
+        {
+            /* Parse into the cache, other connections meanwhile parse their own copy. */
+            xCredentialCache.xState = credentialCacheBUSY;
+            pxCtx->pClientCert = &( xCredentialCache.clientCert );
+            xLoadCache = pdTRUE;
+        }
+        else
+        {
+            /* Empty else for MISRA 15.7 compliance. */
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xLoadCache == pdTRUE )
+    {
+        /* Before the cache is loaded, so credentials saved meanwhile mark it stale. */
+        PKCS11_PAL_SetCredentialsChangedCallback( TLS_FreeRTOS_InvalidateCredentials );
+    }
+
+    if( pxCtx->xCachedCredentials == pdTRUE )
+    {
+        /* Object handles of the module stay valid across sessions and the login
+         * is shared by all sessions, only the key context has to be set up. */
+        xResult = initializePrivateKeyContext( pxCtx );
+    }
+    else
+    {
+        xResult = initializeClientKeys( pxCtx );
+
+        if( xResult != CKR_OK )
+        {
+            LogError( ( "Failed to setup key handling by PKCS #11." ) );
+        }
+        else
+        {
+            xResult = readCertificateIntoContext( pxCtx,
+                                                  pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
+                                                  CKO_CERTIFICATE,
+                                                  pxCtx->pClientCert );
+
+            if( xResult != CKR_OK )
+            {
+                LogError( ( "Failed to get certificate from PKCS #11 module." ) );
+            }
+        }
+
+        if( xLoadCache == pdTRUE )
+        {
+            if( xResult != CKR_OK )
+            {
+                mbedtls_x509_crt_free( &( xCredentialCache.clientCert ) );
+                pxCtx->pClientCert = &( pxCtx->clientCert );
+            }
+
+            taskENTER_CRITICAL();
+            {
+                if( xResult != CKR_OK )
+                {
+                    xCredentialCache.xState = credentialCacheEMPTY;
+                }
+                else
+                {
+                    xCredentialCache.xP11PrivateKey = pxCtx->xP11PrivateKey;
+                    xCredentialCache.xKeyType = pxCtx->xKeyType;
+                    xCredentialCache.uxUsers++;
+                    pxCtx->xCachedCredentials = pdTRUE;
+
+                    /* If invalidated while loading, the credentials may be the old ones
+                     * and stay stale, used by this connection only. */
+                    if( xCredentialCache.xState == credentialCacheBUSY )
+                    {
+                        xCredentialCache.xState = credentialCacheVALID;
+                    }
+                }
+            }
+            taskEXIT_CRITICAL();
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void releaseClientCredentials( SSLContext_t * pxCtx )
+{
+    BaseType_t xFree = pdFALSE;
+
+    if( pxCtx->xCachedCredentials == pdTRUE )
+    {
+        taskENTER_CRITICAL();
+        {
+            xCredentialCache.uxUsers--;
+
+            if( ( xCredentialCache.uxUsers == 0U ) &&
+                ( xCredentialCache.xState == credentialCacheSTALE ) )
+            {
+                xCredentialCache.xState = credentialCacheBUSY;
+                xFree = pdTRUE;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        pxCtx->xCachedCredentials = pdFALSE;
+        pxCtx->pClientCert = &( pxCtx->clientCert );
+
+        if( xFree == pdTRUE )
+        {
+            freeCachedCredentials();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void freeCachedCredentials( void )
+{
+    mbedtls_x509_crt_free( &( xCredentialCache.clientCert ) );
+
+    taskENTER_CRITICAL();
+    {
+        xCredentialCache.xP11PrivateKey = CK_INVALID_HANDLE;
+        xCredentialCache.xState = credentialCacheEMPTY;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_InvalidateCredentials( void )
+{
+    BaseType_t xFree = pdFALSE;
+
+    /* Nothing is cached before the scheduler starts, when provisioned at startup. */
+    if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
+    {
+        return;
+    }
+
+    /* Sessions were established with the old client certificate. */
+    TLS_FreeRTOS_ForgetSessions();
+
+    taskENTER_CRITICAL();
+    {
+        if( xCredentialCache.xState == credentialCacheVALID )
+        {
+            if( xCredentialCache.uxUsers == 0U )
+            {
+                xCredentialCache.xState = credentialCacheBUSY;
+                xFree = pdTRUE;
+            }
+            else
+            {
+                xCredentialCache.xState = credentialCacheSTALE;
+            }
+        }
+        else if( xCredentialCache.xState == credentialCacheBUSY )
+        {
+            /* A connection is loading the cache, it must not become valid. If the
+             * cache is being freed instead, it ends up empty anyway. */
+            xCredentialCache.xState = credentialCacheSTALE;
+        }
+        else
+        {
+            /* Empty else for MISRA 15.7 compliance. */
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xFree == pdTRUE )
+    {
+        freeCachedCredentials();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void sessionCacheLock( void )
+{
+    if( xSessionCacheMutex == NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            if( xSessionCacheMutex == NULL )
+            {
+                xSessionCacheMutex = xSemaphoreCreateMutexStatic( &xSessionCacheMutexBuffer );
+            }
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    ( void ) xSemaphoreTake( xSessionCacheMutex, portMAX_DELAY );
+}
+
+/*-----------------------------------------------------------*/
+
+static void sessionCacheUnlock( void )
+{
+    ( void ) xSemaphoreGive( xSessionCacheMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+static SessionCacheEntry_t * sessionCacheFind( const char * pHostName,
+                                               uint16_t port )
+{
+    SessionCacheEntry_t * pxEntry = NULL;
+    size_t i;
+
+    for( i = 0; i < tlsSESSION_CACHE_ENTRIES; i++ )
+    {
+        if( ( xSessionCache[ i ].cHostName[ 0 ] != '\0' ) &&
+            ( xSessionCache[ i ].usPort == port ) &&
+            ( strcmp( xSessionCache[ i ].cHostName, pHostName ) == 0 ) )
+        {
+            pxEntry = &( xSessionCache[ i ] );
+            break;
+        }
+    }
+
+    if( ( pxEntry != NULL ) &&
+        ( ( xTaskGetTickCount() - pxEntry->xSavedTime ) >= pxEntry->xLifetime ) )
+    {
+        sessionCacheClear( pxEntry );
+        pxEntry = NULL;
+    }
+
+    return pxEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+static void sessionCacheClear( SessionCacheEntry_t * pxEntry )
+{
+    mbedtls_ssl_session_free( &( pxEntry->session ) );
+    pxEntry->cHostName[ 0 ] = '\0';
+}
+
+/*-----------------------------------------------------------*/
+
+static void sessionCacheStore( const char * pHostName,
+                               uint16_t port,
+                               mbedtls_ssl_session * pxSession,
+                               TickType_t xLifetime )
+{
+    SessionCacheEntry_t * pxEntry;
+    TickType_t xNow;
+    size_t i;
+
+    sessionCacheLock();
+
+    xNow = xTaskGetTickCount();
+    pxEntry = sessionCacheFind( pHostName, port );
+
+    /* Otherwise take a free entry, or the oldest one. */
+    for( i = 0; ( pxEntry == NULL ) && ( i < tlsSESSION_CACHE_ENTRIES ); i++ )
+    {
+        if( xSessionCache[ i ].cHostName[ 0 ] == '\0' )
+        {
+            pxEntry = &( xSessionCache[ i ] );
+        }
+    }
+
+    if( pxEntry == NULL )
+    {
+        pxEntry = &( xSessionCache[ 0 ] );
+
+        for( i = 1; i < tlsSESSION_CACHE_ENTRIES; i++ )
+        {
+            if( ( xNow - xSessionCache[ i ].xSavedTime ) > ( xNow - pxEntry->xSavedTime ) )
+            {
+                pxEntry = &( xSessionCache[ i ] );
+            }
+        }
+    }
+
+    if( pxEntry->cHostName[ 0 ] != '\0' )
+    {
+        sessionCacheClear( pxEntry );
+    }
+
+    ( void ) strcpy( pxEntry->cHostName, pHostName );
+    pxEntry->usPort = port;
+    pxEntry->xSavedTime = xNow;
+    pxEntry->xLifetime = xLifetime;
+    pxEntry->session = *pxSession;
+
+    sessionCacheUnlock();
+}
+
+/*-----------------------------------------------------------*/
+
+static void restoreSession( SSLContext_t * pSslContext,
+                            const char * pHostName,
+                            uint16_t port )
+{
+    SessionCacheEntry_t * pxEntry;
+    int32_t mbedtlsError = 0;
+
+    sessionCacheLock();
+
+    pxEntry = sessionCacheFind( pHostName, port );
+
+    if( pxEntry != NULL )
+    {
+        /* Copies the session, with its ticket if any. */
+        mbedtlsError = mbedtls_ssl_set_session( &( pSslContext->context ), &( pxEntry->session ) );
+
+        if( mbedtlsError != 0 )
+        {
+            LogWarn( ( "Failed to set the cached session, doing a full handshake: mbedTLSError= %s : %s.",
+                       mbedtlsHighLevelCodeOrDefault( mbedtlsError ),
+                       mbedtlsLowLevelCodeOrDefault( mbedtlsError ) ) );
+        }
+        else
+        {
+            pSslContext->xSessionOffered = pdTRUE;
+        }
+    }
+
+    sessionCacheUnlock();
+}
+
+/*-----------------------------------------------------------*/
+
+static void saveSession( SSLContext_t * pSslContext,
+                         const char * pHostName,
+                         uint16_t port )
+{
+    mbedtls_ssl_session xSession;
+    uint32_t ulLifetimeS = tlsSESSION_LIFETIME_S;
+    BaseType_t xResumable = pdFALSE;
+
+    if( strlen( pHostName ) < tlsSESSION_HOST_NAME_SIZE )
+    {
+        mbedtls_ssl_session_init( &xSession );
+
+        if( mbedtls_ssl_get_session( &( pSslContext->context ), &xSession ) == 0 )
+        {
+            #if defined( MBEDTLS_X509_CRT_PARSE_C )
+                /* Resumption does not need the server certificate, do not keep a copy. */
+                if( xSession.peer_cert != NULL )
+                {
+                    mbedtls_x509_crt_free( xSession.peer_cert );
+                    mbedtls_free( xSession.peer_cert );
+                    xSession.peer_cert = NULL;
+                }
+            #endif
+
+            xResumable = ( xSession.id_len != 0U ) ? pdTRUE : pdFALSE;
+
+            #if defined( MBEDTLS_SSL_SESSION_TICKETS )
+                if( xSession.ticket_len != 0U )
+                {
+                    xResumable = pdTRUE;
+
+                    if( xSession.ticket_lifetime != 0U )
+                    {
+                        ulLifetimeS = xSession.ticket_lifetime;
+                    }
+                }
+            #endif
+        }
+
+        if( ulLifetimeS > tlsSESSION_LIFETIME_MAX_S )
+        {
+            ulLifetimeS = tlsSESSION_LIFETIME_MAX_S;
+        }
+
+        if( xResumable == pdTRUE )
+        {
+            sessionCacheStore( pHostName, port, &xSession, ( TickType_t ) ulLifetimeS * configTICK_RATE_HZ );
+        }
+        else
+        {
+            mbedtls_ssl_session_free( &xSession );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_ForgetSession( const char * pHostName,
+                                 uint16_t port )
+{
+    SessionCacheEntry_t * pxEntry;
+
+    configASSERT( pHostName != NULL );
+
+    sessionCacheLock();
+
+    pxEntry = sessionCacheFind( pHostName, port );
+
+    if( pxEntry != NULL )
+    {
+        sessionCacheClear( pxEntry );
+    }
+
+    sessionCacheUnlock();
+}
+
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_ForgetSessions( void )
+{
+    size_t i;
+
+    sessionCacheLock();
+
+    for( i = 0; i < tlsSESSION_CACHE_ENTRIES; i++ )
+    {
+        if( xSessionCache[ i ].cHostName[ 0 ] != '\0' )
+        {
+            sessionCacheClear( &( xSessionCache[ i ] ) );
+        }
+    }
+
+    sessionCacheUnlock();
+}
+
+/*-----------------------------------------------------------*/
+
+size_t TLS_FreeRTOS_ExportSession( const char * pHostName,
+                                   uint16_t port,
+                                   uint8_t * pBuffer,
+                                   size_t bufferSize )
+{
+    SessionRecord_t xRecord;
+    SessionCacheEntry_t * pxEntry;
+    const unsigned char * pucTicket = NULL;
+    size_t xTicketLength = 0;
+    size_t xHostNameLength;
+    size_t xLength = 0;
+
+    configASSERT( pHostName != NULL );
+    configASSERT( pBuffer != NULL );
+
+    sessionCacheLock();
+
+    pxEntry = sessionCacheFind( pHostName, port );
+
+    if( pxEntry != NULL )
+    {
+        xHostNameLength = strlen( pxEntry->cHostName );
+
+        #if defined( MBEDTLS_SSL_SESSION_TICKETS )
+            pucTicket = pxEntry->session.ticket;
+            xTicketLength = pxEntry->session.ticket_len;
+        #endif
+
+        if( ( xTicketLength <= UINT16_MAX ) &&
+            ( ( sizeof( xRecord ) + xHostNameLength + xTicketLength ) <= bufferSize ) )
+        {
+            memset( &xRecord, 0, sizeof( xRecord ) );
+            xRecord.ulMagic = tlsSESSION_RECORD_MAGIC;
+            xRecord.usPort = port;
+            xRecord.ucHostNameLength = ( uint8_t ) xHostNameLength;
+            xRecord.ucIdLength = ( uint8_t ) pxEntry->session.id_len;
+            xRecord.lCiphersuite = pxEntry->session.ciphersuite;
+            xRecord.ulVerifyResult = pxEntry->session.verify_result;
+            xRecord.ulLifetimeS = ( pxEntry->xLifetime - ( xTaskGetTickCount() - pxEntry->xSavedTime ) ) / configTICK_RATE_HZ;
+            xRecord.usTicketLength = ( uint16_t ) xTicketLength;
+            #if defined( MBEDTLS_SSL_MAX_FRAGMENT_LENGTH )
+                xRecord.ucMflCode = pxEntry->session.mfl_code;
+            #endif
+            #if defined( MBEDTLS_SSL_ENCRYPT_THEN_MAC )
+                xRecord.ucEncryptThenMac = ( uint8_t ) pxEntry->session.encrypt_then_mac;
+            #endif
+            memcpy( xRecord.ucId, pxEntry->session.id, sizeof( xRecord.ucId ) );
+            memcpy( xRecord.ucMaster, pxEntry->session.master, sizeof( xRecord.ucMaster ) );
+
+            memcpy( pBuffer, &xRecord, sizeof( xRecord ) );
+            memcpy( &( pBuffer[ sizeof( xRecord ) ] ), pxEntry->cHostName, xHostNameLength );
+
+            if( xTicketLength != 0U )
+            {
+                memcpy( &( pBuffer[ sizeof( xRecord ) + xHostNameLength ] ), pucTicket, xTicketLength );
+            }
+
+            xLength = sizeof( xRecord ) + xHostNameLength + xTicketLength;
+
+            /* Holds the master secret. */
+            mbedtls_platform_zeroize( &xRecord, sizeof( xRecord ) );
+        }
+    }
+
+    sessionCacheUnlock();
+
+    return xLength;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t TLS_FreeRTOS_ImportSession( const uint8_t * pBuffer,
+                                       size_t length )
+{
+    SessionRecord_t xRecord;
+    mbedtls_ssl_session xSession;
+    char cHostName[ tlsSESSION_HOST_NAME_SIZE ];
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pBuffer != NULL ) && ( length >= sizeof( xRecord ) ) )
+    {
+        memcpy( &xRecord, pBuffer, sizeof( xRecord ) );
+
+        if( ( xRecord.ulMagic == tlsSESSION_RECORD_MAGIC ) &&
+            ( xRecord.ucHostNameLength != 0U ) &&
+            ( xRecord.ucHostNameLength < tlsSESSION_HOST_NAME_SIZE ) &&
+            ( xRecord.ucIdLength <= sizeof( xRecord.ucId ) ) &&
+            ( xRecord.ulLifetimeS != 0U ) &&
+            ( length == ( sizeof( xRecord ) + xRecord.ucHostNameLength + xRecord.usTicketLength ) ) )
+        {
+            xResult = pdTRUE;
+        }
+
+        #if !defined( MBEDTLS_SSL_SESSION_TICKETS )
+            if( xRecord.usTicketLength != 0U )
+            {
+                xResult = pdFALSE;
+            }
+        #endif
+    }
+
+    if( xResult == pdTRUE )
+    {
+        memcpy( cHostName, &( pBuffer[ sizeof( xRecord ) ] ), xRecord.ucHostNameLength );
+        cHostName[ xRecord.ucHostNameLength ] = '\0';
+
+        mbedtls_ssl_session_init( &xSession );
+        xSession.ciphersuite = xRecord.lCiphersuite;
+        xSession.compression = MBEDTLS_SSL_COMPRESS_NULL;
+        xSession.id_len = xRecord.ucIdLength;
+        xSession.verify_result = xRecord.ulVerifyResult;
+        memcpy( xSession.id, xRecord.ucId, sizeof( xSession.id ) );
+        memcpy( xSession.master, xRecord.ucMaster, sizeof( xSession.master ) );
+        #if defined( MBEDTLS_SSL_MAX_FRAGMENT_LENGTH )
+            xSession.mfl_code = xRecord.ucMflCode;
+        #endif
+        #if defined( MBEDTLS_SSL_ENCRYPT_THEN_MAC )
+            xSession.encrypt_then_mac = xRecord.ucEncryptThenMac;
+        #endif
+
+        if( xRecord.ulLifetimeS > tlsSESSION_LIFETIME_MAX_S )
+        {
+            xRecord.ulLifetimeS = tlsSESSION_LIFETIME_MAX_S;
+        }
+
+        #if defined( MBEDTLS_SSL_SESSION_TICKETS )
+            xSession.ticket_lifetime = xRecord.ulLifetimeS;
+
+            if( xRecord.usTicketLength != 0U )
+            {
+                xSession.ticket = mbedtls_calloc( 1, xRecord.usTicketLength );
+
+                if( xSession.ticket == NULL )
+                {
+                    xResult = pdFALSE;
+                }
+                else
+                {
+                    memcpy( xSession.ticket,
+                            &( pBuffer[ sizeof( xRecord ) + xRecord.ucHostNameLength ] ),
+                            xRecord.usTicketLength );
+                    xSession.ticket_len = xRecord.usTicketLength;
+                }
+            }
+        #endif
+
+        if( xResult == pdTRUE )
+        {
+            sessionCacheStore( cHostName, xRecord.usPort, &xSession,
+                               ( TickType_t ) xRecord.ulLifetimeS * configTICK_RATE_HZ );
+        }
+        else
+        {
+            mbedtls_ssl_session_free( &xSession );
+        }
+    }
+
+    mbedtls_platform_zeroize( &xRecord, sizeof( xRecord ) );
 
     return xResult;
 }
@@ -845,7 +1703,7 @@ TlsTransportStatus_t TLS_FreeRTOS_Connect( NetworkContext_t * pNetworkContext,
     /* Perform TLS handshake. */
     if( returnStatus == TLS_TRANSPORT_SUCCESS )
     {
-        returnStatus = tlsSetup( pNetworkContext, pHostName, pNetworkCredentials );
+        returnStatus = tlsSetup( pNetworkContext, pHostName, port, pNetworkCredentials );
     }
 
     /* Clean up on failure. */
@@ -992,4 +1850,35 @@ int32_t TLS_FreeRTOS_send( const NetworkContext_t * pNetworkContext,
 void TLS_FreeRTOS_SetRecvTimeout( NetworkContext_t * pNetworkContext, uint32_t timeoutMS )
 {
 	Sockets_SetReceiveTimeout( pNetworkContext->tcpSocket, timeoutMS );
+
+    /* The connection is now polled, a receive timeout is no longer an error. */
+    /* coverity[misra_c_2012_rule_11_2_violation] */
+    mbedtls_ssl_set_bio( &( pNetworkContext->sslContext.context ),
+                         ( void * ) pNetworkContext->tcpSocket,
+                         mbedtls_platform_send,
+                         mbedtls_platform_recv_poll,
+                         NULL );
+}
+/*-----------------------------------------------------------*/
+
+void TLS_FreeRTOS_SetWakeupCallback( NetworkContext_t * pNetworkContext,
+                                     SocketWakeupCallback_t wakeupCallback )
+{
+    Sockets_SetWakeupCallback( pNetworkContext->tcpSocket, wakeupCallback );
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t TLS_FreeRTOS_IsDataAvailable( NetworkContext_t * pNetworkContext )
+{
+    BaseType_t result = pdFALSE;
+
+    /* Decrypted bytes may be left over in the mbed TLS context from a record holding
+     * more than one packet, in which case the socket will not signal again. */
+    if( ( mbedtls_ssl_get_bytes_avail( &( pNetworkContext->sslContext.context ) ) > 0U ) ||
+        ( FreeRTOS_recvcount( pNetworkContext->tcpSocket ) > 0 ) )
+    {
+        result = pdTRUE;
+    }
+
+    return result;
 }
@@ -0,0 +1,51 @@
+/*
+ * FreeRTOS PKCS #11 PAL for LPC54018 IoT Module V1.0.3
+ * Copyright (C) 2017 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ * Copyright 2018-2019 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_pkcs11_pal.h
+ * @brief Extensions of the PKCS #11 PAL of the LPC54018 IoT module.
+ */
+
+#ifndef IOT_PKCS11_PAL_H_
+#define IOT_PKCS11_PAL_H_
+
+/**
+ * @brief Called once the device key or certificate has been saved again.
+ */
+typedef void ( * PKCS11_PAL_CredentialsChangedCallback_t )( void );
+
+/**
+ * @brief Sets the function called when the device key or certificate is saved.
+ *
+ * Lets a layer keeping a copy of the credentials, such as the TLS transport,
+ * drop it without the PAL depending on that layer. There is a single callback,
+ * setting it again replaces the previous one.
+ *
+ * @param[in] xCallback Function to call, NULL for none.
+ */
+void PKCS11_PAL_SetCredentialsChangedCallback( PKCS11_PAL_CredentialsChangedCallback_t xCallback );
+
+#endif /* ifndef IOT_PKCS11_PAL_H_ */
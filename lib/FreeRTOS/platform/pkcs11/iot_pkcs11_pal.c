@@ -39,10 +39,14 @@
 #include "task.h"
 #include "core_pkcs11.h"
 #include "core_pkcs11_config.h"
-#include "tls_freertos_pkcs11.h"
+#include "iot_pkcs11_pal.h"
+
+/* mbedTLS mutexes. */
+#include "mbedtls/threading.h"
 
 /* Flash write */
 #include "mflash_file.h"
+#include "flash_task.h"
 
 /* C runtime includes. */
 #include <stdio.h>
@@ -65,92 +69,210 @@ enum eObjectHandles
     eAwsDeviceCertificate,
     eAwsCodeSigningKey, 
     eAwsThing,
-    eAwsThingEndpoint
+    eAwsThingEndpoint,
+    eLastHandle = eAwsThingEndpoint
+};
+
+/* Object stored by the PAL. */
+typedef struct P11Object
+{
+    const char * pcLabel;     /* PKCS #11 label. */
+    size_t xLabelSize;        /* Size of the label, including the terminating zero. */
+    const char * pcFileName;  /* Name of the file holding the object. */
+    CK_BBOOL xIsPrivate;      /* CK_TRUE if the value must not be exported. */
+} P11Object_t;
+
+#define pkcs11palOBJECT( label, file, private )    { ( label ), sizeof( label ), ( file ), ( private ) }
+
+/* Objects by handle, the object of handle h is at index h - 1. */
+static const P11Object_t xP11Objects[ eLastHandle ] =
+{
+    [ eAwsDevicePrivateKey - 1 ] =
+        pkcs11palOBJECT( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS, pkcs11palFILE_NAME_KEY, CK_TRUE ),
+    /* Public and private key are stored together in same file. */
+    [ eAwsDevicePublicKey - 1 ] =
+        pkcs11palOBJECT( pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS, pkcs11palFILE_NAME_KEY, CK_FALSE ),
+    [ eAwsDeviceCertificate - 1 ] =
+        pkcs11palOBJECT( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS, pkcs11palFILE_NAME_CLIENT_CERTIFICATE, CK_FALSE ),
+    [ eAwsCodeSigningKey - 1 ] =
+        pkcs11palOBJECT( pkcs11configLABEL_CODE_VERIFICATION_KEY, pkcs11palFILE_CODE_SIGN_PUBLIC_KEY, CK_FALSE ),
+    [ eAwsThing - 1 ] =
+        pkcs11palOBJECT( FILENAME_AWS_THING_NAME, FILENAME_AWS_THING_NAME, CK_FALSE ),
+    [ eAwsThingEndpoint - 1 ] =
+        pkcs11palOBJECT( FILENAME_AWS_ENDPOINT, FILENAME_AWS_ENDPOINT, CK_FALSE )
 };
 
-/* Flash structure */
-mflash_file_t g_cert_files[] =
+/* Handles in ascending order of their labels, searched by prvLabelToFilenameHandle(). A new object is inserted
+ * at the place of its label, PKCS11_PAL_Initialize() asserts the order. */
+static const uint8_t ucP11ObjectsByLabel[ eLastHandle ] =
 {
-    { .path = pkcs11palFILE_NAME_CLIENT_CERTIFICATE,
-      .flash_addr = MFLASH_FILE_BASEADDR,
-      .max_size = MFLASH_FILE_SIZE },
-    { .path = pkcs11palFILE_NAME_KEY,
-      .flash_addr = MFLASH_FILE_BASEADDR + MFLASH_FILE_SIZE,
-      .max_size = MFLASH_FILE_SIZE },
-    { .path = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY,
-      .flash_addr = MFLASH_FILE_BASEADDR + ( 2 * MFLASH_FILE_SIZE ),
-      .max_size = MFLASH_FILE_SIZE },
-    {.path       = FILENAME_AWS_THING_NAME,
-     .flash_addr = MFLASH_FILE_BASEADDR + 3 * MFLASH_FILE_SIZE,
-     .max_size   = MFLASH_FILE_SIZE},
-    {.path       = FILENAME_AWS_ENDPOINT,
-     .flash_addr = MFLASH_FILE_BASEADDR + 4 * MFLASH_FILE_SIZE,
-     .max_size   = MFLASH_FILE_SIZE},
-    { 0 }
+    eAwsCodeSigningKey,    /* "Code Verify Key" */
+    eAwsDeviceCertificate, /* "Device Cert" */
+    eAwsDevicePrivateKey,  /* "Device Priv TLS Key" */
+    eAwsDevicePublicKey,   /* "Device Pub TLS Key" */
+    eAwsThingEndpoint,     /* "aws_endpoint.dat" */
+    eAwsThing              /* "aws_thing_name.dat" */
+};
+
+/* Called when the device credentials are saved, set by the layer caching them. */
+static PKCS11_PAL_CredentialsChangedCallback_t xCredentialsChangedCallback = NULL;
+
+/* Files of the fixed-slot store that came before the log, in the order of their sectors. */
+static const char * const pcLegacyFiles[] =
+{
+    pkcs11palFILE_NAME_CLIENT_CERTIFICATE,
+    pkcs11palFILE_NAME_KEY,
+    pkcs11palFILE_CODE_SIGN_PUBLIC_KEY,
+    FILENAME_AWS_THING_NAME,
+    FILENAME_AWS_ENDPOINT
 };
 
 
 /*-----------------------------------------------------------*/
 
-/* Converts a label to its respective filename and handle. */
+/* Converts a label to its respective filename and handle, by a binary search of the labels. As before, the label
+ * matches if it is equal to the object label including the terminating zero. */
 void prvLabelToFilenameHandle( uint8_t * pcLabel,
                                char ** pcFileName,
                                CK_OBJECT_HANDLE_PTR pHandle )
 {
+    const P11Object_t * pxObject;
+    size_t xLow = 0;
+    size_t xHigh = eLastHandle;
+    size_t xMiddle;
+    int lCompare;
+
     if( pcLabel != NULL )
     {
-        /* Translate from the PKCS#11 label to local storage file name. */
-        if( 0 == memcmp( pcLabel,
-                         &pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS,
-                         sizeof( pkcs11configLABEL_DEVICE_CERTIFICATE_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_CLIENT_CERTIFICATE;
-            *pHandle = eAwsDeviceCertificate;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS,
-                              sizeof( pkcs11configLABEL_DEVICE_PRIVATE_KEY_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_KEY;
-            *pHandle = eAwsDevicePrivateKey;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS,
-                              sizeof( pkcs11configLABEL_DEVICE_PUBLIC_KEY_FOR_TLS ) ) )
-        {
-            *pcFileName = pkcs11palFILE_NAME_KEY;
-            *pHandle = eAwsDevicePublicKey;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &pkcs11configLABEL_CODE_VERIFICATION_KEY,
-                              sizeof( pkcs11configLABEL_CODE_VERIFICATION_KEY ) ) )
-        {
-            *pcFileName = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY;
-            *pHandle = eAwsCodeSigningKey;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &FILENAME_AWS_THING_NAME,
-                              sizeof( FILENAME_AWS_THING_NAME ) ) )
-        {
-            *pcFileName = FILENAME_AWS_THING_NAME;
-            *pHandle = eAwsThing;
-        }
-        else if( 0 == memcmp( pcLabel,
-                              &FILENAME_AWS_ENDPOINT,
-                              sizeof( FILENAME_AWS_ENDPOINT ) ) )
-        {
-            *pcFileName = FILENAME_AWS_ENDPOINT;
-            *pHandle = eAwsThingEndpoint;
-        }
-        else
+        *pcFileName = NULL;
+        *pHandle = eInvalidHandle;
+
+        while( xLow < xHigh )
         {
-            *pcFileName = NULL;
-            *pHandle = eInvalidHandle;
+            xMiddle = ( xLow + xHigh ) / 2U;
+            pxObject = &xP11Objects[ ucP11ObjectsByLabel[ xMiddle ] - 1 ];
+            lCompare = strncmp( ( const char * ) pcLabel, pxObject->pcLabel, pxObject->xLabelSize );
+
+            if( lCompare == 0 )
+            {
+                *pcFileName = ( char * ) pxObject->pcFileName;
+                *pHandle = ucP11ObjectsByLabel[ xMiddle ];
+                break;
+            }
+            else if( lCompare < 0 )
+            {
+                xHigh = xMiddle;
+            }
+            else
+            {
+                xLow = xMiddle + 1U;
+            }
         }
     }
 }
 
 
+/**
+ * @brief Saves a file, run by the flash task.
+ *
+ * @param[in] pvContext     Name of the file.
+ * @param[in] ulAddress     Unused.
+ * @param[in] pucData       Data to be written to file.
+ * @param[in] ulLength      Size (in bytes) of data to be saved.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int32_t prvSaveFile( void * pvContext,
+                            uint32_t ulAddress,
+                            const uint8_t * pucData,
+                            uint32_t ulLength )
+{
+    ( void ) ulAddress;
+
+    return ( pdTRUE == mflash_save_file( ( char * ) pvContext, ( uint8_t * ) pucData, ulLength ) ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Object value read by prvReadFile().
+ */
+typedef struct ReadFileContext
+{
+    const char * pcFileName;
+    uint8_t * pucData;
+    uint32_t ulDataSize;
+} ReadFileContext_t;
+
+/**
+ * @brief Copies a file into a buffer allocated for the caller, run by the flash task.
+ *
+ * The file store returns data in place in the flash, where the garbage collection of a later save may erase
+ * it. Saves only run on the flash task, so the copy made here is never torn.
+ *
+ * @param[in] pvContext     Read context, the data and size are set on success.
+ * @param[in] ulAddress     Unused.
+ * @param[in] pucData       Unused.
+ * @param[in] ulLength      Unused.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int32_t prvReadFile( void * pvContext,
+                            uint32_t ulAddress,
+                            const uint8_t * pucData,
+                            uint32_t ulLength )
+{
+    ReadFileContext_t * pxRead = ( ReadFileContext_t * ) pvContext;
+    uint8_t * pucFileData = NULL;
+    uint32_t ulFileSize = 0;
+
+    ( void ) ulAddress;
+    ( void ) pucData;
+    ( void ) ulLength;
+
+    if( pdFALSE == mflash_read_file( ( char * ) pxRead->pcFileName, &pucFileData, &ulFileSize ) )
+    {
+        return -1;
+    }
+
+    /* The size is set even if the buffer cannot be allocated, to tell the two failures apart. */
+    pxRead->ulDataSize = ulFileSize;
+    pxRead->pucData = pvPortMalloc( ulFileSize );
+
+    if( pxRead->pucData == NULL )
+    {
+        return -1;
+    }
+
+    memcpy( pxRead->pucData, pucFileData, ulFileSize );
+
+    return 0;
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Moves the files of the fixed-slot store into the log, run by the flash task.
+ *
+ * A device updated over the air keeps its credentials this way.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int32_t prvMigrateFiles( void * pvContext,
+                                uint32_t ulAddress,
+                                const uint8_t * pucData,
+                                uint32_t ulLength )
+{
+    ( void ) pvContext;
+    ( void ) ulAddress;
+    ( void ) pucData;
+    ( void ) ulLength;
+
+    return ( pdTRUE == mflash_migrate_legacy( pcLegacyFiles, sizeof( pcLegacyFiles ) / sizeof( pcLegacyFiles[ 0 ] ) ) ) ? 0 : -1;
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Writes a file to local storage.
  *
@@ -175,10 +297,19 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 
     if( xHandle != eInvalidHandle )
     {
-        if( pdFALSE == mflash_save_file( pcFileName, pucData, ulDataSize ) )
+        /* Written by the flash task, in order with the other flash writes. */
+        if( 0 != lFlashTaskRun( prvSaveFile, pcFileName, 0, pucData, ulDataSize ) )
         {
             xHandle = eInvalidHandle;
         }
+        else if( ( ( xHandle == eAwsDevicePrivateKey ) ||
+                   ( xHandle == eAwsDevicePublicKey ) ||
+                   ( xHandle == eAwsDeviceCertificate ) ) &&
+                 ( xCredentialsChangedCallback != NULL ) )
+        {
+            /* Next TLS connections read the new credentials. */
+            xCredentialsChangedCallback();
+        }
     }
 
     return xHandle;
@@ -186,6 +317,13 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 
 /*-----------------------------------------------------------*/
 
+void PKCS11_PAL_SetCredentialsChangedCallback( PKCS11_PAL_CredentialsChangedCallback_t xCallback )
+{
+    xCredentialsChangedCallback = xCallback;
+}
+
+/*-----------------------------------------------------------*/
+
 /**
  * @brief Translates a PKCS #11 label into an object handle.
  *
@@ -208,8 +346,7 @@ CK_OBJECT_HANDLE PKCS11_PAL_FindObject( uint8_t * pLabel,
     /* Translate from the PKCS#11 label to local storage file name. */
     prvLabelToFilenameHandle( pLabel, &pcFileName, &xHandle );
 
-    /*TODO: check if file actually there.
-     * Note: g_cert_files only seems to check if the entry in the array is present */
+    /*TODO: check if file actually there. */
 
     return xHandle;
 }
@@ -245,48 +382,28 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
                                  uint32_t * pulDataSize,
                                  CK_BBOOL * pIsPrivate )
 {
-    char * pcFileName = NULL;
     CK_RV ulReturn = CKR_OK;
+    ReadFileContext_t xRead = { 0 };
 
-    if( xHandle == eAwsDeviceCertificate )
+    if( ( xHandle == eInvalidHandle ) || ( xHandle > eLastHandle ) )
     {
-        pcFileName = pkcs11palFILE_NAME_CLIENT_CERTIFICATE;
-        *pIsPrivate = CK_FALSE;
-    }
-    else if( xHandle == eAwsDevicePrivateKey )
-    {
-        pcFileName = pkcs11palFILE_NAME_KEY;
-        *pIsPrivate = CK_TRUE;
-    }
-    else if( xHandle == eAwsDevicePublicKey )
-    {
-        /* Public and private key are stored together in same file. */
-        pcFileName = pkcs11palFILE_NAME_KEY;
-        *pIsPrivate = CK_FALSE;
-    }
-    else if( xHandle == eAwsCodeSigningKey )
-    {
-        pcFileName = pkcs11palFILE_CODE_SIGN_PUBLIC_KEY;
-        *pIsPrivate = CK_FALSE;
-    }
-    else if( xHandle == eAwsThing )
-    {
-        pcFileName = FILENAME_AWS_THING_NAME;
-        *pIsPrivate = CK_FALSE;
-    }
-    else if( xHandle == eAwsThingEndpoint )
-    {
-        pcFileName = FILENAME_AWS_ENDPOINT;
-        *pIsPrivate = CK_FALSE;
+        ulReturn = CKR_KEY_HANDLE_INVALID;
     }
     else
     {
-        ulReturn = CKR_KEY_HANDLE_INVALID;
-    }
+        *pIsPrivate = xP11Objects[ xHandle - 1 ].xIsPrivate;
+        xRead.pcFileName = xP11Objects[ xHandle - 1 ].pcFileName;
 
-    if( pdFALSE == mflash_read_file( pcFileName, ppucData, pulDataSize ) )
-    {
-        ulReturn = CKR_FUNCTION_FAILED;
+        /* Copied by the flash task, in order with the saves that may move the file. */
+        if( 0 != lFlashTaskRun( prvReadFile, &xRead, 0, NULL, 0 ) )
+        {
+            ulReturn = ( xRead.ulDataSize == 0 ) ? CKR_FUNCTION_FAILED : CKR_DEVICE_MEMORY;
+        }
+        else
+        {
+            *ppucData = xRead.pucData;
+            *pulDataSize = xRead.ulDataSize;
+        }
     }
 
     return ulReturn;
@@ -303,12 +420,12 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
 void PKCS11_PAL_GetObjectValueCleanup( uint8_t * pucData,
                                        uint32_t ulDataSize )
 {
-    /* Unused parameters. */
-    ( void ) pucData;
-    ( void ) ulDataSize;
-
-    /* Since no buffer was allocated on heap, there is no cleanup
-     * to be done. */
+    if( pucData != NULL )
+    {
+        /* The copy may hold a private key. */
+        memset( pucData, 0, ulDataSize );
+        vPortFree( pucData );
+    }
 }
 
 
@@ -320,6 +437,15 @@ void PKCS11_PAL_GetObjectValueCleanup( uint8_t * pucData,
 CK_RV PKCS11_PAL_Initialize( void )
 {
     CK_RV xResult = CKR_OK;
+    size_t x;
+
+    /* The label search relies on the order of ucP11ObjectsByLabel. */
+    for( x = 1; x < eLastHandle; x++ )
+    {
+        configASSERT( strcmp( xP11Objects[ ucP11ObjectsByLabel[ x - 1 ] - 1 ].pcLabel,
+                              xP11Objects[ ucP11ObjectsByLabel[ x ] - 1 ].pcLabel ) < 0 );
+    }
+
     mbedtls_threading_set_alt( mbedtls_platform_mutex_init,
                                mbedtls_platform_mutex_free,
                                mbedtls_platform_mutex_lock,
@@ -328,7 +454,11 @@ CK_RV PKCS11_PAL_Initialize( void )
     if( !mflash_is_initialized() )
     {
         /* Initialize flash storage. */
-        if( pdTRUE != mflash_init( g_cert_files, 1 ) )
+        if( pdTRUE != mflash_init( true ) )
+        {
+            xResult = CKR_GENERAL_ERROR;
+        }
+        else if( 0 != lFlashTaskRun( prvMigrateFiles, NULL, 0, NULL, 0 ) )
         {
             xResult = CKR_GENERAL_ERROR;
         }
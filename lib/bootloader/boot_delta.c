@@ -0,0 +1,222 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#include <string.h>
+
+#include "boot_delta.h"
+#include "boot_writer.h"
+
+#define BOOT_DELTA_STATE_HEADER  0
+#define BOOT_DELTA_STATE_COMMAND 1
+#define BOOT_DELTA_STATE_INSERT  2
+#define BOOT_DELTA_STATE_DONE    3
+#define BOOT_DELTA_STATE_ERROR   4
+
+
+/* Checks whether there is a delta patch at given address */
+int32_t boot_delta_is_patch(const void *addr)
+{
+    const struct boot_delta_header *header = (const struct boot_delta_header *)addr;
+
+    return (header->magic == BOOT_DELTA_MAGIC) ? 1 : 0;
+}
+
+
+/* Validates the patch header against the base image */
+static int32_t boot_delta_start(struct boot_delta *ctx)
+{
+    struct boot_delta_header *header = &ctx->header;
+
+    memcpy(header, &ctx->rec.header, sizeof(*header));
+
+    if (header->magic != BOOT_DELTA_MAGIC || header->version != BOOT_DELTA_VERSION)
+        return -1;
+
+    if (header->source_size > ctx->source_max || header->target_size > ctx->writer.target_max)
+        return -1;
+
+    /* the patch has to be made against the image being run */
+    if (boot_crc32(0, ctx->source, header->source_size) != header->source_crc)
+        return -1;
+
+    ctx->state = (header->target_size == 0) ? BOOT_DELTA_STATE_DONE : BOOT_DELTA_STATE_COMMAND;
+    return 0;
+}
+
+
+/* Validates a command, returns 0 when both parts fit into the base and target images */
+static int32_t boot_delta_check_command(struct boot_delta *ctx, const struct boot_delta_command *command)
+{
+    uint32_t target_left = ctx->header.target_size - ctx->writer.produced;
+
+    if (command->insert_len > target_left || command->copy_len > target_left - command->insert_len)
+        return -1;
+
+    if (command->copy_offset > ctx->header.source_size ||
+        command->copy_len > ctx->header.source_size - command->copy_offset)
+        return -1;
+
+    if (command->insert_len == 0 && command->copy_len == 0)
+        return -1;
+
+    return 0;
+}
+
+
+/* Completes the current command by copying its range of the base image */
+static int32_t boot_delta_copy(struct boot_delta *ctx)
+{
+    if (boot_writer_emit(&ctx->writer, ctx->source + ctx->rec.command.copy_offset, ctx->rec.command.copy_len) != 0)
+        return -1;
+
+    ctx->state = (ctx->writer.produced == ctx->header.target_size) ? BOOT_DELTA_STATE_DONE : BOOT_DELTA_STATE_COMMAND;
+    return 0;
+}
+
+
+/* Prepares the context to reconstruct an image from 'source' into 'target' */
+int32_t boot_delta_init(
+    struct boot_delta *ctx, const void *source, uint32_t source_max, void *target, uint32_t target_max)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->source = (const uint8_t *)source;
+    ctx->source_max = source_max;
+    boot_writer_init(&ctx->writer, target, target_max);
+    ctx->state = BOOT_DELTA_STATE_HEADER;
+    return 0;
+}
+
+
+/* Feeds next part of the patch stream to the applier */
+int32_t boot_delta_write(struct boot_delta *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t chunk;
+    uint32_t rec_size;
+
+    while (len && ctx->state != BOOT_DELTA_STATE_ERROR)
+    {
+        switch (ctx->state)
+        {
+        case BOOT_DELTA_STATE_HEADER:
+        case BOOT_DELTA_STATE_COMMAND:
+            /* collect fixed size record, it may be split across writes */
+            rec_size = (ctx->state == BOOT_DELTA_STATE_HEADER) ? sizeof(struct boot_delta_header) :
+                                                                  sizeof(struct boot_delta_command);
+            chunk = rec_size - ctx->rec_len;
+            if (chunk > len)
+                chunk = len;
+
+            memcpy(&ctx->rec.raw[ctx->rec_len], data, chunk);
+            ctx->rec_len += chunk;
+            data += chunk;
+            len -= chunk;
+
+            if (ctx->rec_len < rec_size)
+                break;
+
+            ctx->rec_len = 0;
+            if (ctx->state == BOOT_DELTA_STATE_HEADER)
+            {
+                if (boot_delta_start(ctx) != 0)
+                    ctx->state = BOOT_DELTA_STATE_ERROR;
+            }
+            else if (boot_delta_check_command(ctx, &ctx->rec.command) != 0)
+            {
+                ctx->state = BOOT_DELTA_STATE_ERROR;
+            }
+            else
+            {
+                ctx->insert_left = ctx->rec.command.insert_len;
+                ctx->state = BOOT_DELTA_STATE_INSERT;
+                if (ctx->insert_left == 0 && boot_delta_copy(ctx) != 0)
+                    ctx->state = BOOT_DELTA_STATE_ERROR;
+            }
+            break;
+
+        case BOOT_DELTA_STATE_INSERT:
+            chunk = ctx->insert_left;
+            if (chunk > len)
+                chunk = len;
+
+            if (boot_writer_emit(&ctx->writer, data, chunk) != 0)
+            {
+                ctx->state = BOOT_DELTA_STATE_ERROR;
+                break;
+            }
+            ctx->insert_left -= chunk;
+            data += chunk;
+            len -= chunk;
+
+            if (ctx->insert_left == 0 && boot_delta_copy(ctx) != 0)
+                ctx->state = BOOT_DELTA_STATE_ERROR;
+            break;
+
+        default:
+            /* trailing data after the last command */
+            ctx->state = BOOT_DELTA_STATE_ERROR;
+            break;
+        }
+    }
+
+    return (ctx->state == BOOT_DELTA_STATE_ERROR) ? -1 : 0;
+}
+
+
+/* Flushes the target image and checks it is complete and intact */
+int32_t boot_delta_finish(struct boot_delta *ctx)
+{
+    if (ctx->state != BOOT_DELTA_STATE_DONE)
+        return -1;
+
+    if (boot_writer_flush(&ctx->writer) != 0)
+        return -1;
+
+    if (ctx->writer.crc != ctx->header.target_crc)
+        return -1;
+
+    /* the image has been written to flash, check it reads back the same */
+    if (boot_crc32(0, ctx->writer.target, ctx->header.target_size) != ctx->header.target_crc)
+        return -1;
+
+    return (int32_t)ctx->header.target_size;
+}
+
+
+/* Reconstructs an image from 'source' and a patch stored in memory, returns the image size upon success */
+int32_t boot_delta_apply(struct boot_delta *ctx,
+                         const void *source,
+                         uint32_t source_max,
+                         void *target,
+                         uint32_t target_max,
+                         const void *patch,
+                         uint32_t patch_len)
+{
+    boot_delta_init(ctx, source, source_max, target, target_max);
+
+    if (boot_delta_write(ctx, (const uint8_t *)patch, patch_len) != 0)
+        return -1;
+
+    return boot_delta_finish(ctx);
+}
@@ -0,0 +1,96 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#ifndef _BOOT_DELTA_H_
+#define _BOOT_DELTA_H_
+
+#include <stdint.h>
+
+#include "boot_writer.h"
+
+/*
+ * Delta patch format, all fields are little endian.
+ *
+ * The patch starts with struct boot_delta_header followed by a sequence of commands. Each command is
+ * struct boot_delta_command followed by 'insert_len' literal bytes. The literal bytes are appended to the
+ * target image first, then 'copy_len' bytes of the base image starting at 'copy_offset'. Commands follow
+ * until 'target_size' bytes of the target image are produced.
+ *
+ * Patches are generated by tools/ota_delta.py.
+ */
+#define BOOT_DELTA_MAGIC   0x544C4442 /* "BDLT" */
+#define BOOT_DELTA_VERSION 0x00000001
+
+struct boot_delta_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t source_size; /* length of the base image the patch applies to */
+    uint32_t source_crc;  /* CRC32 of the base image */
+    uint32_t target_size; /* length of the reconstructed image */
+    uint32_t target_crc;  /* CRC32 of the reconstructed image */
+};
+
+struct boot_delta_command
+{
+    uint32_t insert_len;
+    uint32_t copy_len;
+    uint32_t copy_offset;
+};
+
+/* Applier context, the patch is consumed as a stream and the output is staged in a single flash page */
+struct boot_delta
+{
+    const uint8_t *source;
+    uint32_t source_max;
+    struct boot_writer writer;
+    uint32_t state;
+    union
+    {
+        struct boot_delta_header header;
+        struct boot_delta_command command;
+        uint8_t raw[sizeof(struct boot_delta_header)];
+    } rec;
+    uint32_t rec_len;
+    struct boot_delta_header header;
+    uint32_t insert_left;
+};
+
+extern int32_t boot_delta_is_patch(const void *addr);
+
+extern int32_t boot_delta_init(
+    struct boot_delta *ctx, const void *source, uint32_t source_max, void *target, uint32_t target_max);
+extern int32_t boot_delta_write(struct boot_delta *ctx, const uint8_t *data, uint32_t len);
+extern int32_t boot_delta_finish(struct boot_delta *ctx);
+
+extern int32_t boot_delta_apply(struct boot_delta *ctx,
+                                const void *source,
+                                uint32_t source_max,
+                                void *target,
+                                uint32_t target_max,
+                                const void *patch,
+                                uint32_t patch_len);
+
+#endif
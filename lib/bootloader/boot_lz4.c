@@ -0,0 +1,231 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#include <string.h>
+
+#include "boot_lz4.h"
+#include "boot_writer.h"
+
+#define BOOT_LZ4_STATE_HEADER      0
+#define BOOT_LZ4_STATE_TOKEN       1
+#define BOOT_LZ4_STATE_LITERAL_LEN 2
+#define BOOT_LZ4_STATE_LITERALS    3
+#define BOOT_LZ4_STATE_OFFSET_LO   4
+#define BOOT_LZ4_STATE_OFFSET_HI   5
+#define BOOT_LZ4_STATE_MATCH_LEN   6
+#define BOOT_LZ4_STATE_DONE        7
+#define BOOT_LZ4_STATE_ERROR       8
+
+#define BOOT_LZ4_MIN_MATCH 4
+
+
+/* Checks whether there is a compressed image at given address */
+int32_t boot_lz4_is_compressed(const void *addr)
+{
+    const struct boot_lz4_header *header = (const struct boot_lz4_header *)addr;
+
+    return (header->magic == BOOT_LZ4_MAGIC) ? 1 : 0;
+}
+
+
+/* Validates the header */
+static uint32_t boot_lz4_start(struct boot_lz4 *ctx)
+{
+    struct boot_lz4_header *header = &ctx->header;
+
+    memcpy(header, &ctx->rec.header, sizeof(*header));
+
+    if (header->magic != BOOT_LZ4_MAGIC || header->version != BOOT_LZ4_VERSION)
+        return BOOT_LZ4_STATE_ERROR;
+
+    if (header->image_size > ctx->writer.target_max)
+        return BOOT_LZ4_STATE_ERROR;
+
+    return (header->image_size == 0) ? BOOT_LZ4_STATE_DONE : BOOT_LZ4_STATE_TOKEN;
+}
+
+
+/* Adds next byte of an extended length, returns non zero once the length is complete */
+static int32_t boot_lz4_extend(struct boot_lz4 *ctx, uint8_t byte)
+{
+    ctx->length += byte;
+    return (byte != 0xFF) ? 1 : 0;
+}
+
+
+/* Decides what follows the literals of a sequence */
+static uint32_t boot_lz4_after_literals(struct boot_lz4 *ctx)
+{
+    /* the last sequence has no match */
+    if (ctx->writer.produced == ctx->header.image_size)
+        return BOOT_LZ4_STATE_DONE;
+
+    return BOOT_LZ4_STATE_OFFSET_LO;
+}
+
+
+/* Copies the match of a sequence */
+static uint32_t boot_lz4_match(struct boot_lz4 *ctx)
+{
+    ctx->length += BOOT_LZ4_MIN_MATCH;
+
+    if (ctx->length > ctx->header.image_size - ctx->writer.produced)
+        return BOOT_LZ4_STATE_ERROR;
+
+    if (boot_writer_repeat(&ctx->writer, ctx->offset, ctx->length) != 0)
+        return BOOT_LZ4_STATE_ERROR;
+
+    return (ctx->writer.produced == ctx->header.image_size) ? BOOT_LZ4_STATE_DONE : BOOT_LZ4_STATE_TOKEN;
+}
+
+
+/* Prepares the context to decompress an image into 'target' */
+int32_t boot_lz4_init(struct boot_lz4 *ctx, void *target, uint32_t target_max)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    boot_writer_init(&ctx->writer, target, target_max);
+    ctx->state = BOOT_LZ4_STATE_HEADER;
+    return 0;
+}
+
+
+/* Feeds next part of the compressed stream to the decoder */
+int32_t boot_lz4_write(struct boot_lz4 *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t chunk;
+    uint8_t byte;
+
+    while (len && ctx->state != BOOT_LZ4_STATE_ERROR)
+    {
+        if (ctx->state == BOOT_LZ4_STATE_HEADER)
+        {
+            /* collect the header, it may be split across writes */
+            chunk = sizeof(struct boot_lz4_header) - ctx->rec_len;
+            if (chunk > len)
+                chunk = len;
+
+            memcpy(&ctx->rec.raw[ctx->rec_len], data, chunk);
+            ctx->rec_len += chunk;
+            data += chunk;
+            len -= chunk;
+
+            if (ctx->rec_len == sizeof(struct boot_lz4_header))
+                ctx->state = boot_lz4_start(ctx);
+            continue;
+        }
+
+        if (ctx->state == BOOT_LZ4_STATE_LITERALS)
+        {
+            chunk = ctx->length;
+            if (chunk > len)
+                chunk = len;
+
+            if (boot_writer_emit(&ctx->writer, data, chunk) != 0)
+            {
+                ctx->state = BOOT_LZ4_STATE_ERROR;
+                break;
+            }
+            ctx->length -= chunk;
+            data += chunk;
+            len -= chunk;
+
+            if (ctx->length == 0)
+                ctx->state = boot_lz4_after_literals(ctx);
+            continue;
+        }
+
+        byte = *data++;
+        len--;
+
+        switch (ctx->state)
+        {
+        case BOOT_LZ4_STATE_TOKEN:
+            ctx->token = byte;
+            ctx->length = byte >> 4;
+            if (ctx->length == 15)
+                ctx->state = BOOT_LZ4_STATE_LITERAL_LEN;
+            else if (ctx->length > 0)
+                ctx->state = BOOT_LZ4_STATE_LITERALS;
+            else
+                ctx->state = BOOT_LZ4_STATE_OFFSET_LO;
+            break;
+
+        case BOOT_LZ4_STATE_LITERAL_LEN:
+            if (boot_lz4_extend(ctx, byte))
+                ctx->state = BOOT_LZ4_STATE_LITERALS;
+            break;
+
+        case BOOT_LZ4_STATE_OFFSET_LO:
+            ctx->offset = byte;
+            ctx->state = BOOT_LZ4_STATE_OFFSET_HI;
+            break;
+
+        case BOOT_LZ4_STATE_OFFSET_HI:
+            ctx->offset |= (uint32_t)byte << 8;
+            ctx->length = ctx->token & 0x0F;
+            if (ctx->length == 15)
+                ctx->state = BOOT_LZ4_STATE_MATCH_LEN;
+            else
+                ctx->state = boot_lz4_match(ctx);
+            break;
+
+        case BOOT_LZ4_STATE_MATCH_LEN:
+            if (boot_lz4_extend(ctx, byte))
+                ctx->state = boot_lz4_match(ctx);
+            break;
+
+        default:
+            /* trailing data after the last sequence */
+            ctx->state = BOOT_LZ4_STATE_ERROR;
+            break;
+        }
+
+        /* literals must fit into the image, checked before any of them is written */
+        if (ctx->state == BOOT_LZ4_STATE_LITERALS && ctx->length > ctx->header.image_size - ctx->writer.produced)
+            ctx->state = BOOT_LZ4_STATE_ERROR;
+    }
+
+    return (ctx->state == BOOT_LZ4_STATE_ERROR) ? -1 : 0;
+}
+
+
+/* Flushes the image and checks it is complete and intact, returns the image size upon success */
+int32_t boot_lz4_finish(struct boot_lz4 *ctx)
+{
+    if (ctx->state != BOOT_LZ4_STATE_DONE)
+        return -1;
+
+    if (boot_writer_flush(&ctx->writer) != 0)
+        return -1;
+
+    if (ctx->writer.crc != ctx->header.image_crc)
+        return -1;
+
+    /* the image has been written to flash, check it reads back the same */
+    if (boot_crc32(0, ctx->writer.target, ctx->header.image_size) != ctx->header.image_crc)
+        return -1;
+
+    return (int32_t)ctx->header.image_size;
+}
@@ -0,0 +1,77 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#ifndef _BOOT_LZ4_H_
+#define _BOOT_LZ4_H_
+
+#include <stdint.h>
+
+#include "boot_writer.h"
+
+/*
+ * Compressed image format, all fields are little endian.
+ *
+ * The file starts with struct boot_lz4_header followed by a single LZ4 block (LZ4 block format, sequences of
+ * token, literals, 16-bit match offset and match length) which decompresses to 'image_size' bytes. The last
+ * sequence ends with its literals. Match offsets reach up to 64 KB back into the image; as the image is written
+ * to memory mapped flash, they are resolved from flash and no history window is kept in RAM.
+ *
+ * Compressed images are created by tools/ota_compress.py.
+ */
+#define BOOT_LZ4_MAGIC   0x345A4C42 /* "BLZ4" */
+#define BOOT_LZ4_VERSION 0x00000001
+
+struct boot_lz4_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t image_size; /* length of the decompressed image */
+    uint32_t image_crc;  /* CRC32 of the decompressed image */
+};
+
+/* Decoder context, the compressed data is consumed as a stream in pieces of any size */
+struct boot_lz4
+{
+    struct boot_writer writer;
+    uint32_t state;
+    union
+    {
+        struct boot_lz4_header header;
+        uint8_t raw[sizeof(struct boot_lz4_header)];
+    } rec;
+    uint32_t rec_len;
+    struct boot_lz4_header header;
+    uint32_t token;
+    uint32_t length; /* length of literals or match being decoded */
+    uint32_t offset;
+};
+
+extern int32_t boot_lz4_is_compressed(const void *addr);
+
+extern int32_t boot_lz4_init(struct boot_lz4 *ctx, void *target, uint32_t target_max);
+extern int32_t boot_lz4_write(struct boot_lz4 *ctx, const uint8_t *data, uint32_t len);
+extern int32_t boot_lz4_finish(struct boot_lz4 *ctx);
+
+#endif
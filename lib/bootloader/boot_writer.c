@@ -0,0 +1,157 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#include <string.h>
+
+#include "boot_writer.h"
+#include "mflash_drv.h"
+
+
+/* CRC32 (IEEE 802.3, same as zlib), nibble table to keep the footprint small */
+static const uint32_t boot_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+uint32_t boot_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ boot_crc_table[crc & 0x0F];
+        crc = (crc >> 4) ^ boot_crc_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+
+void boot_writer_init(struct boot_writer *writer, void *target, uint32_t target_max)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->target = (uint8_t *)target;
+    writer->target_max = target_max;
+}
+
+
+/* Writes the staged page to the target, the sector is erased when its first page is written */
+int32_t boot_writer_flush(struct boot_writer *writer)
+{
+    uint32_t page_off = writer->produced - writer->page_len;
+    uint8_t *page_addr = writer->target + page_off;
+
+    if (writer->page_len == 0)
+        return 0;
+
+    if (0 == (page_off % MFLASH_SECTOR_SIZE))
+    {
+        if (mflash_drv_erase(page_addr, MFLASH_SECTOR_SIZE) != 0)
+            return -1;
+    }
+
+    if (mflash_drv_program(page_addr, writer->page, writer->page_len) != 0)
+        return -1;
+
+    writer->page_len = 0;
+    return 0;
+}
+
+
+/* Appends data to the image */
+int32_t boot_writer_emit(struct boot_writer *writer, const uint8_t *data, uint32_t len)
+{
+    uint32_t chunk;
+
+    if (len > writer->target_max - writer->produced)
+        return -1;
+
+    writer->crc = boot_crc32(writer->crc, data, len);
+
+    while (len)
+    {
+        chunk = MFLASH_PAGE_SIZE - writer->page_len;
+        if (chunk > len)
+            chunk = len;
+
+        memcpy(&writer->page[writer->page_len], data, chunk);
+        writer->page_len += chunk;
+        writer->produced += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (writer->page_len == MFLASH_PAGE_SIZE)
+        {
+            if (boot_writer_flush(writer) != 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Appends 'len' bytes found 'distance' bytes back in the image, the ranges may overlap.
+ * Bytes already programmed are read from flash, the rest from the staged page. */
+int32_t boot_writer_repeat(struct boot_writer *writer, uint32_t distance, uint32_t len)
+{
+    uint32_t page_start;
+    uint32_t from;
+    uint32_t chunk;
+    const uint8_t *src;
+
+    if (distance == 0 || distance > writer->produced)
+        return -1;
+
+    while (len)
+    {
+        page_start = writer->produced - writer->page_len;
+        from = writer->produced - distance;
+
+        if (from < page_start)
+        {
+            src = writer->target + from;
+            chunk = page_start - from;
+        }
+        else
+        {
+            src = &writer->page[from - page_start];
+            chunk = writer->page_len - (from - page_start);
+        }
+
+        /* do not run into the bytes being produced, nor past the staged page as it gets flushed */
+        if (chunk > distance)
+            chunk = distance;
+        if (chunk > MFLASH_PAGE_SIZE - writer->page_len)
+            chunk = MFLASH_PAGE_SIZE - writer->page_len;
+        if (chunk > len)
+            chunk = len;
+
+        if (boot_writer_emit(writer, src, chunk) != 0)
+            return -1;
+
+        len -= chunk;
+    }
+
+    return 0;
+}
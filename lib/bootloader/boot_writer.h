@@ -0,0 +1,52 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#ifndef _BOOT_WRITER_H_
+#define _BOOT_WRITER_H_
+
+#include <stdint.h>
+
+#include "mflash_drv.h"
+
+/* Sequential image writer, output is staged in a single flash page and each sector is erased before its first page
+ * is programmed. Used by the image decoders which reconstruct an image into a flash slot. */
+struct boot_writer
+{
+    uint8_t *target;
+    uint32_t target_max;
+    uint32_t produced; /* bytes of the image emitted so far */
+    uint32_t crc;      /* CRC32 of the bytes emitted so far */
+    uint32_t page_len;
+    uint8_t page[MFLASH_PAGE_SIZE];
+};
+
+extern uint32_t boot_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+extern void boot_writer_init(struct boot_writer *writer, void *target, uint32_t target_max);
+extern int32_t boot_writer_emit(struct boot_writer *writer, const uint8_t *data, uint32_t len);
+extern int32_t boot_writer_repeat(struct boot_writer *writer, uint32_t distance, uint32_t len);
+extern int32_t boot_writer_flush(struct boot_writer *writer);
+
+#endif
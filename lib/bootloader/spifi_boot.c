@@ -37,6 +37,8 @@
 #include "spifi_boot.h"
 #include "mflash_drv.h"
 
+#define BOOT_SLOT_NAME(addr) (((uint32_t)(addr) == BOOT_SLOT_B_ADDR) ? 'B' : 'A')
+
 
 /* Validates the boot image at given address and returns pointer to image header.
  * If the validation fails the return value is NULL.
@@ -64,15 +66,48 @@ static struct boot_image_header *boot_get_image_header(const void *addr)
 }
 
 
-static int boot_image_validate(const void *addr)
+/* Checks whether given address is the start of an image slot */
+static int32_t boot_slot_check(const void *addr)
 {
+    if ((uint32_t)addr == BOOT_SLOT_A_ADDR || (uint32_t)addr == BOOT_SLOT_B_ADDR)
+        return 0;
+
+    return -1;
+}
+
+
+/* Returns the address the image starting in the given buffer is linked to execute from, or 0 if the buffer
+ * does not hold a valid image header. The buffer may be a RAM copy of the start of the image.
+ */
+uint32_t boot_image_load_address(const void *image, uint32_t size)
+{
+    const struct boot_image *boot_image = (const struct boot_image *)image;
     struct boot_image_header *bih;
 
+    if (size < sizeof(struct boot_image))
+        return 0;
+
+    if (boot_image->header_offset > BOOT_HEADER_MAX_OFFSET ||
+        size < boot_image->header_offset + sizeof(struct boot_image_header))
+        return 0;
+
     /* get the image header */
-    bih = boot_get_image_header(addr);
+    bih = boot_get_image_header(image);
+    if (bih == NULL)
+        return 0;
+
+    return bih->load_address;
+}
+
+
+/* Validates the boot image in a slot, the image has to be linked to execute from that very slot */
+int32_t boot_image_validate(const void *addr)
+{
+    if (boot_slot_check(addr) != 0)
+        return -1;
 
     /* check load address */
-    if (bih == NULL || bih->load_address != BOOT_EXEC_IMAGE_ADDR)
+    if (boot_image_load_address(addr, BOOT_SLOT_SIZE) != (uint32_t)addr)
     {
         return -1;
     }
@@ -81,28 +116,36 @@ static int boot_image_validate(const void *addr)
 }
 
 
-/* Validates boot image and copies it to given address of FLASH, returns number of bytes copied upon success */
-static int32_t boot_image_copy(void *flash_dst, const void *img)
+/* Returns the slot the calling application executes from, based on its vector table */
+void *boot_slot_running(void)
 {
-    struct boot_image_header *boot_image_header;
-    int32_t result;
-    int32_t copy_length;
+    uint32_t vtor = SCB->VTOR;
 
-    boot_image_header = boot_get_image_header(img);
-    if (boot_image_header == NULL)
-        return 0;
+    if (vtor >= BOOT_SLOT_B_ADDR && vtor < BOOT_SLOT_B_ADDR + BOOT_SLOT_SIZE)
+        return (void *)BOOT_SLOT_B_ADDR;
 
-    if (boot_image_header->image_length == 0)
-        return 0;
+    return (void *)BOOT_SLOT_A_ADDR;
+}
 
-    copy_length = boot_image_header->image_length + 4;
-    result = mflash_drv_write(flash_dst, (const uint8_t *)img, copy_length);
-    if (result < 0)
-    {
-        return result;
-    }
 
-    return copy_length;
+/* Returns the slot updates of the calling application are installed to */
+void *boot_slot_spare(void)
+{
+    if (boot_slot_running() == (void *)BOOT_SLOT_A_ADDR)
+        return (void *)BOOT_SLOT_B_ADDR;
+
+    return (void *)BOOT_SLOT_A_ADDR;
+}
+
+
+/* Returns the slot to boot when there is no update in progress */
+static void *boot_exec_slot(const struct boot_ucb *ucbp)
+{
+    if (boot_slot_check(ucbp->exec_img) == 0)
+        return ucbp->exec_img;
+
+    /* no slot recorded yet, the image was flashed at the default address */
+    return (void *)BOOT_SLOT_A_ADDR;
 }
 
 
@@ -164,48 +207,27 @@ void boot_cpureset(void)
 }
 
 
-/* Schedules update for next reboot by filling in the update control block structure */
-int32_t boot_update_request(void *update_img, void *backup_storage)
+/* Schedules update for next reboot by filling in the update control block structure.
+ * The running image stays intact in its slot and is booted again upon rollback, nothing is copied.
+ */
+int32_t boot_update_request(void *update_img)
 {
     struct boot_ucb ucb;
-    int32_t result;
 
     memset((void *)&ucb, 0xFF, sizeof(ucb));
 
-    /* backup active image to spare area for rollback */
-    if (backup_storage)
-    {
-        result = boot_image_copy(backup_storage, (void *)BOOT_EXEC_IMAGE_ADDR);
-        if (result < 0)
-        {
-            return result;
-        }
-    }
-
     /* prepare and write update control block */
     ucb.signature = BOOT_UCB_SIGNATURE;
     ucb.version = BOOT_UCB_VERSION;
     ucb.state = BOOT_STATE_NEW;
     ucb.update_img = update_img;
-    ucb.rollback_img = backup_storage;
+    ucb.rollback_img = boot_slot_running();
+    ucb.exec_img = ucb.rollback_img;
 
     /* store update control block in FLASH and return */
     return boot_ucb_write(&ucb);
 }
 
-/* Once update image is running and approved, overwrite the rollback image */
-int32_t boot_overwrite_rollback(void)
-{
-    struct boot_ucb ucb;
-    int32_t result = 0;
-
-    if (boot_ucb_read(&ucb) == 0 && ucb.rollback_img != NULL)
-    {
-        result = boot_image_copy(ucb.rollback_img, ucb.update_img);
-    }
-    return result;
-}
-
 /* Executes image at given address */
 void boot_app_exec(const void *addr)
 {
@@ -279,12 +301,13 @@ void boot_wdtdis(void)
 int32_t boot_run(void)
 {
     struct boot_ucb ucb;
-    void *exec_image = (void *)BOOT_EXEC_IMAGE_ADDR;
+    void *exec_image;
 
     PRINTF("\r\nSPIFI bootloader " BOOT_VERSION_STRING "\r\n");
 
     /* load update control block */
     boot_ucb_read(&ucb);
+    exec_image = boot_exec_slot(&ucb);
 
     /* update control block is present, process it */
     switch (ucb.state)
@@ -295,7 +318,7 @@ int32_t boot_run(void)
         break;
 
     case BOOT_STATE_NEW:
-        /* new update image available, flash it and switch to test mode */
+        /* new update image available in the other slot, switch to test mode and execute it in place */
         if (0 != boot_image_validate(ucb.update_img))
         {
             /* the update image is invalid, erase the update control block and execute the current image */
@@ -304,51 +327,26 @@ int32_t boot_run(void)
         }
         else
         {
-            PRINTF(BOOT_PROMPT_STRING "Installing update... ");
-            if (boot_image_copy((void *)BOOT_EXEC_IMAGE_ADDR, ucb.update_img) > 0)
-            {
-                PRINTF("OK\r\n");
-                ucb.state = BOOT_STATE_PENDING_COMMIT;
-            }
-            else
-            {
-                PRINTF("ERROR\r\n");
-                exec_image = NULL; /* the current image might be corrupted */
-                ucb.state = BOOT_STATE_INVALID; /* set state to invalid to got for rollback upon next boot */
-            }
+            PRINTF(BOOT_PROMPT_STRING "Starting update in slot %c\r\n", BOOT_SLOT_NAME(ucb.update_img));
+            ucb.state = BOOT_STATE_PENDING_COMMIT;
         }
         if (boot_ucb_write(&ucb) != 0)
         {
+            /* do not run the update unless the state says it is being tested */
             PRINTF(BOOT_PROMPT_STRING "ERROR writing update control block\r\n");
         }
+        else if (ucb.state == BOOT_STATE_PENDING_COMMIT)
+        {
+            exec_image = ucb.update_img;
+        }
         break;
 
     /* reboot from test mode or image explicitly rejected, rollback */
     case BOOT_STATE_PENDING_COMMIT:
     case BOOT_STATE_INVALID:
-        if (0 != boot_image_validate(ucb.rollback_img))
-        {
-            /* the rollback image is invalid, just try executing the current one as last resort solution */
-            PRINTF(BOOT_PROMPT_STRING "No rollback image, executing the current one... ");
-            ucb.state = BOOT_STATE_VOID;
-        }
-        else
-        {
-            PRINTF(BOOT_PROMPT_STRING "Rolling back to previous image... ");
-            if (boot_image_copy((void *)BOOT_EXEC_IMAGE_ADDR, ucb.rollback_img) > 0)
-            {
-                PRINTF("OK\r\n");
-                ucb.state = BOOT_STATE_VOID;
-            }
-            else
-            {
-                /* flashing failed, set state to invalid to go for rollback upon next boot */
-                PRINTF("ERROR\r\n");
-                exec_image = NULL; /* the current image might be corrupted */
-                ucb.state = BOOT_STATE_VOID; /* as the state is void, next reboot would attempt to execute whatever is there */
-                break;
-            }
-        }
+        /* the previous image was left untouched in its slot, it only needs to be selected again */
+        PRINTF(BOOT_PROMPT_STRING "Rolling back to previous image in slot %c\r\n", BOOT_SLOT_NAME(exec_image));
+        ucb.state = BOOT_STATE_VOID;
         if (boot_ucb_write(&ucb) != 0)
         {
             PRINTF(BOOT_PROMPT_STRING "ERROR writing update control block\r\n");
@@ -370,18 +368,30 @@ int32_t boot_run(void)
         break;
     }
 
+    if (0 != boot_image_validate(exec_image))
+    {
+        /* last resort solution, the other slot may still hold a working image */
+        PRINTF(BOOT_PROMPT_STRING "No valid image in slot %c, trying the other slot\r\n", BOOT_SLOT_NAME(exec_image));
+        exec_image = (exec_image == (void *)BOOT_SLOT_B_ADDR) ? (void *)BOOT_SLOT_A_ADDR : (void *)BOOT_SLOT_B_ADDR;
+    }
+
     DbgConsole_Flush();
 
-    if (exec_image != NULL)
+    if (0 == boot_image_validate(exec_image))
     {
-        PRINTF(BOOT_PROMPT_STRING "About to execute application...\r\n");
-        if (ucb.state == BOOT_STATE_PENDING_COMMIT)
+        PRINTF(BOOT_PROMPT_STRING "About to execute application in slot %c...\r\n", BOOT_SLOT_NAME(exec_image));
+        /* without remapping an update only runs if it was linked for the other slot */
+        PRINTF(BOOT_PROMPT_STRING "Updates must be linked to 0x%08x (slot %c)\r\n",
+               (exec_image == (void *)BOOT_SLOT_A_ADDR) ? BOOT_SLOT_B_ADDR : BOOT_SLOT_A_ADDR,
+               (exec_image == (void *)BOOT_SLOT_A_ADDR) ? 'B' : 'A');
+        if (ucb.state == BOOT_STATE_PENDING_COMMIT && exec_image == ucb.update_img)
         {
             /* enable watchdog */
             PRINTF(BOOT_PROMPT_STRING "Enabling watchdog...\r\n");
             boot_wdten();
         }
-        boot_app_exec((void *)BOOT_EXEC_IMAGE_ADDR);
+        DbgConsole_Flush();
+        boot_app_exec(exec_image);
         PRINTF(BOOT_PROMPT_STRING "Application exec failed.\r\n");
     }
     else
@@ -44,10 +44,16 @@
 /* Adress where XIP image is flashed and executed */
 #define BOOT_EXEC_IMAGE_ADDR (BOOT_FLASH_BASE + BOOT_RESERVED_AREA)
 
+/* Image slots, the application executes in place from either of them. SPIFI has no address remapping so an image
+ * only runs from the slot it was linked for. Slot A is the default one, at the historical exec address. */
+#define BOOT_SLOT_SIZE   (0x200000)
+#define BOOT_SLOT_A_ADDR (BOOT_EXEC_IMAGE_ADDR)
+#define BOOT_SLOT_B_ADDR (BOOT_EXEC_IMAGE_ADDR + BOOT_SLOT_SIZE)
+
 /* Address of update controll block structure */
 #define BOOT_UCB_ADDR (BOOT_FLASH_BASE + BOOT_RESERVED_AREA - MFLASH_SECTOR_SIZE)
 #define BOOT_UCB_SIGNATURE 0x4243552A
-#define BOOT_UCB_VERSION   0x00000010
+#define BOOT_UCB_VERSION   0x00000020
 
 #define BOOT_STATE_UNDEF               0xFFFFFFFF
 #define BOOT_STATE_NEW                 0xFFFFFF00
@@ -66,6 +72,7 @@ struct boot_ucb
   uint32_t update_img_size; /* reserved, not used in the current version */
   void *rollback_img;
   uint32_t rollback_img_size; /* reserved, not used in the current version */
+  void *exec_img; /* slot booted when no update is in progress */
 };
 
 
@@ -104,8 +111,12 @@ extern int32_t boot_ucb_read(struct boot_ucb *ucbp);
 extern int32_t boot_ucb_write(const struct boot_ucb *ucbp);
 extern int32_t boot_ucb_erase(void);
 
-extern int32_t boot_update_request(void *update_img, void *backup_storage);
-extern int32_t boot_overwrite_rollback(void);
+extern uint32_t boot_image_load_address(const void *image, uint32_t size);
+extern int32_t boot_image_validate(const void *addr);
+extern void *boot_slot_running(void);
+extern void *boot_slot_spare(void);
+
+extern int32_t boot_update_request(void *update_img);
 extern void boot_cpureset(void);
 extern void boot_wdtdis(void);
 
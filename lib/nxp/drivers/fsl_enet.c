@@ -66,6 +66,8 @@
 #define ENET_8021QVLAN 0x8100U
 /*! @brief UDP protocol type. */
 #define ENET_UDPVERSION 0x0011U
+/*! @brief TCP protocol type. */
+#define ENET_TCPPROTOCOL 0x0006U
 /*! @brief Packet IP version IPv4. */
 #define ENET_IPV4VERSION 0x0004U
 /*! @brief Packet IP version IPv6. */
@@ -188,12 +190,29 @@ static status_t ENET_RxDescriptorsInit(ENET_Type *base,
                                        bool doubleBuffEnable);
 
 /*!
- * @brief Set ENET get transmit ring descriptors.
+ * @brief Gets the transmit ring of a frame from the traffic classes.
  *
  * @param data The ENET data to be transfered.
+ * @param trafficClass The traffic classes sent on the ring 1.
+ * @return 1 if the frame matches a traffic class, 0 otherwise.
+ */
+static uint8_t ENET_GetTrafficClassRingId(uint8_t *data, const enet_traffic_class_config_t *trafficClass);
+
+/*!
+ * @brief Gets the checksum status of a frame from its last rx descriptor.
+ *
+ * @param rxDesc The last rx descriptor of the frame, in write back format.
+ */
+static enet_rx_checksum_status_t ENET_GetRxChecksumStatus(enet_rx_bd_struct_t *rxDesc);
+
+/*!
+ * @brief Gets the interrupt on completion flag of a rx descriptor given back to the DMA.
+ *
  * @param handle ENET handler.
+ * @param rxBdRing The rx descriptor ring.
+ * @param rxDesc The rx descriptor.
  */
-static uint8_t ENET_GetTxRingId(uint8_t *data, enet_handle_t *handle);
+static bool ENET_GetRxDescIntEnable(enet_handle_t *handle, enet_rx_bd_ring_t *rxBdRing, enet_rx_bd_struct_t *rxDesc);
 
 #ifdef ENET_PTP1588FEATURE_REQUIRED
 /*!
@@ -328,6 +347,20 @@ static void ENET_SetDMAControl(ENET_Type *base, const enet_config_t *config)
         reg = base->DMA_CH[index].DMA_CHX_RX_CTRL & ~ENET_DMA_CH_DMA_CHX_RX_CTRL_RxPBL_MASK;
         base->DMA_CH[index].DMA_CHX_RX_CTRL = reg | ENET_DMA_CH_DMA_CHX_RX_CTRL_RxPBL(burstLen & 0x3F);
     }
+
+    /* Set the transmit arbitration between the channels. */
+    if (config->multiqueueCfg)
+    {
+        reg            = base->DMA_MODE & ~ENET_DMA_MODE_TAA_MASK;
+        base->DMA_MODE = reg | ENET_DMA_MODE_TAA(config->multiqueueCfg->dmaTxSche);
+
+        for (index = 0; index < ENET_RING_NUM_MAX; index++)
+        {
+            reg = base->DMA_CH[index].DMA_CHX_TX_CTRL & ~ENET_DMA_CH_DMA_CHX_TX_CTRL_TCW_MASK;
+            base->DMA_CH[index].DMA_CHX_TX_CTRL =
+                reg | ENET_DMA_CH_DMA_CHX_TX_CTRL_TCW(config->multiqueueCfg->txdmaChnWeight[index]);
+        }
+    }
 }
 
 static void ENET_SetMTL(ENET_Type *base, const enet_config_t *config)
@@ -345,6 +378,15 @@ static void ENET_SetMTL(ENET_Type *base, const enet_config_t *config)
         txqOpreg = ENET_MTL_QUEUE_MTL_TXQX_OP_MODE_TSF_MASK;
         rxqOpReg = ENET_MTL_QUEUE_MTL_RXQX_OP_MODE_RSF_MASK;
     }
+    else if (config->specialControl & kENET_TxChecksumOffloadEnable)
+    {
+        /* The checksums are inserted once the whole frame is in the tx FIFO. */
+        txqOpreg = ENET_MTL_QUEUE_MTL_TXQX_OP_MODE_TSF_MASK;
+    }
+    else
+    {
+        /* Add for avoid the misra 2004 rule 14.10 */
+    }
     txqOpreg |= ENET_MTL_QUEUE_MTL_TXQX_OP_MODE_FTQ_MASK |
                 ENET_MTL_QUEUE_MTL_TXQX_OP_MODE_TQS(ENET_MTL_TXFIFOSIZE / ENET_FIFOSIZE_UNIT - 1);
     base->MTL_QUEUE[0].MTL_TXQX_OP_MODE = txqOpreg | ENET_MTL_QUEUE_MTL_TXQX_OP_MODE_TXQEN(2);
@@ -379,6 +421,7 @@ static void ENET_SetMacControl(ENET_Type *base, const enet_config_t *config, uin
     assert(config);
 
     uint32_t reg = 0;
+    enet_multiqueue_config_t *multiqCfg;
 
     /* Set Macaddr */
     /* The dma channel 0 is set as to which the rx packet
@@ -408,7 +451,8 @@ static void ENET_SetMacControl(ENET_Type *base, const enet_config_t *config, uin
     /* Set the speed and duplex. */
     reg = ENET_MAC_CONFIG_ECRSFD_MASK | ENET_MAC_CONFIG_PS_MASK | ENET_MAC_CONFIG_DM(config->miiDuplex) |
           ENET_MAC_CONFIG_FES(config->miiSpeed) |
-          ENET_MAC_CONFIG_S2KP(!!(config->specialControl & kENET_8023AS2KPacket));
+          ENET_MAC_CONFIG_S2KP(!!(config->specialControl & kENET_8023AS2KPacket)) |
+          ENET_MAC_CONFIG_IPC(!!(config->specialControl & kENET_RxChecksumOffloadEnable));
     if (config->miiDuplex == kENET_MiiHalfDuplex)
     {
         reg |= ENET_MAC_CONFIG_IPG(ENET_HALFDUPLEX_DEFAULTIPG);
@@ -417,6 +461,22 @@ static void ENET_SetMacControl(ENET_Type *base, const enet_config_t *config, uin
 
     /* Enable channel. */
     base->MAC_RXQ_CTRL[0] = ENET_MAC_RXQ_CTRL_RXQ0EN(1) | ENET_MAC_RXQ_CTRL_RXQ1EN(1);
+
+    /* Set the queues of the VLAN priorities and of the PTP frames. */
+    if (config->multiqueueCfg)
+    {
+        multiqCfg             = config->multiqueueCfg;
+        base->MAC_RXQ_CTRL[2] = ENET_MAC_RXQ_CTRL_PSRQ0(multiqCfg->rxqueuePrio[0]) |
+                                ENET_MAC_RXQ_CTRL_PSRQ1(multiqCfg->rxqueuePrio[1]);
+        base->MAC_TXQ_PRIO_MAP = ENET_MAC_TXQ_PRIO_MAP_PSTQ0(multiqCfg->txqueuePrio[0]) |
+                                 ENET_MAC_TXQ_PRIO_MAP_PSTQ1(multiqCfg->txqueuePrio[1]);
+        if (multiqCfg->trafficClass)
+        {
+            /* The queue 1 receives generic traffic, not only AVB frames. */
+            base->MAC_RXQ_CTRL[0] = ENET_MAC_RXQ_CTRL_RXQ0EN(1) | ENET_MAC_RXQ_CTRL_RXQ1EN(2);
+            base->MAC_RXQ_CTRL[1] = ENET_MAC_RXQ_CTRL_AVPTPQ(multiqCfg->trafficClass->ptpEnable ? 1U : 0U);
+        }
+    }
 }
 
 static status_t ENET_TxDescriptorsInit(ENET_Type *base,
@@ -536,26 +596,93 @@ static status_t ENET_RxDescriptorsInit(
     return kStatus_Success;
 }
 
-static uint8_t ENET_GetTxRingId(uint8_t *data, enet_handle_t *handle)
+static bool ENET_GetRxDescIntEnable(enet_handle_t *handle, enet_rx_bd_ring_t *rxBdRing, enet_rx_bd_struct_t *rxDesc)
 {
-    /* Defuault use the queue/ring 0. */
-    uint8_t ringId = 0;
+    uint32_t index = rxDesc - rxBdRing->rxBdBase;
 
-    if (handle->multiQueEnable)
+    if ((!handle->rxintEnable) || (rxBdRing->rxIntFrameCount <= 1U))
     {
-        /* Parse the frame and choose the queue id for different avb frames
-         *  AVB Class frame in queue 1.
-         *  non-AVB frame in queue 0.
-         */
-        if ((*(uint16_t *)(data + ENET_HEAD_TYPE_OFFSET) == ENET_HTONS(ENET_8021QVLAN)) &&
-            ((*(uint16_t *)(data + ENET_HEAD_AVBTYPE_OFFSET)) == ENET_HTONS(ENET_AVBTYPE)))
+        return handle->rxintEnable;
+    }
+
+    /* Interrupt on the last descriptor of each group of rxIntFrameCount, the rx watchdog covers the others. */
+    return ((index + 1U) % rxBdRing->rxIntFrameCount) == 0U;
+}
+
+static enet_rx_checksum_status_t ENET_GetRxChecksumStatus(enet_rx_bd_struct_t *rxDesc)
+{
+    /* The extended status of the checksum offload engine is in the second word of the write back. */
+    uint32_t extStatus = rxDesc->reserved;
+
+    if ((!(rxDesc->control & ENET_RXDESCRIP_WR_RS1V_MASK)) || (!(extStatus & ENET_RXDESCRIP_WR_IPV4_MASK)) ||
+        (extStatus & ENET_RXDESCRIP_WR_IPCB_MASK))
+    {
+        return kENET_RxChecksumNone;
+    }
+
+    if (extStatus & ENET_RXDESCRIP_WR_ERR_MASK)
+    {
+        return kENET_RxChecksumError;
+    }
+
+    /* Only the IPv4 header is checked for payloads other than TCP, UDP and ICMP. */
+    return (extStatus & ENET_RXDESCRIP_WR_PYLOAD_MASK) ? kENET_RxChecksumOk : kENET_RxChecksumNone;
+}
+
+static uint8_t ENET_GetTrafficClassRingId(uint8_t *data, const enet_traffic_class_config_t *trafficClass)
+{
+    uint8_t *payload = data + ENET_HEAD_TYPE_OFFSET + 2U;
+    uint16_t type    = ENET_NTOHS(*(uint16_t *)(data + ENET_HEAD_TYPE_OFFSET));
+    uint32_t ipHeaderLen;
+    uint16_t srcPort;
+    uint16_t dstPort;
+    uint8_t dscp;
+    uint8_t index;
+
+    if (type == ENET_8021QVLAN)
+    {
+        /* The priority is the 3 msb of the tag control information. */
+        if (trafficClass->vlanPrioMask & (1U << (payload[0] >> 5U)))
         {
-            /* AVBTP stream data frame. */
-            ringId = 1;
+            return 1;
         }
+        type = ENET_NTOHS(*(uint16_t *)(payload + 2U));
+        payload += ENET_FRAME_VLAN_TAGLEN;
     }
 
-    return ringId;
+    if (type == ENET_ETHERNETL2)
+    {
+        return trafficClass->ptpEnable ? 1 : 0;
+    }
+    if (type != ENET_IPV4)
+    {
+        return 0;
+    }
+
+    /* The DSCP is the 6 msb of the second byte of the IPv4 header. */
+    dscp = payload[1] >> 2U;
+    if (trafficClass->dscpMask[dscp >> 5U] & (1UL << (dscp & 0x1FU)))
+    {
+        return 1;
+    }
+
+    /* The ports are in the first fragment only. */
+    if (((payload[9] != ENET_TCPPROTOCOL) && (payload[9] != ENET_UDPVERSION)) || (payload[6] & 0x1FU) || payload[7])
+    {
+        return 0;
+    }
+    ipHeaderLen = (payload[0] & 0x0FU) << 2U;
+    srcPort     = ((uint16_t)payload[ipHeaderLen] << 8U) | payload[ipHeaderLen + 1U];
+    dstPort     = ((uint16_t)payload[ipHeaderLen + 2U] << 8U) | payload[ipHeaderLen + 3U];
+    for (index = 0; index < trafficClass->portNum; index++)
+    {
+        if ((trafficClass->ports[index] == srcPort) || (trafficClass->ports[index] == dstPort))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
 }
 
 #ifdef ENET_PTP1588FEATURE_REQUIRED
@@ -1153,6 +1280,61 @@ void ENET_DisableInterrupts(ENET_Type *base, uint32_t mask)
     }
 }
 
+/*!
+ * brief Sets the rx interrupt coalescing of a DMA channel.
+ *
+ * The rx interrupt is raised once every "frameCount" descriptors instead of on each frame, and by the
+ * rx interrupt watchdog "timeout_us" after the last frame received without interrupt, so that the end of
+ * a burst is not delayed further. The timeout is limited to 255 * 256 core clock cycles.
+ * Call it after ENET_CreateHandler() and before ENET_StartRxTx().
+ *
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler pointer.
+ * param channel The rx DMA channel.
+ * param frameCount Descriptors per rx interrupt, 1 raises the interrupt on each frame.
+ * param timeout_us Rx interrupt watchdog timeout in microseconds, 0 disables the watchdog. Shall not be
+ *        0 if frameCount is larger than 1.
+ */
+void ENET_SetRxInterruptCoalescing(
+    ENET_Type *base, enet_handle_t *handle, uint8_t channel, uint16_t frameCount, uint32_t timeout_us)
+{
+    assert(handle);
+    assert(frameCount);
+    assert((frameCount == 1U) || timeout_us);
+
+    enet_rx_bd_ring_t *rxBdRing = (enet_rx_bd_ring_t *)&handle->rxBdRing[channel];
+    enet_rx_bd_struct_t *rxDesc;
+    uint32_t riwt = 0;
+    uint16_t index;
+
+    /* The watchdog counts units of 256 core clock cycles. */
+    if (timeout_us)
+    {
+        riwt = ((CLOCK_GetCoreSysClkFreq() / ENET_MICRSECS_ONESECOND) * timeout_us + 255U) / 256U;
+        if (riwt > ENET_DMA_CH_DMA_CHX_RX_INT_WDTIMER_RIWT_MASK)
+        {
+            riwt = ENET_DMA_CH_DMA_CHX_RX_INT_WDTIMER_RIWT_MASK;
+        }
+    }
+    base->DMA_CH[channel].DMA_CHX_RX_INT_WDTIMER = ENET_DMA_CH_DMA_CHX_RX_INT_WDTIMER_RIWT(riwt);
+
+    rxBdRing->rxIntFrameCount = frameCount;
+
+    /* The DMA is not started, update the interrupt flag of the descriptors initialized by ENET_DescriptorInit(). */
+    for (index = 0; index < rxBdRing->rxRingLen; index++)
+    {
+        rxDesc = rxBdRing->rxBdBase + index;
+        if (ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc))
+        {
+            rxDesc->control |= ENET_RXDESCRIP_RD_IOC_MASK;
+        }
+        else
+        {
+            rxDesc->control &= ~ENET_RXDESCRIP_RD_IOC_MASK;
+        }
+    }
+}
+
 /*!
  * brief Create ENET Handler
  *
@@ -1207,6 +1389,11 @@ void ENET_CreateHandler(ENET_Type *base,
     if (config->multiqueueCfg)
     {
         handle->multiQueEnable = true;
+        handle->trafficClass   = config->multiqueueCfg->trafficClass;
+    }
+    if (config->specialControl & kENET_TxChecksumOffloadEnable)
+    {
+        handle->txOffloadOps = kENET_TxOffloadAll;
     }
     for (count = 0; count < ringNum; count++)
     {
@@ -1220,6 +1407,14 @@ void ENET_CreateHandler(ENET_Type *base,
         handle->txBdRing[count].txGenIdx    = 0;
         handle->txBdRing[count].txConsumIdx = 0;
         handle->txBdRing[count].txDescUsed  = 0;
+
+        handle->rxBdRing[count].rxBuffers       = buffConfig->rxBufferStartAddr;
+        handle->rxBdRing[count].rxIntFrameCount = 1;
+        handle->txBdRing[count].txFrameContext = buffConfig->txFrameContextAddr;
+        if (buffConfig->txFrameContextAddr)
+        {
+            memset(buffConfig->txFrameContextAddr, 0, buffConfig->txRingLen * sizeof(void *));
+        }
 #ifdef ENET_PTP1588FEATURE_REQUIRED
         assert(bufferConfig->rxPtpTsData);
         assert(bufferConfig->txPtpTsData);
@@ -1529,7 +1724,8 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
             rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
             control            = rxDesc->control;
             /* Updates the receive buffer descriptors. */
-            ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+            ENET_UpdateRxDescriptor(rxDesc, NULL, NULL,
+                                    ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc), handle->doubleBuffEnable);
 
             /* Find the last buffer descriptor for the frame. */
             if (control & ENET_RXDESCRIP_WR_LD_MASK)
@@ -1542,14 +1738,16 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                     if (!handle->doubleBuffEnable)
                     {
                         buffer = handle->rxbuffers[rxBdRing->rxGenIdx];
-                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, NULL, handle->rxintEnable,
+                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, NULL,
+                                                ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc),
                                                 handle->doubleBuffEnable);
                     }
                     else
                     {
                         buffer    = handle->rxbuffers[2 * rxBdRing->rxGenIdx];
                         bufferAdd = handle->rxbuffers[2 * rxBdRing->rxGenIdx + 1];
-                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, (void *)bufferAdd, handle->rxintEnable,
+                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, (void *)bufferAdd,
+                                                ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc),
                                                 handle->doubleBuffEnable);
                     }
                     rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
@@ -1602,7 +1800,8 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                 }
 
                 /* Updates the receive buffer descriptors. */
-                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL,
+                                        ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc), handle->doubleBuffEnable);
 #ifdef ENET_PTP1588FEATURE_REQUIRED
                 /* Store the rx timestamp which is in the next buffer descriptor of the last
                  * descriptor of a frame. */
@@ -1619,14 +1818,16 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                     if (!handle->doubleBuffEnable)
                     {
                         buffer = handle->rxbuffers[rxBdRing->rxGenIdx];
-                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, NULL, handle->rxintEnable,
+                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, NULL,
+                                                ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc),
                                                 handle->doubleBuffEnable);
                     }
                     else
                     {
                         buffer    = handle->rxbuffers[2 * rxBdRing->rxGenIdx];
                         bufferAdd = handle->rxbuffers[2 * rxBdRing->rxGenIdx + 1];
-                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, (void *)bufferAdd, handle->rxintEnable,
+                        ENET_UpdateRxDescriptor(rxDesc, (void *)buffer, (void *)bufferAdd,
+                                                ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc),
                                                 handle->doubleBuffEnable);
                     }
                     rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
@@ -1642,7 +1843,9 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                 if (offset >= length)
                 {
                     /* Updates the receive buffer descriptors. */
-                    ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+                    ENET_UpdateRxDescriptor(rxDesc, NULL, NULL,
+                                            ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc),
+                                            handle->doubleBuffEnable);
                     break;
                 }
 
@@ -1655,7 +1858,8 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
                 }
 
                 /* Updates the receive buffer descriptors. */
-                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL, handle->rxintEnable, handle->doubleBuffEnable);
+                ENET_UpdateRxDescriptor(rxDesc, NULL, NULL,
+                                        ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc), handle->doubleBuffEnable);
             }
         }
     }
@@ -1669,6 +1873,175 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     return result;
 }
 
+/*!
+ * brief Receives a frame without copy, by swapping the buffer of its descriptor.
+ *
+ * The buffer holding the frame is handed over to the caller and replaced in the descriptor by a new
+ * one, which must be at least rxBuffSizeAlign bytes and 2 bytes aligned. Call it after ENET_GetRxFrameSize()
+ * returned kStatus_Success. A frame spanning several descriptors cannot be handed over, it is left in the
+ * ring and shall be read with ENET_ReadFrame(). The double buffer mode is not supported.
+ *
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler structure. This is the same handler pointer used in the ENET_Init.
+ * param newBuffer The buffer given to the descriptor in place of the received one.
+ * param buffer The buffer holding the received frame, owned by the caller on return.
+ * param channel The rx DMA channel. shall not be larger than 2.
+ * retval kStatus_Success  The frame is handed over in "buffer".
+ * retval kStatus_InvalidArgument  The frame spans several descriptors or has an error, nothing is changed.
+ */
+status_t ENET_ReadFrameZeroCopy(ENET_Type *base, enet_handle_t *handle, void *newBuffer, void **buffer, uint8_t channel)
+{
+    assert(handle);
+    assert(newBuffer);
+    assert(buffer);
+    assert(!handle->doubleBuffEnable);
+    assert(!((uint32_t)newBuffer & ENET_RXBUFF_ZEROCOPY_ALIGNMENT));
+
+    enet_rx_bd_ring_t *rxBdRing = (enet_rx_bd_ring_t *)&handle->rxBdRing[channel];
+    enet_rx_bd_struct_t *rxDesc = rxBdRing->rxBdBase + rxBdRing->rxGenIdx;
+    uint32_t control            = rxDesc->control;
+    bool suspend                = false;
+
+#ifdef ENET_PTP1588FEATURE_REQUIRED
+    /* The context descriptor following a frame is not handled, frames are read with ENET_ReadFrame(). */
+    control = ENET_RXDESCRIP_WR_OWN_MASK;
+#endif /* ENET_PTP1588FEATURE_REQUIRED */
+
+    /* Only an error free frame held in a single descriptor can be handed over. */
+    if ((control & ENET_RXDESCRIP_WR_OWN_MASK) || (!(control & ENET_RXDESCRIP_WR_FD_MASK)) ||
+        (!(control & ENET_RXDESCRIP_WR_LD_MASK)) || (control & ENET_RXDESCRIP_WR_ERRSUM_MASK))
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    /* Suspend and command for rx. */
+    if (base->DMA_CH[channel].DMA_CHX_STAT & ENET_DMA_CH_DMA_CHX_STAT_RBU_MASK)
+    {
+        suspend = true;
+    }
+
+    /* Hand over the buffer recorded in the ring, the descriptor address is not kept by the write back. */
+    *buffer                                 = (void *)rxBdRing->rxBuffers[rxBdRing->rxGenIdx];
+    rxBdRing->rxBuffers[rxBdRing->rxGenIdx] = (uint32_t)newBuffer;
+
+    /* Updates the receive buffer descriptor with the new buffer. */
+    ENET_UpdateRxDescriptor(rxDesc, newBuffer, NULL, ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc), false);
+    rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
+
+    /* Set command for rx when it is suspend. */
+    if (suspend)
+    {
+        base->DMA_CH[channel].DMA_CHX_RXDESC_TAIL_PTR = base->DMA_CH[channel].DMA_CHX_RXDESC_TAIL_PTR;
+    }
+
+    return kStatus_Success;
+}
+
+/*!
+ * brief Reads the frames received, in one pass over the ready descriptors.
+ *
+ * The callback is called for each frame with the buffer of its descriptor, which is given back to
+ * the DMA with the buffer returned by the callback. Frames with an error are given back without
+ * calling the callback. The pass stops at a frame spanning several descriptors, which shall be read
+ * with ENET_GetRxFrameSize() and ENET_ReadFrame(). The double buffer mode is not supported, and with
+ * the PTP 1588 feature all the frames are read with ENET_ReadFrame().
+ *
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler structure. This is the same handler pointer used in the ENET_Init.
+ * param callback The receive frame callback.
+ * param userData Passed to the callback.
+ * param frameCount In: the most descriptors to read. Out: the frames passed to the callback.
+ * param channel The rx DMA channel. shall not be larger than 2.
+ * retval kStatus_Success  "frameCount" descriptors were read, more frames may be ready.
+ * retval kStatus_ENET_RxFrameEmpty  All the frames received were read.
+ * retval kStatus_InvalidArgument  The next frame spans several descriptors.
+ */
+status_t ENET_ReadFrames(ENET_Type *base,
+                         enet_handle_t *handle,
+                         enet_rx_frame_callback_t callback,
+                         void *userData,
+                         uint32_t *frameCount,
+                         uint8_t channel)
+{
+    assert(handle);
+    assert(callback);
+    assert(frameCount);
+    assert(!handle->doubleBuffEnable);
+
+    enet_rx_bd_ring_t *rxBdRing = (enet_rx_bd_ring_t *)&handle->rxBdRing[channel];
+    enet_rx_bd_struct_t *rxDesc;
+    uint32_t maxCount = *frameCount;
+    uint32_t count    = 0;
+    uint32_t control;
+    void *buffer;
+    void *newBuffer;
+    status_t result = kStatus_Success;
+    bool suspend    = false;
+
+    *frameCount = 0;
+
+    /* Suspend and command for rx. */
+    if (base->DMA_CH[channel].DMA_CHX_STAT & ENET_DMA_CH_DMA_CHX_STAT_RBU_MASK)
+    {
+        suspend = true;
+    }
+
+    while (count < maxCount)
+    {
+        rxDesc  = rxBdRing->rxBdBase + rxBdRing->rxGenIdx;
+        control = rxDesc->control;
+
+        if (control & ENET_RXDESCRIP_WR_OWN_MASK)
+        {
+            result = kStatus_ENET_RxFrameEmpty;
+            break;
+        }
+
+#ifdef ENET_PTP1588FEATURE_REQUIRED
+        /* The context descriptor following a frame is not handled, frames are read with ENET_ReadFrame(). */
+        control &= ~ENET_RXDESCRIP_WR_FD_MASK;
+#endif /* ENET_PTP1588FEATURE_REQUIRED */
+        if ((!(control & ENET_RXDESCRIP_WR_FD_MASK)) || (!(control & ENET_RXDESCRIP_WR_LD_MASK)))
+        {
+            result = kStatus_InvalidArgument;
+            break;
+        }
+
+        /* The buffer address of the descriptor is not kept by the write back. */
+        buffer    = (void *)rxBdRing->rxBuffers[rxBdRing->rxGenIdx];
+        newBuffer = NULL;
+        if (!(control & ENET_RXDESCRIP_WR_ERRSUM_MASK))
+        {
+            newBuffer = callback(base, handle, (uint8_t *)buffer, control & ENET_RXDESCRIP_WR_PACKETLEN_MASK,
+                                 ENET_GetRxChecksumStatus(rxDesc), channel, userData);
+            (*frameCount)++;
+        }
+
+        if (newBuffer)
+        {
+            assert(!((uint32_t)newBuffer & ENET_RXBUFF_ZEROCOPY_ALIGNMENT));
+            rxBdRing->rxBuffers[rxBdRing->rxGenIdx] = (uint32_t)newBuffer;
+        }
+        else
+        {
+            newBuffer = buffer;
+        }
+
+        /* Updates the receive buffer descriptor. */
+        ENET_UpdateRxDescriptor(rxDesc, newBuffer, NULL, ENET_GetRxDescIntEnable(handle, rxBdRing, rxDesc), false);
+        rxBdRing->rxGenIdx = ENET_IncreaseIndex(rxBdRing->rxGenIdx, rxBdRing->rxRingLen);
+        count++;
+    }
+
+    /* Set command for rx when it is suspend, once for all the descriptors given back. */
+    if (suspend)
+    {
+        base->DMA_CH[channel].DMA_CHX_RXDESC_TAIL_PTR = base->DMA_CH[channel].DMA_CHX_RXDESC_TAIL_PTR;
+    }
+
+    return result;
+}
+
 /*!
  * brief Updates the buffers and the own status for a given rx descriptor.
  *  This function is a low level functional API to Updates the
@@ -1732,6 +2105,7 @@ void ENET_UpdateRxDescriptor(
  * param tsEnable The timestamp enable.
  * param flag The flag of this tx desciriptor, see "enet_desc_flag" .
  * param slotNum The slot num used for AV  only.
+ * param txOffloadOps The checksum insertion, ignored for frames other than IPv4, see "enet_tx_offload_t".
  *
  * note This must be called after all the ENET initilization.
  * And should be called when the ENET receive/transmit is required.
@@ -1748,7 +2122,8 @@ void ENET_SetupTxDescriptor(enet_tx_bd_struct_t *txDesc,
                             bool intEnable,
                             bool tsEnable,
                             enet_desc_flag flag,
-                            uint8_t slotNum)
+                            uint8_t slotNum,
+                            enet_tx_offload_t txOffloadOps)
 {
     uint32_t control = ENET_TXDESCRIP_RD_BL1(bytes1) | ENET_TXDESCRIP_RD_BL2(bytes2);
 
@@ -1775,7 +2150,8 @@ void ENET_SetupTxDescriptor(enet_tx_bd_struct_t *txDesc,
     txDesc->buff2Addr = (uint32_t)buffer2;
     txDesc->buffLen   = control;
 
-    control = ENET_TXDESCRIP_RD_FL(framelen) | ENET_TXDESCRIP_RD_LDFD(flag) | ENET_TXDESCRIP_RD_OWN_MASK;
+    control = ENET_TXDESCRIP_RD_FL(framelen) | ENET_TXDESCRIP_RD_LDFD(flag) | ENET_TXDESCRIP_RD_CIC(txOffloadOps) |
+              ENET_TXDESCRIP_RD_OWN_MASK;
 
     txDesc->controlStat = control;
 }
@@ -1796,6 +2172,7 @@ void ENET_ReclaimTxDescriptor(ENET_Type *base, enet_handle_t *handle, uint8_t ch
 {
     enet_tx_bd_ring_t *txBdRing = &handle->txBdRing[channel];
     enet_tx_bd_struct_t *txDesc = txBdRing->txBdBase + txBdRing->txConsumIdx;
+    void *context;
 
     /* Need to update the first index for transmit buffer free. */
     while ((txBdRing->txDescUsed > 0) && (!(txDesc->controlStat & ENET_TXDESCRIP_RD_OWN_MASK)))
@@ -1827,7 +2204,20 @@ void ENET_ReclaimTxDescriptor(ENET_Type *base, enet_handle_t *handle, uint8_t ch
 
         /* For tx buffer free or requeue for each descriptor.
          * The tx interrupt callback should free/requeue the tx buffer. */
-        if (handle->callback)
+        if (handle->txReclaimCallback)
+        {
+            context = NULL;
+            if (txBdRing->txFrameContext)
+            {
+                context                                         = txBdRing->txFrameContext[txBdRing->txConsumIdx];
+                txBdRing->txFrameContext[txBdRing->txConsumIdx] = NULL;
+            }
+            if (context)
+            {
+                handle->txReclaimCallback(base, handle, channel, context, handle->userData);
+            }
+        }
+        else if (handle->callback)
         {
             handle->callback(base, handle, kENET_TxIntEvent, channel, handle->userData);
         }
@@ -1840,6 +2230,49 @@ void ENET_ReclaimTxDescriptor(ENET_Type *base, enet_handle_t *handle, uint8_t ch
     }
 }
 
+/*!
+ * brief Gets the transmit ring of a frame.
+ *
+ * With multi-queue, AVB frames and the frames matching the traffic classes of the multi-queue
+ * configuration are sent on the ring 1. Otherwise, all the frames are sent on the ring 0.
+ *
+ * param data The frame to be sent.
+ * param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * return The ring, that is the tx DMA channel, ENET_SendFrame() sends the frame on.
+ */
+uint8_t ENET_GetTxRingId(uint8_t *data, enet_handle_t *handle)
+{
+    assert(data);
+    assert(handle);
+
+    /* Defuault use the queue/ring 0. */
+    uint8_t ringId = 0;
+
+    if (handle->multiQueEnable)
+    {
+        /* Parse the frame and choose the queue id for different avb frames
+         *  AVB Class frame in queue 1.
+         *  non-AVB frame in queue 0.
+         */
+        if ((*(uint16_t *)(data + ENET_HEAD_TYPE_OFFSET) == ENET_HTONS(ENET_8021QVLAN)) &&
+            ((*(uint16_t *)(data + ENET_HEAD_AVBTYPE_OFFSET)) == ENET_HTONS(ENET_AVBTYPE)))
+        {
+            /* AVBTP stream data frame. */
+            ringId = 1;
+        }
+        else if (handle->trafficClass)
+        {
+            ringId = ENET_GetTrafficClassRingId(data, handle->trafficClass);
+        }
+        else
+        {
+            /* Add for avoid the misra 2004 rule 14.10 */
+        }
+    }
+
+    return ringId;
+}
+
 /*!
  * brief Transmits an ENET frame.
  * note The CRC is automatically appended to the data. Input the data
@@ -1856,6 +2289,26 @@ void ENET_ReclaimTxDescriptor(ENET_Type *base, enet_handle_t *handle, uint8_t ch
  *         kStatus_ENET_TxFrameBusy.
  */
 status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length)
+{
+    return ENET_SendFrameZeroCopy(base, handle, data, length, NULL);
+}
+
+/*!
+ * brief Transmits an ENET frame from a buffer owned by the driver until the frame is sent.
+ *
+ * The descriptor points to the data, which must stay untouched until the transmit reclaim callback
+ * set with ENET_SetTxReclaimCallback() is called with the context. The buffer context array of the ring
+ * must be given in txFrameContextAddr of the buffer configuration.
+ *
+ * param base  ENET peripheral base address.
+ * param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * param data The data buffer to be send.
+ * param length The length of the data to be send.
+ * param context Passed to the transmit reclaim callback, e.g. the buffer to free.
+ * retval kStatus_Success  Send frame succeed.
+ * retval kStatus_ENET_TxFrameBusy  Transmit buffer descriptor is busy under transmission.
+ */
+status_t ENET_SendFrameZeroCopy(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length, void *context)
 {
     assert(handle);
     assert(data);
@@ -1890,12 +2343,20 @@ status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
     /* Fill the descriptor. */
     if (length <= ENET_TXDESCRIP_RD_BL1_MASK)
     {
-        ENET_SetupTxDescriptor(txDesc, data, length, NULL, 0, length, true, ptp1588, kENET_FirstLastFlag, 0);
+        ENET_SetupTxDescriptor(txDesc, data, length, NULL, 0, length, true, ptp1588, kENET_FirstLastFlag, 0,
+                               handle->txOffloadOps);
     }
     else
     {
         ENET_SetupTxDescriptor(txDesc, data, ENET_TXDESCRIP_RD_BL1_MASK, data + ENET_TXDESCRIP_RD_BL1_MASK,
-                               (length - ENET_TXDESCRIP_RD_BL1_MASK), length, true, ptp1588, kENET_FirstLastFlag, 0);
+                               (length - ENET_TXDESCRIP_RD_BL1_MASK), length, true, ptp1588, kENET_FirstLastFlag, 0,
+                               handle->txOffloadOps);
+    }
+
+    /* Store the context for the reclaim. */
+    if (txBdRing->txFrameContext)
+    {
+        txBdRing->txFrameContext[txBdRing->txGenIdx] = context;
     }
 
     /* Increase the index. */
@@ -2094,7 +2555,18 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
         if (flag & ENET_DMA_CH_DMA_CHX_STAT_TI_MASK)
         {
             base->DMA_CH[0].DMA_CHX_STAT = ENET_DMA_CH_DMA_CHX_STAT_TI_MASK | ENET_DMA_CH_DMA_CHX_STAT_NIS_MASK;
-            ENET_ReclaimTxDescriptor(base, handle, 0);
+            if (handle->txReclaimCallback)
+            {
+                /* Zero copy transmit, the descriptors are reclaimed by the application out of the interrupt. */
+                if (handle->callback)
+                {
+                    handle->callback(base, handle, kENET_TxIntEvent, 0, handle->userData);
+                }
+            }
+            else
+            {
+                ENET_ReclaimTxDescriptor(base, handle, 0);
+            }
         }
     }
 
@@ -2113,7 +2585,18 @@ void ENET_IRQHandler(ENET_Type *base, enet_handle_t *handle)
         if (flag & ENET_DMA_CH_DMA_CHX_STAT_TI_MASK)
         {
             base->DMA_CH[1].DMA_CHX_STAT = ENET_DMA_CH_DMA_CHX_STAT_TI_MASK | ENET_DMA_CH_DMA_CHX_STAT_NIS_MASK;
-            ENET_ReclaimTxDescriptor(base, handle, 1);
+            if (handle->txReclaimCallback)
+            {
+                /* Zero copy transmit, the descriptors are reclaimed by the application out of the interrupt. */
+                if (handle->callback)
+                {
+                    handle->callback(base, handle, kENET_TxIntEvent, 1, handle->userData);
+                }
+            }
+            else
+            {
+                ENET_ReclaimTxDescriptor(base, handle, 1);
+            }
         }
     }
 
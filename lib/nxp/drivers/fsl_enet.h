@@ -36,6 +36,9 @@
 /*! @brief Defines for write back format. */
 #define ENET_RXDESCRIP_WR_ERR_MASK        ((1U << 3) | (1U << 7))
 #define ENET_RXDESCRIP_WR_PYLOAD_MASK     (0x7U)
+#define ENET_RXDESCRIP_WR_IPV4_MASK       (1U << 4)
+#define ENET_RXDESCRIP_WR_IPV6_MASK       (1U << 5)
+#define ENET_RXDESCRIP_WR_IPCB_MASK       (1U << 6)
 #define ENET_RXDESCRIP_WR_PTPMSGTYPE_MASK (0xF00U)
 #define ENET_RXDESCRIP_WR_PTPTYPE_MASK    (1U << 12)
 #define ENET_RXDESCRIP_WR_PTPVERSION_MASK (1U << 13)
@@ -99,6 +102,8 @@
 #define ENET_FRAME_MAX_FRAMELEN (1518U) /*!< Default maximum Ethernet frame size. */
 #define ENET_ADDR_ALIGNMENT     (0x3U)  /*!< Recommended ethernet buffer alignment. */
 #define ENET_BUFF_ALIGNMENT     (4U)    /*!< Receive buffer alignment shall be 4bytes-aligned. */
+#define ENET_RXBUFF_ZEROCOPY_ALIGNMENT (0x1U) /*!< Zero copy rx buffers may start 2 bytes past a word boundary,
+                                                   which aligns the IP header of the frame. */
 #define ENET_RING_NUM_MAX       (2U)    /*!< The Maximum number of tx/rx descriptor rings. */
 #define ENET_MTL_RXFIFOSIZE     (2048U) /*!< The rx fifo size. */
 #define ENET_MTL_TXFIFOSIZE     (2048U) /*!< The tx fifo size. */
@@ -182,6 +187,23 @@ typedef enum _enet_desc_flag
     kENET_FirstLastFlag   /*!< It's the first and last descriptor of the frame. */
 } enet_desc_flag;
 
+/*! @brief Define the checksum insertion of a tx frame. */
+typedef enum _enet_tx_offload
+{
+    kENET_TxOffloadDisable = 0U,        /*!< No checksum insertion. */
+    kENET_TxOffloadIPHeader,            /*!< Only the IPv4 header checksum is inserted. */
+    kENET_TxOffloadIPHeaderPlusPayload, /*!< The pseudo-header checksum is in the payload checksum field. */
+    kENET_TxOffloadAll                  /*!< IPv4 header and TCP, UDP or ICMP checksums inserted. */
+} enet_tx_offload_t;
+
+/*! @brief Define the checksum status of a rx frame. */
+typedef enum _enet_rx_checksum_status
+{
+    kENET_RxChecksumNone = 0U, /*!< Not checked: not an IPv4 TCP, UDP or ICMP frame, or not supported. */
+    kENET_RxChecksumOk,        /*!< IPv4 header and payload checksums are correct. */
+    kENET_RxChecksumError      /*!< IPv4 header or payload checksum error. */
+} enet_rx_checksum_status_t;
+
 /*! @brief Define the system time adjust operation control. */
 typedef enum _enet_systime_op
 {
@@ -214,11 +236,13 @@ typedef enum _enet_special_config
     /**************************MTL************************************/
     kENET_StoreAndForward = 0x0002U, /*!< The rx/tx store and forward enable. */
     /***********************MAC****************************************/
-    kENET_PromiscuousEnable  = 0x0004U, /*!< The promiscuous enabled. */
-    kENET_FlowControlEnable  = 0x0008U, /*!< The flow control enabled. */
-    kENET_BroadCastRxDisable = 0x0010U, /*!< The broadcast disabled. */
-    kENET_MulticastAllEnable = 0x0020U, /*!< All multicast are passed. */
-    kENET_8023AS2KPacket     = 0x0040U  /*!< 8023as support for 2K packets. */
+    kENET_PromiscuousEnable       = 0x0004U, /*!< The promiscuous enabled. */
+    kENET_FlowControlEnable       = 0x0008U, /*!< The flow control enabled. */
+    kENET_BroadCastRxDisable      = 0x0010U, /*!< The broadcast disabled. */
+    kENET_MulticastAllEnable      = 0x0020U, /*!< All multicast are passed. */
+    kENET_8023AS2KPacket          = 0x0040U, /*!< 8023as support for 2K packets. */
+    kENET_RxChecksumOffloadEnable = 0x0080U, /*!< The rx IPv4 header and payload checksums are checked. */
+    kENET_TxChecksumOffloadEnable = 0x0100U  /*!< The tx checksums are inserted, tx store and forward is enabled. */
 } enet_special_config_t;
 
 /*! @brief List of DMA interrupts supported by the ENET interrupt. This
@@ -391,6 +415,8 @@ typedef struct _enet_buffer_config
     enet_rx_bd_struct_t *rxDescTailAddrAlign;  /*!< Aligned receive descriptor tail address. */
     uint32_t *rxBufferStartAddr;               /*!< Start address of the rx buffers. */
     uint32_t rxBuffSizeAlign;                  /*!< Aligned receive data buffer size. */
+    void **txFrameContextAddr; /*!< Context of the frames sent with ENET_SendFrameZeroCopy(), an array of
+                                    txRingLen entries. NULL if zero copy transmit is not used. */
 #ifdef ENET_PTP1588FEATURE_REQUIRED
     uint8_t ptpTsRxBuffNum;            /*!< Receive 1588 timestamp buffer number*/
     uint8_t ptpTsTxBuffNum;            /*!< Transmit 1588 timestamp buffer number*/
@@ -399,6 +425,21 @@ typedef struct _enet_buffer_config
 #endif                                 /* ENET_PTP1588FEATURE_REQUIRED */
 } enet_buffer_config_t;
 
+/*! @brief Defines the traffic classes sent on the ring 1 when multi-queue is used.
+ *
+ * A transmitted frame matching any of the classes goes to the ring 1, other frames to the ring 0.
+ * The MAC routes received frames to the ring 1 by VLAN priority and PTP over Ethernet only, set
+ * rxqueuePrio[1] of the multi-queue configuration to vlanPrioMask.
+ */
+typedef struct _enet_traffic_class_config
+{
+    uint8_t vlanPrioMask;  /*!< VLAN priorities (PCP), bit n for priority n. */
+    uint32_t dscpMask[2];  /*!< IPv4 DSCP values, bit (n % 32) of dscpMask[n / 32] for DSCP n. */
+    const uint16_t *ports; /*!< TCP or UDP source or destination ports, in host byte order. */
+    uint8_t portNum;       /*!< Number of ports. */
+    bool ptpEnable;        /*!< PTP over Ethernet frames. */
+} enet_traffic_class_config_t;
+
 /*! @brief Defines the configuration when multi-queue is used. */
 typedef struct enet_multiqueue_config
 {
@@ -414,6 +455,8 @@ typedef struct enet_multiqueue_config
     uint8_t rxqueuePrio[ENET_RING_NUM_MAX];  /*!< Receive queue priority. */
     uint8_t txqueuePrio[ENET_RING_NUM_MAX];  /*!< Refer to Transmit Queue Priority Mapping register. */
     enet_mtl_rxqueuemap mtlrxQuemap;         /*!< Rx queue DMA Channel mapping. */
+    /***********************Transactional***************************/
+    const enet_traffic_class_config_t *trafficClass; /*!< Traffic sent on the ring 1, NULL for AVB frames only. */
 } enet_multiqueue_config_t;
 
 /*! @brief Defines the basic configuration structure for the ENET device.
@@ -446,6 +489,23 @@ typedef struct _enet_handle enet_handle_t;
 typedef void (*enet_callback_t)(
     ENET_Type *base, enet_handle_t *handle, enet_event_t event, uint8_t channel, void *userData);
 
+/*! @brief ENET transmit reclaim callback, called for each frame sent with ENET_SendFrameZeroCopy() once the DMA
+ * is done with its buffer. */
+typedef void (*enet_tx_reclaim_callback_t)(
+    ENET_Type *base, enet_handle_t *handle, uint8_t channel, void *context, void *userData);
+
+/*! @brief ENET receive frame callback of ENET_ReadFrames(), called for each frame received in a single
+ * descriptor. It returns NULL to give "buffer" back to the DMA once the frame is copied or dropped, or a new
+ * buffer of rxBuffSizeAlign bytes, 2 bytes aligned, to keep "buffer". The checksum status is
+ * kENET_RxChecksumNone unless kENET_RxChecksumOffloadEnable is set. */
+typedef void *(*enet_rx_frame_callback_t)(ENET_Type *base,
+                                          enet_handle_t *handle,
+                                          uint8_t *buffer,
+                                          uint32_t length,
+                                          enet_rx_checksum_status_t checksum,
+                                          uint8_t channel,
+                                          void *userData);
+
 /*! @brief Defines the ENET transmit buffer descriptor ring/queue structure. */
 typedef struct _enet_tx_bd_ring
 {
@@ -454,6 +514,7 @@ typedef struct _enet_tx_bd_ring
     uint16_t txConsumIdx;          /*!< tx consum index. */
     volatile uint16_t txDescUsed;  /*!< tx descriptor used number. */
     uint16_t txRingLen;            /*!< tx ring length. */
+    void **txFrameContext;         /*!< Context of the frame of each descriptor, NULL if not used. */
 #ifdef ENET_PTP1588FEATURE_REQUIRED
     enet_ptp_time_data_ring_t txPtpTsDataRing; /*!< Transmit PTP 1588 time stamp data ring buffer. */
 #endif                                         /* ENET_PTP1588FEATURE_REQUIRED */
@@ -466,6 +527,8 @@ typedef struct _enet_rx_bd_ring
     uint16_t rxGenIdx;             /*!< The current available receive buffer descriptor pointer. */
     uint16_t rxRingLen;            /*!< Receive ring length. */
     uint32_t rxBuffSizeAlign;      /*!< Receive buffer size. */
+    uint32_t *rxBuffers;           /*!< Buffers of the descriptors, updated by ENET_ReadFrameZeroCopy(). */
+    uint16_t rxIntFrameCount;      /*!< Frames per receive interrupt, see ENET_SetRxInterruptCoalescing(). */
 #ifdef ENET_PTP1588FEATURE_REQUIRED
     enet_ptp_time_data_ring_t rxPtpTsDataRing; /*!< Receive PTP 1588 time stamp data ring buffer. */
 #endif                                         /* ENET_PTP1588FEATURE_REQUIRED*/
@@ -484,6 +547,9 @@ struct _enet_handle
 #endif
     enet_callback_t callback; /*!< Callback function. */
     void *userData;           /*!< Callback function parameter.*/
+    enet_tx_reclaim_callback_t txReclaimCallback; /*!< Zero copy transmit reclaim callback. */
+    enet_tx_offload_t txOffloadOps;               /*!< Checksum insertion of the frames sent. */
+    const enet_traffic_class_config_t *trafficClass; /*!< Traffic sent on the ring 1. */
 };
 
 /*******************************************************************************
@@ -834,6 +900,52 @@ static inline uint32_t ENET_GetMacInterruptStatus(ENET_Type *base)
  */
 void ENET_ClearMacInterruptStatus(ENET_Type *base, uint32_t mask);
 
+/*!
+ * @brief Enables the rx interrupt of a DMA channel.
+ *
+ * Unlike ENET_EnableInterrupts(), the other interrupts of the channel are kept. A frame received while the
+ * interrupt was disabled raises it once enabled.
+ *
+ * @param base  ENET peripheral base address.
+ * @param channel The DMA Channel. Shall not be larger than ENET_RING_NUM_MAX.
+ */
+static inline void ENET_EnableRxInterrupt(ENET_Type *base, uint8_t channel)
+{
+    base->DMA_CH[channel].DMA_CHX_INT_EN |= ENET_DMA_CH_DMA_CHX_INT_EN_RIE_MASK;
+}
+
+/*!
+ * @brief Disables the rx interrupt of a DMA channel.
+ *
+ * Unlike ENET_DisableInterrupts(), the other interrupts of the channel are kept. Used to poll the rx ring
+ * under load: disabled by the ENET callback on kENET_RxIntEvent and enabled again once the ring is drained.
+ *
+ * @param base  ENET peripheral base address.
+ * @param channel The DMA Channel. Shall not be larger than ENET_RING_NUM_MAX.
+ */
+static inline void ENET_DisableRxInterrupt(ENET_Type *base, uint8_t channel)
+{
+    base->DMA_CH[channel].DMA_CHX_INT_EN &= ~ENET_DMA_CH_DMA_CHX_INT_EN_RIE_MASK;
+}
+
+/*!
+ * @brief Sets the rx interrupt coalescing of a DMA channel.
+ *
+ * The rx interrupt is raised once every "frameCount" descriptors instead of on each frame, and by the
+ * rx interrupt watchdog "timeout_us" after the last frame received without interrupt, so that the end of
+ * a burst is not delayed further. The timeout is limited to 255 * 256 core clock cycles.
+ * Call it after ENET_CreateHandler() and before ENET_StartRxTx().
+ *
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler pointer.
+ * @param channel The rx DMA channel.
+ * @param frameCount Descriptors per rx interrupt, 1 raises the interrupt on each frame.
+ * @param timeout_us Rx interrupt watchdog timeout in microseconds, 0 disables the watchdog. Shall not be
+ *        0 if frameCount is larger than 1.
+ */
+void ENET_SetRxInterruptCoalescing(
+    ENET_Type *base, enet_handle_t *handle, uint8_t channel, uint16_t frameCount, uint32_t timeout_us);
+
 /* @} */
 
 /*!
@@ -868,6 +980,7 @@ static inline bool ENET_IsTxDescriptorDmaOwn(enet_tx_bd_struct_t *txDesc)
  * @param tsEnable The timestamp enable.
  * @param flag The flag of this tx desciriptor, see "enet_desc_flag" .
  * @param slotNum The slot num used for AV  only.
+ * @param txOffloadOps The checksum insertion, ignored for frames other than IPv4, see "enet_tx_offload_t".
  *
  * @note This must be called after all the ENET initilization.
  * And should be called when the ENET receive/transmit is required.
@@ -884,7 +997,8 @@ void ENET_SetupTxDescriptor(enet_tx_bd_struct_t *txDesc,
                             bool intEnable,
                             bool tsEnable,
                             enet_desc_flag flag,
-                            uint8_t slotNum);
+                            uint8_t slotNum,
+                            enet_tx_offload_t txOffloadOps);
 
 /*!
  * @brief Update the tx descriptor tail pointer.
@@ -1051,6 +1165,95 @@ status_t ENET_GetRxFrameSize(ENET_Type *base, enet_handle_t *handle, uint32_t *l
  */
 status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length, uint8_t channel);
 
+/*!
+ * @brief Receives a frame without copy, by swapping the buffer of its descriptor.
+ *
+ * The buffer holding the frame is handed over to the caller and replaced in the descriptor by a new
+ * one, which must be at least rxBuffSizeAlign bytes and 2 bytes aligned. Call it after ENET_GetRxFrameSize()
+ * returned kStatus_Success. A frame spanning several descriptors cannot be handed over, it is left in the
+ * ring and shall be read with ENET_ReadFrame(). Rx buffers of rxBuffSizeAlign larger than the largest
+ * frame avoid this. The double buffer mode is not supported.
+ * For example use rx dma channel 0:
+ * @code
+ *       status = ENET_GetRxFrameSize(ENET, &g_handle, &length, 0);
+ *       if (status == kStatus_Success)
+ *       {
+ *           //Allocate a buffer of rxBuffSizeAlign bytes to replace the one received.
+ *           uint8_t *newBuffer = memory allocate interface;
+ *           if (!newBuffer)
+ *           {
+ *               ENET_ReadFrame(ENET, &g_handle, NULL, 0, 0);
+ *           }
+ *           else if (ENET_ReadFrameZeroCopy(ENET, &g_handle, newBuffer, &buffer, 0) == kStatus_Success)
+ *           {
+ *               //Deliver "buffer" of "length" bytes to the stack, it is owned by the stack now.
+ *           }
+ *           else
+ *           {
+ *               status = ENET_ReadFrame(ENET, &g_handle, newBuffer, length, 0);
+ *           }
+ *       }
+ * @endcode
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler structure. This is the same handler pointer used in the ENET_Init.
+ * @param newBuffer The buffer given to the descriptor in place of the received one.
+ * @param buffer The buffer holding the received frame, owned by the caller on return.
+ * @param channel The rx DMA channel. shall not be larger than 2.
+ * @retval kStatus_Success  The frame is handed over in "buffer".
+ * @retval kStatus_InvalidArgument  The frame spans several descriptors or has an error, nothing is changed.
+ */
+status_t ENET_ReadFrameZeroCopy(
+    ENET_Type *base, enet_handle_t *handle, void *newBuffer, void **buffer, uint8_t channel);
+
+/*!
+ * @brief Reads the frames received, in one pass over the ready descriptors.
+ *
+ * The callback is called for each frame with the buffer of its descriptor, which is given back to
+ * the DMA with the buffer returned by the callback. Frames with an error are given back without
+ * calling the callback. The pass stops at a frame spanning several descriptors, which shall be read
+ * with ENET_GetRxFrameSize() and ENET_ReadFrame(). The double buffer mode is not supported, and with
+ * the PTP 1588 feature all the frames are read with ENET_ReadFrame().
+ * For example use rx dma channel 0:
+ * @code
+ *       do
+ *       {
+ *           count  = 16;
+ *           status = ENET_ReadFrames(ENET, &g_handle, callback, NULL, &count, 0);
+ *           if (status == kStatus_InvalidArgument)
+ *           {
+ *               //Read the next frame with ENET_GetRxFrameSize() and ENET_ReadFrame().
+ *           }
+ *       } while (status != kStatus_ENET_RxFrameEmpty);
+ * @endcode
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler structure. This is the same handler pointer used in the ENET_Init.
+ * @param callback The receive frame callback.
+ * @param userData Passed to the callback.
+ * @param frameCount In: the most descriptors to read. Out: the frames passed to the callback.
+ * @param channel The rx DMA channel. shall not be larger than 2.
+ * @retval kStatus_Success  "frameCount" descriptors were read, more frames may be ready.
+ * @retval kStatus_ENET_RxFrameEmpty  All the frames received were read.
+ * @retval kStatus_InvalidArgument  The next frame spans several descriptors.
+ */
+status_t ENET_ReadFrames(ENET_Type *base,
+                         enet_handle_t *handle,
+                         enet_rx_frame_callback_t callback,
+                         void *userData,
+                         uint32_t *frameCount,
+                         uint8_t channel);
+
+/*!
+ * @brief Gets the transmit ring of a frame.
+ *
+ * With multi-queue, AVB frames and the frames matching the traffic classes of the multi-queue
+ * configuration are sent on the ring 1. Otherwise, all the frames are sent on the ring 0.
+ *
+ * @param data The frame to be sent.
+ * @param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * @return The ring, that is the tx DMA channel, ENET_SendFrame() sends the frame on.
+ */
+uint8_t ENET_GetTxRingId(uint8_t *data, enet_handle_t *handle);
+
 /*!
  * @brief Transmits an ENET frame.
  * @note The CRC is automatically appended to the data. Input the data
@@ -1068,12 +1271,33 @@ status_t ENET_ReadFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
  */
 status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length);
 
+/*!
+ * @brief Transmits an ENET frame from a buffer owned by the driver until the frame is sent.
+ *
+ * The descriptor points to the data, which must stay untouched until the transmit reclaim callback
+ * set with ENET_SetTxReclaimCallback() is called with the context. The buffer context array of the ring
+ * must be given in txFrameContextAddr of the buffer configuration.
+ *
+ * @param base  ENET peripheral base address.
+ * @param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
+ * @param data The data buffer to be send.
+ * @param length The length of the data to be send.
+ * @param context Passed to the transmit reclaim callback, e.g. the buffer to free.
+ * @retval kStatus_Success  Send frame succeed.
+ * @retval kStatus_ENET_TxFrameBusy  Transmit buffer descriptor is busy under transmission.
+ */
+status_t ENET_SendFrameZeroCopy(ENET_Type *base, enet_handle_t *handle, uint8_t *data, uint32_t length, void *context);
+
 /*!
  * @brief Reclaim tx descriptors.
  *  This function is used to update the tx descriptor status and
  *  store the tx timestamp when the 1588 feature is enabled.
  *  This is called by the transmit interupt IRQ handler after the
  *  complete of a frame transmission.
+ *  With a transmit reclaim callback, the IRQ handler only signals the transmit
+ *  event with the ENET callback and the application calls this function out of
+ *  the interrupt, so that the callback can free the buffers. It shall then not run
+ *  concurrently with ENET_SendFrame() or ENET_SendFrameZeroCopy().
  *
  * @param base    ENET peripheral base address.
  * @param handle The ENET handler pointer. This is the same handler pointer used in the ENET_Init.
@@ -1082,6 +1306,20 @@ status_t ENET_SendFrame(ENET_Type *base, enet_handle_t *handle, uint8_t *data, u
  */
 void ENET_ReclaimTxDescriptor(ENET_Type *base, enet_handle_t *handle, uint8_t channel);
 
+/*!
+ * @brief Sets the transmit reclaim callback of the zero copy transmit.
+ *
+ * Call it after ENET_CreateHandler(). The callback is called by ENET_ReclaimTxDescriptor() for each
+ * frame sent with ENET_SendFrameZeroCopy(), in place of the ENET callback with kENET_TxIntEvent.
+ *
+ * @param handle The ENET handler pointer.
+ * @param callback The transmit reclaim callback, called with the userData of the handle.
+ */
+static inline void ENET_SetTxReclaimCallback(enet_handle_t *handle, enet_tx_reclaim_callback_t callback)
+{
+    handle->txReclaimCallback = callback;
+}
+
 /*!
  * @brief The ENET PMT IRQ handler.
  *
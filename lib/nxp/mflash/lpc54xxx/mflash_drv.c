@@ -8,15 +8,60 @@
 #include "mflash_drv.h"
 #include "pin_mux.h"
 #include <stdbool.h>
+#include <string.h>
 
 /* Command ID */
-#define COMMAND_NUM (6)
+#define COMMAND_NUM (9)
 #define READ (0)
 #define PROGRAM_PAGE (1)
 #define GET_STATUS (2)
 #define ERASE_SECTOR (3)
 #define WRITE_ENABLE (4)
 #define WRITE_REGISTER (5)
+#define GET_QE_REGISTER (6)
+#define SUSPEND (7)
+#define RESUME (8)
+
+/* Quad enable bit, the status register holding it and the number of status bytes written to set it */
+#if MFLASH_PART == MFLASH_PART_W25Q
+#define QE_REGISTER_OPCODE (0x35) /* status register 2, written along with status register 1 */
+#define QE_MASK (0x02)
+#define QE_WRITE_LEN (2)
+#define SUSPEND_OPCODE (0x75)
+#define RESUME_OPCODE (0x7A)
+#elif MFLASH_PART == MFLASH_PART_MX25L
+#define QE_REGISTER_OPCODE (0x05) /* status register */
+#define QE_MASK (0x40)
+#define QE_WRITE_LEN (1)
+#define SUSPEND_OPCODE (0xB0)
+#define RESUME_OPCODE (0x30)
+#else
+#define QE_REGISTER_OPCODE (0x05)
+#define QE_MASK (0x00)
+#define QE_WRITE_LEN (4)
+#define SUSPEND_OPCODE (0x00) /* not supported */
+#define RESUME_OPCODE (0x00)
+#endif
+
+/* Running XIP, interrupt handlers are in the flash. Unless disabled, a program or erase is suspended whenever an
+ * interrupt is pending so that the flash is readable to serve it, instead of keeping interrupts disabled until the
+ * operation completes. */
+#if !defined(FLASHDRV_SUSPEND) && (SUSPEND_OPCODE != 0)
+#define FLASHDRV_SUSPEND 1
+#endif
+
+/* Status polls after a resume before the next suspend. The flash needs some time after a resume to make progress,
+ * 128 polls of 16 clocks take at least 20 us at 96 MHz. */
+#ifndef FLASHDRV_RESUME_POLLS
+#define FLASHDRV_RESUME_POLLS (128)
+#endif
+
+/* BASEPRI masking the priority of the RTOS kernel, the lowest one, while interrupts are served during a program or
+ * erase. PendSV and SysTick stay pending so that no task switch happens and no other task reaches the flash while an
+ * operation is in progress or suspended. Must match configKERNEL_INTERRUPT_PRIORITY of FreeRTOS. */
+#ifndef FLASHDRV_KERNEL_BASEPRI
+#define FLASHDRV_KERNEL_BASEPRI (((1U << __NVIC_PRIO_BITS) - 1U) << (8U - __NVIC_PRIO_BITS))
+#endif
 
 //#ifdef XIP_IMAGE
 //#warning NOTE: MFLASH driver expects that application runs from XIP
@@ -34,10 +79,22 @@ static uint32_t g_flashm_sector[MFLASH_SECTOR_SIZE / sizeof(uint32_t)];
 
 /* Commands definition, taken from SPIFI demo */
 static spifi_command_t command[COMMAND_NUM] = {
+#if MFLASH_PART == MFLASH_PART_SERIAL
     /* read */
     {MFLASH_PAGE_SIZE, false, kSPIFI_DataInput, 1, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0x0B},
     /* program */
     {MFLASH_PAGE_SIZE, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0x2},
+#else
+    /* quad I/O read, address and mode byte followed by dummy clocks on four lines */
+    {MFLASH_PAGE_SIZE, false, kSPIFI_DataInput, 3, kSPIFI_CommandOpcodeSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0xEB},
+#if MFLASH_PART == MFLASH_PART_MX25L
+    /* quad page program, address and data on four lines */
+    {MFLASH_PAGE_SIZE, false, kSPIFI_DataOutput, 0, kSPIFI_CommandOpcodeSerial, kSPIFI_CommandOpcodeAddrThreeBytes, 0x38},
+#else
+    /* quad page program, data on four lines */
+    {MFLASH_PAGE_SIZE, false, kSPIFI_DataOutput, 0, kSPIFI_CommandDataQuad, kSPIFI_CommandOpcodeAddrThreeBytes, 0x32},
+#endif
+#endif
     /* status */
     {1, false, kSPIFI_DataInput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x05},
     /* erase */
@@ -45,20 +102,30 @@ static spifi_command_t command[COMMAND_NUM] = {
     /* write enable */
     {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x06},
     /* write register */
-    {4, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x01}};
+    {QE_WRITE_LEN, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, 0x01},
+    /* status register holding the quad enable bit */
+    {1, false, kSPIFI_DataInput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, QE_REGISTER_OPCODE},
+    /* program/erase suspend */
+    {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, SUSPEND_OPCODE},
+    /* program/erase resume */
+    {0, false, kSPIFI_DataOutput, 0, kSPIFI_CommandAllSerial, kSPIFI_CommandOpcodeOnly, RESUME_OPCODE}};
+
+/* Read single byte register of the flash */
+static inline uint8_t mflash_drv_read_register(uint32_t cmd_id)
+{
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[cmd_id]);
+    while ((MFLASH_SPIFI->STAT & SPIFI_STAT_INTRQ_MASK) == 0U)
+    {
+    }
+    return SPIFI_ReadDataByte(MFLASH_SPIFI);
+}
 
 /* Wait until command finishes */
 static inline void mflash_drv_check_if_finish(void)
 {
-    uint8_t val = 0;
-    do
+    while (mflash_drv_read_register(GET_STATUS) & 0x1)
     {
-        SPIFI_SetCommand(MFLASH_SPIFI, &command[GET_STATUS]);
-        while ((MFLASH_SPIFI->STAT & SPIFI_STAT_INTRQ_MASK) == 0U)
-        {
-        }
-        val = SPIFI_ReadDataByte(MFLASH_SPIFI);
-    } while (val & 0x1);
+    }
 }
 
 /* return offset from sector */
@@ -69,6 +136,114 @@ static void mflash_drv_read_mode(void)
     SPIFI_SetMemoryCommand(MFLASH_SPIFI, &command[READ]);
 }
 
+#if defined(XIP_IMAGE) && FLASHDRV_SUSPEND
+/* Check if the pending exception 'vector' is taken with the kernel priority masked, and with the priorities masked
+ * by the caller ('basepri'). Otherwise suspending the operation would be useless. */
+static bool mflash_drv_is_irq_servable(uint32_t vector, uint32_t basepri)
+{
+    uint32_t mask = FLASHDRV_KERNEL_BASEPRI;
+
+    if ((basepri != 0) && (basepri < mask))
+    {
+        mask = basepri;
+    }
+
+    /* Only PendSV and SysTick of the system exceptions can be pending here */
+    if (vector < 16)
+    {
+        return false;
+    }
+
+    return (NVIC_GetPriority((IRQn_Type)(vector - 16)) << (8U - __NVIC_PRIO_BITS)) < mask;
+}
+#endif
+
+/* Wait until program or erase finishes, with interrupts disabled upon entry. Interrupts above the kernel priority are
+ * served while waiting: running from SRAM their handlers do not need the flash so they are simply enabled, running
+ * XIP the operation is suspended and the flash switched to memory mode whenever one is pending. Interrupts stay
+ * disabled if they were disabled by the caller ('primask' set). */
+static void mflash_drv_wait_operation(uint32_t primask)
+{
+    uint32_t basepri = __get_BASEPRI();
+#ifndef XIP_IMAGE
+    if (primask == 0)
+    {
+        __set_BASEPRI_MAX(FLASHDRV_KERNEL_BASEPRI);
+        __asm("cpsie i");
+    }
+
+    mflash_drv_check_if_finish();
+
+    __asm("cpsid i");
+    __set_BASEPRI(basepri);
+#elif FLASHDRV_SUSPEND
+    uint32_t polls = 0;
+
+    while (mflash_drv_read_register(GET_STATUS) & 0x1)
+    {
+        /* Nothing to serve, or the operation was resumed too recently to make progress */
+        if ((primask != 0) || (++polls < FLASHDRV_RESUME_POLLS) ||
+            !mflash_drv_is_irq_servable((SCB->ICSR & SCB_ICSR_VECTPENDING_Msk) >> SCB_ICSR_VECTPENDING_Pos, basepri))
+            continue;
+
+        /* Suspend takes effect once the flash is not busy anymore, the operation may also have just completed */
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[SUSPEND]);
+        mflash_drv_check_if_finish();
+        mflash_drv_read_mode();
+
+        /* Pending interrupts are taken here, except PendSV: another task must not run while the operation is
+         * suspended, it could issue flash commands or read the flash that is not in memory mode after the resume */
+        __set_BASEPRI_MAX(FLASHDRV_KERNEL_BASEPRI);
+        __asm("cpsie i");
+        __ISB();
+        __asm("cpsid i");
+        __set_BASEPRI(basepri);
+
+        /* Resume is ignored by the flash if nothing was suspended */
+        SPIFI_ResetCommand(MFLASH_SPIFI);
+        SPIFI_SetCommand(MFLASH_SPIFI, &command[RESUME]);
+        polls = 0;
+    }
+#else
+    (void)primask;
+    (void)basepri;
+    mflash_drv_check_if_finish();
+#endif
+}
+
+/* Set the quad enable bit of the flash through the status register write, unless it is set already.
+ * The bit is non-volatile so it is written once in the lifetime of the part, not on every init. */
+static int32_t mflash_drv_quad_enable(void)
+{
+#if MFLASH_PART != MFLASH_PART_SERIAL
+    uint8_t status;
+    uint8_t qe_reg;
+
+    SPIFI_ResetCommand(MFLASH_SPIFI);
+
+    status = mflash_drv_read_register(GET_STATUS);
+    qe_reg = mflash_drv_read_register(GET_QE_REGISTER);
+    if (qe_reg & QE_MASK)
+        return 0;
+
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_ENABLE]);
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_REGISTER]);
+#if QE_WRITE_LEN == 2
+    /* status register 1 is written first, keep its protection bits */
+    SPIFI_WriteDataHalfword(MFLASH_SPIFI, status | ((uint16_t)(qe_reg | QE_MASK) << 8));
+#else
+    (void)status;
+    SPIFI_WriteDataByte(MFLASH_SPIFI, qe_reg | QE_MASK);
+#endif
+    mflash_drv_check_if_finish();
+
+    if (0 == (mflash_drv_read_register(GET_QE_REGISTER) & QE_MASK))
+        return -1;
+#endif
+
+    return 0;
+}
+
 /* Initialize SPIFI & flash peripheral,
  * cannot be invoked directly, requires calling wrapper in non XIP memory */
 static int32_t mflash_drv_init_internal(void)
@@ -81,6 +256,7 @@ static int32_t mflash_drv_init_internal(void)
      * TODO: store/restore previous PRIMASK on stack to avoid
      * failure in case of nested critical sections !! */
     uint32_t primask = __get_PRIMASK();
+    int32_t result;
 
     __asm("cpsid i");
 
@@ -101,7 +277,11 @@ static int32_t mflash_drv_init_internal(void)
 #endif
 
     SPIFI_GetDefaultConfig(&config);
+#if MFLASH_PART == MFLASH_PART_SERIAL
     config.dualMode = kSPIFI_DualMode;
+#else
+    config.dualMode = kSPIFI_QuadMode;
+#endif
 #ifdef XIP_IMAGE
     config.disablePrefetch     = false; // true;
     config.disableCachePrefech = false; // true;
@@ -119,6 +299,9 @@ static int32_t mflash_drv_init_internal(void)
                          SPIFI_CTRL_PRFTCH_DIS(config.disableCachePrefech) | SPIFI_CTRL_DUAL(config.dualMode) |
                          SPIFI_CTRL_RFCLK(config.isReadFullClockCycle) | SPIFI_CTRL_FBCLK(config.isFeedbackClock);
 
+    /* The quad commands are ignored by the flash until the quad enable bit is set */
+    result = mflash_drv_quad_enable();
+
     mflash_drv_read_mode();
 
     if (primask == 0)
@@ -126,7 +309,7 @@ static int32_t mflash_drv_init_internal(void)
         __asm("cpsie i");
     }
 
-    return 0;
+    return result;
 }
 
 /* API - initialize 'mflash' */
@@ -155,7 +338,7 @@ static int32_t mflash_drv_sector_erase(uint32_t sector_addr)
     /* Erase sector */
     SPIFI_SetCommand(MFLASH_SPIFI, &command[ERASE_SECTOR]);
     /* Check if finished */
-    mflash_drv_check_if_finish();
+    mflash_drv_wait_operation(primask);
     /* Switch to read mode to enable interrupts as soon ass possible */
     mflash_drv_read_mode();
 
@@ -189,7 +372,59 @@ static int32_t mflash_drv_page_program(uint32_t page_addr, const uint32_t *page_
         SPIFI_WriteData(MFLASH_SPIFI, page_data[i]);
     }
 
-    mflash_drv_check_if_finish();
+    mflash_drv_wait_operation(primask);
+    /* Switch to read mode to enable interrupts as soon ass possible */
+    mflash_drv_read_mode();
+
+    if (primask == 0)
+    {
+        __asm("cpsie i");
+    }
+
+    /* Flush pipeline to allow pending interrupts take place */
+    __ISB();
+
+    return 0;
+}
+
+/* Internal - program 'data_len' bytes of 'data' to single page 'page_addr', starting from 'page_off'.
+ * Data is streamed to SPIFI directly from the caller's buffer, bytes outside of the range are sent as 0xFF
+ * which leaves the flash content unchanged. */
+static int32_t mflash_drv_page_program_partial(uint32_t page_addr,
+                                               uint32_t page_off,
+                                               const uint8_t *data,
+                                               uint32_t data_len)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t word;
+
+    __asm("cpsid i");
+
+    /* Program page */
+    SPIFI_ResetCommand(MFLASH_SPIFI);
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[WRITE_ENABLE]);
+    SPIFI_SetCommandAddress(MFLASH_SPIFI, page_addr);
+    SPIFI_SetCommand(MFLASH_SPIFI, &command[PROGRAM_PAGE]);
+
+    if ((page_off == 0) && (data_len == MFLASH_PAGE_SIZE))
+    {
+        /* Whole page, store 4B in each loop. The source buffer may be unaligned. memcpy is not called since it may
+         * be placed in XIP, which cannot be read while the SPIFI is in command mode, the read is inlined instead */
+        for (uint32_t i = 0; i < MFLASH_PAGE_SIZE; i += sizeof(word))
+        {
+            word = __UNALIGNED_UINT32_READ(&data[i]);
+            SPIFI_WriteData(MFLASH_SPIFI, word);
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < MFLASH_PAGE_SIZE; i++)
+        {
+            SPIFI_WriteDataByte(MFLASH_SPIFI, ((i >= page_off) && (i < page_off + data_len)) ? data[i - page_off] : 0xFF);
+        }
+    }
+
+    mflash_drv_wait_operation(primask);
     /* Switch to read mode to enable interrupts as soon ass possible */
     mflash_drv_read_mode();
 
@@ -226,12 +461,32 @@ static int32_t mflash_drv_sector_program(uint32_t sector_addr, const uint32_t *s
 }
 #endif
 
+/* Internal - copy 'count' words, a multiple of 4. Four words per loop are moved with load and store multiple, the
+ * copy from the XIP window is then bound by the SPIFI read rate. */
+static void mflash_drv_copy_words(uint32_t *dst, const uint32_t *src, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        uint32_t w0 = src[i];
+        uint32_t w1 = src[i + 1];
+        uint32_t w2 = src[i + 2];
+        uint32_t w3 = src[i + 3];
+
+        dst[i]     = w0;
+        dst[i + 1] = w1;
+        dst[i + 2] = w2;
+        dst[i + 3] = w3;
+    }
+}
+
 /* Internal - write data of 'data_len' to single sector 'sector_addr', starting from 'sect_off' */
 static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off, const uint8_t *data, uint32_t data_len)
 {
 #if FLASHDRV_SMART_UPDATE
-    int sector_erase_req      = 0;
+    uint32_t set_bits         = 0; /* Bits flipped from 0 to 1, the sector has to be erased */
     uint32_t page_program_map = 0; /* Current implementation is limited to 32 pages per sector */
+    uint32_t word_idx         = sect_off / sizeof(uint32_t);
+    uint32_t byte_off         = sect_off % sizeof(uint32_t);
 #endif
 
     /* Address not aligned to sector boundary */
@@ -244,42 +499,52 @@ static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off,
     /* Switch back to read mode */
     mflash_drv_read_mode();
 
-    /* Copy old sector data by 4B in each loop to buffer */
-    for (uint32_t i = 0; i < sizeof(g_flashm_sector) / sizeof(g_flashm_sector[0]); i++)
-    {
-        g_flashm_sector[i] = *((uint32_t *)(sector_addr) + i);
-    }
+    /* Copy old sector data to buffer */
+    mflash_drv_copy_words(g_flashm_sector, (const uint32_t *)sector_addr,
+                          sizeof(g_flashm_sector) / sizeof(g_flashm_sector[0]));
 
 #if FLASHDRV_SMART_UPDATE /* Perform only the erase/program operations that are necessary */
 
-    /* Copy custom data (1B in each loop) to buffer at specific position */
-    for (uint32_t i = 0; i < data_len; i++)
+    /* Merge custom data into the buffer a word at a time, only the first and last words may be partial. 'data' need
+     * not be aligned, the core handles unaligned word loads. */
+    while (data_len > 0)
     {
-        /* Unless it was already decided to erase the whole sector, evaluate differences between current and new data */
-        if (0 == sector_erase_req)
+        uint32_t cur_value = g_flashm_sector[word_idx];
+        uint32_t new_value = cur_value;
+        uint32_t to_copy   = sizeof(uint32_t) - byte_off;
+
+        if (to_copy > data_len)
         {
-            uint8_t cur_value = ((uint8_t *)(g_flashm_sector))[sect_off + i];
-            uint8_t new_value = data[i];
+            to_copy = data_len;
+        }
 
-            /* Check the the bit transitions */
-            if ((cur_value | new_value) != cur_value)
-            {
-                sector_erase_req = 1; /* A bit needs to be flipped from 0 to 1, the sector has to be erased */
-            }
-            else if ((cur_value & new_value) != cur_value)
-            {
-                page_program_map |=
-                    1 << ((sect_off + i) /
-                          MFLASH_PAGE_SIZE); /* A bit needs to be flipped from 1 to 0, the page has to be programmed */
-            }
+        if (to_copy == sizeof(uint32_t))
+        {
+            memcpy(&new_value, data, sizeof(new_value));
+        }
+        else
+        {
+            memcpy((uint8_t *)&new_value + byte_off, data, to_copy);
         }
 
-        /* Copy data over to the buffer */
-        ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
+        /* Check the the bit transitions */
+        set_bits |= ~cur_value & new_value;
+        if ((cur_value & ~new_value) != 0)
+        {
+            /* A bit needs to be flipped from 1 to 0, the page has to be programmed */
+            page_program_map |= 1U << (word_idx / (MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0])));
+        }
+
+        g_flashm_sector[word_idx] = new_value;
+
+        word_idx++;
+        data += to_copy;
+        data_len -= to_copy;
+        byte_off = 0;
     }
 
     /* Erase the sector if required */
-    if (0 != sector_erase_req)
+    if (0 != set_bits)
     {
         if (0 != mflash_drv_sector_erase(sector_addr))
         {
@@ -287,17 +552,23 @@ static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off,
         }
 
         /* Update page program map according to non-blank areas in the buffer */
-        for (int page_idx = 0; page_idx < MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE; page_idx++)
+        for (uint32_t page_idx = 0; page_idx < MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE; page_idx++)
         {
-            int page_word_start = page_idx * (MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0]));
-            int page_word_end   = page_word_start + (MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0]));
+            uint32_t page_word_start = page_idx * (MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0]));
+            uint32_t page_word_end   = page_word_start + (MFLASH_PAGE_SIZE / sizeof(g_flashm_sector[0]));
 
-            for (int i = page_word_start; i < page_word_end; i++)
+            /* Pages with updated data are programmed anyway */
+            if (0 != (page_program_map & (1U << page_idx)))
+            {
+                continue;
+            }
+
+            for (uint32_t i = page_word_start; i < page_word_end; i++)
             {
                 if (g_flashm_sector[i] != 0xFFFFFFFF)
                 {
                     /* Mark the page for programming and go for next one */
-                    page_program_map |= (1 << page_idx);
+                    page_program_map |= (1U << page_idx);
                     break;
                 }
             }
@@ -319,11 +590,8 @@ static int32_t mflash_drv_sector_update(uint32_t sector_addr, uint32_t sect_off,
 
 #else /* Erase the sector and all the pages unconditionally */
 
-    /* Copy custom data (1B in each loop) to buffer at specific position */
-    for (uint32_t i = 0; i < data_len; i++)
-    {
-        ((uint8_t *)g_flashm_sector)[sect_off + i] = data[i];
-    }
+    /* Copy custom data to buffer at specific position */
+    memcpy((uint8_t *)g_flashm_sector + sect_off, data, data_len);
 
     /* Erase the sector */
     if (0 != mflash_drv_sector_erase(sector_addr))
@@ -376,6 +644,69 @@ int32_t mflash_drv_erase_internal(void *addr, uint32_t len)
     return 0;
 }
 
+/* Calling wrapper for 'mflash_drv_erase_internal'.
+ * Erase 'len' bytes starting at 'addr', both have to be sector aligned. Blank sectors are skipped.
+ */
+int32_t mflash_drv_erase(void *addr, uint32_t len)
+{
+    volatile int32_t result;
+    result = mflash_drv_erase_internal(addr, len);
+    return result;
+}
+
+/* Program data to flash without erase, cannot be invoked directly, requires calling wrapper in non XIP memory */
+int32_t mflash_drv_program_internal(void *any_addr, const uint8_t *data, uint32_t data_len)
+{
+    uint32_t addr = (uint32_t)any_addr;
+    uint32_t page_off;
+    uint32_t to_write;
+
+    /* Switch back to read mode */
+    mflash_drv_read_mode();
+
+    /* Programming can only flip bits from 1 to 0, refuse the request if any bit would need an erase */
+    for (uint32_t i = 0; i < data_len; i++)
+    {
+        uint8_t cur_value = *((const uint8_t *)(addr + i));
+
+        if ((cur_value & data[i]) != data[i])
+        {
+            return -1;
+        }
+    }
+
+    while (data_len)
+    {
+        page_off = addr & (MFLASH_PAGE_SIZE - 1);
+        to_write = MFLASH_PAGE_SIZE - page_off;
+        if (to_write > data_len)
+        {
+            to_write = data_len;
+        }
+
+        mflash_drv_page_program_partial(addr - page_off, page_off, data, to_write);
+
+        addr += to_write;
+        data += to_write;
+        data_len -= to_write;
+    }
+
+    return 0;
+}
+
+/* Calling wrapper for 'mflash_drv_program_internal'.
+ * Program 'data' of 'data_len' to 'any_addr' of an area which is already erased, without the sector
+ * read-modify-write of 'mflash_drv_write'. Data is streamed from 'data' to the flash, so no copy is made.
+ * Returns -1 without programming if the area has a bit cleared which 'data' needs set.
+ * NOTE: Don't try to store constant data that are located in XIP !!
+ */
+int32_t mflash_drv_program(void *any_addr, const uint8_t *data, uint32_t data_len)
+{
+    volatile int32_t result;
+    result = mflash_drv_program_internal(any_addr, data, data_len);
+    return result;
+}
+
 /* Write data to flash, cannot be invoked directly, requires calling wrapper in non XIP memory */
 int32_t mflash_drv_write_internal(void *any_addr, const uint8_t *data, uint32_t data_len)
 {
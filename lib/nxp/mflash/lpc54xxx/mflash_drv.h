@@ -31,6 +31,15 @@
 #define MFLASH_BAUDRATE (96000000)
 #endif
 
+/* Flash parts, each has its own quad command set */
+#define MFLASH_PART_SERIAL (0) /* any part, single bit I/O only */
+#define MFLASH_PART_W25Q (1)   /* Winbond W25Q, fitted on LPCXpresso54018 */
+#define MFLASH_PART_MX25L (2)  /* Macronix MX25L */
+
+#ifndef MFLASH_PART
+#define MFLASH_PART MFLASH_PART_W25Q
+#endif
+
 static inline uint32_t mflash_drv_is_sector_aligned(uint32_t addr)
 {
     return ((addr) & (MFLASH_SECTOR_MASK)) == 0 ? true : false;
@@ -48,5 +57,7 @@ static inline uint32_t mflash_drv_addr_to_sector_of(uint32_t addr)
 
 int32_t mflash_drv_init(void);
 int32_t mflash_drv_write(void *any_addr, const uint8_t *data, uint32_t data_len);
+int32_t mflash_drv_erase(void *addr, uint32_t len);
+int32_t mflash_drv_program(void *any_addr, const uint8_t *data, uint32_t data_len);
 
 #endif
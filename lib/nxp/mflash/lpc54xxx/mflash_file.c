@@ -11,129 +11,504 @@
 #include "mflash_file.h"
 #include "mflash_drv.h"
 
-static mflash_file_t *g_file_table = NULL;
-static bool g_mflash_initialized   = false;
-
-#if 0
-/* Example of NULL terminated file table */
-mflash_file_t g_flash_files[] = {
-    { .flash_addr = MFLASH_FILE_BASEADDR, .max_size = MFLASH_FILE_SIZE, .path = "/test/file1" },
-    { .flash_addr = MFLASH_FILE_BASEADDR + 1 * MFLASH_FILE_SIZE, .max_size = MFLASH_FILE_SIZE, .path = "/test/file2" },
-    { .flash_addr = MFLASH_FILE_BASEADDR + 2 * MFLASH_FILE_SIZE, .max_size = MFLASH_FILE_SIZE, .path = "/test/file3" },
-    { 0 }
-};
-#endif
+/*
+ * Files are appended to a log as records, a record is only ever programmed to erased flash. Saving a file again
+ * appends a new record, the older one stays in place until its sector is collected. The sectors of the area form a
+ * ring, a sector is opened with an increasing sequence number once the previous one is full. When only the reserved
+ * sectors are left, the oldest sector is collected: its live records are copied at the head of the log and it is
+ * erased, so all sectors wear evenly. A RAM index of the latest record of each file, built upon init, avoids
+ * searching the flash.
+ *
+ * Sector: sector meta | record | record | ... | erased
+ * Record: file meta | path, padded to 4 bytes | data, padded to 4 bytes
+ */
+
+#define MFLASH_FILE_SECTORS (MFLASH_FILE_AREA_SIZE / MFLASH_SECTOR_SIZE)
+#define MFLASH_FILE_NONE (0xFFFFFFFF)
+#define MFLASH_ALIGN4(x) (((x) + 3U) & ~3U)
 
 /* Help to identify mfile without knowing an address */
 #define MFLASH_META_MAGIC_NO (0xABECEDA8)
+#define MFLASH_SECTOR_MAGIC_NO (0x474F4C4D)
 
 typedef struct
 {
-    uint32_t file_size;
     uint32_t magic_no;
+    uint32_t seq;
+    uint32_t seq_inv; /* ~seq, a torn sector meta is not taken for a valid one */
+    uint32_t reserved;
+} msector_meta_t;
+
+typedef struct
+{
+    uint32_t magic_no;
+    uint16_t path_len;
+    uint16_t reserved;
+    uint32_t file_size;
+    uint32_t crc; /* CRC32 of path_len to file_size, the path and the data */
 } mfile_meta_t;
 
-bool mflash_is_initialized()
+/* Fixed-slot layout used before the log: the file of slot n is in sector n of the area, after this meta data */
+typedef struct
 {
-    return g_mflash_initialized;
+    uint32_t file_size;
+    uint32_t magic_no; /* MFLASH_META_MAGIC_NO */
+} mfile_legacy_meta_t;
+
+typedef struct
+{
+    uint32_t hash; /* hash of the path */
+    uint32_t addr; /* address of the latest record, 0 if the entry is unused */
+} mfile_index_t;
+
+#if (MFLASH_FILE_MAX_FILES & (MFLASH_FILE_MAX_FILES - 1)) != 0
+#error "MFLASH_FILE_MAX_FILES must be a power of 2"
+#endif
+
+#if MFLASH_FILE_SECTORS <= MFLASH_FILE_GC_RESERVE + 1
+#error "MFLASH_FILE_AREA_SIZE is too small for the garbage collection"
+#endif
+
+static mfile_index_t g_file_index[MFLASH_FILE_MAX_FILES];
+static uint32_t g_sector_seq[MFLASH_FILE_SECTORS]; /* sequence number of the sectors in use, 0 if free */
+static uint32_t g_sectors_used;
+static uint32_t g_seq;                       /* sequence number of the head sector */
+static uint32_t g_head = MFLASH_FILE_NONE;   /* sector records are appended to */
+static uint32_t g_head_off;                  /* offset of the first erased byte in the head sector */
+static bool g_mflash_initialized = false;
+
+/* Record meta data and path, staged in RAM as it cannot be programmed from XIP */
+static uint32_t g_record_buf[(sizeof(mfile_meta_t) + MFLASH_FILE_MAX_PATH) / sizeof(uint32_t)];
+
+/* CRC32 (IEEE 802.3, same as zlib), nibble table to keep the footprint small */
+static const uint32_t mflash_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+static uint32_t mflash_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ mflash_crc_table[crc & 0x0F];
+        crc = (crc >> 4) ^ mflash_crc_table[crc & 0x0F];
+    }
+    return ~crc;
 }
 
-BaseType_t mflash_init(mflash_file_t *user_file_table, bool init_drv)
+/* FNV-1a */
+static uint32_t mflash_hash(const uint8_t *path, uint32_t len)
 {
-    /* Check params */
-    if (NULL == user_file_table)
-        return pdFALSE;
+    uint32_t hash = 2166136261u;
 
-    /* Check attributes of each file in table */
-    for (mflash_file_t *tmp_file = user_file_table; (0 != tmp_file->flash_addr) && (0 != tmp_file->max_size);
-         tmp_file += 1)
+    while (len--)
     {
-        /* NOTE: This loop does not check overlapping sectors !!! */
-        /* Assume that zero address and zero size belong to unitialized struct. */
-        if ((0 == tmp_file->flash_addr) || (0 == tmp_file->max_size))
-            return pdFALSE;
-        /* Starting file address ('flash_addr') must be sector aligned */
-        if (!mflash_drv_is_sector_aligned(tmp_file->flash_addr))
-            return pdFALSE;
-        /* File max_size must be multiple of sector size */
-        if (!mflash_drv_is_sector_aligned(tmp_file->max_size))
-            return pdFALSE;
+        hash ^= *path++;
+        hash *= 16777619u;
     }
-    /* Store reference to user*/
-    g_file_table = user_file_table;
-    /* Init flash driver */
-    if (init_drv)
-        mflash_drv_init();
+    return hash;
+}
 
-    g_mflash_initialized = true;
-    return pdTRUE;
+static inline uint32_t mflash_sector_addr(uint32_t sector)
+{
+    return MFLASH_FILE_BASEADDR + sector * MFLASH_SECTOR_SIZE;
+}
+
+static inline const uint8_t *mflash_record_path(uint32_t addr)
+{
+    return (const uint8_t *)(addr + sizeof(mfile_meta_t));
+}
+
+static inline uint8_t *mflash_record_data(uint32_t addr)
+{
+    return (uint8_t *)(addr + sizeof(mfile_meta_t) + MFLASH_ALIGN4(((const mfile_meta_t *)addr)->path_len));
+}
+
+static inline uint32_t mflash_record_size(const mfile_meta_t *meta)
+{
+    return sizeof(mfile_meta_t) + MFLASH_ALIGN4(meta->path_len) + MFLASH_ALIGN4(meta->file_size);
+}
+
+static uint32_t mflash_record_crc(const mfile_meta_t *meta, const uint8_t *path, const uint8_t *data)
+{
+    uint32_t crc = mflash_crc32(0, (const uint8_t *)&meta->path_len, offsetof(mfile_meta_t, crc) - offsetof(mfile_meta_t, path_len));
+    crc = mflash_crc32(crc, path, meta->path_len);
+    return mflash_crc32(crc, data, meta->file_size);
+}
+
+/* Check the record at 'addr', which has 'room' bytes up to the end of its sector */
+static bool mflash_record_is_valid(uint32_t addr, uint32_t room)
+{
+    const mfile_meta_t *meta = (const mfile_meta_t *)addr;
+
+    if (room < sizeof(mfile_meta_t) || MFLASH_META_MAGIC_NO != meta->magic_no)
+        return false;
+    if (meta->path_len == 0 || meta->path_len > MFLASH_FILE_MAX_PATH || meta->file_size > MFLASH_FILE_MAX_SIZE)
+        return false;
+    if (mflash_record_size(meta) > room)
+        return false;
+    return meta->crc == mflash_record_crc(meta, mflash_record_path(addr), mflash_record_data(addr));
+}
+
+/* Find the index entry of a path, or the free entry it would take. Returns NULL if the index is full. */
+static mfile_index_t *mflash_index_lookup(const uint8_t *path, uint32_t len, uint32_t hash)
+{
+    for (uint32_t i = 0; i < MFLASH_FILE_MAX_FILES; i++)
+    {
+        mfile_index_t *entry = &g_file_index[(hash + i) & (MFLASH_FILE_MAX_FILES - 1)];
+
+        if (0 == entry->addr)
+            return entry;
+        /* Only a matching hash needs the path compared */
+        if (entry->hash == hash && ((const mfile_meta_t *)entry->addr)->path_len == len &&
+            0 == memcmp(mflash_record_path(entry->addr), path, len))
+            return entry;
+    }
+    return NULL;
+}
+
+/* Make the record at 'addr' the latest one of its file */
+static int32_t mflash_index_update(uint32_t addr)
+{
+    const mfile_meta_t *meta = (const mfile_meta_t *)addr;
+    uint32_t hash            = mflash_hash(mflash_record_path(addr), meta->path_len);
+    mfile_index_t *entry     = mflash_index_lookup(mflash_record_path(addr), meta->path_len, hash);
+
+    if (NULL == entry)
+        return -1;
+    entry->hash = hash;
+    entry->addr = addr;
+    return 0;
 }
 
-/* Find a file in file_table */
-int32_t mflash_find_file(char *path, mflash_file_t *file)
+/* Program 'len' bytes at 'addr', data in XIP is staged through RAM a page at a time */
+static int32_t mflash_file_program(uint32_t addr, const uint8_t *data, uint32_t len, bool xip)
 {
-    int32_t status = -1;
+    static uint32_t page[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+
+    if (!xip)
+        return mflash_drv_program((void *)addr, data, len);
+
+    while (len)
+    {
+        uint32_t to_copy = (len > sizeof(page)) ? sizeof(page) : len;
+
+        memcpy(page, data, to_copy);
+        if (0 != mflash_drv_program((void *)addr, (const uint8_t *)page, to_copy))
+            return -1;
+        addr += to_copy;
+        data += to_copy;
+        len -= to_copy;
+    }
+    return 0;
+}
+
+/* Open the next free sector of the ring as the head of the log */
+static int32_t mflash_sector_open(void)
+{
+    uint32_t sector = (MFLASH_FILE_NONE == g_head) ? 0 : (g_head + 1) % MFLASH_FILE_SECTORS;
+    msector_meta_t meta;
+    const uint32_t *word;
+    uint32_t i;
+
+    for (i = 0; i < MFLASH_FILE_SECTORS && 0 != g_sector_seq[sector]; i++)
+        sector = (sector + 1) % MFLASH_FILE_SECTORS;
+    if (i == MFLASH_FILE_SECTORS)
+        return -1;
 
-    /* Check file_table */
-    if (NULL == g_file_table)
+    /* Free sectors are erased by the collection, unless an erase or a sector meta write was interrupted */
+    word = (const uint32_t *)mflash_sector_addr(sector);
+    for (i = 0; i < MFLASH_SECTOR_SIZE / sizeof(uint32_t) && 0xFFFFFFFF == word[i]; i++)
+    {
+    }
+    if (i < MFLASH_SECTOR_SIZE / sizeof(uint32_t) && 0 != mflash_drv_erase((void *)mflash_sector_addr(sector), MFLASH_SECTOR_SIZE))
+        return -1;
+
+    meta.magic_no = MFLASH_SECTOR_MAGIC_NO;
+    meta.seq      = g_seq + 1;
+    meta.seq_inv  = ~meta.seq;
+    meta.reserved = 0xFFFFFFFF;
+    if (0 != mflash_drv_program((void *)mflash_sector_addr(sector), (const uint8_t *)&meta, sizeof(meta)))
         return -1;
 
-    for (mflash_file_t *tmp_file = g_file_table; (0 != tmp_file->flash_addr) && (0 != tmp_file->max_size);
-         tmp_file += 1)
+    g_seq                = meta.seq;
+    g_sector_seq[sector] = meta.seq;
+    g_sectors_used++;
+    g_head     = sector;
+    g_head_off = sizeof(msector_meta_t);
+    return 0;
+}
+
+/* Copy the records of the oldest sector which are the latest of their file to the head, then erase it */
+static int32_t mflash_sector_collect(void)
+{
+    uint32_t oldest = MFLASH_FILE_NONE;
+    uint32_t addr;
+    uint32_t off;
+
+    for (uint32_t sector = 0; sector < MFLASH_FILE_SECTORS; sector++)
     {
-        /* Found a file by path */
-        if (0 == strncmp(path, tmp_file->path, 64))
+        if (0 != g_sector_seq[sector] && sector != g_head &&
+            (MFLASH_FILE_NONE == oldest || g_sector_seq[sector] < g_sector_seq[oldest]))
+            oldest = sector;
+    }
+    if (MFLASH_FILE_NONE == oldest)
+        return -1;
+
+    addr = mflash_sector_addr(oldest);
+    for (off = sizeof(msector_meta_t); mflash_record_is_valid(addr + off, MFLASH_SECTOR_SIZE - off);
+         off += mflash_record_size((const mfile_meta_t *)(addr + off)))
+    {
+        const mfile_meta_t *meta = (const mfile_meta_t *)(addr + off);
+        uint32_t size            = mflash_record_size(meta);
+        mfile_index_t *entry     = mflash_index_lookup(mflash_record_path(addr + off), meta->path_len,
+                                                       mflash_hash(mflash_record_path(addr + off), meta->path_len));
+
+        if (NULL == entry || entry->addr != addr + off)
+            continue;
+
+        /* Live record, the reserved sectors have room for it */
+        if (g_head_off + size > MFLASH_SECTOR_SIZE && 0 != mflash_sector_open())
+            return -1;
+        if (0 != mflash_file_program(mflash_sector_addr(g_head) + g_head_off, (const uint8_t *)meta, size, true))
+            return -1;
+        entry->addr = mflash_sector_addr(g_head) + g_head_off;
+        g_head_off += size;
+    }
+
+    if (0 != mflash_drv_erase((void *)addr, MFLASH_SECTOR_SIZE))
+        return -1;
+    g_sector_seq[oldest] = 0;
+    g_sectors_used--;
+    return 0;
+}
+
+/* Make room for a record of 'size' bytes at the head of the log */
+static int32_t mflash_log_reserve(uint32_t size)
+{
+    if (MFLASH_FILE_NONE != g_head && g_head_off + size <= MFLASH_SECTOR_SIZE)
+        return 0;
+
+    /* Each collection frees a sector unless the oldest one only holds live records */
+    for (uint32_t i = 0; MFLASH_FILE_SECTORS - g_sectors_used <= MFLASH_FILE_GC_RESERVE; i++)
+    {
+        if (i == MFLASH_FILE_SECTORS || 0 != mflash_sector_collect())
+            return -1;
+    }
+    return mflash_sector_open();
+}
+
+/* Replay the records of a sector into the index, returns the offset of the end of the valid records */
+static uint32_t mflash_sector_scan(uint32_t sector)
+{
+    uint32_t addr = mflash_sector_addr(sector);
+    uint32_t off  = sizeof(msector_meta_t);
+
+    while (mflash_record_is_valid(addr + off, MFLASH_SECTOR_SIZE - off))
+    {
+        (void)mflash_index_update(addr + off);
+        off += mflash_record_size((const mfile_meta_t *)(addr + off));
+    }
+
+    /* A record was interrupted, nothing more is appended to this sector */
+    if (off + sizeof(uint32_t) <= MFLASH_SECTOR_SIZE && 0xFFFFFFFF != *(const uint32_t *)(addr + off))
+        off = MFLASH_SECTOR_SIZE;
+    return off;
+}
+
+bool mflash_is_initialized()
+{
+    return g_mflash_initialized;
+}
+
+BaseType_t mflash_init(bool init_drv)
+{
+    uint32_t last_seq = 0;
+
+    /* Init flash driver */
+    if (init_drv)
+        mflash_drv_init();
+
+    memset(g_file_index, 0, sizeof(g_file_index));
+    memset(g_sector_seq, 0, sizeof(g_sector_seq));
+    g_sectors_used = 0;
+    g_seq          = 0;
+    g_head         = MFLASH_FILE_NONE;
+    g_head_off     = 0;
+
+    for (uint32_t sector = 0; sector < MFLASH_FILE_SECTORS; sector++)
+    {
+        const msector_meta_t *meta = (const msector_meta_t *)mflash_sector_addr(sector);
+
+        if (MFLASH_SECTOR_MAGIC_NO == meta->magic_no && meta->seq == ~meta->seq_inv && 0 != meta->seq &&
+            MFLASH_FILE_NONE != meta->seq)
         {
-            status = 0;
-            *file  = *tmp_file;
-            break;
+            g_sector_seq[sector] = meta->seq;
+            g_sectors_used++;
         }
     }
-    return status;
+
+    /* Replay the sectors from the oldest one, a later record of a file replaces the earlier ones in the index */
+    for (uint32_t i = 0; i < g_sectors_used; i++)
+    {
+        uint32_t next = MFLASH_FILE_NONE;
+
+        for (uint32_t sector = 0; sector < MFLASH_FILE_SECTORS; sector++)
+        {
+            if (g_sector_seq[sector] > last_seq && (MFLASH_FILE_NONE == next || g_sector_seq[sector] < g_sector_seq[next]))
+                next = sector;
+        }
+
+        last_seq   = g_sector_seq[next];
+        g_head     = next;
+        g_head_off = mflash_sector_scan(next);
+    }
+    g_seq = last_seq;
+
+    g_mflash_initialized = true;
+    return pdTRUE;
+}
+
+/* Append a record of a file, data in XIP is staged through RAM */
+static BaseType_t mflash_file_append(const char *path, uint32_t path_len, const uint8_t *data, uint32_t size, bool xip)
+{
+    mfile_meta_t *meta = (mfile_meta_t *)g_record_buf;
+    uint32_t hash      = mflash_hash((const uint8_t *)path, path_len);
+    mfile_index_t *entry;
+    uint32_t addr;
+
+    /* No room for another file */
+    entry = mflash_index_lookup((const uint8_t *)path, path_len, hash);
+    if (NULL == entry)
+        return pdFALSE;
+    /* The same content is not written again, e.g. a device provisioned again */
+    if (0 != entry->addr && ((const mfile_meta_t *)entry->addr)->file_size == size &&
+        0 == memcmp(mflash_record_data(entry->addr), data, size))
+        return pdTRUE;
+
+    /* Set meta data, the path is padded with erased bytes */
+    memset(g_record_buf, 0xFF, sizeof(g_record_buf));
+    memcpy(meta + 1, path, path_len);
+    meta->magic_no  = MFLASH_META_MAGIC_NO;
+    meta->path_len  = (uint16_t)path_len;
+    meta->reserved  = 0xFFFF;
+    meta->file_size = size;
+    meta->crc       = mflash_record_crc(meta, (const uint8_t *)(meta + 1), data);
+
+    if (0 != mflash_log_reserve(mflash_record_size(meta)))
+        return pdFALSE;
+
+    /* Meta data first, an interrupted record then fails its CRC */
+    addr = mflash_sector_addr(g_head) + g_head_off;
+    if (0 != mflash_file_program(addr, (const uint8_t *)g_record_buf, sizeof(mfile_meta_t) + MFLASH_ALIGN4(path_len), false))
+        return pdFALSE;
+    g_head_off += mflash_record_size(meta);
+    if (0 != mflash_file_program((uint32_t)mflash_record_data(addr), data, size, xip))
+        return pdFALSE;
+
+    /* The collection may have moved the entry */
+    entry       = mflash_index_lookup((const uint8_t *)path, path_len, hash);
+    entry->hash = hash;
+    entry->addr = addr;
+    return pdTRUE;
 }
 
-/* NOTE: Don't try to store constant data that are located in XIP !! */
 /* API, write to file of path 'pcFileName' */
 BaseType_t mflash_save_file(char *pcFileName, uint8_t *pucData, uint32_t ulDataSize)
 {
-    mflash_file_t tmp_file = {0};
-    mfile_meta_t tmp_meta  = {0};
+    uint32_t path_len = strnlen(pcFileName, MFLASH_FILE_MAX_PATH + 1);
 
-    /* No file was found in file table */
-    if (0 != mflash_find_file(pcFileName, &tmp_file))
+    if (!g_mflash_initialized || 0 == path_len || path_len > MFLASH_FILE_MAX_PATH)
         return pdFALSE;
     /* Trying to write data over file boundary */
-    if (ulDataSize > tmp_file.max_size + sizeof(tmp_meta))
+    if (ulDataSize > MFLASH_FILE_MAX_SIZE)
         return pdFALSE;
-    /* Write real data after a meta data location */
-    if (0 != mflash_drv_write((void *)(tmp_file.flash_addr + sizeof(tmp_meta)), pucData, ulDataSize))
-        return pdFALSE;
-    /* Set & write meta data before a real data */
-    tmp_meta.magic_no  = MFLASH_META_MAGIC_NO;
-    tmp_meta.file_size = ulDataSize;
-    if (0 != mflash_drv_write((void *)tmp_file.flash_addr, (uint8_t *)&tmp_meta, sizeof(tmp_meta)))
+    return mflash_file_append(pcFileName, path_len, pucData, ulDataSize, false);
+}
+
+/* Check if a sector holds a file of the fixed-slot layout */
+static bool mflash_legacy_is_valid(uint32_t sector)
+{
+    const mfile_legacy_meta_t *meta = (const mfile_legacy_meta_t *)mflash_sector_addr(sector);
+
+    /* A sector of the log has its sequence number there */
+    if (0 != g_sector_seq[sector])
+        return false;
+    return MFLASH_META_MAGIC_NO == meta->magic_no && meta->file_size <= MFLASH_FILE_MAX_SIZE;
+}
+
+/* API, move the files of the fixed-slot layout into the log */
+BaseType_t mflash_migrate_legacy(const char *const *ppcPaths, uint32_t ulSlots)
+{
+    bool found = false;
+    bool moved = false;
+
+    if (!g_mflash_initialized || 2 * ulSlots + MFLASH_FILE_GC_RESERVE >= MFLASH_FILE_SECTORS)
         return pdFALSE;
+
+    for (uint32_t slot = 0; slot < ulSlots; slot++)
+        found = found || mflash_legacy_is_valid(slot);
+    if (!found)
+        return pdTRUE;
+
+    /* The log starts after the slots, so none is erased by a sector open before its file is copied */
+    if (MFLASH_FILE_NONE == g_head)
+    {
+        g_head     = ulSlots - 1;
+        g_head_off = MFLASH_SECTOR_SIZE;
+        moved      = true;
+    }
+
+    for (uint32_t slot = 0; slot < ulSlots; slot++)
+    {
+        const mfile_legacy_meta_t *meta = (const mfile_legacy_meta_t *)mflash_sector_addr(slot);
+        uint32_t path_len               = strnlen(ppcPaths[slot], MFLASH_FILE_MAX_PATH + 1);
+        mfile_index_t *entry;
+
+        if (!mflash_legacy_is_valid(slot) || 0 == path_len || path_len > MFLASH_FILE_MAX_PATH)
+            continue;
+
+        /* Already copied by a migration interrupted before the slots were erased */
+        entry = mflash_index_lookup((const uint8_t *)ppcPaths[slot], path_len,
+                                    mflash_hash((const uint8_t *)ppcPaths[slot], path_len));
+        if (NULL != entry && 0 != entry->addr)
+            continue;
+
+        if (pdTRUE != mflash_file_append(ppcPaths[slot], path_len, (const uint8_t *)(meta + 1), meta->file_size, true))
+            return pdFALSE;
+    }
+
+    /* No record was appended, the log is still empty */
+    if (moved && 0 == g_sector_seq[g_head])
+    {
+        g_head     = MFLASH_FILE_NONE;
+        g_head_off = 0;
+    }
+
+    /* All files are in the log, the slots are free sectors from now on */
+    for (uint32_t slot = 0; slot < ulSlots; slot++)
+    {
+        if (mflash_legacy_is_valid(slot) && 0 != mflash_drv_erase((void *)mflash_sector_addr(slot), MFLASH_SECTOR_SIZE))
+            return pdFALSE;
+    }
     return pdTRUE;
 }
 
 /* API, read file of path 'pcFileName' */
 BaseType_t mflash_read_file(char *pcFileName, uint8_t **ppucData, uint32_t *pulDataSize)
 {
-    mflash_file_t tmp_file = {0};
-    mfile_meta_t *tmp_meta = NULL;
-    /* No file was found in file table */
-    if (0 != mflash_find_file(pcFileName, &tmp_file))
-        return pdFALSE;
-    /* Locate meta data and check magic number */
-    tmp_meta = (mfile_meta_t *)tmp_file.flash_addr;
-    /* To avoid hard-fault better check NULL ptr */
-    if (NULL == tmp_meta)
+    uint32_t path_len = strnlen(pcFileName, MFLASH_FILE_MAX_PATH + 1);
+    mfile_index_t *entry;
+
+    if (!g_mflash_initialized || path_len > MFLASH_FILE_MAX_PATH)
         return pdFALSE;
-    /* Magic number does not match, this location is not a valid file */
-    if (MFLASH_META_MAGIC_NO != tmp_meta->magic_no)
+    entry = mflash_index_lookup((const uint8_t *)pcFileName, path_len, mflash_hash((const uint8_t *)pcFileName, path_len));
+    /* No file was found */
+    if (NULL == entry || 0 == entry->addr)
         return pdFALSE;
     /* Set file size and set data pointer to real_data */
-    *pulDataSize = tmp_meta->file_size;
-    *ppucData    = (uint8_t *)(tmp_file.flash_addr + sizeof(*tmp_meta));
+    *pulDataSize = ((const mfile_meta_t *)entry->addr)->file_size;
+    *ppucData    = mflash_record_data(entry->addr);
     return pdTRUE;
 }
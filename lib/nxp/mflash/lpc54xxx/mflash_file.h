@@ -9,22 +9,40 @@
 
 #include "mflash_drv.h"
 
-typedef struct
-{
-    uint32_t flash_addr;
-    uint32_t max_size;
-    char path[64];
-} mflash_file_t;
-
+/* Flash area of the file store, a log of the saved files over a ring of sectors */
 #define MFLASH_FILE_BASEADDR (0x10800000)
-#define MFLASH_FILE_SIZE (MFLASH_SECTOR_SIZE)
+#define MFLASH_FILE_AREA_SIZE (32 * MFLASH_SECTOR_SIZE)
+
+/* Sectors kept free for the garbage collection to move the live files of the oldest sector */
+#define MFLASH_FILE_GC_RESERVE (1)
+
+/* Number of files in the RAM index, a power of 2 */
+#define MFLASH_FILE_MAX_FILES (16)
+
+/* Maximum length of a path, without terminating zero */
+#define MFLASH_FILE_MAX_PATH (64)
+
+/* Maximum size of a file, a file record and its path fit in a sector */
+#define MFLASH_FILE_MAX_SIZE (MFLASH_SECTOR_SIZE - 32 - MFLASH_FILE_MAX_PATH)
 
 bool mflash_is_initialized(void);
 
-BaseType_t mflash_init(mflash_file_t *user_file_table, bool init_drv);
+/* Scans the file store and builds the index, nothing is written to the flash */
+BaseType_t mflash_init(bool init_drv);
 
+/* Data is returned in place in the flash, the pointer is valid until the next file is saved. As the garbage
+ * collection of a save may erase it, callers copy the data out in the context that runs the saves. */
 BaseType_t mflash_read_file(char *pcFileName, uint8_t **ppucData, uint32_t *pulDataSize);
 
+/* NOTE: Don't try to store constant data that are located in XIP !! */
 BaseType_t mflash_save_file(char *pcFileName, uint8_t *pucData, uint32_t ulDataSize);
 
+/*
+ * Before the log, the file store gave each file of a table a fixed sector of the same area, the file of
+ * 'ppcPaths[n]' in sector n. Copies the files found in the first 'ulSlots' sectors into the log, then erases these
+ * sectors, nothing is written once they are migrated. To be called after mflash_init() and before any file is saved,
+ * a file larger than MFLASH_FILE_MAX_SIZE is not migrated and has to be provisioned again.
+ */
+BaseType_t mflash_migrate_legacy(const char *const *ppcPaths, uint32_t ulSlots);
+
 #endif
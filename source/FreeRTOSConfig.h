@@ -73,7 +73,29 @@
 /* Memory allocation related definitions. */
 #define configSUPPORT_STATIC_ALLOCATION         1
 #define configSUPPORT_DYNAMIC_ALLOCATION        1
-#define configTOTAL_HEAP_SIZE                   ((size_t)(98 * 1024))
+/* Set NETWORK_BULK_PROFILE_ENABLED to 1 for the bulk transfer network profile of
+ * FreeRTOSIPConfig.h, larger TCP windows meant for the OTA download, for 32 KB more
+ * heap. Its effect on the OTA throughput has not been measured, the receive test of
+ * NETWORK_THROUGHPUT_BENCH_ENABLED in benchmarks.h compares both profiles. */
+#ifndef NETWORK_BULK_PROFILE_ENABLED
+#define NETWORK_BULK_PROFILE_ENABLED            0
+#endif
+
+/* mbed TLS allocates from its own 40 KB of slabs and arena, see MBEDTLS_FREERTOS_ARENA_SIZE
+ * in mbedtls_freertos_port.c, add the arena back here when setting it to 0.
+ * The two receive rings of the ENET hold eight full size network buffers from this heap,
+ * in place of the static receive buffers of the driver, 6 KB for each ring. The bulk
+ * transfer profile adds the larger TCP buffers of the OTA connection and the segments
+ * in flight. NETWORK_THROUGHPUT_BENCH_ENABLED in benchmarks.h reports the minimum ever free
+ * heap with both rings full, check it after changing either.
+ * The heap and the mbed TLS arena are in the .bss of SRAMX (192 KB), with the data and
+ * the code run from RAM. With the bulk transfer profile they take 142 KB of it, check
+ * the SRAMX usage printed by the linker, or shrink MBEDTLS_FREERTOS_ARENA_SIZE. */
+#if ( NETWORK_BULK_PROFILE_ENABLED == 1 )
+#define configTOTAL_HEAP_SIZE                   ((size_t)(102 * 1024))
+#else
+#define configTOTAL_HEAP_SIZE                   ((size_t)(70 * 1024))
+#endif
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
 /* Hook function related definitions. */
@@ -60,9 +60,15 @@
 
 /* If the network card/driver includes checksum offloading (IP/TCP/UDP checksums)
  * then set ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM to 1 to prevent the software
- * stack repeating the checksum calculations. */
+ * stack repeating the checksum calculations.  The ENET MAC checks them, the
+ * network interface checks in software the frames the MAC does not. */
 #define ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM     1
 
+/* Set ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM to 1 to have the ENET MAC insert
+ * the IP/TCP/UDP/ICMP checksums of the transmitted frames instead of the
+ * software stack. */
+#define ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM     1
+
 /* Several API's will block until the result is known, or the action has been
  * performed, for example FreeRTOS_send() and FreeRTOS_recv().  The timeouts can be
  * set per socket, using setsockopt().  If not set, the times below will be
@@ -191,8 +197,14 @@ extern UBaseType_t uxRand();
 /* ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS defines the total number of network buffer that
  * are available to the IP stack.  The total number of network buffers is limited
  * to ensure the total amount of RAM that can be consumed by the IP stack is capped
- * to a pre-determinable value. */
-#define ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS                15
+ * to a pre-determinable value.  The bulk transfer profile, see
+ * NETWORK_BULK_PROFILE_ENABLED in FreeRTOSConfig.h, adds one network buffer per
+ * segment of its larger receive window. */
+#if ( NETWORK_BULK_PROFILE_ENABLED == 1 )
+    #define ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS            31
+#else
+    #define ipconfigNUM_NETWORK_BUFFER_DESCRIPTORS            23
+#endif
 
 /* A FreeRTOS queue is used to send events from application tasks to the IP
  * stack.  ipconfigEVENT_QUEUE_LENGTH sets the maximum number of events that can
@@ -224,6 +236,10 @@ extern UBaseType_t uxRand();
 /* Use the TCP socket wake context with a callback. */
 #define ipconfigSOCKET_HAS_USER_WAKE_CALLBACK_WITH_CONTEXT    ( 1 )
 
+/* Allow a task to register FREERTOS_SO_WAKEUP_CALLBACK on a socket. The MQTT
+ * agent uses it to wake up as soon as data arrives instead of polling. */
+#define ipconfigSOCKET_HAS_USER_WAKE_CALLBACK                 ( 1 )
+
 /* USE_WIN: Let TCP use windowing mechanism. */
 #define ipconfigUSE_TCP_WIN                                   ( 1 )
 
@@ -231,8 +247,13 @@ extern UBaseType_t uxRand();
  * contain.  For normal Ethernet V2 frames the maximum MTU is 1500.  Setting a
  * lower value can save RAM, depending on the buffer management scheme used.  If
  * ipconfigCAN_FRAGMENT_OUTGOING_PACKETS is 1 then (ipconfigNETWORK_MTU - 28) must
- * be divisible by 8. */
-#define ipconfigNETWORK_MTU                                   1200
+ * be divisible by 8.  The bulk transfer profile uses full size frames, which
+ * carry an OTA block of 1 KB with its MQTT and TLS overhead in one segment. */
+#if ( NETWORK_BULK_PROFILE_ENABLED == 1 )
+    #define ipconfigNETWORK_MTU                               1500
+#else
+    #define ipconfigNETWORK_MTU                               1200
+#endif
 
 /* Set ipconfigUSE_DNS to 1 to include a basic DNS client/resolver.  DNS is used
  * through the FreeRTOS_gethostbyname() API function. */
@@ -275,6 +296,20 @@ extern UBaseType_t uxRand();
  * 32-bit-aligned, plus 16-bit(!) */
 #define ipconfigPACKET_FILLER_SIZE                            2
 
+/* The network interface hands the network buffers to the ENET DMA, which
+ * receives frames into the buffers and sends frames from them without copy.
+ * The receive descriptors own one network buffer each, eight of the network
+ * buffers above, four per receive ring, are always held by the driver.  The DMA
+ * writes a frame at the Ethernet buffer, which the default ipconfigBUFFER_PADDING
+ * of 8 + ipconfigPACKET_FILLER_SIZE bytes places 2 bytes past a word boundary,
+ * so that the IP header is 32-bit aligned. */
+#define ipconfigZERO_COPY_RX_DRIVER                           1
+#define ipconfigZERO_COPY_TX_DRIVER                           1
+
+/* The network interface drains the receive ring in one pass and hands the
+ * frames received to the IP task as a chain, in a single event. */
+#define ipconfigUSE_LINKED_RX_MESSAGES                        1
+
 /* Define the size of the pool of TCP window descriptors.  On the average, each
  * TCP socket will use up to 2 x 6 descriptors, meaning that it can have 2 x 6
  * outstanding packets (for Rx and Tx).  When using up to 10 TP sockets
@@ -282,11 +317,25 @@ extern UBaseType_t uxRand();
 #define ipconfigTCP_WIN_SEG_COUNT                             240
 
 /* Each TCP socket has a circular buffers for Rx and Tx, which have a fixed
- * maximum size.  Define the size of Rx buffer for TCP sockets. */
-#define ipconfigTCP_RX_BUFFER_LENGTH                          ( 3000 )
+ * maximum size.  The TCP windows default to half of these buffers, so 3000
+ * bytes leave a single segment in flight.  The bulk transfer profile buffers 12
+ * segments, for a receive window of 6 segments, 8760 bytes, which holds the 4
+ * OTA blocks of a request (otaconfigMAX_NUM_BLOCKS_REQUEST).  Window scaling
+ * is offered by FreeRTOS+TCP (ipconfigUSE_TCP_WIN) once a window exceeds 64 KB,
+ * which the heap of this device does not allow.  Define the size of Rx buffer
+ * for TCP sockets. */
+#if ( NETWORK_BULK_PROFILE_ENABLED == 1 )
+    #define ipconfigTCP_RX_BUFFER_LENGTH                      ( 12 * 1460 )
+#else
+    #define ipconfigTCP_RX_BUFFER_LENGTH                      ( 3000 )
+#endif
 
 /* Define the size of Tx buffer for TCP sockets. */
-#define ipconfigTCP_TX_BUFFER_LENGTH                          ( 3000 )
+#if ( NETWORK_BULK_PROFILE_ENABLED == 1 )
+    #define ipconfigTCP_TX_BUFFER_LENGTH                      ( 4 * 1460 )
+#else
+    #define ipconfigTCP_TX_BUFFER_LENGTH                      ( 3000 )
+#endif
 
 /* When using call-back handlers, the driver may check if the handler points to
  * real program memory (RAM or flash) or just has a random non-zero value. */
@@ -86,6 +86,7 @@
 #define MBEDTLS_SSL_PROTO_TLS1_2
 #define MBEDTLS_SSL_ALPN
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
+#define MBEDTLS_SSL_SESSION_TICKETS
 
 /* Check certificate key usage. */
 #define MBEDTLS_X509_CHECK_KEY_USAGE
@@ -148,6 +149,9 @@ int mbedtls_platform_send( void * ctx,
 int mbedtls_platform_recv( void * ctx,
                            unsigned char * buf,
                            size_t len );
+int mbedtls_platform_recv_poll( void * ctx,
+                                unsigned char * buf,
+                                size_t len );
 
 /* The entropy poll function. */
 int mbedtls_platform_entropy_poll( void * data,
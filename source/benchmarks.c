@@ -0,0 +1,486 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @brief Benchmarks of the demo, see benchmarks.h.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Freescale includes. */
+#include "fsl_device_registers.h"
+#include "fsl_debug_console.h"
+
+#include "FreeRTOS_IP.h"
+#include "FreeRTOS_IP_Private.h"
+#include "FreeRTOS_Sockets.h"
+
+#include "tls_freertos_pkcs11.h"
+#include "flash_task.h"
+#include "mflash_drv.h"
+#include "mflash_file.h"
+#include "mbedtls_freertos_port.h"
+#include "network_interface_lpc54018.h"
+#include "spifi_boot.h"
+#include "benchmarks.h"
+
+/**
+ * @brief Milliseconds per FreeRTOS tick, to report durations counted in ticks.
+ */
+#define MILLISECONDS_PER_TICK    ( 1000U / configTICK_RATE_HZ )
+
+#if ( ( FLASH_UPDATE_BENCH_ENABLED == 1 ) || ( NETWORK_CHECKSUM_BENCH_ENABLED == 1 ) || ( TLS_RECONNECT_BENCH_ENABLED == 1 ) )
+
+/**
+ * @brief Start the DWT cycle counter, which the benchmarks read to time their runs.
+ * The counter is left running and not reset, the benchmarks only take differences of it.
+ */
+    static void prvCycleCounterEnable( void )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+#endif
+
+#if ( NETWORK_THROUGHPUT_BENCH_ENABLED == 1 )
+
+/**
+ * @brief Report the receive and transmit throughput of a TCP connection and the counters
+ * of the network interface during the transfer, see NETWORK_THROUGHPUT_BENCH_ENABLED.
+ *
+ * @param[in] pvParameters Unused.
+ */
+    static void prvNetworkThroughputBenchTask( void * pvParameters );
+
+/**
+ * @brief Wait for a host to connect to a port.
+ *
+ * @param[in] usPort Port to listen on.
+ *
+ * @return The connected socket, NULL on failure.
+ */
+    static Socket_t prvBenchAccept( uint16_t usPort );
+
+/**
+ * @brief Report the throughput of a transfer and the interface counters since it started.
+ *
+ * @param[in] pcName Direction of the transfer.
+ * @param[in] ulBytes Bytes transferred.
+ * @param[in] xTicks Duration of the transfer.
+ * @param[in] pxBefore Interface counters when the transfer started.
+ */
+    static void prvPrintThroughput( const char * pcName,
+                                    uint32_t ulBytes,
+                                    TickType_t xTicks,
+                                    const NetworkInterfaceStats_t * pxBefore );
+#endif
+
+#if ( FLASH_UPDATE_BENCH_ENABLED == 1 )
+    void vFlashUpdateBench( void )
+    {
+        static uint8_t ucSector[ MFLASH_SECTOR_SIZE ];
+        void * pvSector = ( void * ) ( BOOT_EXEC_IMAGE_ADDR + 3 * BOOT_SLOT_SIZE - MFLASH_SECTOR_SIZE );
+        uint32_t ulStart;
+        uint32_t ulCycles;
+        uint32_t i;
+
+        if( mflash_drv_init() != 0 )
+        {
+            PRINTF( "Flash update benchmark: driver init failed.\r\n" );
+            return;
+        }
+
+        prvCycleCounterEnable();
+
+        memcpy( ucSector, pvSector, sizeof( ucSector ) );
+
+        ulStart = DWT->CYCCNT;
+
+        for( i = 0; i < FLASH_UPDATE_BENCH_COUNT; i++ )
+        {
+            ( void ) mflash_drv_write( pvSector, ucSector, sizeof( ucSector ) );
+        }
+
+        ulCycles = ( DWT->CYCCNT - ulStart ) / FLASH_UPDATE_BENCH_COUNT;
+        PRINTF( "Flash update benchmark: %u cycles per 4 KB unchanged\r\n", ulCycles );
+
+        for( i = 0; i < sizeof( ucSector ); i++ )
+        {
+            ucSector[ i ] &= 0xFEU;
+        }
+
+        ulStart = DWT->CYCCNT;
+        ( void ) mflash_drv_write( pvSector, ucSector, sizeof( ucSector ) );
+        ulCycles = DWT->CYCCNT - ulStart;
+        PRINTF( "Flash update benchmark: %u cycles per 4 KB program\r\n", ulCycles );
+
+        for( i = 0; i < sizeof( ucSector ); i++ )
+        {
+            ucSector[ i ] |= 0x01U;
+        }
+
+        ulStart = DWT->CYCCNT;
+        ( void ) mflash_drv_write( pvSector, ucSector, sizeof( ucSector ) );
+        ulCycles = DWT->CYCCNT - ulStart;
+        PRINTF( "Flash update benchmark: %u cycles per 4 KB erase\r\n", ulCycles );
+    }
+#endif /* if ( FLASH_UPDATE_BENCH_ENABLED == 1 ) */
+
+#if ( NETWORK_CHECKSUM_BENCH_ENABLED == 1 )
+    void vChecksumBench( void )
+    {
+        static uint8_t ucFrame[ ipSIZE_OF_ETH_HEADER + ipconfigNETWORK_MTU ];
+        TCPPacket_t * pxPacket = ( TCPPacket_t * ) ucFrame;
+        uint32_t ulStart;
+        uint32_t ulCycles;
+        uint32_t i;
+
+        for( i = 0; i < sizeof( ucFrame ); i++ )
+        {
+            ucFrame[ i ] = ( uint8_t ) i;
+        }
+
+        pxPacket->xEthernetHeader.usFrameType = ipIPv4_FRAME_TYPE;
+        pxPacket->xIPHeader.ucVersionHeaderLength = ipIPV4_VERSION_HEADER_LENGTH_MIN;
+        pxPacket->xIPHeader.usLength = FreeRTOS_htons( ipconfigNETWORK_MTU );
+        pxPacket->xIPHeader.ucProtocol = ipPROTOCOL_TCP;
+        pxPacket->xTCPHeader.ucTCPOffset = 0x50U;
+
+        prvCycleCounterEnable();
+
+        ulStart = DWT->CYCCNT;
+
+        for( i = 0; i < NETWORK_CHECKSUM_BENCH_COUNT; i++ )
+        {
+            /* What the IP task runs per segment sent without checksum offload. */
+            pxPacket->xIPHeader.usHeaderChecksum = 0U;
+            pxPacket->xIPHeader.usHeaderChecksum = ~usGenerateChecksum( 0U,
+                                                                        ( const uint8_t * ) &( pxPacket->xIPHeader ),
+                                                                        ipSIZE_OF_IPv4_HEADER );
+            ( void ) usGenerateProtocolChecksum( ucFrame, sizeof( ucFrame ), pdTRUE );
+        }
+
+        ulCycles = ( DWT->CYCCNT - ulStart ) / NETWORK_CHECKSUM_BENCH_COUNT;
+        PRINTF( "Checksum benchmark: %u cycles per %u byte TCP segment\r\n", ulCycles, ipconfigNETWORK_MTU );
+    }
+#endif /* if ( NETWORK_CHECKSUM_BENCH_ENABLED == 1 ) */
+
+#if ( TLS_SESSION_PERSIST_ENABLED == 1 )
+
+/**
+ * @brief Buffer of the exported TLS session.
+ */
+    static uint8_t ucTlsSession[ TLS_SESSION_FILE_SIZE ];
+
+/**
+ * @brief Saves the TLS session file, run by the flash task.
+ */
+    static int32_t prvSaveTlsSessionFile( void * pvContext,
+                                          uint32_t ulAddress,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength )
+    {
+        ( void ) pvContext;
+        ( void ) ulAddress;
+
+        return ( pdTRUE == mflash_save_file( TLS_SESSION_FILE_NAME, ( uint8_t * ) pucData, ulLength ) ) ? 0 : -1;
+    }
+
+/**
+ * @brief Copies the TLS session file to the session buffer, run by the flash task.
+ *
+ * The file is read in place in the flash, where the next save may move it.
+ */
+    static int32_t prvLoadTlsSessionFile( void * pvContext,
+                                          uint32_t ulAddress,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength )
+    {
+        uint32_t * pulLength = ( uint32_t * ) pvContext;
+        uint8_t * pucFileData = NULL;
+        uint32_t ulFileSize = 0;
+
+        ( void ) ulAddress;
+        ( void ) pucData;
+        ( void ) ulLength;
+
+        if( ( pdTRUE != mflash_read_file( TLS_SESSION_FILE_NAME, &pucFileData, &ulFileSize ) ) ||
+            ( ulFileSize > sizeof( ucTlsSession ) ) )
+        {
+            return -1;
+        }
+
+        memcpy( ucTlsSession, pucFileData, ulFileSize );
+        *pulLength = ulFileSize;
+
+        return 0;
+    }
+
+    void vLoadTlsSession( void )
+    {
+        uint32_t ulLength = 0;
+
+        if( mflash_is_initialized() &&
+            ( 0 == lFlashTaskRun( prvLoadTlsSessionFile, &ulLength, 0, NULL, 0 ) ) )
+        {
+            if( pdTRUE == TLS_FreeRTOS_ImportSession( ucTlsSession, ulLength ) )
+            {
+                PRINTF( "TLS session loaded.\r\n" );
+            }
+
+            memset( ucTlsSession, 0, ulLength );
+        }
+    }
+
+    void vSaveTlsSession( const char * pcHostName,
+                          uint16_t usPort )
+    {
+        size_t xLength;
+
+        xLength = TLS_FreeRTOS_ExportSession( pcHostName, usPort, ucTlsSession, sizeof( ucTlsSession ) );
+
+        /* The file store skips writing an unchanged session. */
+        if( ( xLength != 0U ) &&
+            ( 0 != lFlashTaskRun( prvSaveTlsSessionFile, NULL, 0, ucTlsSession, xLength ) ) )
+        {
+            PRINTF( "TLS session could not be saved.\r\n" );
+        }
+
+        memset( ucTlsSession, 0, xLength );
+    }
+#endif /* if ( TLS_SESSION_PERSIST_ENABLED == 1 ) */
+
+#if ( TLS_RECONNECT_BENCH_ENABLED == 1 )
+    void vTlsReconnectBench( NetworkContext_t * pxNetworkContext,
+                             const char * pcHostName,
+                             uint16_t usPort,
+                             const NetworkCredentials_t * pxNetworkCredentials )
+    {
+        TlsTransportStatus_t xStatus;
+        MbedtlsHeapStats_t xMbedtlsHeapStats;
+        TickType_t xStartTicks;
+        uint32_t ulStart;
+        uint32_t ulCycles;
+        uint32_t ulMs;
+        BaseType_t xResume;
+        uint32_t i;
+
+        prvCycleCounterEnable();
+
+        for( xResume = pdFALSE; xResume <= pdTRUE; xResume++ )
+        {
+            for( i = 0; i < TLS_RECONNECT_BENCH_COUNT; i++ )
+            {
+                if( xResume == pdFALSE )
+                {
+                    TLS_FreeRTOS_ForgetSession( pcHostName, usPort );
+                }
+
+                #if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+                    mbedtls_platform_reset_alloc_profile();
+                #endif
+
+                xStartTicks = xTaskGetTickCount();
+                ulStart = DWT->CYCCNT;
+                xStatus = TLS_FreeRTOS_Connect( pxNetworkContext, pcHostName, usPort, pxNetworkCredentials, 4000, 36000 );
+                ulCycles = DWT->CYCCNT - ulStart;
+                ulMs = ( xTaskGetTickCount() - xStartTicks ) * MILLISECONDS_PER_TICK;
+
+                if( xStatus != TLS_TRANSPORT_SUCCESS )
+                {
+                    PRINTF( "TLS reconnect benchmark: connection failed (%d).\r\n", xStatus );
+                    return;
+                }
+
+                mbedtls_platform_get_heap_stats( &xMbedtlsHeapStats );
+                PRINTF( "TLS reconnect benchmark: %s handshake, %u ms, %u cycles, mbedTLS arena high water mark %u bytes\r\n",
+                        ( pxNetworkContext->sslContext.xSessionResumed == pdTRUE ) ? "resumed" : "full",
+                        ulMs, ulCycles, xMbedtlsHeapStats.xMaxUsedBytes );
+
+                #if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+                    vPrintAllocProfile( ( pxNetworkContext->sslContext.xSessionResumed == pdTRUE ) ? "resumed handshake" : "full handshake" );
+                #endif
+
+                TLS_FreeRTOS_Disconnect( pxNetworkContext );
+            }
+        }
+    }
+#endif /* if ( TLS_RECONNECT_BENCH_ENABLED == 1 ) */
+
+#if ( NETWORK_THROUGHPUT_BENCH_ENABLED == 1 )
+    static Socket_t prvBenchAccept( uint16_t usPort )
+    {
+        static const TickType_t xNoTimeout = portMAX_DELAY;
+        struct freertos_sockaddr xAddress = { 0 };
+        Socket_t xListeningSocket;
+        Socket_t xSocket = NULL;
+
+        xListeningSocket = FreeRTOS_socket( FREERTOS_AF_INET, FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP );
+
+        if( xListeningSocket != FREERTOS_INVALID_SOCKET )
+        {
+            ( void ) FreeRTOS_setsockopt( xListeningSocket, 0, FREERTOS_SO_RCVTIMEO, &xNoTimeout, sizeof( xNoTimeout ) );
+            xAddress.sin_port = FreeRTOS_htons( usPort );
+
+            if( ( FreeRTOS_bind( xListeningSocket, &xAddress, sizeof( xAddress ) ) == 0 ) &&
+                ( FreeRTOS_listen( xListeningSocket, 1 ) == 0 ) )
+            {
+                xSocket = FreeRTOS_accept( xListeningSocket, NULL, NULL );
+            }
+
+            ( void ) FreeRTOS_closesocket( xListeningSocket );
+        }
+
+        return ( xSocket == FREERTOS_INVALID_SOCKET ) ? NULL : xSocket;
+    }
+
+    static void prvPrintThroughput( const char * pcName,
+                                    uint32_t ulBytes,
+                                    TickType_t xTicks,
+                                    const NetworkInterfaceStats_t * pxBefore )
+    {
+        NetworkInterfaceStats_t xAfter;
+        uint32_t ulMs = ( uint32_t ) xTicks * MILLISECONDS_PER_TICK;
+
+        vNetworkInterfaceGetStats( &xAfter );
+
+        PRINTF( "Network benchmark: %s %u bytes in %u ms, %u kbit/s\r\n",
+                pcName, ulBytes, ulMs, ( ulMs != 0U ) ? ( ulBytes / ulMs ) * 8U : 0U );
+        PRINTF( "Network benchmark: rx %u frames, %u priority, %u interrupts, %u copied, %u dropped, "
+                "%u checksum errors, %u software checksums, tx %u frames, %u priority, %u busy, %u dropped\r\n",
+                xAfter.ulRxFrames - pxBefore->ulRxFrames, xAfter.ulRxPriorityFrames - pxBefore->ulRxPriorityFrames,
+                xAfter.ulRxInterrupts - pxBefore->ulRxInterrupts,
+                xAfter.ulRxCopied - pxBefore->ulRxCopied, xAfter.ulRxDropped - pxBefore->ulRxDropped,
+                xAfter.ulRxChecksumErrors - pxBefore->ulRxChecksumErrors,
+                xAfter.ulRxSoftwareChecksums - pxBefore->ulRxSoftwareChecksums,
+                xAfter.ulTxFrames - pxBefore->ulTxFrames, xAfter.ulTxPriorityFrames - pxBefore->ulTxPriorityFrames,
+                xAfter.ulTxBusy - pxBefore->ulTxBusy, xAfter.ulTxDropped - pxBefore->ulTxDropped );
+
+        /* Both receive rings are full of network buffers during the test, this is the
+         * headroom configTOTAL_HEAP_SIZE has to cover. */
+        PRINTF( "Network benchmark: heap minimum ever free %u bytes\r\n", xPortGetMinimumEverFreeHeapSize() );
+    }
+
+    static void prvNetworkThroughputBenchTask( void * pvParameters )
+    {
+        static uint8_t ucBuffer[ 1460 ];
+        NetworkInterfaceStats_t xBefore;
+        Socket_t xSocket;
+        TickType_t xStartTicks;
+        uint32_t ulBytes;
+        BaseType_t xResult;
+
+        ( void ) pvParameters;
+
+        for( ; ; )
+        {
+            /* Receive until the host closes the connection. */
+            xSocket = prvBenchAccept( NETWORK_THROUGHPUT_BENCH_RX_PORT );
+
+            if( xSocket != NULL )
+            {
+                vNetworkInterfaceGetStats( &xBefore );
+                xStartTicks = xTaskGetTickCount();
+                ulBytes = 0;
+
+                while( ( xResult = FreeRTOS_recv( xSocket, ucBuffer, sizeof( ucBuffer ), 0 ) ) >= 0 )
+                {
+                    ulBytes += ( uint32_t ) xResult;
+                }
+
+                prvPrintThroughput( "received", ulBytes, xTaskGetTickCount() - xStartTicks, &xBefore );
+                ( void ) FreeRTOS_closesocket( xSocket );
+            }
+
+            /* Send, then wait for the host to acknowledge the shutdown. */
+            xSocket = prvBenchAccept( NETWORK_THROUGHPUT_BENCH_TX_PORT );
+
+            if( xSocket != NULL )
+            {
+                vNetworkInterfaceGetStats( &xBefore );
+                xStartTicks = xTaskGetTickCount();
+                ulBytes = 0;
+
+                while( ulBytes < NETWORK_THROUGHPUT_BENCH_TX_BYTES )
+                {
+                    xResult = FreeRTOS_send( xSocket, ucBuffer, sizeof( ucBuffer ), 0 );
+
+                    if( xResult < 0 )
+                    {
+                        break;
+                    }
+
+                    ulBytes += ( uint32_t ) xResult;
+                }
+
+                ( void ) FreeRTOS_shutdown( xSocket, FREERTOS_SHUT_RDWR );
+
+                while( FreeRTOS_recv( xSocket, ucBuffer, sizeof( ucBuffer ), 0 ) >= 0 )
+                {
+                }
+
+                prvPrintThroughput( "sent", ulBytes, xTaskGetTickCount() - xStartTicks, &xBefore );
+                ( void ) FreeRTOS_closesocket( xSocket );
+            }
+        }
+    }
+
+    BaseType_t xStartNetworkThroughputBench( void )
+    {
+        return xTaskCreate( prvNetworkThroughputBenchTask, "NetBench", 512, NULL,
+                            ( tskIDLE_PRIORITY + 2 ) | portPRIVILEGE_BIT, NULL );
+    }
+#endif /* if ( NETWORK_THROUGHPUT_BENCH_ENABLED == 1 ) */
+
+#if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+    void vPrintAllocProfile( const char * pcName )
+    {
+        MbedtlsAllocProfile_t xProfile;
+        uint32_t i;
+
+        mbedtls_platform_get_alloc_profile( &xProfile );
+
+        PRINTF( "mbedTLS allocations, %s: %u allocations, %u from the slabs, %u frees, peak %u bytes\r\n",
+                pcName, xProfile.ulAllocations, xProfile.ulSlabAllocations, xProfile.ulFrees, xProfile.xPeakBytes );
+
+        for( i = 0; i < MBEDTLS_FREERTOS_PROFILE_BUCKETS; i++ )
+        {
+            if( xProfile.ulSizeHistogram[ i ] != 0U )
+            {
+                if( i < ( MBEDTLS_FREERTOS_PROFILE_BUCKETS - 1U ) )
+                {
+                    PRINTF( "    up to %5u bytes: %u\r\n", 16U << i, xProfile.ulSizeHistogram[ i ] );
+                }
+                else
+                {
+                    PRINTF( "    larger:          %u\r\n", xProfile.ulSizeHistogram[ i ] );
+                }
+            }
+        }
+    }
+#endif /* if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 ) */
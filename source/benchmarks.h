@@ -0,0 +1,188 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @brief Benchmarks of the demo, each enabled by its flag below and disabled by default.
+ *
+ * They report cycles, as counted by the DWT cycle counter, or times on the debug console. The TLS
+ * session persistence shares this file as it is built on the same file store and transport hooks.
+ */
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "tls_freertos_pkcs11.h"
+#include "mbedtls_freertos_port.h"
+
+/**
+ * @brief Flag which enables the benchmark of the flash sector update at startup.
+ * Disabled by default, it rewrites the last sector of the OTA staging slot.
+ */
+#define FLASH_UPDATE_BENCH_ENABLED          ( 0 )
+
+/**
+ * @brief Number of sector updates timed by the flash update benchmark.
+ */
+#define FLASH_UPDATE_BENCH_COUNT            ( 64U )
+
+/**
+ * @brief Flag which enables the benchmark of the software checksums at startup.
+ * Disabled by default, it reports the cycles the IP task spends on the IPv4 and TCP checksums
+ * of a full size segment, which the ENET MAC computes instead with
+ * ipconfigDRIVER_INCLUDED_RX_IP_CHECKSUM and ipconfigDRIVER_INCLUDED_TX_IP_CHECKSUM.
+ */
+#define NETWORK_CHECKSUM_BENCH_ENABLED      ( 0 )
+
+/**
+ * @brief Number of segments timed by the checksum benchmark.
+ */
+#define NETWORK_CHECKSUM_BENCH_COUNT        ( 256U )
+
+/**
+ * @brief Flag which keeps the TLS session of the broker in the flash file store, so that
+ * the first connection after a reset can resume it. Disabled by default, as the stored
+ * session holds its master secret.
+ */
+#define TLS_SESSION_PERSIST_ENABLED         ( 0 )
+
+/**
+ * @brief File and largest size of the stored TLS session, which includes the session ticket.
+ */
+#define TLS_SESSION_FILE_NAME               "tls_session.dat"
+#define TLS_SESSION_FILE_SIZE               ( 1024U )
+
+/**
+ * @brief Flag which enables the benchmark of the TLS reconnection before connecting to the
+ * broker. Disabled by default, it connects TLS_RECONNECT_BENCH_COUNT times with a full
+ * handshake, then as many times resuming the session.
+ */
+#define TLS_RECONNECT_BENCH_ENABLED         ( 0 )
+
+/**
+ * @brief Number of connections per kind of handshake of the TLS reconnect benchmark.
+ */
+#define TLS_RECONNECT_BENCH_COUNT           ( 4U )
+
+/**
+ * @brief Flag which enables the benchmark of the TCP throughput once the network is up.
+ * Disabled by default, it receives from a host connecting to NETWORK_THROUGHPUT_BENCH_RX_PORT
+ * until the host closes the connection, then sends NETWORK_THROUGHPUT_BENCH_TX_BYTES to a host
+ * connecting to NETWORK_THROUGHPUT_BENCH_TX_PORT, and repeats. From the host:
+ *
+ *   dd if=/dev/zero bs=1024 count=4096 | nc -N <board address> 5001
+ *   nc <board address> 5002 > /dev/null
+ *
+ * The receive test stands for an OTA download. To compare the network profiles, see
+ * NETWORK_BULK_PROFILE_ENABLED, over the round trip time of a broker, delay the host:
+ *
+ *   tc qdisc add dev <host interface> root netem delay 25ms
+ */
+#define NETWORK_THROUGHPUT_BENCH_ENABLED    ( 0 )
+
+/**
+ * @brief Ports and transmit size of the network throughput benchmark.
+ */
+#define NETWORK_THROUGHPUT_BENCH_RX_PORT    ( 5001U )
+#define NETWORK_THROUGHPUT_BENCH_TX_PORT    ( 5002U )
+#define NETWORK_THROUGHPUT_BENCH_TX_BYTES   ( 4U * 1024U * 1024U )
+
+#if ( FLASH_UPDATE_BENCH_ENABLED == 1 )
+
+/**
+ * @brief Report the cycles per 4 KB sector update of the flash driver.
+ * The sector is rewritten with its own content, which only copies the sector and merges the data, then with
+ * bits cleared, which programs it, and with bits set, which erases it.
+ */
+    void vFlashUpdateBench( void );
+#endif
+
+#if ( NETWORK_CHECKSUM_BENCH_ENABLED == 1 )
+
+/**
+ * @brief Report the cycles per full size TCP segment of the IPv4 and TCP checksums computed in
+ * software.
+ */
+    void vChecksumBench( void );
+#endif
+
+#if ( TLS_SESSION_PERSIST_ENABLED == 1 )
+
+/**
+ * @brief Import the TLS session stored by vSaveTlsSession(), if any.
+ */
+    void vLoadTlsSession( void );
+
+/**
+ * @brief Store the cached TLS session of a server in the flash file store.
+ *
+ * @param[in] pcHostName Host name of the server.
+ * @param[in] usPort Port of the server.
+ */
+    void vSaveTlsSession( const char * pcHostName,
+                          uint16_t usPort );
+#endif
+
+#if ( TLS_RECONNECT_BENCH_ENABLED == 1 )
+
+/**
+ * @brief Report the time and the cycles of TLS connections to a server, with a full handshake
+ * and with the session resumed. The cycles are elapsed cycles, including the network round trips.
+ *
+ * @param[in] pxNetworkContext Network context, disconnected on return.
+ * @param[in] pcHostName Host name of the server.
+ * @param[in] usPort Port of the server.
+ * @param[in] pxNetworkCredentials Credentials for the TLS connection.
+ */
+    void vTlsReconnectBench( NetworkContext_t * pxNetworkContext,
+                             const char * pcHostName,
+                             uint16_t usPort,
+                             const NetworkCredentials_t * pxNetworkCredentials );
+#endif
+
+#if ( NETWORK_THROUGHPUT_BENCH_ENABLED == 1 )
+
+/**
+ * @brief Create the task of the network throughput benchmark, see NETWORK_THROUGHPUT_BENCH_ENABLED.
+ *
+ * @return pdPASS if the task was created.
+ */
+    BaseType_t xStartNetworkThroughputBench( void );
+#endif
+
+#if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+
+/**
+ * @brief Report the mbedTLS allocations since the profile was reset, the size histogram
+ * and the peak memory, to tune the slab classes of mbedtls_freertos_port.c.
+ *
+ * @param[in] pcName What was profiled.
+ */
+    void vPrintAllocProfile( const char * pcName );
+#endif
+
+#endif /* ifndef BENCHMARKS_H */
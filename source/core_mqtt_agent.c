@@ -29,7 +29,9 @@
  * application tasks. A queue is used by the application tasks to enqueue an MQTT operation to be picked
  * up by the MQTT agent task. MQTT agent task calls the corresponding MQTT library API and adds it to a pending
  * operations list if the operation requires an acknowledgment. It receives MQTT packets from the network, if there
- * are no operations in queue to be processed.
+ * are no operations in queue to be processed. The agent is woken up by a task notification, given either when an
+ * operation is enqueued or when data is received on the connection, instead of polling the connection.
+ * Publish operations queued back to back are serialized together and sent with a single transport write.
  */
 
 
@@ -45,36 +47,97 @@
 #include "fsl_debug_console.h"
 
 #include "core_mqtt_agent.h"
+#include "core_mqtt_state.h"
 
 /**
- * @brief Task priority for MQTT agent is set to higher priority than other tasks.
+ * @brief Task priority for MQTT agent, below the FreeRTOS+TCP IP task (configMAX_PRIORITIES - 2) which
+ * fills the socket the agent reads from.
  */
-#define MQTT_AGENT_TASK_PRIORITY                ( configMAX_PRIORITIES - 1 )
+#define MQTT_AGENT_TASK_PRIORITY              ( configMAX_PRIORITIES - 3 )
 
 /**
  * @brief Stack size of the MQTT agent, will be the minimum size required by the MQTT library
  * and the underlying transport interface.
  */
-#define MQTT_AGENT_TASK_STACK_SIZE              ( 2048 )
+#define MQTT_AGENT_TASK_STACK_SIZE            ( 2048 )
 
 /**
- * @brief Maximum number of concurrent operations for MQTT agent.
+ * @brief Maximum time the agent sleeps when there are no operations queued and no data received.
+ * The agent wakes up at least this often to send keep-alive packets and to expire pending operations,
+ * and reads the connection at least this often even if no data was signalled.
  */
-#define MQTT_AGENT_MAX_CONCURRENT_OPERATIONS    ( 5 )
+#define MQTT_AGENT_MAX_IDLE_INTERVAL_MS       ( 1000 )
 
 /**
- * @brief Maximum polling interval for the agent. The agent will be listening on incoming messages during
- * this interval.
+ * @brief Mask used to map a packet identifier to its home slot in the pending ACK table.
  */
-#define MQTT_AGENT_MAX_POLLING_INTERVAL_MS      ( 500 )
+#define MQTT_AGENT_ACK_TABLE_MASK             ( MQTT_AGENT_ACK_TABLE_SIZE - 1U )
+
+#if ( ( MQTT_AGENT_ACK_TABLE_SIZE & ( MQTT_AGENT_ACK_TABLE_SIZE - 1U ) ) != 0U )
+    #error "MQTT_AGENT_ACK_TABLE_SIZE must be a power of 2."
+#endif
+
+#if ( MQTT_AGENT_ACK_TABLE_SIZE < ( 2U * MQTT_AGENT_MAX_OUTSTANDING_ACKS ) )
+    #error "MQTT_AGENT_ACK_TABLE_SIZE must be at least twice MQTT_AGENT_MAX_OUTSTANDING_ACKS."
+#endif
+
+#if ( MQTT_AGENT_MAX_OUTSTANDING_ACKS > MQTT_STATE_ARRAY_MAX_COUNT )
+    #error "MQTT_AGENT_MAX_OUTSTANDING_ACKS must not exceed MQTT_STATE_ARRAY_MAX_COUNT."
+#endif
+
+/**
+ * @brief Maximum time the agent retries a batch send which the transport accepted only partially.
+ */
+#define MQTT_AGENT_SEND_TIMEOUT_MS            ( 5000 )
+
+/**
+ * @brief An entry in the pending ACK table.
+ * Entries are keyed by the packet identifier of the operation and are placed using linear probing
+ * starting from the slot selected by MQTT_AGENT_ACK_TABLE_MASK. An empty slot has pOperation set to NULL.
+ */
+typedef struct PendingAck
+{
+    MQTTOperation_t * pOperation;
+    TickType_t startTicks;
+    TickType_t timeoutTicks;
+} PendingAck_t;
+
+/**
+ * @brief Checks if an operation requires an ACK from the broker to complete.
+ *
+ * @param[in] pOperation Pointer to the operation.
+ * @return pdTRUE if the operation holds a slot in the pending ACK table.
+ */
+static BaseType_t operationNeedsAck( const MQTTOperation_t * pOperation );
+
+/**
+ * @brief Invokes the callback of an operation if one is set.
+ *
+ * @param[in] pOperation Pointer to the operation completed.
+ * @param[in] status Status of the operation.
+ */
+static void completeOperation( MQTTOperation_t * pOperation,
+                               MQTTStatus_t status );
 
 /**
  * @brief Function used to add a MQTT operation to the pending list for receiving ACKS from broker.
+ * A slot is always available since callers reserve one in MQTTAgent_Enqueue().
  *
  * @param[in] pOperation Pointer to the operation pending.
- * @return pdTRUE if the operation was enqueued, pdFALSE if max pending operations are reached.
  */
-static BaseType_t addPendingOperation( MQTTOperation_t * pOperation );
+static void addPendingOperation( MQTTOperation_t * pOperation );
+
+/**
+ * @brief Removes the entry at a slot of the pending ACK table.
+ * Entries following the slot in the same probe sequence are shifted back so that lookups do not
+ * need tombstones.
+ *
+ * @param[in] index Index of the slot to be removed.
+ * @param[in] releaseSlot pdTRUE to release the reservation held by the entry, pdFALSE to keep it.
+ * @return Pointer to the MQTT operation removed.
+ */
+static MQTTOperation_t * removePendingOperation( size_t index,
+                                                 BaseType_t releaseSlot );
 
 /**
  * @brief Pops pending MQTT operation with the packet identifier.
@@ -84,22 +147,101 @@ static BaseType_t addPendingOperation( MQTTOperation_t * pOperation );
  */
 static MQTTOperation_t * getPendingOperation( uint16_t packetIdentifier );
 
+/**
+ * @brief Fails pending operations for which an ACK was not received in time.
+ * coreMQTT keeps the outgoing record of an expired QoS1/QoS2 publish until its ACK is received, so the
+ * publish keeps its reservation until then, see expiredPublishCount.
+ */
+static void expirePendingOperations( void );
+
+/**
+ * @brief Fails all pending operations with the given status.
+ *
+ * @param[in] status Status passed to the callback of each operation.
+ */
+static void flushPendingOperations( MQTTStatus_t status );
+
+/**
+ * @brief Sends a publish operation with MQTT_Publish(), used when the publish does not fit in the batch buffer.
+ *
+ * @param[in] pMQTTContext The MQTT context of the connection.
+ * @param[in] pOperation Pointer to the publish operation.
+ */
+static void sendSinglePublish( MQTTContext_t * pMQTTContext,
+                               MQTTOperation_t * pOperation );
+
+/**
+ * @brief Serializes a publish operation at the end of the batch buffer.
+ * A packet identifier is assigned and a coreMQTT state record is reserved for QoS1/QoS2 publishes,
+ * once the publish is serialized.
+ *
+ * @param[in] pMQTTContext The MQTT context of the connection.
+ * @param[in] pOperation Pointer to the publish operation.
+ * @param[in] packetSize Size of the serialized publish packet.
+ * @param[in] remainingLength Remaining length of the publish packet.
+ * @return MQTTSuccess if the publish was added to the batch, error returned by coreMQTT otherwise.
+ */
+static MQTTStatus_t appendPublishToBatch( MQTTContext_t * pMQTTContext,
+                                          MQTTOperation_t * pOperation,
+                                          size_t packetSize,
+                                          size_t remainingLength );
+
+/**
+ * @brief Writes the whole batch buffer with the transport send function.
+ * The time of the last packet sent is updated as MQTT_Publish() does, for the keep-alive.
+ *
+ * @param[in] pMQTTContext The MQTT context of the connection.
+ * @return MQTTSuccess if all bytes were sent, MQTTSendFailed otherwise.
+ */
+static MQTTStatus_t sendBatch( MQTTContext_t * pMQTTContext );
+
+/**
+ * @brief Sends a publish operation along with the publish operations queued right after it.
+ * Consecutive publishes are serialized into one buffer and written with a single transport send, so that
+ * they go out in one TLS record and TCP segment where possible. Each operation is completed individually.
+ *
+ * @param[in] pMQTTContext The MQTT context of the connection.
+ * @param[in] pOperation Pointer to the first publish operation, already dequeued.
+ */
+static void processPublishBatch( MQTTContext_t * pMQTTContext,
+                                 MQTTOperation_t * pOperation );
+
+/**
+ * @brief Fails an operation dequeued while the connection is lost.
+ *
+ * @param[in] pOperation Pointer to the operation.
+ */
+static void failOperation( MQTTOperation_t * pOperation );
+
+/**
+ * @brief Executes an MQTT operation dequeued from the operations queue.
+ *
+ * @param[in] pMQTTContext The MQTT context of the connection.
+ * @param[in] pOperation Pointer to the operation.
+ * @return pdTRUE if the operation requested the agent to stop.
+ */
+static BaseType_t processOperation( MQTTContext_t * pMQTTContext,
+                                    MQTTOperation_t * pOperation );
+
 /**
  * @brief Main agent task loop.
  * Agent runs in a loop processing MQTT operations from application tasks. It exits loop on explicitly calling
- * MQTTAgent_Stop() from application tasks.
+ * MQTTAgent_Stop() from application tasks. The agent sleeps on its task notification until an operation is
+ * enqueued or data is received on the connection.
  *
  * @param[in] pParams Paramaters for the agent task.
  */
 static void prvMQTTAgentLoop( void * pParams );
 
 /**
- * @brief The default operation used when there are no other operations in queue.
+ * @brief Handle of the agent task, used to wake up the agent.
  */
-static MQTTOperation_t receiveOP =
-{
-    .type = MQTT_OP_RECEIVE
-};
+static TaskHandle_t xAgentTask = NULL;
+
+/**
+ * @brief Function used to check for pending received data on the transport.
+ */
+static MQTTAgentDataAvailable_t dataAvailableFunction = NULL;
 
 /**
  * @brief Queue used to receive MQTT operations to be processed by MQTT agent.
@@ -107,9 +249,62 @@ static MQTTOperation_t receiveOP =
 static QueueHandle_t xOperationsQueue;
 
 /**
- * @brief Static array used to keep track of pending MQTT operations that require an ACK to be received from broker.
+ * @brief Counting semaphore holding one token for each free slot in the pending ACK table.
+ * A token is taken by MQTTAgent_Enqueue() and given back when the operation completes.
+ */
+static SemaphoreHandle_t xPendingSlotsSemaphore;
+
+/**
+ * @brief Table used to keep track of pending MQTT operations that require an ACK to be received from broker.
+ * The table is only accessed from the agent task context.
+ */
+static PendingAck_t pendingOperations[ MQTT_AGENT_ACK_TABLE_SIZE ];
+
+/**
+ * @brief Number of operations in the pending ACK table.
+ */
+static size_t pendingOperationsCount = 0;
+
+/**
+ * @brief Number of QoS1/QoS2 publishes given up by the agent whose coreMQTT outgoing record is still held.
+ * Each also holds a token of xPendingSlotsSemaphore. An expired publish releases both when its late ACK is
+ * received, a publish of a failed batch when the application reconnects with a clean session. As there are
+ * no more tokens than records, coreMQTT never runs out of records.
+ */
+static size_t expiredPublishCount = 0;
+
+/**
+ * @brief Buffer used to serialize a batch of publish packets sent with one transport write.
+ */
+static uint8_t batchBuffer[ MQTT_AGENT_BATCH_BUFFER_SIZE ];
+
+/**
+ * @brief Number of bytes serialized in the batch buffer.
  */
-static MQTTOperation_t * pendingOperations[ MQTT_AGENT_MAX_CONCURRENT_OPERATIONS ];
+static size_t batchBufferUsed = 0;
+
+/**
+ * @brief Publish operations serialized in the batch buffer, in the order they were dequeued.
+ */
+static MQTTOperation_t * batchOperations[ MQTT_AGENT_MAX_BATCH_PUBLISHES ];
+
+/**
+ * @brief Number of publish operations in the batch.
+ */
+static size_t batchCount = 0;
+
+/**
+ * @brief Counters of the publish batches sent, reported by MQTTAgent_GetStats().
+ */
+static MQTTAgentStats_t agentStats = { 0 };
+
+/**
+ * @brief Variable used to check if the connection of the agent is usable.
+ * Cleared by the agent when MQTT_ProcessLoop() or a publish batch fails, or when no slot is left for
+ * operations waiting for an ACK, after which the agent does not touch the MQTT context until
+ * MQTTAgent_Reconnected() is called.
+ */
+static volatile BaseType_t isConnected = pdFALSE;
 
 /**
  * @brief Variable used to check if the agent is running.
@@ -117,165 +312,590 @@ static MQTTOperation_t * pendingOperations[ MQTT_AGENT_MAX_CONCURRENT_OPERATIONS
 static BaseType_t isAgentRunning = pdFALSE;
 
 
-static BaseType_t addPendingOperation( MQTTOperation_t * pOperation )
+static BaseType_t operationNeedsAck( const MQTTOperation_t * pOperation )
 {
-    size_t index = 0;
     BaseType_t result = pdFALSE;
 
-    for( index = 0; index < MQTT_AGENT_MAX_CONCURRENT_OPERATIONS; index++ )
+    switch( pOperation->type )
     {
-        if( pendingOperations[ index ] == NULL )
-        {
-            pendingOperations[ index ] = pOperation;
+        case MQTT_OP_PUBLISH:
+
+            if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
+            {
+                result = pdTRUE;
+            }
+
+            break;
+
+        case MQTT_OP_SUBSCRIBE:
+        case MQTT_OP_UNSUBSCRIBE:
             result = pdTRUE;
             break;
-        }
+
+        default:
+            break;
     }
 
     return result;
 }
 
+static void completeOperation( MQTTOperation_t * pOperation,
+                               MQTTStatus_t status )
+{
+    if( pOperation->callback != NULL )
+    {
+        pOperation->callback( pOperation, status );
+    }
+}
+
+static void addPendingOperation( MQTTOperation_t * pOperation )
+{
+    size_t index = pOperation->packetIdentifier & MQTT_AGENT_ACK_TABLE_MASK;
+    uint32_t timeoutMs = pOperation->ackTimeoutMs;
+
+    configASSERT( pendingOperationsCount < MQTT_AGENT_MAX_OUTSTANDING_ACKS );
+
+    if( timeoutMs == 0U )
+    {
+        timeoutMs = MQTT_AGENT_DEFAULT_ACK_TIMEOUT_MS;
+    }
+
+    while( pendingOperations[ index ].pOperation != NULL )
+    {
+        index = ( index + 1U ) & MQTT_AGENT_ACK_TABLE_MASK;
+    }
+
+    pendingOperations[ index ].pOperation = pOperation;
+    pendingOperations[ index ].startTicks = xTaskGetTickCount();
+    pendingOperations[ index ].timeoutTicks = pdMS_TO_TICKS( timeoutMs );
+    pendingOperationsCount++;
+}
+
+static MQTTOperation_t * removePendingOperation( size_t index,
+                                                 BaseType_t releaseSlot )
+{
+    MQTTOperation_t * pOperation = pendingOperations[ index ].pOperation;
+    size_t next = index;
+    size_t home;
+
+    for( ; ; )
+    {
+        next = ( next + 1U ) & MQTT_AGENT_ACK_TABLE_MASK;
+
+        if( pendingOperations[ next ].pOperation == NULL )
+        {
+            break;
+        }
+
+        home = pendingOperations[ next ].pOperation->packetIdentifier & MQTT_AGENT_ACK_TABLE_MASK;
+
+        /* Move the entry into the hole only if the hole lies between its home slot and its
+         * current slot, otherwise the entry would become unreachable from its home slot. */
+        if( ( ( next - home ) & MQTT_AGENT_ACK_TABLE_MASK ) >= ( ( next - index ) & MQTT_AGENT_ACK_TABLE_MASK ) )
+        {
+            pendingOperations[ index ] = pendingOperations[ next ];
+            index = next;
+        }
+    }
+
+    pendingOperations[ index ].pOperation = NULL;
+    pendingOperationsCount--;
+
+    if( releaseSlot == pdTRUE )
+    {
+        ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+    }
+
+    return pOperation;
+}
+
 static MQTTOperation_t * getPendingOperation( uint16_t packetIdentifier )
 {
-    size_t index = 0;
+    size_t index = packetIdentifier & MQTT_AGENT_ACK_TABLE_MASK;
     MQTTOperation_t * pOperation = NULL;
 
-
-    for( index = 0; index < MQTT_AGENT_MAX_CONCURRENT_OPERATIONS; index++ )
+    while( pendingOperations[ index ].pOperation != NULL )
     {
-        if( ( pendingOperations[ index ] != NULL ) &&
-            ( pendingOperations[ index ]->packetIdentifier == packetIdentifier ) )
+        if( pendingOperations[ index ].pOperation->packetIdentifier == packetIdentifier )
         {
-            pOperation = pendingOperations[ index ];
-            pendingOperations[ index ] = NULL;
+            pOperation = removePendingOperation( index, pdTRUE );
             break;
         }
+
+        index = ( index + 1U ) & MQTT_AGENT_ACK_TABLE_MASK;
     }
 
     return pOperation;
 }
 
+static void expirePendingOperations( void )
+{
+    size_t index = 0;
+    TickType_t now = xTaskGetTickCount();
+    MQTTOperation_t * pOperation;
+    BaseType_t isPublish;
+
+    while( ( index < MQTT_AGENT_ACK_TABLE_SIZE ) && ( pendingOperationsCount > 0U ) )
+    {
+        if( ( pendingOperations[ index ].pOperation != NULL ) &&
+            ( ( TickType_t ) ( now - pendingOperations[ index ].startTicks ) >= pendingOperations[ index ].timeoutTicks ) )
+        {
+            isPublish = ( pendingOperations[ index ].pOperation->type == MQTT_OP_PUBLISH ) ? pdTRUE : pdFALSE;
+
+            /* The slot of a publish stays reserved for its coreMQTT record until the late ACK. */
+            pOperation = removePendingOperation( index, ( isPublish == pdTRUE ) ? pdFALSE : pdTRUE );
+            PRINTF( "MQTT agent timed out waiting for ACK, packet identifier %u.\r\n",
+                    pOperation->packetIdentifier );
+
+            if( isPublish == pdTRUE )
+            {
+                expiredPublishCount++;
+            }
+
+            completeOperation( pOperation, MQTTRecvFailed );
+
+            /* Removal may have shifted another entry into this slot, so check it again. */
+        }
+        else
+        {
+            index++;
+        }
+    }
+}
+
+static void flushPendingOperations( MQTTStatus_t status )
+{
+    size_t index;
+
+    for( index = 0; index < MQTT_AGENT_ACK_TABLE_SIZE; index++ )
+    {
+        while( pendingOperations[ index ].pOperation != NULL )
+        {
+            completeOperation( removePendingOperation( index, pdTRUE ), status );
+        }
+    }
+}
+
+
+static void sendSinglePublish( MQTTContext_t * pMQTTContext,
+                               MQTTOperation_t * pOperation )
+{
+    uint16_t packetIdentifier = 0;
+    MQTTStatus_t mqttStatus;
+
+    if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
+    {
+        packetIdentifier = MQTT_GetPacketId( pMQTTContext );
+    }
+
+    mqttStatus = MQTT_Publish( pMQTTContext, pOperation->info.pPublishInfo, packetIdentifier );
+
+    if( pOperation->info.pPublishInfo->qos == MQTTQoS0 )
+    {
+        completeOperation( pOperation, mqttStatus );
+    }
+    else if( mqttStatus != MQTTSuccess )
+    {
+        ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+        completeOperation( pOperation, mqttStatus );
+    }
+    else
+    {
+        pOperation->packetIdentifier = packetIdentifier;
+        addPendingOperation( pOperation );
+    }
+}
+
+static MQTTStatus_t appendPublishToBatch( MQTTContext_t * pMQTTContext,
+                                          MQTTOperation_t * pOperation,
+                                          size_t packetSize,
+                                          size_t remainingLength )
+{
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTFixedBuffer_t fixedBuffer;
+    uint16_t packetIdentifier = 0;
+
+    if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
+    {
+        packetIdentifier = MQTT_GetPacketId( pMQTTContext );
+    }
+
+    fixedBuffer.pBuffer = &batchBuffer[ batchBufferUsed ];
+    fixedBuffer.size = packetSize;
+
+    mqttStatus = MQTT_SerializePublish( pOperation->info.pPublishInfo,
+                                        packetIdentifier,
+                                        remainingLength,
+                                        &fixedBuffer );
+
+    /* Reserve the record last, coreMQTT has no call to free it again if the publish fails. */
+    if( ( mqttStatus == MQTTSuccess ) && ( packetIdentifier != 0U ) )
+    {
+        /* Same state record as MQTT_Publish() reserves, so that coreMQTT accepts the ACK. */
+        mqttStatus = MQTT_ReserveState( pMQTTContext,
+                                        packetIdentifier,
+                                        pOperation->info.pPublishInfo->qos );
+    }
+
+    if( mqttStatus == MQTTSuccess )
+    {
+        pOperation->packetIdentifier = packetIdentifier;
+        batchOperations[ batchCount ] = pOperation;
+        batchCount++;
+        batchBufferUsed += packetSize;
+    }
+
+    return mqttStatus;
+}
+
+static MQTTStatus_t sendBatch( MQTTContext_t * pMQTTContext )
+{
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    size_t bytesSent = 0;
+    int32_t sendResult;
+    TickType_t startTicks = xTaskGetTickCount();
+
+    while( ( mqttStatus == MQTTSuccess ) && ( bytesSent < batchBufferUsed ) )
+    {
+        sendResult = pMQTTContext->transportInterface.send( pMQTTContext->transportInterface.pNetworkContext,
+                                                            &batchBuffer[ bytesSent ],
+                                                            batchBufferUsed - bytesSent );
+
+        if( sendResult > 0 )
+        {
+            bytesSent += ( size_t ) sendResult;
+        }
+        else if( ( sendResult < 0 ) ||
+                 ( ( xTaskGetTickCount() - startTicks ) >= pdMS_TO_TICKS( MQTT_AGENT_SEND_TIMEOUT_MS ) ) )
+        {
+            mqttStatus = MQTTSendFailed;
+        }
+        else
+        {
+            /* Nothing was sent, retry. */
+        }
+    }
+
+    if( mqttStatus == MQTTSuccess )
+    {
+        /* MQTT_Publish() does the same, so that no PINGREQ is sent while publishes keep the
+         * connection alive. */
+        pMQTTContext->lastPacketTime = pMQTTContext->getTime();
+    }
+
+    return mqttStatus;
+}
+
+static void processPublishBatch( MQTTContext_t * pMQTTContext,
+                                 MQTTOperation_t * pOperation )
+{
+    MQTTStatus_t mqttStatus;
+    MQTTStatus_t sendStatus = MQTTSuccess;
+    size_t packetSize = 0;
+    size_t remainingLength = 0;
+    size_t index;
+    MQTTPublishState_t publishState;
+
+    batchBufferUsed = 0;
+    batchCount = 0;
+
+    while( pOperation != NULL )
+    {
+        mqttStatus = MQTT_GetPublishPacketSize( pOperation->info.pPublishInfo,
+                                                &remainingLength,
+                                                &packetSize );
+
+        if( ( mqttStatus == MQTTSuccess ) &&
+            ( packetSize <= ( MQTT_AGENT_BATCH_BUFFER_SIZE - batchBufferUsed ) ) )
+        {
+            mqttStatus = appendPublishToBatch( pMQTTContext, pOperation, packetSize, remainingLength );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
+                {
+                    ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+                }
+
+                completeOperation( pOperation, mqttStatus );
+            }
+        }
+        else
+        {
+            /* Only the first publish can be larger than the batch buffer, as the following ones
+             * are dequeued only if they fit. MQTT_Publish() also reports invalid parameters. */
+            sendSinglePublish( pMQTTContext, pOperation );
+        }
+
+        pOperation = NULL;
+
+        /* Take the next operation only if it is a publish which fits in the remaining space, so that
+         * the order of operations is kept. */
+        if( ( batchCount > 0U ) &&
+            ( batchCount < MQTT_AGENT_MAX_BATCH_PUBLISHES ) &&
+            ( xQueuePeek( xOperationsQueue, &pOperation, 0 ) == pdTRUE ) )
+        {
+            if( ( pOperation->type != MQTT_OP_PUBLISH ) ||
+                ( MQTT_GetPublishPacketSize( pOperation->info.pPublishInfo,
+                                             &remainingLength,
+                                             &packetSize ) != MQTTSuccess ) ||
+                ( packetSize > ( MQTT_AGENT_BATCH_BUFFER_SIZE - batchBufferUsed ) ) )
+            {
+                pOperation = NULL;
+            }
+            else
+            {
+                ( void ) xQueueReceive( xOperationsQueue, &pOperation, 0 );
+            }
+        }
+        else
+        {
+            pOperation = NULL;
+        }
+    }
+
+    if( batchCount > 0U )
+    {
+        sendStatus = sendBatch( pMQTTContext );
+
+        if( sendStatus == MQTTSuccess )
+        {
+            agentStats.ulBatches++;
+            agentStats.ulBatchedPublishes += batchCount;
+
+            if( batchCount > 1U )
+            {
+                agentStats.ulMultiPublishBatches++;
+            }
+
+            if( batchCount > agentStats.ulLargestBatch )
+            {
+                agentStats.ulLargestBatch = batchCount;
+            }
+        }
+
+        for( index = 0; index < batchCount; index++ )
+        {
+            pOperation = batchOperations[ index ];
+
+            if( pOperation->info.pPublishInfo->qos == MQTTQoS0 )
+            {
+                completeOperation( pOperation, sendStatus );
+            }
+            else if( sendStatus != MQTTSuccess )
+            {
+                /* The record stays reserved until the reconnection, and so does the slot. */
+                expiredPublishCount++;
+                completeOperation( pOperation, sendStatus );
+            }
+            else
+            {
+                ( void ) MQTT_UpdateStatePublish( pMQTTContext,
+                                                  pOperation->packetIdentifier,
+                                                  MQTT_SEND,
+                                                  pOperation->info.pPublishInfo->qos,
+                                                  &publishState );
+                addPendingOperation( pOperation );
+            }
+        }
+
+        batchCount = 0;
+        batchBufferUsed = 0;
+
+        if( sendStatus != MQTTSuccess )
+        {
+            /* Part of a packet may have been sent, the connection cannot be used any further. */
+            PRINTF( "MQTT agent failed to send a publish batch, status %d.\r\n", sendStatus );
+            isConnected = pdFALSE;
+            flushPendingOperations( sendStatus );
+        }
+    }
+}
+
+static void failOperation( MQTTOperation_t * pOperation )
+{
+    if( operationNeedsAck( pOperation ) == pdTRUE )
+    {
+        ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+    }
+
+    completeOperation( pOperation, MQTTIllegalState );
+}
+
+static BaseType_t processOperation( MQTTContext_t * pMQTTContext,
+                                    MQTTOperation_t * pOperation )
+{
+    BaseType_t stopRequested = pdFALSE;
+    uint16_t packetIdentifier = 0;
+    MQTTStatus_t mqttStatus;
+
+    switch( pOperation->type )
+    {
+        case MQTT_OP_PUBLISH:
+            processPublishBatch( pMQTTContext, pOperation );
+            break;
+
+        case MQTT_OP_SUBSCRIBE:
+            packetIdentifier = MQTT_GetPacketId( pMQTTContext );
+            mqttStatus = MQTT_Subscribe( pMQTTContext,
+                                         pOperation->info.subscriptionInfo.pSubscriptionList,
+                                         pOperation->info.subscriptionInfo.numSubscriptions,
+                                         packetIdentifier );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+                completeOperation( pOperation, mqttStatus );
+            }
+            else
+            {
+                pOperation->packetIdentifier = packetIdentifier;
+                addPendingOperation( pOperation );
+            }
+
+            break;
+
+        case MQTT_OP_UNSUBSCRIBE:
+            packetIdentifier = MQTT_GetPacketId( pMQTTContext );
+            mqttStatus = MQTT_Unsubscribe( pMQTTContext,
+                                           pOperation->info.subscriptionInfo.pSubscriptionList,
+                                           pOperation->info.subscriptionInfo.numSubscriptions,
+                                           packetIdentifier );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+                completeOperation( pOperation, mqttStatus );
+            }
+            else
+            {
+                pOperation->packetIdentifier = packetIdentifier;
+                addPendingOperation( pOperation );
+            }
+
+            break;
+
+        case MQTT_OP_STOP:
+            /* Reset the operations queue to empty state to stop the agent. */
+            xQueueReset( xOperationsQueue );
+            flushPendingOperations( MQTTIllegalState );
+            completeOperation( pOperation, MQTTSuccess );
+            stopRequested = pdTRUE;
+            break;
+
+        default:
+            break;
+    }
+
+    return stopRequested;
+}
 
 static void prvMQTTAgentLoop( void * pParams )
 {
-    BaseType_t status;
+    BaseType_t stopRequested = pdFALSE;
     MQTTOperation_t * pOperation;
-    uint16_t packetIdentifier = 0;
     MQTTContext_t * pMQTTContext = ( MQTTContext_t * ) pParams;
     MQTTStatus_t mqttStatus;
+    BaseType_t dataAvailable = pdTRUE;
+    TickType_t lastProcessTicks = xTaskGetTickCount();
 
     isAgentRunning = pdTRUE;
 
-    for( ; ; )
+    while( stopRequested == pdFALSE )
     {
-        status = xQueueReceive( xOperationsQueue, &pOperation, 1 );
+        /* Send out all operations queued by the application tasks first, so that they
+         * never wait behind a receive. */
+        while( ( stopRequested == pdFALSE ) &&
+               ( xQueueReceive( xOperationsQueue, &pOperation, 0 ) == pdTRUE ) )
+        {
+            if( ( isConnected == pdFALSE ) && ( pOperation->type != MQTT_OP_STOP ) )
+            {
+                failOperation( pOperation );
+            }
+            else
+            {
+                stopRequested = processOperation( pMQTTContext, pOperation );
+            }
+        }
 
-        if( status == pdTRUE )
+        if( ( stopRequested == pdFALSE ) && ( isConnected == pdTRUE ) )
         {
-            switch( pOperation->type )
+            /* The transport receive blocks for a short time, so read only when data is buffered or
+             * the agent was woken up, or when a keep-alive packet may be due. Once a packet is partly
+             * read, the receive blocks for the rest of it instead of spinning. */
+            if( ( dataAvailable == pdTRUE ) ||
+                ( ( xTaskGetTickCount() - lastProcessTicks ) >= pdMS_TO_TICKS( MQTT_AGENT_MAX_IDLE_INTERVAL_MS ) ) )
+            {
+                mqttStatus = MQTT_ProcessLoop( pMQTTContext, 0 );
+                lastProcessTicks = xTaskGetTickCount();
+
+                if( mqttStatus != MQTTSuccess )
+                {
+                    /* The application reconnects when it sees MQTTAgent_IsConnected() return pdFALSE. */
+                    PRINTF( "MQTT agent lost the connection, status %d.\r\n", mqttStatus );
+                    isConnected = pdFALSE;
+                    flushPendingOperations( mqttStatus );
+                }
+            }
+
+            if( pendingOperationsCount > 0U )
+            {
+                expirePendingOperations();
+            }
+
+            if( ( isConnected == pdTRUE ) && ( expiredPublishCount == MQTT_AGENT_MAX_OUTSTANDING_ACKS ) )
             {
-                case MQTT_OP_RECEIVE:
-                    mqttStatus = MQTT_ProcessLoop( pMQTTContext, MQTT_AGENT_MAX_POLLING_INTERVAL_MS );
-                    configASSERT( mqttStatus == MQTTSuccess );
-                    xQueueSend( xOperationsQueue, &pOperation, 1 );
-                    break;
-
-                case MQTT_OP_PUBLISH:
-
-                    if( pOperation->info.pPublishInfo->qos != MQTTQoS0 )
-                    {
-                        packetIdentifier = MQTT_GetPacketId( pMQTTContext );
-                    }
-                    else
-                    {
-                        packetIdentifier = 0;
-                    }
-
-                    mqttStatus = MQTT_Publish( pMQTTContext, pOperation->info.pPublishInfo, packetIdentifier );
-
-                    if( ( mqttStatus != MQTTSuccess ) || ( pOperation->info.pPublishInfo->qos == MQTTQoS0 ) )
-                    {
-                        pOperation->callback( pOperation, mqttStatus );
-                    }
-                    else
-                    {
-                        pOperation->packetIdentifier = packetIdentifier;
-                        configASSERT( addPendingOperation( pOperation ) == pdTRUE );
-                    }
-
-                    break;
-
-                case MQTT_OP_SUBSCRIBE:
-                    packetIdentifier = MQTT_GetPacketId( pMQTTContext );
-                    mqttStatus = MQTT_Subscribe( pMQTTContext,
-                                                 pOperation->info.subscriptionInfo.pSubscriptionList,
-                                                 pOperation->info.subscriptionInfo.numSubscriptions,
-                                                 packetIdentifier );
-
-                    if( mqttStatus != MQTTSuccess )
-                    {
-                        pOperation->callback( pOperation, mqttStatus );
-                    }
-                    else
-                    {
-                        pOperation->packetIdentifier = packetIdentifier;
-                        configASSERT( addPendingOperation( pOperation ) == pdTRUE );
-                    }
-
-                    break;
-
-                case MQTT_OP_UNSUBSCRIBE:
-                    packetIdentifier = MQTT_GetPacketId( pMQTTContext );
-                    mqttStatus = MQTT_Unsubscribe( pMQTTContext,
-                                                   pOperation->info.subscriptionInfo.pSubscriptionList,
-                                                   pOperation->info.subscriptionInfo.numSubscriptions,
-                                                   packetIdentifier );
-
-                    if( mqttStatus != MQTTSuccess )
-                    {
-                        pOperation->callback( pOperation, mqttStatus );
-                    }
-                    else
-                    {
-                        pOperation->packetIdentifier = packetIdentifier;
-                        configASSERT( addPendingOperation( pOperation ) == pdTRUE );
-                    }
-
-                    break;
-
-                case MQTT_OP_STOP:
-                    /* Reset the operations queue to empty state to stop the agent. */
-                    xQueueReset( xOperationsQueue );
-                    pOperation->callback( pOperation, MQTTSuccess );
-                    break;
-
-                default:
-                    break;
+                /* Every slot waits for an ACK the broker does not send, reconnect to start over. */
+                PRINTF( "MQTT agent gave up on the connection, %u publishes not acknowledged.\r\n",
+                        ( unsigned int ) expiredPublishCount );
+                isConnected = pdFALSE;
+                flushPendingOperations( MQTTRecvFailed );
             }
         }
-        else
+
+        if( stopRequested == pdFALSE )
         {
-            break;
+            dataAvailable = pdFALSE;
+
+            if( ( isConnected == pdTRUE ) && ( dataAvailableFunction != NULL ) )
+            {
+                dataAvailable = dataAvailableFunction( pMQTTContext->transportInterface.pNetworkContext );
+            }
+
+            /* Sleep only when there is nothing more to receive. A notification given while
+             * the agent was busy is not lost, and makes the wait return immediately. */
+            if( ( dataAvailable == pdFALSE ) &&
+                ( ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( MQTT_AGENT_MAX_IDLE_INTERVAL_MS ) ) != 0U ) )
+            {
+                dataAvailable = pdTRUE;
+            }
         }
     }
 
     vQueueDelete( xOperationsQueue );
+    vSemaphoreDelete( xPendingSlotsSemaphore );
 
+    xAgentTask = NULL;
     isAgentRunning = pdFALSE;
 
     vTaskDelete( NULL );
 }
 
-BaseType_t MQTTAgent_Init( MQTTContext_t * pMqttContext )
+BaseType_t MQTTAgent_Init( MQTTContext_t * pMqttContext,
+                           MQTTAgentDataAvailable_t dataAvailable )
 {
     BaseType_t result = pdTRUE;
-    MQTTOperation_t * pOperation = &receiveOP;
 
     memset( pendingOperations, 0x00, sizeof( pendingOperations ) );
+    pendingOperationsCount = 0;
+    expiredPublishCount = 0;
+    memset( &agentStats, 0x00, sizeof( agentStats ) );
+    dataAvailableFunction = dataAvailable;
+    isConnected = pdTRUE;
 
     if( result == pdTRUE )
     {
-        xOperationsQueue = xQueueCreate( MQTT_AGENT_MAX_CONCURRENT_OPERATIONS, sizeof( MQTTOperation_t * ) );
+        xOperationsQueue = xQueueCreate( MQTT_AGENT_QUEUE_LENGTH, sizeof( MQTTOperation_t * ) );
 
         if( xOperationsQueue == NULL )
         {
@@ -286,7 +906,14 @@ BaseType_t MQTTAgent_Init( MQTTContext_t * pMqttContext )
 
     if( result == pdTRUE )
     {
-        result = xQueueSend( xOperationsQueue, &pOperation, 1 );
+        xPendingSlotsSemaphore = xSemaphoreCreateCounting( MQTT_AGENT_MAX_OUTSTANDING_ACKS,
+                                                           MQTT_AGENT_MAX_OUTSTANDING_ACKS );
+
+        if( xPendingSlotsSemaphore == NULL )
+        {
+            PRINTF( "MQTT Agent failed to create the pending ACK semaphore.\r\n" );
+            result = pdFALSE;
+        }
     }
 
     if( result == pdTRUE )
@@ -296,7 +923,7 @@ BaseType_t MQTTAgent_Init( MQTTContext_t * pMqttContext )
                                     MQTT_AGENT_TASK_STACK_SIZE,
                                     pMqttContext,
                                     MQTT_AGENT_TASK_PRIORITY | portPRIVILEGE_BIT,
-                                    NULL ) ) != pdTRUE )
+                                    &xAgentTask ) ) != pdTRUE )
         {
             PRINTF( "Failed to create MQTT Agent task.\r\n" );
         }
@@ -318,15 +945,29 @@ BaseType_t MQTTAgent_ProcessEvent( MQTTContext_t * pMQTTContext,
         switch( pPacketInfo->type )
         {
             case MQTT_PACKET_TYPE_PUBACK:
+            case MQTT_PACKET_TYPE_PUBCOMP:
             case MQTT_PACKET_TYPE_SUBACK:
             case MQTT_PACKET_TYPE_UNSUBACK:
                 pOperation = getPendingOperation( pDeserializedInfo->packetIdentifier );
 
                 if( pOperation != NULL )
                 {
-                    pOperation->callback( pOperation, MQTTSuccess );
+                    completeOperation( pOperation, MQTTSuccess );
+                    result = pdTRUE;
+                }
+                else if( ( pPacketInfo->type != MQTT_PACKET_TYPE_SUBACK ) &&
+                         ( pPacketInfo->type != MQTT_PACKET_TYPE_UNSUBACK ) &&
+                         ( expiredPublishCount > 0U ) )
+                {
+                    /* Late ACK of an expired publish, coreMQTT has now freed its record. */
+                    expiredPublishCount--;
+                    ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
                     result = pdTRUE;
                 }
+                else
+                {
+                    /* Empty else marker. */
+                }
 
                 break;
 
@@ -341,10 +982,12 @@ BaseType_t MQTTAgent_ProcessEvent( MQTTContext_t * pMQTTContext,
 void MQTTAgent_Stop( void )
 {
     MQTTOperation_t operation = { 0 };
+    MQTTOperation_t * pOperation = &operation;
 
     operation.type = MQTT_OP_STOP;
 
-    xQueueSend( xOperationsQueue, &operation, portMAX_DELAY );
+    xQueueSend( xOperationsQueue, &pOperation, portMAX_DELAY );
+    MQTTAgent_Wakeup();
 
     while( isAgentRunning == pdTRUE )
     {
@@ -356,5 +999,82 @@ void MQTTAgent_Stop( void )
 BaseType_t MQTTAgent_Enqueue( MQTTOperation_t * pOperation,
                               TickType_t timeoutTicks )
 {
-    return xQueueSend( xOperationsQueue, &pOperation, timeoutTicks );
+    BaseType_t result = pdTRUE;
+    BaseType_t needsAck = operationNeedsAck( pOperation );
+    TimeOut_t timeOut;
+
+    vTaskSetTimeOutState( &timeOut );
+
+    if( needsAck == pdTRUE )
+    {
+        /* Reserve a slot in the pending ACK table so that the agent never runs out of space
+         * once the operation is sent. */
+        result = xSemaphoreTake( xPendingSlotsSemaphore, timeoutTicks );
+
+        if( result == pdTRUE )
+        {
+            /* Wait for the operations queue only for the remainder of the timeout. */
+            if( xTaskCheckForTimeOut( &timeOut, &timeoutTicks ) == pdTRUE )
+            {
+                timeoutTicks = 0;
+            }
+        }
+    }
+
+    if( result == pdTRUE )
+    {
+        result = xQueueSend( xOperationsQueue, &pOperation, timeoutTicks );
+
+        if( result == pdTRUE )
+        {
+            MQTTAgent_Wakeup();
+        }
+        else if( needsAck == pdTRUE )
+        {
+            ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+        }
+        else
+        {
+            /* Empty else marker. */
+        }
+    }
+
+    return result;
+}
+
+BaseType_t MQTTAgent_IsConnected( void )
+{
+    return isConnected;
+}
+
+void MQTTAgent_Reconnected( void )
+{
+    /* The clean session dropped the records of the expired publishes along with their ACKs. */
+    while( expiredPublishCount > 0U )
+    {
+        expiredPublishCount--;
+        ( void ) xSemaphoreGive( xPendingSlotsSemaphore );
+    }
+
+    isConnected = pdTRUE;
+    MQTTAgent_Wakeup();
+}
+
+void MQTTAgent_GetStats( MQTTAgentStats_t * pStats )
+{
+    taskENTER_CRITICAL();
+    {
+        *pStats = agentStats;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void MQTTAgent_Wakeup( void )
+{
+    TaskHandle_t xTask = xAgentTask;
+
+    if( xTask != NULL )
+    {
+        ( void ) xTaskNotifyGive( xTask );
+    }
 }
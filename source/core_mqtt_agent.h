@@ -65,7 +65,6 @@ typedef enum MQTTOperationType
     MQTT_OP_PUBLISH = 0,
     MQTT_OP_SUBSCRIBE,
     MQTT_OP_UNSUBSCRIBE,
-    MQTT_OP_RECEIVE,
     MQTT_OP_STOP
 } MQTTOperationType_t;
 
@@ -84,32 +83,74 @@ typedef union MQTTOperationInfo
 
 /**
  * @brief Structure used to hold the MQTT operation enqueued with the MQTT agent.
+ * The structure must remain valid until the callback is invoked for the operation.
+ * ackTimeoutMs is the maximum time to wait for an ACK from the broker, for operations which
+ * require one. A value of 0 selects MQTT_AGENT_DEFAULT_ACK_TIMEOUT_MS.
  */
 typedef struct MQTTOperation
 {
     MQTTOperationType_t type;
     MQTTOperationInfo_t info;
     MQTTOperationStatusCallback_t callback;
+    uint32_t ackTimeoutMs;
     uint16_t packetIdentifier;
 } MQTTOperation_t;
 
+/**
+ * @brief Counters of the publish batches sent by the MQTT agent.
+ * ulMultiPublishBatches counts the batches which carried more than one publish in a single
+ * transport write, so ulBatchedPublishes / ulBatches is the average batch size.
+ */
+typedef struct MQTTAgentStats
+{
+    uint32_t ulBatches;
+    uint32_t ulBatchedPublishes;
+    uint32_t ulMultiPublishBatches;
+    uint32_t ulLargestBatch;
+} MQTTAgentStats_t;
+
+/**
+ * @brief Function used by the MQTT agent to check if the transport has received data which is not yet read.
+ * The agent keeps receiving while the function returns pdTRUE and otherwise sleeps until it is woken up
+ * by MQTTAgent_Wakeup() or a new operation.
+ *
+ * @param[in] pNetworkContext The network context of the MQTT connection.
+ * @return pdTRUE if a receive on the transport would return data without waiting.
+ */
+typedef BaseType_t ( * MQTTAgentDataAvailable_t ) ( NetworkContext_t * pNetworkContext );
+
 /**
  * @brief Initializes Agent task and creates the queue for MQTT operations.
- * Enqueues an MQTT receive operation by default.
- * The API should be called after an MQTT connection is established.
+ * The API should be called after an MQTT connection is established. The transport receive
+ * of the connection should block only for a short time, long enough for the rest of a packet
+ * already partly received, and MQTTAgent_Wakeup() should be called whenever data is received
+ * on the connection.
  *
  * @param[in] pContext The corteMQTT library MQTT context.
+ * @param[in] dataAvailable Function used to check for pending received data on the transport.
  * @return pdTRUE if the initialization was successful.
  *
  */
-BaseType_t MQTTAgent_Init( MQTTContext_t * pContext );
+BaseType_t MQTTAgent_Init( MQTTContext_t * pContext,
+                           MQTTAgentDataAvailable_t dataAvailable );
+
+/**
+ * @brief Wakes up the agent task to process received data.
+ * The API does not block and can be called from the FreeRTOS+TCP socket wakeup callback.
+ */
+void MQTTAgent_Wakeup( void );
 
 /*
  * @brief Enqueues an MQTT operation to be executed in agent context.
  * Result of the operation will be available using MQTTOperationStatusCallback_t.
+ * Operations which require an ACK from the broker (QoS1/QoS2 publish, subscribe and unsubscribe)
+ * also reserve a slot in the agent's pending ACK table. If all slots are in use, the API blocks
+ * until an ACK is received or an operation times out, or until timeoutTicks expires.
+ *
  * @param[in] pOperation Pointer to the structure containing operation type and params.
  * @param[in] timeoutTicks Timeout in ticks API blocks for enqueue operation to succeed.
- * @return pdTRUE If the operation was successfully enqueued with the agent.
+ * @return pdTRUE If the operation was successfully enqueued with the agent, pdFALSE if either
+ * the operations queue or the pending ACK table stayed full for timeoutTicks.
  */
 BaseType_t MQTTAgent_Enqueue( MQTTOperation_t * pOperation,
                               TickType_t timeoutTicks );
@@ -130,6 +171,31 @@ BaseType_t MQTTAgent_ProcessEvent( MQTTContext_t * pMQTTContext,
                                    struct MQTTPacketInfo * pPacketInfo,
                                    struct MQTTDeserializedInfo * pDeserializedInfo );
 
+/**
+ * @brief Checks if the connection used by the agent is usable.
+ * The agent stops using the connection when MQTT_ProcessLoop() or a publish batch fails, or when
+ * the broker no longer acknowledges publishes. Pending operations and
+ * operations enqueued afterwards then fail, until the application has connected again and called
+ * MQTTAgent_Reconnected().
+ *
+ * @return pdFALSE if the application should reconnect, pdTRUE otherwise.
+ */
+BaseType_t MQTTAgent_IsConnected( void );
+
+/**
+ * @brief Lets the agent use the MQTT context again after the application connected it again.
+ * The MQTT context and the transport must not be used by the application after the call.
+ * The connection must use a clean session, the agent then forgets the publishes it gave up.
+ */
+void MQTTAgent_Reconnected( void );
+
+/**
+ * @brief Gets the counters of the publish batches sent by the agent.
+ *
+ * @param[out] pStats Structure the counters are copied to.
+ */
+void MQTTAgent_GetStats( MQTTAgentStats_t * pStats );
+
 /**
  * @brief Stops the agent task and deletes the queue.
  * Should be called before disconnecting an MQTT connection.
@@ -133,4 +133,100 @@
     #define MQTT_PINGRESP_TIMEOUT_MS    ( 500U )
 #endif
 
+/**
+ * @brief The maximum duration between non-empty network reads while
+ * receiving an MQTT packet via the #MQTT_ProcessLoop or #MQTT_ReceiveLoop
+ * API functions.
+ *
+ * The MQTT agent makes the transport receive non-blocking, so this is the time
+ * the library keeps retrying the receive of the remainder of a packet which was
+ * only partly received.
+ *
+ * <b>Possible values:</b> Any positive 32 bit integer. <br>
+ * <b>Default value:</b> `1000`
+ */
+#ifndef MQTT_RECV_POLLING_TIMEOUT_MS
+    #define MQTT_RECV_POLLING_TIMEOUT_MS    ( 1000U )
+#endif
+
+/**
+ * @brief Maximum number of operations the MQTT agent keeps waiting for an
+ * acknowledgment from the broker at a time.
+ *
+ * QoS1/QoS2 publishes, subscribes and unsubscribes hold a slot in the agent's
+ * pending ACK table from the time they are enqueued until the ACK is received
+ * or the operation times out. When all slots are in use, MQTTAgent_Enqueue()
+ * blocks the caller instead of the agent running out of space. Outgoing publishes
+ * also hold a coreMQTT state record, so the value must not exceed
+ * MQTT_STATE_ARRAY_MAX_COUNT.
+ *
+ * <b>Possible values:</b> Any positive integer up to MQTT_STATE_ARRAY_MAX_COUNT. <br>
+ * <b>Default value:</b> `8`
+ */
+#ifndef MQTT_AGENT_MAX_OUTSTANDING_ACKS
+    #define MQTT_AGENT_MAX_OUTSTANDING_ACKS    ( 8U )
+#endif
+
+/**
+ * @brief Number of slots in the MQTT agent's pending ACK table.
+ *
+ * Pending operations are indexed by their packet identifier, so the table is
+ * kept at least twice the size of MQTT_AGENT_MAX_OUTSTANDING_ACKS to make a
+ * lookup on an incoming ACK constant time.
+ *
+ * <b>Possible values:</b> A power of 2, at least 2 * MQTT_AGENT_MAX_OUTSTANDING_ACKS. <br>
+ * <b>Default value:</b> `16`
+ */
+#ifndef MQTT_AGENT_ACK_TABLE_SIZE
+    #define MQTT_AGENT_ACK_TABLE_SIZE    ( 16U )
+#endif
+
+/**
+ * @brief Number of operations which can be queued with the MQTT agent.
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `10`
+ */
+#ifndef MQTT_AGENT_QUEUE_LENGTH
+    #define MQTT_AGENT_QUEUE_LENGTH    ( 10U )
+#endif
+
+/**
+ * @brief Size of the buffer the MQTT agent uses to batch publish packets.
+ *
+ * Publish operations found next to each other in the agent's queue are
+ * serialized into this buffer and written with a single transport send, so
+ * that small messages share one TLS record. A publish larger than the buffer
+ * is sent on its own with MQTT_Publish(). The buffer should not exceed the
+ * TLS maximum fragment length (MBEDTLS_SSL_MAX_CONTENT_LEN).
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `1024`
+ */
+#ifndef MQTT_AGENT_BATCH_BUFFER_SIZE
+    #define MQTT_AGENT_BATCH_BUFFER_SIZE    ( 1024U )
+#endif
+
+/**
+ * @brief Maximum number of publish packets the MQTT agent sends in one batch.
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `8`
+ */
+#ifndef MQTT_AGENT_MAX_BATCH_PUBLISHES
+    #define MQTT_AGENT_MAX_BATCH_PUBLISHES    ( 8U )
+#endif
+
+/**
+ * @brief Time in milliseconds the MQTT agent waits for an ACK from the broker
+ * before failing an operation with MQTTRecvFailed. Used when the ackTimeoutMs
+ * field of the operation is left as 0.
+ *
+ * <b>Possible values:</b> Any positive 32 bit integer. <br>
+ * <b>Default value:</b> `10000`
+ */
+#ifndef MQTT_AGENT_DEFAULT_ACK_TIMEOUT_MS
+    #define MQTT_AGENT_DEFAULT_ACK_TIMEOUT_MS    ( 10000U )
+#endif
+
 #endif /* ifndef CORE_MQTT_CONFIG_H_ */
@@ -0,0 +1,430 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @brief Flash task serializing the flash writes of all tasks.
+ *
+ * Flash writes keep the flash busy for milliseconds, during which code cannot execute from it. Callers
+ * queue their requests and go on, a single low priority task runs them in order, so a task receiving
+ * data over the network is not held by the flash and only one task ever drives the flash controller.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#include "fsl_debug_console.h"
+#include "mflash_drv.h"
+
+#include "flash_task.h"
+
+/**
+ * @brief The flash task runs below the tasks submitting requests, which then keep running while the
+ * flash is written.
+ */
+#define FLASH_TASK_PRIORITY        ( tskIDLE_PRIORITY + 1 )
+
+/**
+ * @brief Stack size of the flash task, enough for the handlers of the OTA PAL, which hash and
+ * decompress the data written.
+ */
+#define FLASH_TASK_STACK_SIZE      ( 1024 )
+
+/**
+ * @brief Number of requests, a submitter blocks once all of them are queued.
+ */
+#define FLASH_TASK_MAX_REQUESTS    ( 4 )
+
+/**
+ * @brief A request queued for the flash task.
+ */
+typedef struct FlashRequest
+{
+    FlashTaskHandler_t xHandler;
+    void * pvHandlerContext;
+    uint32_t ulAddress;
+    const uint8_t * pucData; /* ucBuffer, the caller's data of a synchronous request, or NULL */
+    uint32_t ulLength;
+    FlashTaskCallback_t xCallback;
+    void * pvCallbackContext;
+    uint32_t ulSubmitted; /* number of submitted requests merged into this one */
+    uint8_t ucBuffer[ flashtaskREQUEST_DATA_SIZE ];
+} FlashRequest_t;
+
+/**
+ * @brief Completion of a synchronous request.
+ */
+typedef struct FlashRun
+{
+    StaticSemaphore_t xDoneBuffer;
+    SemaphoreHandle_t xDone;
+    int32_t lResult;
+} FlashRun_t;
+
+/**
+ * @brief Requests, kept out of the heap.
+ */
+static FlashRequest_t xRequests[ FLASH_TASK_MAX_REQUESTS ];
+
+/**
+ * @brief Queue of the requests not in use.
+ */
+static QueueHandle_t xFreeQueue = NULL;
+
+/**
+ * @brief Queue of the requests to run, in order of submission.
+ */
+static QueueHandle_t xPendingQueue = NULL;
+
+/**
+ * @brief Guards the last queued request against being merged into while the flash task picks it up.
+ */
+static SemaphoreHandle_t xTailMutex = NULL;
+
+/**
+ * @brief Last queued request, as long as it has not started and can be merged into.
+ */
+static FlashRequest_t * pxTail = NULL;
+
+static TaskHandle_t xFlashTask = NULL;
+
+/**
+ * @brief Check if requests have to go through the flash task. Without the task, before the scheduler
+ * is started and from the flash task itself, they are run directly.
+ */
+static BaseType_t prvUseFlashTask( void )
+{
+    return ( xFlashTask != NULL ) &&
+           ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) &&
+           ( xTaskGetCurrentTaskHandle() != xFlashTask );
+}
+
+/**
+ * @brief Check if a request can be appended to the last queued one.
+ */
+static BaseType_t prvCanMerge( const FlashRequest_t * pxRequest,
+                               FlashTaskHandler_t xHandler,
+                               void * pvHandlerContext,
+                               uint32_t ulAddress,
+                               const uint8_t * pucData,
+                               uint32_t ulLength,
+                               FlashTaskCallback_t xCallback,
+                               void * pvCallbackContext )
+{
+    if( ( pxRequest == NULL ) ||
+        ( pxRequest->xHandler != xHandler ) ||
+        ( pxRequest->pvHandlerContext != pvHandlerContext ) ||
+        ( pxRequest->xCallback != xCallback ) ||
+        ( pxRequest->pvCallbackContext != pvCallbackContext ) ||
+        ( pxRequest->ulAddress + pxRequest->ulLength != ulAddress ) )
+    {
+        return pdFALSE;
+    }
+
+    if( pucData == NULL )
+    {
+        return ( pxRequest->pucData == NULL );
+    }
+
+    return ( pxRequest->pucData == pxRequest->ucBuffer ) &&
+           ( pxRequest->ulLength + ulLength <= flashtaskREQUEST_DATA_SIZE );
+}
+
+/**
+ * @brief Queue a filled in request, the last one queued can be merged into if it is mergeable.
+ */
+static void prvQueueRequest( FlashRequest_t * pxRequest,
+                             BaseType_t xMergeable )
+{
+    ( void ) xSemaphoreTake( xTailMutex, portMAX_DELAY );
+
+    /* Never full, it has room for all the requests. */
+    ( void ) xQueueSend( xPendingQueue, &pxRequest, portMAX_DELAY );
+    pxTail = ( xMergeable == pdTRUE ) ? pxRequest : NULL;
+
+    ( void ) xSemaphoreGive( xTailMutex );
+}
+
+/**
+ * @brief Completion callback of a synchronous request, wakes up the caller.
+ */
+static void prvRunComplete( void * pvContext,
+                            int32_t lResult )
+{
+    FlashRun_t * pxRun = ( FlashRun_t * ) pvContext;
+
+    pxRun->lResult = lResult;
+    ( void ) xSemaphoreGive( pxRun->xDone );
+}
+
+static int32_t prvWrite( void * pvContext,
+                         uint32_t ulAddress,
+                         const uint8_t * pucData,
+                         uint32_t ulLength )
+{
+    ( void ) pvContext;
+
+    return mflash_drv_write( ( void * ) ulAddress, pucData, ulLength );
+}
+
+static int32_t prvErase( void * pvContext,
+                         uint32_t ulAddress,
+                         const uint8_t * pucData,
+                         uint32_t ulLength )
+{
+    ( void ) pvContext;
+    ( void ) pucData;
+
+    return mflash_drv_erase( ( void * ) ulAddress, ulLength );
+}
+
+static void prvFlashTask( void * pvParameters )
+{
+    FlashRequest_t * pxRequest;
+    int32_t lResult;
+    uint32_t i;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        ( void ) xQueueReceive( xPendingQueue, &pxRequest, portMAX_DELAY );
+
+        /* The request is started, later ones are queued on their own. */
+        ( void ) xSemaphoreTake( xTailMutex, portMAX_DELAY );
+
+        if( pxTail == pxRequest )
+        {
+            pxTail = NULL;
+        }
+
+        ( void ) xSemaphoreGive( xTailMutex );
+
+        lResult = 0;
+
+        if( pxRequest->xHandler != NULL )
+        {
+            lResult = pxRequest->xHandler( pxRequest->pvHandlerContext,
+                                           pxRequest->ulAddress,
+                                           pxRequest->pucData,
+                                           pxRequest->ulLength );
+        }
+
+        if( lResult != 0 )
+        {
+            PRINTF( "[FLASH] Request at 0x%x of %u bytes failed\r\n", pxRequest->ulAddress, pxRequest->ulLength );
+        }
+
+        if( pxRequest->xCallback != NULL )
+        {
+            for( i = 0; i < pxRequest->ulSubmitted; i++ )
+            {
+                pxRequest->xCallback( pxRequest->pvCallbackContext, lResult );
+            }
+        }
+
+        ( void ) xQueueSend( xFreeQueue, &pxRequest, 0 );
+    }
+}
+
+BaseType_t xFlashTaskInit( void )
+{
+    FlashRequest_t * pxRequest;
+    uint32_t i;
+
+    if( xFlashTask != NULL )
+    {
+        return pdTRUE;
+    }
+
+    xFreeQueue = xQueueCreate( FLASH_TASK_MAX_REQUESTS, sizeof( FlashRequest_t * ) );
+    xPendingQueue = xQueueCreate( FLASH_TASK_MAX_REQUESTS, sizeof( FlashRequest_t * ) );
+    xTailMutex = xSemaphoreCreateMutex();
+
+    if( ( xFreeQueue == NULL ) || ( xPendingQueue == NULL ) || ( xTailMutex == NULL ) )
+    {
+        PRINTF( "Failed to create flash task queues.\r\n" );
+        return pdFALSE;
+    }
+
+    for( i = 0; i < FLASH_TASK_MAX_REQUESTS; i++ )
+    {
+        pxRequest = &xRequests[ i ];
+        ( void ) xQueueSend( xFreeQueue, &pxRequest, 0 );
+    }
+
+    if( xTaskCreate( prvFlashTask,
+                     "Flash_task",
+                     FLASH_TASK_STACK_SIZE,
+                     NULL,
+                     FLASH_TASK_PRIORITY | portPRIVILEGE_BIT,
+                     &xFlashTask ) != pdPASS )
+    {
+        PRINTF( "Failed to create flash task.\r\n" );
+        xFlashTask = NULL;
+        return pdFALSE;
+    }
+
+    return pdTRUE;
+}
+
+BaseType_t xFlashTaskSubmit( FlashTaskHandler_t xHandler,
+                             void * pvHandlerContext,
+                             uint32_t ulAddress,
+                             const uint8_t * pucData,
+                             uint32_t ulLength,
+                             FlashTaskCallback_t xCallback,
+                             void * pvCallbackContext )
+{
+    FlashRequest_t * pxRequest = NULL;
+    BaseType_t xMerged = pdFALSE;
+    int32_t lResult;
+
+    if( ( xHandler == NULL ) || ( ( pucData != NULL ) && ( ulLength > flashtaskREQUEST_DATA_SIZE ) ) )
+    {
+        return pdFALSE;
+    }
+
+    if( prvUseFlashTask() == pdFALSE )
+    {
+        lResult = xHandler( pvHandlerContext, ulAddress, pucData, ulLength );
+
+        if( xCallback != NULL )
+        {
+            xCallback( pvCallbackContext, lResult );
+        }
+
+        return pdTRUE;
+    }
+
+    /* Append to the last request if it continues it, the handler then runs once for both. */
+    ( void ) xSemaphoreTake( xTailMutex, portMAX_DELAY );
+
+    if( prvCanMerge( pxTail, xHandler, pvHandlerContext, ulAddress, pucData, ulLength, xCallback, pvCallbackContext ) == pdTRUE )
+    {
+        if( pucData != NULL )
+        {
+            memcpy( &pxTail->ucBuffer[ pxTail->ulLength ], pucData, ulLength );
+        }
+
+        pxTail->ulLength += ulLength;
+        pxTail->ulSubmitted++;
+        xMerged = pdTRUE;
+    }
+
+    ( void ) xSemaphoreGive( xTailMutex );
+
+    if( xMerged == pdTRUE )
+    {
+        return pdTRUE;
+    }
+
+    ( void ) xQueueReceive( xFreeQueue, &pxRequest, portMAX_DELAY );
+
+    pxRequest->xHandler = xHandler;
+    pxRequest->pvHandlerContext = pvHandlerContext;
+    pxRequest->ulAddress = ulAddress;
+    pxRequest->pucData = NULL;
+    pxRequest->ulLength = ulLength;
+    pxRequest->xCallback = xCallback;
+    pxRequest->pvCallbackContext = pvCallbackContext;
+    pxRequest->ulSubmitted = 1;
+
+    if( pucData != NULL )
+    {
+        memcpy( pxRequest->ucBuffer, pucData, ulLength );
+        pxRequest->pucData = pxRequest->ucBuffer;
+    }
+
+    prvQueueRequest( pxRequest, pdTRUE );
+
+    return pdTRUE;
+}
+
+BaseType_t xFlashTaskIsActive( void )
+{
+    return prvUseFlashTask();
+}
+
+BaseType_t xFlashTaskWrite( uint32_t ulAddress,
+                            const uint8_t * pucData,
+                            uint32_t ulLength,
+                            FlashTaskCallback_t xCallback,
+                            void * pvCallbackContext )
+{
+    if( pucData == NULL )
+    {
+        return pdFALSE;
+    }
+
+    return xFlashTaskSubmit( prvWrite, NULL, ulAddress, pucData, ulLength, xCallback, pvCallbackContext );
+}
+
+BaseType_t xFlashTaskErase( uint32_t ulAddress,
+                            uint32_t ulLength,
+                            FlashTaskCallback_t xCallback,
+                            void * pvCallbackContext )
+{
+    return xFlashTaskSubmit( prvErase, NULL, ulAddress, NULL, ulLength, xCallback, pvCallbackContext );
+}
+
+int32_t lFlashTaskRun( FlashTaskHandler_t xHandler,
+                       void * pvHandlerContext,
+                       uint32_t ulAddress,
+                       const uint8_t * pucData,
+                       uint32_t ulLength )
+{
+    FlashRequest_t * pxRequest = NULL;
+    FlashRun_t xRun;
+
+    if( prvUseFlashTask() == pdFALSE )
+    {
+        return ( xHandler != NULL ) ? xHandler( pvHandlerContext, ulAddress, pucData, ulLength ) : 0;
+    }
+
+    xRun.xDone = xSemaphoreCreateBinaryStatic( &xRun.xDoneBuffer );
+    xRun.lResult = 0;
+
+    ( void ) xQueueReceive( xFreeQueue, &pxRequest, portMAX_DELAY );
+
+    /* The caller waits, its data is used in place. */
+    pxRequest->xHandler = xHandler;
+    pxRequest->pvHandlerContext = pvHandlerContext;
+    pxRequest->ulAddress = ulAddress;
+    pxRequest->pucData = pucData;
+    pxRequest->ulLength = ulLength;
+    pxRequest->xCallback = prvRunComplete;
+    pxRequest->pvCallbackContext = &xRun;
+    pxRequest->ulSubmitted = 1;
+
+    prvQueueRequest( pxRequest, pdFALSE );
+
+    ( void ) xSemaphoreTake( xRun.xDone, portMAX_DELAY );
+
+    return xRun.lResult;
+}
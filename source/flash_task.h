@@ -0,0 +1,128 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#ifndef FLASH_TASK_H
+#define FLASH_TASK_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+/**
+ * @brief Size of the data buffer of a request, one flash sector.
+ */
+#define flashtaskREQUEST_DATA_SIZE    ( 4096U )
+
+/**
+ * @brief Operation run by the flash task on behalf of a request.
+ *
+ * @param[in] pvContext Context given with the request.
+ * @param[in] ulAddress Address given with the request.
+ * @param[in] pucData Data of the request, NULL for a request without data.
+ * @param[in] ulLength Length of the request, merged requests are run at once.
+ * @return 0 on success, a negative value on failure.
+ */
+typedef int32_t ( * FlashTaskHandler_t )( void * pvContext,
+                                          uint32_t ulAddress,
+                                          const uint8_t * pucData,
+                                          uint32_t ulLength );
+
+/**
+ * @brief Completion callback of a request, called from the flash task once per submitted request,
+ * with the result of the handler.
+ */
+typedef void ( * FlashTaskCallback_t )( void * pvContext,
+                                        int32_t lResult );
+
+/**
+ * @brief Create the flash task, which runs the flash requests of all other tasks in order.
+ * Requests made before the task is created, or before the scheduler is started, are run directly.
+ *
+ * @return pdTRUE if the task was created.
+ */
+BaseType_t xFlashTaskInit( void );
+
+/**
+ * @brief Queue a request for the flash task, without waiting for it to complete.
+ *
+ * Data is copied into the request, the caller may reuse its buffer on return. A request following
+ * a queued one which has not started yet, with the same handler and contexts and at the next address,
+ * is merged into it so the handler runs once for both. Blocks while all requests are in use.
+ *
+ * @param[in] xHandler Operation to run.
+ * @param[in] pvHandlerContext Context passed to the operation.
+ * @param[in] ulAddress Address passed to the operation.
+ * @param[in] pucData Data copied into the request, NULL for a request without data.
+ * @param[in] ulLength Length of the data, at most flashtaskREQUEST_DATA_SIZE bytes if there is data.
+ * @param[in] xCallback Completion callback, can be NULL.
+ * @param[in] pvCallbackContext Context passed to the callback.
+ * @return pdTRUE if the request was queued or, without the flash task, run.
+ */
+BaseType_t xFlashTaskSubmit( FlashTaskHandler_t xHandler,
+                             void * pvHandlerContext,
+                             uint32_t ulAddress,
+                             const uint8_t * pucData,
+                             uint32_t ulLength,
+                             FlashTaskCallback_t xCallback,
+                             void * pvCallbackContext );
+
+/**
+ * @brief Check if the requests of the calling task go through the flash task.
+ *
+ * @return pdTRUE if xFlashTaskSubmit() queues and copies the data, pdFALSE if it runs the request in place.
+ */
+BaseType_t xFlashTaskIsActive( void );
+
+/**
+ * @brief Queue a write of data to flash, see mflash_drv_write().
+ */
+BaseType_t xFlashTaskWrite( uint32_t ulAddress,
+                            const uint8_t * pucData,
+                            uint32_t ulLength,
+                            FlashTaskCallback_t xCallback,
+                            void * pvCallbackContext );
+
+/**
+ * @brief Queue an erase of flash sectors, see mflash_drv_erase().
+ */
+BaseType_t xFlashTaskErase( uint32_t ulAddress,
+                            uint32_t ulLength,
+                            FlashTaskCallback_t xCallback,
+                            void * pvCallbackContext );
+
+/**
+ * @brief Run an operation in the flash task and wait for it, once all requests queued before are done.
+ *
+ * Data is not copied. With a NULL handler the call only waits for the queued requests, e.g. before
+ * reading back what was written.
+ *
+ * @return The result of the handler, 0 for a NULL handler.
+ */
+int32_t lFlashTaskRun( FlashTaskHandler_t xHandler,
+                       void * pvHandlerContext,
+                       uint32_t ulAddress,
+                       const uint8_t * pucData,
+                       uint32_t ulLength );
+
+#endif /* ifndef FLASH_TASK_H */
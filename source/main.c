@@ -74,6 +74,10 @@
 #include "user/demo-restrictions.h"
 #include "ota_update.h"
 #include "core_mqtt_agent.h"
+#include "flash_task.h"
+#include "mbedtls_freertos_port.h"
+#include "benchmarks.h"
+#include "spifi_boot.h"
 
 /*******************************************************************************
  * Definitions
@@ -129,17 +133,40 @@
     "-----END CERTIFICATE-----\n"
 
 
+/**
+ * @brief Port of the MQTT broker.
+ */
+#define MQTT_BROKER_PORT              ( 8883U )
+
+/**
+ * @brief Flag which prints the use of the mbedTLS arena and slabs after each connection to
+ * the broker, to size them. Disabled by default.
+ */
+#define MBEDTLS_HEAP_STATS_PRINT_ENABLED    ( 0 )
+
 /**
  * @brief Task priority of the MQTT Hello World task.
  */
 #define hello_task_PRIORITY    ( configMAX_PRIORITIES - 1 )
 
+/**
+ * @brief Receive timeout of the MQTT connection once the MQTT agent owns it.
+ * The agent reads only when data is signalled, so this only bounds the wait for the rest
+ * of a packet split across TLS records, without spinning.
+ */
+#define MQTT_AGENT_RECV_TIMEOUT_MS    ( 20U )
+
+/**
+ * @brief Delay before connecting again after the connection failed or was lost.
+ */
+#define MQTT_RECONNECT_DELAY_MS       ( 5000U )
+
 
 /**
  * @brief MQTT hello world demo task.
  * Task creates a secure TLS connection with MQTT broker, spawns OTA demo task
- * and then keeps publishing messages in a loop at regular intervals. The task never
- * exits the loop.
+ * and then keeps publishing messages in a loop at regular intervals. When the MQTT
+ * agent loses the connection, the task connects again. The task never exits the loop.
  *
  * @param[in] pvParameters The parameters for hello world task.
  */
@@ -173,6 +200,14 @@ static void eventCallback( MQTTContext_t * pContext,
                            MQTTPacketInfo_t * pPacketInfo,
                            MQTTDeserializedInfo_t * pDeserializedInfo );
 
+/**
+ * @brief Callback invoked by FreeRTOS+TCP from the IP task on activity on the MQTT connection socket.
+ * Wakes up the MQTT agent to receive the data.
+ *
+ * @param[in] xSocket The socket with activity.
+ */
+static void socketWakeupCallback( Socket_t xSocket );
+
 /**
  * @brief Callback indicating a publish has been successful.
  * Callback will be invoked by MQTT agent upon successfully publishing a message and a
@@ -222,7 +257,12 @@ static uint32_t ulGlobalEntryTimeMs;
 /**
  * @brief Semaphore used to synchronize publish complete callback.
  */
-static SemaphoreHandle_t xPublishCompleteSemaphore;
+static SemaphoreHandle_t xPublishCompleteSemaphore = NULL;
+
+/**
+ * @brief Status of the last publish operation, set by publishCompleteCallback().
+ */
+static MQTTStatus_t xPublishStatus = MQTTSuccess;
 
 
 /*******************************************************************************
@@ -249,11 +289,36 @@ int main( void )
     CRYPTO_InitHardware();
     printRegions();
 
+    #if ( OTA_UPDATE_ENABLED == 1 )
+        /* Flash is not remapped, an OTA image only runs from the slot it was linked for. */
+        PRINTF( "Running from 0x%08x, OTA images must be linked to 0x%08x.\r\n",
+                ( uint32_t ) boot_slot_running(),
+                ( uint32_t ) boot_slot_spare() );
+    #endif
+
+    #if ( FLASH_UPDATE_BENCH_ENABLED == 1 )
+        vFlashUpdateBench();
+    #endif
+
+    #if ( NETWORK_CHECKSUM_BENCH_ENABLED == 1 )
+        vChecksumBench();
+    #endif
+
     /* Provision certificates over UART. */
     vUartProvision();
 
     FreeRTOS_IPInit( ucIPAddress, ucNetMask, ucGatewayAddress, ucDNSServerAddress, ucMACAddress );
 
+    /* Flash writes of all tasks are run by the flash task once the scheduler is started. */
+    if( xFlashTaskInit() != pdTRUE )
+    {
+        PRINTF( "Flash Task creation failed!.\n" );
+
+        while( 1 )
+        {
+        }
+    }
+
     if( xTaskCreate( hello_task, "Hello_task", 2048, NULL, hello_task_PRIORITY | portPRIVILEGE_BIT, NULL ) !=
         pdPASS )
     {
@@ -311,9 +376,17 @@ static void eventCallback( MQTTContext_t * pContext,
     /* Process any application callback here. */
 }
 
+static void socketWakeupCallback( Socket_t xSocket )
+{
+    ( void ) xSocket;
+
+    MQTTAgent_Wakeup();
+}
+
 static void publishCompleteCallback( struct MQTTOperation * pOperation,
                                      MQTTStatus_t status )
 {
+    xPublishStatus = status;
     xSemaphoreGive( xPublishCompleteSemaphore );
 }
 
@@ -335,6 +408,11 @@ static void hello_task( void * pvParameters )
 
     HeapStats_t xHeapStats;
 
+    #if ( MBEDTLS_HEAP_STATS_PRINT_ENABLED == 1 )
+        MbedtlsHeapStats_t xMbedtlsHeapStats;
+    #endif
+    MQTTAgentStats_t xAgentStats;
+
 
     CK_ULONG ulTemp = 0;
     char * pcEndpoint = NULL;
@@ -399,86 +477,146 @@ static void hello_task( void * pvParameters )
         xMQTTConnectInfo.pPassword = "";
         xMQTTConnectInfo.passwordLength = strlen( xMQTTConnectInfo.pPassword );
 
+        #if ( TLS_SESSION_PERSIST_ENABLED == 1 )
+            vLoadTlsSession();
+        #endif
+
+        #if ( TLS_RECONNECT_BENCH_ENABLED == 1 )
+            vTlsReconnectBench( xMQTTContext.transportInterface.pNetworkContext, pcEndpoint, MQTT_BROKER_PORT, &xNetworkCredentials );
+        #endif
+
         FreeRTOS_debug_printf( ( "Attempting a connection\n" ) );
-        xTransportStatus = TLS_FreeRTOS_Connect( xMQTTContext.transportInterface.pNetworkContext, pcEndpoint, 8883, &xNetworkCredentials, 4000, 36000 );
 
-        if( TLS_TRANSPORT_SUCCESS == xTransportStatus )
+        for( ; ; )
         {
-            /* Send the connect packet. Use 100 ms as the timeout to wait for the CONNACK packet. */
-            xMQTTStatus = MQTT_Connect( &xMQTTContext, &xMQTTConnectInfo, NULL, 100, &bSessionPresent );
+            #if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+                mbedtls_platform_reset_alloc_profile();
+            #endif
 
-            TLS_FreeRTOS_SetRecvTimeout( xMQTTContext.transportInterface.pNetworkContext, 500 );
+            xTransportStatus = TLS_FreeRTOS_Connect( xMQTTContext.transportInterface.pNetworkContext, pcEndpoint, MQTT_BROKER_PORT, &xNetworkCredentials, 4000, 36000 );
 
-            if( xMQTTStatus == MQTTSuccess )
+            if( TLS_TRANSPORT_SUCCESS == xTransportStatus )
             {
-                xStatus = MQTTAgent_Init( &xMQTTContext );
-                configASSERT( xStatus == pdTRUE );
-
-                xPublishCompleteSemaphore = xSemaphoreCreateBinary();
-                configASSERT( xPublishCompleteSemaphore != NULL );
-
-                #if ( OTA_UPDATE_ENABLED == 1 )
-                    xStatus = xStartOTAUpdateDemo();
-                    configASSERT( xStatus == pdTRUE );
+                #if ( TLS_SESSION_PERSIST_ENABLED == 1 )
+                    vSaveTlsSession( pcEndpoint, MQTT_BROKER_PORT );
                 #endif
 
-                for( ; ; )
-                {
-                    xPayloadLength = snprintf( cPayload, sizeof( cPayload ), "Hello %ld", lCounter++ );
-
-                    /* Since we requested a clean session, this must be false */
-                    assert( bSessionPresent == false );
-
-                    /* Do something with the connection. Publish some data. */
-                    xPublishInfo.qos = MQTTQoS0;
-                    xPublishInfo.dup = false;
-                    xPublishInfo.retain = false;
-                    xPublishInfo.pTopicName = "Test/Hello";
-                    xPublishInfo.topicNameLength = 10;
-                    xPublishInfo.pPayload = cPayload;
-                    xPublishInfo.payloadLength = xPayloadLength;
-
-                    xPublishOperation.type = MQTT_OP_PUBLISH;
-                    xPublishOperation.info.pPublishInfo = &xPublishInfo;
-                    xPublishOperation.callback = publishCompleteCallback;
+                #if ( MBEDTLS_HEAP_STATS_PRINT_ENABLED == 1 )
+                    mbedtls_platform_get_heap_stats( &xMbedtlsHeapStats );
+                    PRINTF( "mbedTLS arena: %u of %u bytes used, high water mark %u, %u failed allocations.\r\n",
+                            xMbedtlsHeapStats.xUsedBytes, xMbedtlsHeapStats.xArenaSize,
+                            xMbedtlsHeapStats.xMaxUsedBytes, xMbedtlsHeapStats.ulFailedAllocations );
+                    PRINTF( "mbedTLS slabs: %u of %u bytes used, high water mark %u, %u allocations to the arena.\r\n",
+                            xMbedtlsHeapStats.xSlabUsedBytes, xMbedtlsHeapStats.xSlabSize,
+                            xMbedtlsHeapStats.xSlabMaxUsedBytes, xMbedtlsHeapStats.ulSlabFallbacks );
+                #endif
 
-                    MQTTAgent_Enqueue( &xPublishOperation, portMAX_DELAY );
+                #if ( MBEDTLS_FREERTOS_ALLOC_PROFILE == 1 )
+                    vPrintAllocProfile( "TLS connection" );
+                #endif
 
-                    xSemaphoreTake( xPublishCompleteSemaphore, portMAX_DELAY );
+                /* Send the connect packet. Use 100 ms as the timeout to wait for the CONNACK packet. */
+                xMQTTStatus = MQTT_Connect( &xMQTTContext, &xMQTTConnectInfo, NULL, 100, &bSessionPresent );
 
-                    PRINTF( "Published helloworld.\r\n" );
+                /* The MQTT agent does not poll the connection. It is woken up by the socket callback
+                 * when data arrives, and the receive only waits for the rest of a partly received packet. */
+                TLS_FreeRTOS_SetRecvTimeout( xMQTTContext.transportInterface.pNetworkContext, MQTT_AGENT_RECV_TIMEOUT_MS );
+                TLS_FreeRTOS_SetWakeupCallback( xMQTTContext.transportInterface.pNetworkContext, socketWakeupCallback );
 
-                    vTaskDelay( pdMS_TO_TICKS( 5000 ) );
+                if( xMQTTStatus == MQTTSuccess )
+                {
+                    if( xPublishCompleteSemaphore == NULL )
+                    {
+                        xStatus = MQTTAgent_Init( &xMQTTContext, TLS_FreeRTOS_IsDataAvailable );
+                        configASSERT( xStatus == pdTRUE );
+
+                        xPublishCompleteSemaphore = xSemaphoreCreateBinary();
+                        configASSERT( xPublishCompleteSemaphore != NULL );
+
+                        #if ( OTA_UPDATE_ENABLED == 1 )
+                            xStatus = xStartOTAUpdateDemo();
+                            configASSERT( xStatus == pdTRUE );
+                        #endif
+                    }
+                    else
+                    {
+                        /* The agent left the MQTT context alone since it lost the connection. */
+                        MQTTAgent_Reconnected();
+
+                        #if ( OTA_UPDATE_ENABLED == 1 )
+                            /* The clean session dropped the OTA job and stream subscriptions. */
+                            if( xOTAUpdateReconnected() != pdTRUE )
+                            {
+                                PRINTF( "OTA update could not be restored after reconnecting.\r\n" );
+                            }
+                        #endif
+                    }
+
+                    while( MQTTAgent_IsConnected() == pdTRUE )
+                    {
+                        xPayloadLength = snprintf( cPayload, sizeof( cPayload ), "Hello %ld", lCounter++ );
+
+                        /* Since we requested a clean session, this must be false */
+                        assert( bSessionPresent == false );
+
+                        /* Do something with the connection. Publish some data. */
+                        xPublishInfo.qos = MQTTQoS0;
+                        xPublishInfo.dup = false;
+                        xPublishInfo.retain = false;
+                        xPublishInfo.pTopicName = "Test/Hello";
+                        xPublishInfo.topicNameLength = 10;
+                        xPublishInfo.pPayload = cPayload;
+                        xPublishInfo.payloadLength = xPayloadLength;
+
+                        xPublishOperation.type = MQTT_OP_PUBLISH;
+                        xPublishOperation.info.pPublishInfo = &xPublishInfo;
+                        xPublishOperation.callback = publishCompleteCallback;
+
+                        MQTTAgent_Enqueue( &xPublishOperation, portMAX_DELAY );
+
+                        xSemaphoreTake( xPublishCompleteSemaphore, portMAX_DELAY );
+
+                        if( xPublishStatus == MQTTSuccess )
+                        {
+                            PRINTF( "Published helloworld.\r\n" );
+                        }
+
+                        MQTTAgent_GetStats( &xAgentStats );
+                        FreeRTOS_debug_printf( ( "MQTT agent: %u publishes in %u batches, %u batches of more than one, largest %u\n",
+                                                 xAgentStats.ulBatchedPublishes, xAgentStats.ulBatches,
+                                                 xAgentStats.ulMultiPublishBatches, xAgentStats.ulLargestBatch ) );
+
+                        vTaskDelay( pdMS_TO_TICKS( 5000 ) );
+                    }
+
+                    PRINTF( "MQTT connection lost, reconnecting.\r\n" );
+
+                    vPortGetHeapStats( &xHeapStats );
+                    FreeRTOS_debug_printf( ( "Available heap space              %d\n", xHeapStats.xAvailableHeapSpaceInBytes ) );
+                    FreeRTOS_debug_printf( ( "Largest Free Block                %d\n", xHeapStats.xSizeOfLargestFreeBlockInBytes ) );
+                    FreeRTOS_debug_printf( ( "Smallest Free Block               %d\n", xHeapStats.xSizeOfSmallestFreeBlockInBytes ) );
+                    FreeRTOS_debug_printf( ( "Number of Free Blocks             %d\n", xHeapStats.xNumberOfFreeBlocks ) );
+                    FreeRTOS_debug_printf( ( "Minimum Ever Free Bytes Remaining %d\n", xHeapStats.xMinimumEverFreeBytesRemaining ) );
+                    FreeRTOS_debug_printf( ( "Number of Successful Allocations  %d\n", xHeapStats.xNumberOfSuccessfulAllocations ) );
+                    FreeRTOS_debug_printf( ( "Number of Successful Frees        %d\n", xHeapStats.xNumberOfSuccessfulFrees ) );
                 }
 
-                vPortGetHeapStats( &xHeapStats );
-                FreeRTOS_debug_printf( ( "Available heap space              %d\n", xHeapStats.xAvailableHeapSpaceInBytes ) );
-                FreeRTOS_debug_printf( ( "Largest Free Block                %d\n", xHeapStats.xSizeOfLargestFreeBlockInBytes ) );
-                FreeRTOS_debug_printf( ( "Smallest Free Block               %d\n", xHeapStats.xSizeOfSmallestFreeBlockInBytes ) );
-                FreeRTOS_debug_printf( ( "Number of Free Blocks             %d\n", xHeapStats.xNumberOfFreeBlocks ) );
-                FreeRTOS_debug_printf( ( "Minimum Ever Free Bytes Remaining %d\n", xHeapStats.xMinimumEverFreeBytesRemaining ) );
-                FreeRTOS_debug_printf( ( "Number of Successful Allocations  %d\n", xHeapStats.xNumberOfSuccessfulAllocations ) );
-                FreeRTOS_debug_printf( ( "Number of Successful Frees        %d\n", xHeapStats.xNumberOfSuccessfulFrees ) );
-
-
-                /* Disconnect */
-                MQTT_Disconnect( &xMQTTContext );
+                TLS_FreeRTOS_Disconnect( xMQTTContext.transportInterface.pNetworkContext );
+            }
+            else if( TLS_TRANSPORT_INVALID_PARAMETER == xTransportStatus )
+            {
+                FreeRTOS_debug_printf( ( "Error Connecting to server : bad parameter\n" ) );
+            }
+            else if( TLS_TRANSPORT_CONNECT_FAILURE == xTransportStatus )
+            {
+                FreeRTOS_debug_printf( ( "Error Connecting to server : connect failure\n" ) );
+            }
+            else
+            {
+                FreeRTOS_debug_printf( ( "Error Connecting to server : unknown\n" ) );
             }
 
-            TLS_FreeRTOS_Disconnect( xMQTTContext.transportInterface.pNetworkContext );
-        }
-
-        else if( TLS_TRANSPORT_INVALID_PARAMETER == xTransportStatus )
-        {
-            FreeRTOS_debug_printf( ( "Error Connecting to server : bad parameter\n" ) );
-        }
-        else if( TLS_TRANSPORT_CONNECT_FAILURE == xTransportStatus )
-        {
-            FreeRTOS_debug_printf( ( "Error Connecting to server : connect failure\n" ) );
-        }
-        else
-        {
-            FreeRTOS_debug_printf( ( "Error Connecting to server : unknown\n" ) );
+            vTaskDelay( pdMS_TO_TICKS( MQTT_RECONNECT_DELAY_MS ) );
         }
     }
 
@@ -510,6 +648,13 @@ void vApplicationIPNetworkEventHook( eIPCallbackEvent_t eNetworkEvent )
              * up. */
             PRINTF( ( "---------STARTING DEMO---------\r\n" ) );
             /* vStartSimpleMQTTDemo(); */
+
+            #if ( NETWORK_THROUGHPUT_BENCH_ENABLED == 1 )
+                if( xStartNetworkThroughputBench() != pdPASS )
+                {
+                    PRINTF( "Network benchmark task creation failed!.\r\n" );
+                }
+            #endif
             xTasksAlreadyCreated = pdTRUE;
         }
 
@@ -27,43 +27,64 @@
  * @brief File contains OTA platform layer abstraction implementations using NXP SDK.
  */
 
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "ota_pal.h"
+#include "ota_config.h"
 #include "fsl_debug_console.h"
 #include "spifi_boot.h"
 #include "mflash_drv.h"
+#include "boot_delta.h"
+#include "boot_lz4.h"
+#include "mbedtls/sha256.h"
+#include "flash_task.h"
 
 /**
  * @brief The maximum size of each image slots.
- * Flash memory is divided in such a way there are 3 slots one for the current image
- * being executed, one for new image being written to and one for the backup image.
+ * Flash memory is divided in such a way there are 3 slots. The image executes from one of the two boot slots
+ * and the new image is written to the other one, the spare slot. The third slot is the staging slot where
+ * delta patches and compressed images are received before being reconstructed into the spare slot.
  */
-#define OTA_IMAGE_SLOT_SIZE      ( 0x200000 )
+#define OTA_IMAGE_SLOT_SIZE      ( BOOT_SLOT_SIZE )
 
 /**
- * @brief The flash address where the new image will be written to.
+ * @brief The flash address where received files which are not a full image are written to.
  */
-#define OTA_UPDATE_IMAGE_ADDR    ( BOOT_EXEC_IMAGE_ADDR + 1 * OTA_IMAGE_SLOT_SIZE )
+#define OTA_STAGING_IMAGE_ADDR   ( BOOT_EXEC_IMAGE_ADDR + 2 * OTA_IMAGE_SLOT_SIZE )
 
 /**
- * @brief The flash address where the backup image will be stored for rollback.
+ * @brief Maximum size an offset of a firmware image can go in flash.
  */
-#define OTA_BACKUP_IMAGE_ADDR    ( BOOT_EXEC_IMAGE_ADDR + 2 * OTA_IMAGE_SLOT_SIZE )
+#define OTA_MAX_IMAGE_SIZE       ( OTA_IMAGE_SLOT_SIZE )
 
 /**
- * @brief Maximum size an offset of a firmware image can go in flash.
+ * @brief Pointer representation of the staging slot in flash
  */
-#define OTA_MAX_IMAGE_SIZE       ( OTA_IMAGE_SLOT_SIZE )
+#define OTA_STAGING_IMAGE_PTR    ( ( uint8_t * ) OTA_STAGING_IMAGE_ADDR )
 
 /**
- * @brief Pointer representation of the new firmware image in flash
+ * @brief Number of flash sectors in an image slot.
  */
-#define OTA_UPDATE_IMAGE_PTR     ( ( void * ) OTA_UPDATE_IMAGE_ADDR )
+#define OTA_IMAGE_SLOT_SECTORS   ( OTA_IMAGE_SLOT_SIZE / MFLASH_SECTOR_SIZE )
 
 /**
- * @brief Pointer representation of the backup firmware image in flash
+ * @brief Size of the OTA file blocks, the unit in which written ranges are tracked for hashing.
  */
-#define OTA_BACKUP_IMAGE_PTR     ( ( void * ) OTA_BACKUP_IMAGE_ADDR )
+#define OTA_FILE_BLOCK_SIZE      ( 1UL << otaconfigLOG2_FILE_BLOCK_SIZE )
 
+/**
+ * @brief Number of OTA file blocks in an image slot.
+ */
+#define OTA_IMAGE_SLOT_BLOCKS    ( OTA_IMAGE_SLOT_SIZE / OTA_FILE_BLOCK_SIZE )
+
+/**
+ * @brief States of the decompression of a received file while it is being downloaded.
+ */
+#define OTA_PAL_DECODE_PENDING   ( 0U ) /* start of the file not received yet */
+#define OTA_PAL_DECODE_NONE      ( 1U ) /* file is not compressed */
+#define OTA_PAL_DECODE_LZ4       ( 2U ) /* file is being decompressed into the spare slot */
+#define OTA_PAL_DECODE_FAILED    ( 3U ) /* stream broken, decompress again from flash once validated */
 
 
 /* low level file context structure */
@@ -72,6 +93,22 @@ typedef struct
     const OtaFileContext_t * FileXRef;
     uint8_t * BaseAddr;
     uint32_t Size;
+    uint32_t ErasedSectors[ OTA_IMAGE_SLOT_SECTORS / 32 ]; /* bitmap of sectors erased since the file was created */
+    uint32_t SectorsErased;
+    uint32_t WrittenBlocks[ OTA_IMAGE_SLOT_BLOCKS / 32 ]; /* bitmap of blocks written and not consumed yet */
+    mbedtls_sha256_context HashContext;
+    uint32_t HashedSize;   /* length of the image prefix fed to the hash */
+    bool HashValid;        /* false if a hashed range was written again */
+    uint32_t BytesRehashed; /* bytes read back from flash to complete the hash */
+    uint32_t DecodeState;
+    uint32_t DecodedSize;   /* length of the file prefix fed to the decompressor */
+    uint32_t BlocksDirect;  /* blocks streamed from the OTA buffer straight to flash */
+    uint32_t BlocksUpdated; /* blocks that went through the sector read-modify-write */
+    uint32_t BlocksQueued;  /* blocks copied into a flash task request */
+    uint32_t BytesWritten;
+    bool WriteFailed;       /* a block queued to the flash task could not be written */
+    TickType_t StartTicks;
+    TickType_t WriteTicks; /* ticks spent in flash writes */
 } LL_FileContext_t;
 
 /**
@@ -81,11 +118,188 @@ typedef struct
  */
 static LL_FileContext_t * prvPAL_GetLLFileContext( OtaFileContext_t * const C );
 
+/**
+ * @brief Print flash write throughput and copy statistics of the received file.
+ *
+ * @param[in] Pointer to low level file context.
+ */
+static void prvPAL_PrintWriteStats( const LL_FileContext_t * FileContext );
+
+/**
+ * @brief Select the slot a received file is written to, upon its first block and upon block 0.
+ *
+ * Block 0 of a full image holds its header, which is checked against the spare slot so that an image
+ * linked for the running slot is rejected before the rest of it is downloaded.
+ *
+ * @param[in] Offset of the block.
+ * @param[in] Pointer to the block data.
+ * @param[in] Size of the block.
+ *
+ * @return Address of the spare slot for a full image, of the staging slot otherwise, NULL if the image
+ * is not linked to execute from the spare slot.
+ */
+static uint8_t * prvPAL_SelectSlot( uint32_t offset,
+                                    const uint8_t * pData,
+                                    uint32_t blockSize );
+
+/**
+ * @brief Erase the sectors spanned by a block, unless they were erased earlier for this file.
+ *
+ * Blocks may arrive out of order and several of them share a sector, so each sector is erased once
+ * on its first touch and all of its blocks are then page programmed without another erase.
+ *
+ * @param[in] Pointer to low level file context.
+ * @param[in] Offset of the block in the file.
+ * @param[in] Size of the block.
+ *
+ * @return 0 on success, -1 on erase failure.
+ */
+static int32_t prvPAL_PrepareSectors( LL_FileContext_t * FileContext,
+                                      uint32_t offset,
+                                      uint32_t blockSize );
+
+/**
+ * @brief Feed the next part of the file, in order, to the running hash and to the decompressor.
+ *
+ * @param[in] Pointer to low level file context.
+ * @param[in] Pointer to the data.
+ * @param[in] Size of the data.
+ *
+ * @return true on success, false if the hash could not be updated.
+ */
+static bool prvPAL_ConsumeInOrder( LL_FileContext_t * FileContext,
+                                   const uint8_t * pData,
+                                   uint32_t length );
+
+/**
+ * @brief Complete the decompression of a received compressed image into the spare slot.
+ *
+ * @param[in] Pointer to low level file context.
+ *
+ * @return OtaPalSuccess if the image was decompressed and verified.
+ */
+static OtaPalStatus_t prvPAL_PrepareCompressedImage( LL_FileContext_t * FileContext );
+
+/**
+ * @brief Reconstruct the image from the running image and a received delta patch into the spare slot.
+ *
+ * @param[in] Pointer to low level file context.
+ *
+ * @return OtaPalSuccess if the image was reconstructed and verified.
+ */
+static OtaPalStatus_t prvPAL_PrepareDeltaImage( LL_FileContext_t * FileContext );
+
+/**
+ * @brief Move a full image received into the staging slot to the spare slot.
+ *
+ * @param[in] Pointer to low level file context.
+ *
+ * @return OtaPalSuccess if the image was written.
+ */
+static OtaPalStatus_t prvPAL_PrepareStagedImage( LL_FileContext_t * FileContext );
+
+/**
+ * @brief Feed the newly written block to the running hash of the file and, for compressed files, to the
+ * decompressor.
+ *
+ * A block at the end of the consumed prefix is taken from the OTA buffer, then the following blocks
+ * which were received earlier, out of order, are read directly from flash. Other blocks are only
+ * marked as written and are picked up once the gap before them is filled.
+ *
+ * @param[in] Pointer to low level file context.
+ * @param[in] Offset of the block in the file.
+ * @param[in] Pointer to the block data.
+ * @param[in] Size of the block.
+ */
+static void prvPAL_ConsumeBlock( LL_FileContext_t * FileContext,
+                                 uint32_t offset,
+                                 const uint8_t * pData,
+                                 uint32_t blockSize );
+
+/**
+ * @brief Write a received block to flash and consume it, run by the flash task.
+ *
+ * Consecutive blocks queued while the flash task was busy are merged into one request and
+ * written at once.
+ *
+ * @param[in] Pointer to low level file context.
+ * @param[in] Offset of the data in the file.
+ * @param[in] Pointer to the data.
+ * @param[in] Size of the data.
+ *
+ * @return 0 on success, -1 on flash failure.
+ */
+static int32_t prvPAL_WriteHandler( void * pvContext,
+                                    uint32_t offset,
+                                    const uint8_t * pData,
+                                    uint32_t blockSize );
+
+/**
+ * @brief Completion of the blocks queued to the flash task, records a failure to be reported
+ * on the next block and when the file is closed.
+ *
+ * @param[in] Pointer to low level file context.
+ * @param[in] Result of the write.
+ */
+static void prvPAL_WriteComplete( void * pvContext,
+                                  int32_t result );
+
+/**
+ * @brief Prepare the received file into a bootable image in the spare slot, run by the flash task.
+ *
+ * @param[in] Pointer to low level file context.
+ *
+ * @return 0 if the image is ready to boot, -1 otherwise.
+ */
+static int32_t prvPAL_PrepareHandler( void * pvContext,
+                                      uint32_t address,
+                                      const uint8_t * pData,
+                                      uint32_t length );
+
+/**
+ * @brief Write the update control block, run by the flash task.
+ *
+ * @param[in] Pointer to the update control block.
+ *
+ * @return 0 on success, -1 on flash failure.
+ */
+static int32_t prvPAL_UcbWriteHandler( void * pvContext,
+                                       uint32_t address,
+                                       const uint8_t * pData,
+                                       uint32_t length );
+
+/**
+ * @brief Request the bootloader to boot the spare slot, run by the flash task.
+ *
+ * @param[in] Pointer to the spare slot.
+ *
+ * @return 0 on success, -1 on flash failure.
+ */
+static int32_t prvPAL_UpdateRequestHandler( void * pvContext,
+                                            uint32_t address,
+                                            const uint8_t * pData,
+                                            uint32_t length );
+
 /* Specify the OTA signature algorithm we support on this platform. */
 const char OTA_JsonFileSignatureKey[ OTA_FILE_SIG_KEY_STR_MAX_LENGTH ] = "sig-sha256-ecdsa";
 
 static LL_FileContext_t prvPAL_CurrentFileContext;
 
+/**
+ * @brief Delta applier context, kept out of the task stack.
+ */
+static struct boot_delta prvPAL_Delta;
+
+/**
+ * @brief Decompressor context, kept out of the task stack.
+ */
+static struct boot_lz4 prvPAL_Lz4;
+
+/**
+ * @brief Writer moving a full image from the staging slot, kept out of the task stack.
+ */
+static struct boot_writer prvPAL_Writer;
+
 static LL_FileContext_t * prvPAL_GetLLFileContext( OtaFileContext_t * const C )
 {
     LL_FileContext_t * FileContext;
@@ -105,6 +319,226 @@ static LL_FileContext_t * prvPAL_GetLLFileContext( OtaFileContext_t * const C )
     return FileContext;
 }
 
+static uint8_t * prvPAL_SelectSlot( uint32_t offset,
+                                    const uint8_t * pData,
+                                    uint32_t blockSize )
+{
+    uint32_t loadAddress;
+
+    /* A full image goes straight to the spare slot it is going to execute from. Delta patches and compressed
+     * images go to the staging slot, and so does a file whose start is not the first block received as its
+     * type is not known yet. */
+    if( ( offset == 0 ) &&
+        ( blockSize >= sizeof( struct boot_delta_header ) ) &&
+        !boot_delta_is_patch( pData ) &&
+        !boot_lz4_is_compressed( pData ) )
+    {
+        /* Flash is not remapped, the image has to be linked for the slot it is installed to. */
+        loadAddress = boot_image_load_address( pData, blockSize );
+
+        if( loadAddress != ( uint32_t ) boot_slot_spare() )
+        {
+            PRINTF( "[OTA-NXP] Image is linked to 0x%x, this device needs images linked to 0x%x\r\n",
+                    loadAddress,
+                    ( uint32_t ) boot_slot_spare() );
+            return NULL;
+        }
+
+        return ( uint8_t * ) boot_slot_spare();
+    }
+
+    return OTA_STAGING_IMAGE_PTR;
+}
+
+static int32_t prvPAL_PrepareSectors( LL_FileContext_t * FileContext,
+                                      uint32_t offset,
+                                      uint32_t blockSize )
+{
+    uint32_t sector = offset / MFLASH_SECTOR_SIZE;
+    uint32_t lastSector = ( offset + blockSize - 1 ) / MFLASH_SECTOR_SIZE;
+
+    for( ; sector <= lastSector; sector++ )
+    {
+        if( ( FileContext->ErasedSectors[ sector / 32 ] & ( 1UL << ( sector % 32 ) ) ) == 0 )
+        {
+            if( mflash_drv_erase( FileContext->BaseAddr + sector * MFLASH_SECTOR_SIZE, MFLASH_SECTOR_SIZE ) != 0 )
+            {
+                return -1;
+            }
+
+            FileContext->ErasedSectors[ sector / 32 ] |= ( 1UL << ( sector % 32 ) );
+            FileContext->SectorsErased++;
+        }
+    }
+
+    return 0;
+}
+
+static bool prvPAL_ConsumeInOrder( LL_FileContext_t * FileContext,
+                                   const uint8_t * pData,
+                                   uint32_t length )
+{
+    if( FileContext->DecodeState == OTA_PAL_DECODE_PENDING )
+    {
+        /* Start of the file, decompress it on the fly if it is a compressed image. */
+        if( ( length >= sizeof( struct boot_lz4_header ) ) && boot_lz4_is_compressed( pData ) )
+        {
+            boot_lz4_init( &prvPAL_Lz4, boot_slot_spare(), OTA_IMAGE_SLOT_SIZE );
+            FileContext->DecodeState = OTA_PAL_DECODE_LZ4;
+        }
+        else
+        {
+            FileContext->DecodeState = OTA_PAL_DECODE_NONE;
+        }
+    }
+
+    if( FileContext->DecodeState == OTA_PAL_DECODE_LZ4 )
+    {
+        if( boot_lz4_write( &prvPAL_Lz4, pData, length ) == 0 )
+        {
+            FileContext->DecodedSize += length;
+        }
+        else
+        {
+            FileContext->DecodeState = OTA_PAL_DECODE_FAILED;
+        }
+    }
+
+    if( mbedtls_sha256_update_ret( &FileContext->HashContext, pData, length ) != 0 )
+    {
+        return false;
+    }
+
+    FileContext->HashedSize += length;
+
+    return true;
+}
+
+static void prvPAL_ConsumeBlock( LL_FileContext_t * FileContext,
+                                 uint32_t offset,
+                                 const uint8_t * pData,
+                                 uint32_t blockSize )
+{
+    uint32_t block;
+    uint32_t length;
+
+    if( FileContext->HashValid == false )
+    {
+        return;
+    }
+
+    if( offset < FileContext->HashedSize )
+    {
+        /* Part of the file already consumed was rewritten, the digest has to be recomputed and the
+         * image decompressed again. */
+        FileContext->HashValid = false;
+
+        if( FileContext->DecodeState == OTA_PAL_DECODE_LZ4 )
+        {
+            FileContext->DecodeState = OTA_PAL_DECODE_FAILED;
+        }
+
+        return;
+    }
+
+    if( offset > FileContext->HashedSize )
+    {
+        /* Out of order blocks, consume them later once all preceding blocks are written. Blocks not aligned
+         * to the tracking unit are left to the re-read from flash when the file is validated. */
+        if( ( offset % OTA_FILE_BLOCK_SIZE ) == 0 )
+        {
+            for( length = 0; length < blockSize; length += OTA_FILE_BLOCK_SIZE )
+            {
+                block = ( offset + length ) / OTA_FILE_BLOCK_SIZE;
+                FileContext->WrittenBlocks[ block / 32 ] |= ( 1UL << ( block % 32 ) );
+            }
+        }
+
+        return;
+    }
+
+    if( prvPAL_ConsumeInOrder( FileContext, pData, blockSize ) == false )
+    {
+        FileContext->HashValid = false;
+        return;
+    }
+
+    /* Catch up with the blocks which arrived ahead of this one. */
+    while( ( FileContext->HashedSize % OTA_FILE_BLOCK_SIZE ) == 0 )
+    {
+        block = FileContext->HashedSize / OTA_FILE_BLOCK_SIZE;
+
+        if( ( block >= OTA_IMAGE_SLOT_BLOCKS ) ||
+            ( ( FileContext->WrittenBlocks[ block / 32 ] & ( 1UL << ( block % 32 ) ) ) == 0 ) )
+        {
+            break;
+        }
+
+        FileContext->WrittenBlocks[ block / 32 ] &= ~( 1UL << ( block % 32 ) );
+
+        length = FileContext->Size - FileContext->HashedSize;
+
+        if( length > OTA_FILE_BLOCK_SIZE )
+        {
+            length = OTA_FILE_BLOCK_SIZE;
+        }
+
+        if( prvPAL_ConsumeInOrder( FileContext, FileContext->BaseAddr + FileContext->HashedSize, length ) == false )
+        {
+            FileContext->HashValid = false;
+            return;
+        }
+    }
+}
+
+static void prvPAL_PrintWriteStats( const LL_FileContext_t * FileContext )
+{
+    uint32_t totalMs = ( xTaskGetTickCount() - FileContext->StartTicks ) * portTICK_PERIOD_MS;
+    uint32_t writeMs = FileContext->WriteTicks * portTICK_PERIOD_MS;
+
+    /* A block queued to the flash task is copied into the request, an updated block is copied
+     * once more into the driver's sector shadow. A direct block is then programmed from the
+     * request, or from the OTA buffer when it was not queued. The OTA library has already
+     * copied each block twice, into its event buffer and into the decode buffer. */
+    PRINTF( "[OTA-NXP] Wrote %u bytes in %u blocks, %u direct, %u read-modify-write, %u queued (copies per block in the PAL: %u/%u, plus 2 in the OTA library)\r\n",
+            FileContext->BytesWritten,
+            FileContext->BlocksDirect + FileContext->BlocksUpdated,
+            FileContext->BlocksDirect,
+            FileContext->BlocksUpdated,
+            FileContext->BlocksQueued,
+            FileContext->BlocksQueued + FileContext->BlocksUpdated,
+            FileContext->BlocksDirect + FileContext->BlocksUpdated );
+    PRINTF( "[OTA-NXP] Erased %u sectors\r\n", FileContext->SectorsErased );
+    PRINTF( "[OTA-NXP] Flash write %u ms (%u B/s), total %u ms (%u B/s)\r\n",
+            writeMs,
+            ( writeMs > 0 ) ? ( uint32_t ) ( ( ( uint64_t ) FileContext->BytesWritten * 1000U ) / writeMs ) : 0U,
+            totalMs,
+            ( totalMs > 0 ) ? ( uint32_t ) ( ( ( uint64_t ) FileContext->BytesWritten * 1000U ) / totalMs ) : 0U );
+}
+
+static int32_t prvPAL_UcbWriteHandler( void * pvContext,
+                                       uint32_t address,
+                                       const uint8_t * pData,
+                                       uint32_t length )
+{
+    ( void ) address;
+    ( void ) pData;
+    ( void ) length;
+
+    return boot_ucb_write( ( const struct boot_ucb * ) pvContext );
+}
+
+static int32_t prvPAL_UpdateRequestHandler( void * pvContext,
+                                            uint32_t address,
+                                            const uint8_t * pData,
+                                            uint32_t length )
+{
+    ( void ) address;
+    ( void ) pData;
+    ( void ) length;
+
+    return boot_update_request( pvContext );
+}
 
 OtaPalImageState_t xOtaPalGetPlatformImageState( OtaFileContext_t * const pFileContext )
 {
@@ -145,31 +579,18 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
             if( ucb.state == BOOT_STATE_PENDING_COMMIT )
             {
+                /* Select the slot of the running image for the next boots, the previous image is left in
+                 * the other slot until the next update overwrites it. */
                 ucb.state = BOOT_STATE_VOID;
+                ucb.exec_img = ucb.update_img;
 
-                if( 0 != boot_ucb_write( &ucb ) )
+                if( 0 != lFlashTaskRun( prvPAL_UcbWriteHandler, &ucb, 0, NULL, 0 ) )
                 {
                     PRINTF( "[OTA-NXP] FLASH operation failed during commit\r\n" );
                     result = OTA_PAL_COMBINE_ERR( OtaPalCommitFailed, 0 );
                 }
 
                 boot_wdtdis(); /* disable watchdog */
-
-                if( 0 != boot_overwrite_rollback() )
-                {
-                    /* rollback image may be partially overwritten - do not return error as that would initiate a rollback */
-                    PRINTF( "[OTA-NXP] FLASH operation failed during overwrite\r\n" );
-                    ucb.rollback_img = NULL;
-
-                    if( 0 != boot_ucb_write( &ucb ) )
-                    {
-                        PRINTF( "[OTA-NXP] FLASH operation failed during commit\r\n" );
-                    }
-                    else
-                    {
-                        PRINTF( "[OTA-NXP] rollback disabled\r\n" );
-                    }
-                }
             }
             else
             {
@@ -191,7 +612,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
                 ucb.state = BOOT_STATE_INVALID;
 
-                if( 0 != boot_ucb_write( &ucb ) )
+                if( 0 != lFlashTaskRun( prvPAL_UcbWriteHandler, &ucb, 0, NULL, 0 ) )
                 {
                     PRINTF( "[OTA-NXP] FLASH operation failed during reject\r\n" );
                     result = OTA_PAL_COMBINE_ERR( OtaPalRejectFailed, 0 );
@@ -201,7 +622,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
             {
                 ucb.state = BOOT_STATE_VOID;
 
-                if( 0 != boot_ucb_write( &ucb ) )
+                if( 0 != lFlashTaskRun( prvPAL_UcbWriteHandler, &ucb, 0, NULL, 0 ) )
                 {
                     PRINTF( "[OTA-NXP] FLASH operation failed during reject\r\n" );
                     result = OTA_PAL_COMBINE_ERR( OtaPalRejectFailed, 0 );
@@ -222,7 +643,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
 
                 ucb.state = BOOT_STATE_INVALID;
 
-                if( 0 != boot_ucb_write( &ucb ) )
+                if( 0 != lFlashTaskRun( prvPAL_UcbWriteHandler, &ucb, 0, NULL, 0 ) )
                 {
                     PRINTF( "[OTA-NXP] FLASH operation failed during abort\r\n" );
                     result = OTA_PAL_COMBINE_ERR( OtaPalAbortFailed, 0 );
@@ -232,7 +653,7 @@ OtaPalStatus_t xOtaPalSetPlatformImageState( OtaFileContext_t * const pFileConte
             {
                 ucb.state = BOOT_STATE_VOID;
 
-                if( 0 != boot_ucb_write( &ucb ) )
+                if( 0 != lFlashTaskRun( prvPAL_UcbWriteHandler, &ucb, 0, NULL, 0 ) )
                 {
                     PRINTF( "[OTA-NXP] FLASH operation failed during abort\r\n" );
                     result = OTA_PAL_COMBINE_ERR( OtaPalAbortFailed, 0 );
@@ -263,7 +684,7 @@ OtaPalStatus_t xOtaPalActivateNewImage( OtaFileContext_t * const pFileContext )
 {
     PRINTF( "[OTA-NXP] ActivateNewImage\r\n" );
 
-    if( 0 != boot_update_request( OTA_UPDATE_IMAGE_PTR, OTA_BACKUP_IMAGE_PTR ) )
+    if( 0 != lFlashTaskRun( prvPAL_UpdateRequestHandler, boot_slot_spare(), 0, NULL, 0 ) )
     {
         return OTA_PAL_COMBINE_ERR( OtaPalActivateFailed, 0 );
     }
@@ -273,39 +694,131 @@ OtaPalStatus_t xOtaPalActivateNewImage( OtaFileContext_t * const pFileContext )
     return OtaPalSuccess;
 }
 
+static int32_t prvPAL_WriteHandler( void * pvContext,
+                                    uint32_t offset,
+                                    const uint8_t * pData,
+                                    uint32_t blockSize )
+{
+    LL_FileContext_t * FileContext = ( LL_FileContext_t * ) pvContext;
+    uint32_t blocks = ( blockSize + OTA_FILE_BLOCK_SIZE - 1 ) / OTA_FILE_BLOCK_SIZE;
+    TickType_t startTicks;
+    int32_t result;
+
+    startTicks = xTaskGetTickCount();
+
+    /* Erase each sector once, then program the block straight from the request buffer. Fall back to the
+     * read-modify-write of the whole sector, which stages the data in the driver's sector shadow, only
+     * if the destination is still not blank, e.g. a block received twice with different content. */
+    result = prvPAL_PrepareSectors( FileContext, offset, blockSize );
+
+    if( result == 0 )
+    {
+        result = mflash_drv_program( ( void * ) ( FileContext->BaseAddr + offset ), pData, blockSize );
+    }
+
+    if( result == 0 )
+    {
+        FileContext->BlocksDirect += blocks;
+    }
+    else
+    {
+        result = mflash_drv_write( ( void * ) ( FileContext->BaseAddr + offset ), pData, blockSize );
+        FileContext->BlocksUpdated += blocks;
+    }
+
+    FileContext->WriteTicks += xTaskGetTickCount() - startTicks;
+
+    if( result == 0 )
+    {
+        FileContext->BytesWritten += blockSize;
+        prvPAL_ConsumeBlock( FileContext, offset, pData, blockSize );
+    }
+
+    return result;
+}
+
+static void prvPAL_WriteComplete( void * pvContext,
+                                  int32_t result )
+{
+    LL_FileContext_t * FileContext = ( LL_FileContext_t * ) pvContext;
+
+    if( result != 0 )
+    {
+        FileContext->WriteFailed = true;
+    }
+}
+
 int16_t xOtaPalWriteBlock( OtaFileContext_t * const pFileContext,
                            uint32_t offset,
                            uint8_t * const pData,
                            uint32_t blockSize )
 {
-    int32_t result;
     LL_FileContext_t * FileContext;
+    uint8_t * slot;
 
     PRINTF( "[OTA-NXP] WriteBlock %x : %x\r\n", offset, blockSize );
 
     FileContext = prvPAL_GetLLFileContext( pFileContext );
 
-    if( FileContext == NULL )
+    if( ( FileContext == NULL ) || ( blockSize == 0 ) || ( offset + blockSize > OTA_MAX_IMAGE_SIZE ) ||
+        ( FileContext->WriteFailed == true ) )
     {
         return -1;
     }
 
-    result = mflash_drv_write( ( void * ) ( FileContext->BaseAddr + offset ), pData, blockSize );
+    if( ( FileContext->BaseAddr == NULL ) || ( offset == 0 ) )
+    {
+        slot = prvPAL_SelectSlot( offset, pData, blockSize );
 
-    if( result == 0 )
+        if( slot == NULL )
+        {
+            /* Fail the job now rather than after the whole download. */
+            FileContext->WriteFailed = true;
+            return -1;
+        }
+
+        if( FileContext->BaseAddr == NULL )
+        {
+            FileContext->BaseAddr = slot;
+        }
+    }
+
+    if( FileContext->Size < offset + blockSize )
     {
-        /* zero indicates no error, return number of bytes written to the caller */
-        result = blockSize;
+        /* extend file size according to highest offset */
+        FileContext->Size = offset + blockSize;
+    }
 
-        if( FileContext->Size < offset + blockSize )
+    /* The block is copied and written by the flash task while the next one is being received. A failure
+     * is reported on a later block or when the file is closed. The OTA library reuses its buffer once this
+     * returns, so overlapping the flash write with the reception costs this copy: with the two copies of
+     * the library, a direct block is copied three times rather than once. */
+    if( xFlashTaskSubmit( prvPAL_WriteHandler,
+                          FileContext,
+                          offset,
+                          pData,
+                          blockSize,
+                          prvPAL_WriteComplete,
+                          FileContext ) == pdTRUE )
+    {
+        if( xFlashTaskIsActive() == pdTRUE )
         {
-            /* extend file size according to highest offset */
-            FileContext->Size = offset + blockSize;
+            FileContext->BlocksQueued += ( blockSize + OTA_FILE_BLOCK_SIZE - 1 ) / OTA_FILE_BLOCK_SIZE;
+        }
+    }
+    else
+    {
+        /* Larger than a request, write it in place and wait. */
+        if( lFlashTaskRun( prvPAL_WriteHandler, FileContext, offset, pData, blockSize ) != 0 )
+        {
+            FileContext->WriteFailed = true;
         }
     }
 
-    return result;
+    /* return number of bytes written to the caller */
+    return ( FileContext->WriteFailed == true ) ? -1 : ( int16_t ) blockSize;
 }
+
 OtaPalStatus_t xOtaPalCloseFile( OtaFileContext_t * const pFileContext )
 {
     OtaPalStatus_t result = OtaPalSuccess;
@@ -320,6 +833,17 @@ OtaPalStatus_t xOtaPalCloseFile( OtaFileContext_t * const pFileContext )
         return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
     }
 
+    /* Wait for the blocks still queued to the flash task. */
+    ( void ) lFlashTaskRun( NULL, NULL, 0, NULL, 0 );
+
+    prvPAL_PrintWriteStats( FileContext );
+
+    if( FileContext->WriteFailed == true )
+    {
+        PRINTF( "[OTA-NXP] FLASH operation failed while writing the file\r\n" );
+        result = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
     pFileContext->pFile = NULL;
     FileContext->FileXRef = NULL;
     return result;
@@ -336,9 +860,29 @@ OtaPalStatus_t xOtaPalCreateFileForRx( OtaFileContext_t * const pFileContext )
         return OTA_PAL_COMBINE_ERR( OtaPalRxFileTooLarge, 0 );
     }
 
+    /* Blocks of an aborted file may still be queued to the flash task and use the context. */
+    ( void ) lFlashTaskRun( NULL, NULL, 0, NULL, 0 );
+
     FileContext->FileXRef = pFileContext; /* cross reference for integrity check */
-    FileContext->BaseAddr = OTA_UPDATE_IMAGE_PTR;
+    FileContext->BaseAddr = NULL; /* slot selected upon the first block written */
     FileContext->Size = 0;
+    memset( FileContext->ErasedSectors, 0, sizeof( FileContext->ErasedSectors ) );
+    FileContext->SectorsErased = 0;
+    memset( FileContext->WrittenBlocks, 0, sizeof( FileContext->WrittenBlocks ) );
+    mbedtls_sha256_free( &FileContext->HashContext );
+    mbedtls_sha256_init( &FileContext->HashContext );
+    FileContext->HashedSize = 0;
+    FileContext->HashValid = ( mbedtls_sha256_starts_ret( &FileContext->HashContext, 0 ) == 0 );
+    FileContext->BytesRehashed = 0;
+    FileContext->DecodeState = OTA_PAL_DECODE_PENDING;
+    FileContext->DecodedSize = 0;
+    FileContext->BlocksDirect = 0;
+    FileContext->BlocksUpdated = 0;
+    FileContext->BlocksQueued = 0;
+    FileContext->BytesWritten = 0;
+    FileContext->WriteFailed = false;
+    FileContext->StartTicks = xTaskGetTickCount();
+    FileContext->WriteTicks = 0;
 
     pFileContext->pFile = ( uint8_t * ) FileContext;
 
@@ -353,6 +897,8 @@ OtaPalStatus_t xOtaPalAbort( OtaFileContext_t * const pFileContext )
 
     PRINTF( "[OTA-NXP] Abort\r\n" );
 
+    ( void ) lFlashTaskRun( NULL, NULL, 0, NULL, 0 );
+
     pFileContext->pFile = NULL;
     return result;
 }
@@ -361,6 +907,8 @@ OtaPalStatus_t xOtaPalOpenFileForRead( OtaFileContext_t * const pContext )
 {
     LL_FileContext_t * FileContext = &prvPAL_CurrentFileContext;
 
+    /* Read back what the flash task has written. */
+    ( void ) lFlashTaskRun( NULL, NULL, 0, NULL, 0 );
 
     FileContext->FileXRef = pContext; /* cross reference for integrity check */
     pContext->pFile = ( uint8_t * ) FileContext;
@@ -397,3 +945,216 @@ int32_t xOtaPalReadBlock( OtaFileContext_t * const pContext,
 
     return ( int32_t ) ( bytesToRead );
 }
+
+OtaPalStatus_t xOtaPalGetImageDigest( OtaFileContext_t * const pContext,
+                                      uint8_t * pDigest )
+{
+    LL_FileContext_t * FileContext;
+    int ret = 0;
+
+    FileContext = prvPAL_GetLLFileContext( pContext );
+
+    if( FileContext == NULL )
+    {
+        return OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
+    }
+
+    /* The hash is updated by the flash task as blocks are written. */
+    ( void ) lFlashTaskRun( NULL, NULL, 0, NULL, 0 );
+
+    if( FileContext->HashValid == false )
+    {
+        /* Fall back to hashing the whole image from flash. */
+        mbedtls_sha256_free( &FileContext->HashContext );
+        mbedtls_sha256_init( &FileContext->HashContext );
+        ret = mbedtls_sha256_starts_ret( &FileContext->HashContext, 0 );
+        FileContext->HashedSize = 0;
+    }
+
+    if( ( ret == 0 ) && ( FileContext->HashedSize < FileContext->Size ) )
+    {
+        /* Hash the range which was written out of order and not caught up with. The image is
+         * memory mapped so it is hashed in place. */
+        FileContext->BytesRehashed += FileContext->Size - FileContext->HashedSize;
+        ret = mbedtls_sha256_update_ret( &FileContext->HashContext,
+                                         FileContext->BaseAddr + FileContext->HashedSize,
+                                         FileContext->Size - FileContext->HashedSize );
+        FileContext->HashedSize = FileContext->Size;
+    }
+
+    if( ret == 0 )
+    {
+        ret = mbedtls_sha256_finish_ret( &FileContext->HashContext, pDigest );
+    }
+
+    PRINTF( "[OTA-NXP] Image digest of %u bytes, %u bytes re-hashed from flash\r\n",
+            FileContext->Size,
+            FileContext->BytesRehashed );
+
+    /* The context is finished, any further request has to start over. */
+    FileContext->HashValid = false;
+
+    if( ret != 0 )
+    {
+        return OTA_PAL_COMBINE_ERR( OtaPalSignatureCheckFailed, 0 );
+    }
+
+    return OtaPalSuccess;
+}
+
+static OtaPalStatus_t prvPAL_PrepareCompressedImage( LL_FileContext_t * FileContext )
+{
+    int32_t result = 0;
+
+    if( FileContext->DecodeState != OTA_PAL_DECODE_LZ4 )
+    {
+        /* The file was not decompressed while downloading, start over from flash. */
+        boot_lz4_init( &prvPAL_Lz4, boot_slot_spare(), OTA_IMAGE_SLOT_SIZE );
+        FileContext->DecodedSize = 0;
+    }
+
+    PRINTF( "[OTA-NXP] Compressed image of %u bytes, %u bytes decompressed while downloading\r\n",
+            FileContext->Size,
+            FileContext->DecodedSize );
+
+    /* Decompress what was not consumed in order during the download. */
+    if( FileContext->DecodedSize < FileContext->Size )
+    {
+        result = boot_lz4_write( &prvPAL_Lz4,
+                                 FileContext->BaseAddr + FileContext->DecodedSize,
+                                 FileContext->Size - FileContext->DecodedSize );
+        FileContext->DecodedSize = FileContext->Size;
+    }
+
+    if( result == 0 )
+    {
+        result = boot_lz4_finish( &prvPAL_Lz4 );
+    }
+
+    /* The decompressor is finished, any further request has to start over. */
+    FileContext->DecodeState = OTA_PAL_DECODE_FAILED;
+
+    if( result < 0 )
+    {
+        PRINTF( "[OTA-NXP] Compressed image could not be decompressed\r\n" );
+        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    PRINTF( "[OTA-NXP] Decompressed %u bytes image\r\n", result );
+
+    return OtaPalSuccess;
+}
+
+static OtaPalStatus_t prvPAL_PrepareDeltaImage( LL_FileContext_t * FileContext )
+{
+    TickType_t startTicks;
+    int32_t result;
+
+    PRINTF( "[OTA-NXP] Applying delta patch of %u bytes\r\n", FileContext->Size );
+
+    /* Reconstruct the image from the running one into the spare slot. */
+    startTicks = xTaskGetTickCount();
+    result = boot_delta_apply( &prvPAL_Delta,
+                               boot_slot_running(),
+                               OTA_IMAGE_SLOT_SIZE,
+                               boot_slot_spare(),
+                               OTA_IMAGE_SLOT_SIZE,
+                               FileContext->BaseAddr,
+                               FileContext->Size );
+
+    if( result < 0 )
+    {
+        PRINTF( "[OTA-NXP] Delta patch could not be applied to the running image\r\n" );
+        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    PRINTF( "[OTA-NXP] Reconstructed %u bytes image in %u ms\r\n",
+            result,
+            ( xTaskGetTickCount() - startTicks ) * portTICK_PERIOD_MS );
+
+    return OtaPalSuccess;
+}
+
+static OtaPalStatus_t prvPAL_PrepareStagedImage( LL_FileContext_t * FileContext )
+{
+    int32_t result;
+
+    PRINTF( "[OTA-NXP] Moving %u bytes image from the staging slot\r\n", FileContext->Size );
+
+    boot_writer_init( &prvPAL_Writer, boot_slot_spare(), OTA_IMAGE_SLOT_SIZE );
+    result = boot_writer_emit( &prvPAL_Writer, FileContext->BaseAddr, FileContext->Size );
+
+    if( result == 0 )
+    {
+        result = boot_writer_flush( &prvPAL_Writer );
+    }
+
+    if( result != 0 )
+    {
+        PRINTF( "[OTA-NXP] Image could not be written to the spare slot\r\n" );
+        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    return OtaPalSuccess;
+}
+
+static int32_t prvPAL_PrepareHandler( void * pvContext,
+                                      uint32_t address,
+                                      const uint8_t * pData,
+                                      uint32_t length )
+{
+    LL_FileContext_t * FileContext = ( LL_FileContext_t * ) pvContext;
+    OtaPalStatus_t result;
+
+    ( void ) address;
+    ( void ) pData;
+    ( void ) length;
+
+    if( ( FileContext->Size >= sizeof( struct boot_lz4_header ) ) && boot_lz4_is_compressed( FileContext->BaseAddr ) )
+    {
+        result = prvPAL_PrepareCompressedImage( FileContext );
+    }
+    else if( ( FileContext->Size >= sizeof( struct boot_delta_header ) ) && boot_delta_is_patch( FileContext->BaseAddr ) )
+    {
+        result = prvPAL_PrepareDeltaImage( FileContext );
+    }
+    else if( FileContext->BaseAddr != ( uint8_t * ) boot_slot_spare() )
+    {
+        result = prvPAL_PrepareStagedImage( FileContext );
+    }
+    else
+    {
+        /* Full image, it was received into the spare slot and executes from there. */
+        result = OtaPalSuccess;
+    }
+
+    /* Flash is not remapped, the image has to be linked to execute from the spare slot. */
+    if( ( result == OtaPalSuccess ) && ( boot_image_validate( boot_slot_spare() ) != 0 ) )
+    {
+        PRINTF( "[OTA-NXP] Image is not linked to execute from the spare slot at 0x%x\r\n",
+                ( uint32_t ) boot_slot_spare() );
+        result = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    return ( result == OtaPalSuccess ) ? 0 : -1;
+}
+
+OtaPalStatus_t xOtaPalPrepareImage( OtaFileContext_t * const pFileContext )
+{
+    LL_FileContext_t * FileContext = &prvPAL_CurrentFileContext;
+
+    ( void ) pFileContext;
+
+    if( FileContext->BaseAddr == NULL )
+    {
+        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    /* The spare slot is written by the flash task, after the blocks still queued. */
+    if( lFlashTaskRun( prvPAL_PrepareHandler, FileContext, 0, NULL, 0 ) != 0 )
+    {
+        return OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+    }
+
+    return OtaPalSuccess;
+}
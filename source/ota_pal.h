@@ -131,4 +131,29 @@ int32_t xOtaPalReadBlock( OtaFileContext_t * const pContext,
                           uint8_t * pData,
                           uint16_t blockSize );
 
+/**
+ * @brief Gets the SHA-256 digest of the firmware image.
+ * The digest is computed as blocks are written in order, only ranges which could not be hashed
+ * while being written, are read back from flash.
+ *
+ * @param[in] pFileContext Pointer to a context containing firmware image details.
+ * @param[out] pDigest Buffer of 32 bytes where the digest is stored.
+ * @return OtaPalSuccess if succesful, else OTA error code along with detailed PAL error code.
+ */
+OtaPalStatus_t xOtaPalGetImageDigest( OtaFileContext_t * const pContext,
+                                      uint8_t * pDigest );
+
+/**
+ * @brief Prepares the received and validated file for activation.
+ * The new firmware image is placed in the spare slot, the one the running image does not execute from.
+ * If the file is a delta patch, the new firmware image is reconstructed from the running image and the patch.
+ * If the file is a compressed image, the decompression done while the file was received is completed.
+ * A full image is usually received straight into the spare slot, otherwise it is moved there.
+ * The image is rejected unless it is linked to execute from the spare slot.
+ *
+ * @param[in] pFileContext Pointer to a context containing firmware image details.
+ * @return OtaPalSuccess if succesful, else OTA error code along with detailed PAL error code.
+ */
+OtaPalStatus_t xOtaPalPrepareImage( OtaFileContext_t * const pFileContext );
+
 #endif /* OTA_PAL_H */
@@ -41,12 +41,6 @@
  */
 #define SIGNATURE_METHOD          cryptoHASH_ALGORITHM_SHA256
 
-/**
- * @brief Length of block of firmware image to be read at once from flash
- * to calculate the signature.
- */
-#define OTA_IMAGE_BLOCK_LENGTH    ( 4096 )
-
 /**
  * @brief Opens a PKCS11 Session.
  *
@@ -78,7 +72,7 @@ static CK_RV prvPKCS11GetCertificateHandle( CK_SESSION_HANDLE xSession,
 
 /**
  * @brief Verifies the firmware image signature using PKCS11 APIs.
- * Uses PKCS11 SHA256 hash APIS to calculate running checksum of the image and  verify
+ * Takes the SHA256 digest of the image computed by the PAL while the image was written, and verifies
  * the signature using the certificate handle stored in a PKCS11 slot.
  *
  * @param[in] session PKCS11 session handle being opened.
@@ -185,69 +179,23 @@ CK_RV xVerifyImageSignatureUsingPKCS11( CK_SESSION_HANDLE session,
     /* The ECDSA mechanism will be used to verify the message digest. */
     CK_MECHANISM mechanism = { CKM_ECDSA, NULL, 0 };
 
-    /* SHA 256  will be used to calculate the digest. */
-    CK_MECHANISM xDigestMechanism = { CKM_SHA256, NULL, 0 };
-
     /* The buffer used to hold the calculated SHA25 digest of the image. */
     CK_BYTE digestResult[ pkcs11SHA256_DIGEST_LENGTH ] = { 0 };
-    CK_ULONG digestLength = pkcs11SHA256_DIGEST_LENGTH;
 
     CK_RV result = CKR_OK;
 
     CK_FUNCTION_LIST_PTR functionList;
 
-    /* Buffer used to fetch blocks from image to calculate the digest. */
-    static uint8_t buffer[ OTA_IMAGE_BLOCK_LENGTH ] = { 0 };
-
-    size_t offset = 0, bufLength;
-
     result = C_GetFunctionList( &functionList );
 
-    /* Calculate the digest of the image. */
+    /* Get the digest of the image, hashed as it was written. */
     if( result == CKR_OK )
     {
-        result = functionList->C_DigestInit( session,
-                                             &xDigestMechanism );
-    }
-
-    do
-    {
-        bufLength = xOtaPalReadBlock( pFile, offset, buffer, OTA_IMAGE_BLOCK_LENGTH );
-
-        if( bufLength > 0 )
+        if( xOtaPalGetImageDigest( pFile, digestResult ) != OtaPalSuccess )
         {
-            result = functionList->C_DigestUpdate( session, buffer, bufLength );
-
-            if( result != CKR_OK )
-            {
-                break;
-            }
-
-            offset += bufLength;
+            PRINTF( "Failed to calculate the digest of the image.\r\n" );
+            result = CKR_GENERAL_ERROR;
         }
-    } while( bufLength == OTA_IMAGE_BLOCK_LENGTH );
-
-    if( bufLength < 0 )
-    {
-        PRINTF( "Failed to read a block of data from the image.\r\n" );
-        result = CKR_GENERAL_ERROR;
-    }
-
-    if( result == CKR_OK )
-    {
-        result = functionList->C_DigestFinal( session,
-                                              NULL,
-                                              &digestLength );
-    }
-
-    /* Now that digestLength contains the required byte length, retrieve the
-     * digest buffer.
-     */
-    if( result == CKR_OK )
-    {
-        result = functionList->C_DigestFinal( session,
-                                              digestResult,
-                                              &digestLength );
     }
 
     if( result == CKR_OK )
@@ -109,6 +109,27 @@
  */
 #define DATA_TOPIC_FILTER_LENGTH                ( ( uint16_t ) ( sizeof( DATA_TOPIC_FILTER ) - 1 ) )
 
+/**
+ * @brief Number of topic filters the OTA agent subscribes to at once: the job response, the job
+ * notification and the data stream.
+ */
+#define OTA_MAX_SUBSCRIPTIONS                   ( 3U )
+
+/**
+ * @brief Size of the longest topic filter subscribed by the OTA agent, the data stream topic.
+ */
+#define OTA_SUBSCRIPTION_TOPIC_SIZE             ( sizeof( "$aws/things//streams//data/cbor" ) - 1U + otaconfigMAX_THINGNAME_LEN + OTA_MAX_STREAM_NAME_SIZE )
+
+/**
+ * @brief A topic filter the OTA agent is subscribed to, an unused entry has a topicFilterLength of 0.
+ */
+typedef struct OtaSubscription
+{
+    char topicFilter[ OTA_SUBSCRIPTION_TOPIC_SIZE + 1U ];
+    uint16_t topicFilterLength;
+    uint8_t qos;
+} OtaSubscription_t;
+
 
 /**
  * @brief Function used by OTA agent to publish control packets with the MQTT broker.
@@ -145,6 +166,26 @@ static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
                                       uint16_t topicFilterLength,
                                       uint8_t qos );
 
+/**
+ * @brief Records a topic filter the OTA agent subscribed to, so that it can be subscribed again on a new session.
+ *
+ * @param[in] pTopicFilter Topic filter subscribed.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] qos Quality of Service of the subscription.
+ */
+static void recordSubscription( const char * pTopicFilter,
+                                uint16_t topicFilterLength,
+                                uint8_t qos );
+
+/**
+ * @brief Forgets a topic filter the OTA agent unsubscribed from.
+ *
+ * @param[in] pTopicFilter Topic filter unsubscribed.
+ * @param[in] topicFilterLength Length of the topic filter.
+ */
+static void forgetSubscription( const char * pTopicFilter,
+                                uint16_t topicFilterLength );
+
 /**
  * @brief Function used by OTA agent to unsubscribe a topic filter from MQTT broker.
  * Function is registered as a callback and is invoked by OTA agent invokes before
@@ -231,6 +272,11 @@ static SemaphoreHandle_t opSemaphore;
  */
 static MQTTStatus_t opStatus;
 
+/**
+ * @brief Topic filters the OTA agent is subscribed to, subscribed again by xOTAUpdateReconnected().
+ */
+static OtaSubscription_t otaSubscriptions[ OTA_MAX_SUBSCRIPTIONS ];
+
 /**
  * @brief Application allocated buffer used to store the OTA firmware image file path.
  * Buffer is passed to the OTA agent and is used internally by OTA agent.
@@ -585,6 +631,7 @@ static OtaMqttStatus_t mqttSubscribe( const char * pTopicFilter,
         {
             PRINTF( "Subscribed to topic %s.\r\n",
                     pTopicFilter );
+            recordSubscription( pTopicFilter, topicFilterLength, qos );
         }
     }
 
@@ -665,6 +712,7 @@ static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
     operation.type = MQTT_OP_UNSUBSCRIBE;
     operation.info.subscriptionInfo.numSubscriptions = 1;
     operation.info.subscriptionInfo.pSubscriptionList = pSubscriptionList;
+    operation.callback = mqttOperationCallback;
 
     /* Send UNSUBSCRIBE packet. */
     status = MQTTAgent_Enqueue( &operation, portMAX_DELAY );
@@ -691,9 +739,67 @@ static OtaMqttStatus_t mqttUnsubscribe( const char * pTopicFilter,
         }
     }
 
+    /* Not subscribed any longer, or lost with the session if the connection failed. */
+    forgetSubscription( pTopicFilter, topicFilterLength );
+
     return otaRet;
 }
 
+/*-----------------------------------------------------------*/
+
+static void recordSubscription( const char * pTopicFilter,
+                                uint16_t topicFilterLength,
+                                uint8_t qos )
+{
+    OtaSubscription_t * pFree = NULL;
+    uint32_t index;
+
+    for( index = 0; index < OTA_MAX_SUBSCRIPTIONS; index++ )
+    {
+        if( otaSubscriptions[ index ].topicFilterLength == 0U )
+        {
+            if( pFree == NULL )
+            {
+                pFree = &otaSubscriptions[ index ];
+            }
+        }
+        else if( ( otaSubscriptions[ index ].topicFilterLength == topicFilterLength ) &&
+                 ( memcmp( otaSubscriptions[ index ].topicFilter, pTopicFilter, topicFilterLength ) == 0 ) )
+        {
+            /* Already recorded, e.g. subscribed again after a reconnection. */
+            otaSubscriptions[ index ].qos = qos;
+            return;
+        }
+    }
+
+    if( ( pFree == NULL ) || ( topicFilterLength > OTA_SUBSCRIPTION_TOPIC_SIZE ) )
+    {
+        PRINTF( "Cannot record the subscription to topic %s, it will be lost on reconnection.\r\n", pTopicFilter );
+    }
+    else
+    {
+        memcpy( pFree->topicFilter, pTopicFilter, topicFilterLength );
+        pFree->topicFilter[ topicFilterLength ] = '\0';
+        pFree->topicFilterLength = topicFilterLength;
+        pFree->qos = qos;
+    }
+}
+
+static void forgetSubscription( const char * pTopicFilter,
+                                uint16_t topicFilterLength )
+{
+    uint32_t index;
+
+    for( index = 0; index < OTA_MAX_SUBSCRIPTIONS; index++ )
+    {
+        if( ( otaSubscriptions[ index ].topicFilterLength == topicFilterLength ) &&
+            ( memcmp( otaSubscriptions[ index ].topicFilter, pTopicFilter, topicFilterLength ) == 0 ) )
+        {
+            otaSubscriptions[ index ].topicFilterLength = 0;
+        }
+    }
+}
+
 /*-----------------------------------------------------------*/
 static void prvOTAStatsTimerCallback( TimerHandle_t xTimer )
 {
@@ -734,6 +840,9 @@ static OtaPalStatus_t appCloseFileCallback( OtaFileContext_t * const pFileContex
         else
         {
             PRINTF( "**** OTA image signature is valid. ***** \r\n" );
+
+            /* Place the image in the spare slot, reconstructing it if a delta patch or a compressed image was received. */
+            status = xOtaPalPrepareImage( pFileContext );
         }
     }
 
@@ -852,7 +961,7 @@ BaseType_t xStartOTAUpdateDemo( void )
 BaseType_t xSuspendOTAUpdate( void )
 {
     OtaErr_t otaRet;
-    BaseType_t result;
+    BaseType_t result = pdTRUE;
 
     /* Suspend OTA operations. */
 
@@ -899,3 +1008,34 @@ BaseType_t xResumeOTAUpdate( void )
 
     return result;
 }
+
+BaseType_t xOTAUpdateReconnected( void )
+{
+    BaseType_t result;
+    uint32_t index;
+
+    /* Keep the OTA agent from using the MQTT agent while its topics are subscribed again. */
+    result = xSuspendOTAUpdate();
+
+    if( result == pdTRUE )
+    {
+        for( index = 0; index < OTA_MAX_SUBSCRIPTIONS; index++ )
+        {
+            if( ( otaSubscriptions[ index ].topicFilterLength != 0U ) &&
+                ( mqttSubscribe( otaSubscriptions[ index ].topicFilter,
+                                 otaSubscriptions[ index ].topicFilterLength,
+                                 otaSubscriptions[ index ].qos ) != OtaMqttSuccess ) )
+            {
+                result = pdFALSE;
+            }
+        }
+
+        /* On resume, the OTA agent requests the job document again and carries on with the update. */
+        if( xResumeOTAUpdate() != pdTRUE )
+        {
+            result = pdFALSE;
+        }
+    }
+
+    return result;
+}
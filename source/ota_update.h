@@ -47,6 +47,16 @@
  */
 BaseType_t xStartOTAUpdateDemo( void );
 
+/**
+ * @brief Restores the OTA update after the MQTT connection was established again with a clean session.
+ * The broker dropped the subscriptions of the OTA agent along with the previous session. The OTA agent is
+ * suspended, its topic filters are subscribed again, then it is resumed, which requests the job document again.
+ * Call after MQTTAgent_Reconnected().
+ *
+ * @return pdTRUE if the OTA agent is subscribed again and resumed.
+ */
+BaseType_t xOTAUpdateReconnected( void );
+
 /**
  * @brief Handles an MQTT packet for OTA.
  * Filters out  MQTT control and data packets for OTA and queues appropirate events for OTA agent to process them.
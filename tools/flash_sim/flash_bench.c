@@ -0,0 +1,626 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/*
+ * Flash benchmark, drives the file store, the OTA PAL and the bootloader through the unmodified mflash driver
+ * and the flash simulator and reports the flash operations and the simulated time of each scenario.
+ *
+ * Usage: flash_bench [-v] [-f flash.bin] [-b base.bin] [ota_file ...]
+ *
+ *   -v  print the console output of the code under test
+ *   -f  keep the flash content in given file, a temporary file is used otherwise
+ *   -b  preload given image into the running slot, for delta patches made against it
+ *
+ * Without OTA files, synthetic full and delta images are used.
+ */
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "fsl_device_registers.h"
+
+#include "mflash_sim.h"
+#include "mflash_drv.h"
+#include "mflash_file.h"
+#include "spifi_boot.h"
+#include "boot_delta.h"
+#include "ota_pal.h"
+#include "flash_task.h"
+#include "mbedtls/sha256.h"
+
+#define BENCH_BLOCK_SIZE (1024)
+#define BENCH_IMAGE_SIZE (300 * 1024)
+#define BENCH_HEADER_OFFSET (0x160)
+#define BENCH_READ_SIZE (1024 * 1024)
+#define BENCH_WRITE_SIZE (256 * 1024)
+#define BENCH_WRITE_ADDR (BOOT_EXEC_IMAGE_ADDR + 2 * BOOT_SLOT_SIZE)
+#define BENCH_UPDATES (256)
+
+static bool bench_verbose;
+static uint32_t bench_failures;
+static uint64_t bench_start_ns;
+
+/* Image read into memory or generated, with its expected content once prepared in the spare slot */
+struct bench_file
+{
+    const char *name;
+    uint8_t *data;
+    uint32_t size;
+    const uint8_t *image; /* NULL if unknown */
+    uint32_t image_size;
+};
+
+static jmp_buf bench_boot_jmp;
+
+
+int DbgConsole_Printf(const char *fmt_s, ...)
+{
+    va_list ap;
+    int ret = 0;
+
+    if (bench_verbose)
+    {
+        va_start(ap, fmt_s);
+        ret = vprintf(fmt_s, ap);
+        va_end(ap);
+    }
+
+    return ret;
+}
+
+
+int DbgConsole_Flush(void)
+{
+    return fflush(stdout);
+}
+
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(mflash_sim_time_us() / (1000 * portTICK_PERIOD_MS));
+}
+
+
+/* Without a scheduler the flash requests of the PAL are run by the caller, as on the target before the flash task
+ * is started */
+BaseType_t xFlashTaskSubmit(FlashTaskHandler_t xHandler,
+                            void *pvHandlerContext,
+                            uint32_t ulAddress,
+                            const uint8_t *pucData,
+                            uint32_t ulLength,
+                            FlashTaskCallback_t xCallback,
+                            void *pvCallbackContext)
+{
+    int32_t result = xHandler(pvHandlerContext, ulAddress, pucData, ulLength);
+
+    if (xCallback != NULL)
+        xCallback(pvCallbackContext, result);
+    return pdTRUE;
+}
+
+
+BaseType_t xFlashTaskIsActive(void)
+{
+    return pdFALSE;
+}
+
+
+int32_t lFlashTaskRun(
+    FlashTaskHandler_t xHandler, void *pvHandlerContext, uint32_t ulAddress, const uint8_t *pucData, uint32_t ulLength)
+{
+    return (xHandler != NULL) ? xHandler(pvHandlerContext, ulAddress, pucData, ulLength) : 0;
+}
+
+
+static void bench_start(void)
+{
+    struct mflash_sim_stats stats;
+
+    /* the simulated clock keeps running across scenarios */
+    mflash_sim_reset_stats();
+    mflash_sim_get_stats(&stats);
+    bench_start_ns = stats.time_ns;
+}
+
+
+static void bench_report(const char *name, bool ok)
+{
+    struct mflash_sim_stats stats;
+
+    mflash_sim_get_stats(&stats);
+    printf("%-24s %8u %8u %10.1f %10.1f %8.1f %8u %6u  %s\n", name, stats.sector_erases, stats.page_programs,
+           stats.bytes_programmed / 1024.0, (stats.time_ns - bench_start_ns) / 1e6, stats.irq_latency_max_ns / 1e3,
+           mflash_sim_max_erase_count(), stats.protocol_errors, ok ? "ok" : "FAILED");
+
+    if (!ok || stats.protocol_errors)
+        bench_failures++;
+}
+
+
+/* Deterministic content, so runs are comparable */
+static void bench_fill(uint8_t *data, uint32_t len, uint32_t seed)
+{
+    uint32_t x = seed * 2654435761u + 1;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        x = x * 1103515245u + 12345u;
+        data[i] = (uint8_t)(x >> 16);
+    }
+}
+
+
+/* Formats a synthetic image linked to execute from 'slot' */
+static void bench_make_image(uint8_t *image, uint32_t size, void *slot, uint32_t seed)
+{
+    struct boot_image *bi = (struct boot_image *)image;
+    struct boot_image_header *bih = (struct boot_image_header *)(image + BENCH_HEADER_OFFSET);
+    extern void bench_app_entry(void);
+
+    bench_fill(image, size, seed);
+    memset(image, 0, BENCH_HEADER_OFFSET + sizeof(*bih));
+
+    bi->vector_table_0x1c[0] = 0x20010000;
+    bi->vector_table_0x1c[1] = (uint32_t)(uintptr_t)bench_app_entry;
+    bi->image_marker = BOOT_IMAGE_MARKER;
+    bi->header_offset = BENCH_HEADER_OFFSET;
+    bih->header_marker = BOOT_HEADER_MARKER;
+    bih->load_address = (uint32_t)(uintptr_t)slot;
+    bih->image_length = size;
+}
+
+
+/* Makes a patch of 'target' against 'source', unchanged blocks are copied and the others inserted */
+static uint32_t bench_make_delta(uint8_t *patch, const uint8_t *source, uint32_t source_size, const uint8_t *target,
+                                 uint32_t target_size)
+{
+    struct boot_delta_header *header = (struct boot_delta_header *)patch;
+    struct boot_delta_command *command = NULL;
+    uint32_t len = sizeof(*header);
+
+    header->magic = BOOT_DELTA_MAGIC;
+    header->version = BOOT_DELTA_VERSION;
+    header->source_size = source_size;
+    header->source_crc = boot_crc32(0, source, source_size);
+    header->target_size = target_size;
+    header->target_crc = boot_crc32(0, target, target_size);
+
+    for (uint32_t offset = 0; offset < target_size; offset += BENCH_BLOCK_SIZE)
+    {
+        uint32_t chunk = (target_size - offset < BENCH_BLOCK_SIZE) ? target_size - offset : BENCH_BLOCK_SIZE;
+        bool same = offset + chunk <= source_size && memcmp(source + offset, target + offset, chunk) == 0;
+
+        if (same && command && command->copy_offset + command->copy_len == offset)
+        {
+            command->copy_len += chunk;
+        }
+        else if (same)
+        {
+            command = (struct boot_delta_command *)(patch + len);
+            command->insert_len = 0;
+            command->copy_len = chunk;
+            command->copy_offset = offset;
+            len += sizeof(*command);
+        }
+        else
+        {
+            command = (struct boot_delta_command *)(patch + len);
+            command->insert_len = chunk;
+            command->copy_len = 0;
+            command->copy_offset = 0;
+            memcpy(patch + len + sizeof(*command), target + offset, chunk);
+            len += sizeof(*command) + chunk;
+            command = NULL;
+        }
+    }
+
+    return len;
+}
+
+
+static uint8_t *bench_read_file(const char *path, uint32_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *data;
+    long len;
+
+    if (f == NULL)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    data = malloc(len ? len : 1);
+    if (data == NULL || fread(data, 1, len, f) != (size_t)len)
+    {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(f);
+    *size = (uint32_t)len;
+    return data;
+}
+
+
+/* Raw throughput of the driver command set, an image read through the XIP window and an OTA sized write in blocks */
+static void bench_throughput(void)
+{
+    static uint8_t data[BENCH_WRITE_SIZE];
+    bool ok;
+
+    bench_start();
+    mflash_sim_xip_read(BOOT_SLOT_A_ADDR, BENCH_READ_SIZE);
+    bench_report("read 1 MB (XIP)", true);
+
+    bench_fill(data, sizeof(data), 7);
+
+    bench_start();
+    ok = mflash_drv_erase((void *)BENCH_WRITE_ADDR, sizeof(data)) == 0;
+    for (uint32_t offset = 0; ok && offset < sizeof(data); offset += BENCH_BLOCK_SIZE)
+        ok = mflash_drv_program((void *)(BENCH_WRITE_ADDR + offset), data + offset, BENCH_BLOCK_SIZE) == 0;
+    ok = ok && memcmp((void *)BENCH_WRITE_ADDR, data, sizeof(data)) == 0;
+    bench_report("write 256 KB", ok);
+}
+
+
+/* Saves and reads back the credentials the way the PKCS#11 PAL does */
+static uint64_t bench_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+static uint64_t bench_cpu_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+/* Sector read-modify-write of mflash_drv_write(). Rewriting a sector with its own content runs the shadow copy and
+ * the merge without any erase or program, the host CPU time of which is reported per update, without the XIP guard
+ * of the simulator. */
+static void bench_sector_update(void)
+{
+    static uint8_t sector[MFLASH_SECTOR_SIZE];
+    void *addr = (void *)(BENCH_WRITE_ADDR + BENCH_WRITE_SIZE);
+    uint64_t ns, cycles;
+    bool ok;
+
+    bench_fill(sector, sizeof(sector), 7);
+    mflash_sim_load((uint32_t)(uintptr_t)addr, sector, sizeof(sector));
+
+    bench_start();
+    ok = true;
+    mflash_sim_xip_guard(false);
+    ns = bench_cpu_ns();
+    cycles = bench_cpu_cycles();
+    for (uint32_t i = 0; i < BENCH_UPDATES; i++)
+        ok = ok && mflash_drv_write(addr, sector, sizeof(sector)) == 0;
+    cycles = bench_cpu_cycles() - cycles;
+    ns = bench_cpu_ns() - ns;
+    mflash_sim_xip_guard(true);
+    bench_report("update 4 KB unchanged", ok && memcmp(addr, sector, sizeof(sector)) == 0);
+    printf("%-24s %.0f ns", "  per update (host CPU)", (double)ns / BENCH_UPDATES);
+    if (cycles)
+        printf(", %.0f cycles", (double)cycles / BENCH_UPDATES);
+    printf("\n");
+
+    /* bits only cleared, the changed pages are programmed */
+    bench_start();
+    ok = true;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        for (uint32_t j = 0; j < sizeof(sector); j++)
+            sector[j] &= (uint8_t) ~(1u << i);
+        ok = ok && mflash_drv_write(addr, sector, sizeof(sector)) == 0;
+    }
+    bench_report("update 4 KB program", ok && memcmp(addr, sector, sizeof(sector)) == 0);
+
+    /* new content, the sector is erased and programmed */
+    bench_start();
+    ok = true;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        bench_fill(sector, sizeof(sector), 8 + i);
+        ok = ok && mflash_drv_write(addr, sector, sizeof(sector)) == 0;
+    }
+    bench_report("update 4 KB erase", ok && memcmp(addr, sector, sizeof(sector)) == 0);
+}
+
+
+static void bench_file_store(void)
+{
+    static uint8_t cert[1200];
+    static uint8_t key[250];
+    uint8_t *data;
+    uint32_t size;
+    bool ok;
+
+    bench_fill(cert, sizeof(cert), 1);
+    bench_fill(key, sizeof(key), 2);
+
+    bench_start();
+    ok = mflash_init(false) == pdTRUE;
+    ok = ok && mflash_save_file("cert", cert, sizeof(cert)) == pdTRUE;
+    ok = ok && mflash_save_file("key", key, sizeof(key)) == pdTRUE;
+
+    /* the certificate is provisioned again with the same content */
+    ok = ok && mflash_save_file("cert", cert, sizeof(cert)) == pdTRUE;
+
+    ok = ok && mflash_read_file("cert", &data, &size) == pdTRUE && size == sizeof(cert) &&
+         memcmp(data, cert, size) == 0;
+    ok = ok && mflash_read_file("key", &data, &size) == pdTRUE && size == sizeof(key) && memcmp(data, key, size) == 0;
+    bench_report("file store", ok);
+
+    /* the certificate is renewed many times, the log wraps around and is collected */
+    bench_start();
+    for (uint32_t i = 0; ok && i < 200; i++)
+    {
+        bench_fill(cert, sizeof(cert), 100 + i);
+        ok = mflash_save_file("cert", cert, sizeof(cert)) == pdTRUE;
+    }
+
+    /* the index is built again from the flash */
+    ok = ok && mflash_init(false) == pdTRUE;
+    ok = ok && mflash_read_file("cert", &data, &size) == pdTRUE && size == sizeof(cert) &&
+         memcmp(data, cert, size) == 0;
+    ok = ok && mflash_read_file("key", &data, &size) == pdTRUE && size == sizeof(key) && memcmp(data, key, size) == 0;
+    bench_report("file store 200 renewals", ok);
+}
+
+
+/* Receives a file through the OTA PAL, blocks are written in order or shuffled */
+static void bench_ota(const char *name, const struct bench_file *file, bool shuffle)
+{
+    static uint8_t buffer[BENCH_BLOCK_SIZE];
+    OtaFileContext_t context;
+    mbedtls_sha256_context sha;
+    uint8_t digest[32];
+    uint8_t expected[32];
+    uint32_t blocks = (file->size + BENCH_BLOCK_SIZE - 1) / BENCH_BLOCK_SIZE;
+    uint32_t *order = malloc(blocks * sizeof(uint32_t));
+    bool ok = (order != NULL);
+
+    for (uint32_t i = 0; i < blocks; i++)
+        order[i] = i;
+
+    /* fixed seed, the same permutation on every run */
+    srand(1);
+    for (uint32_t i = 0; shuffle && i + 1 < blocks; i++)
+    {
+        uint32_t j = i + (uint32_t)rand() % (blocks - i);
+        uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    bench_start();
+    memset(&context, 0, sizeof(context));
+    context.fileSize = file->size;
+    ok = ok && xOtaPalCreateFileForRx(&context) == OtaPalSuccess;
+
+    for (uint32_t i = 0; ok && i < blocks; i++)
+    {
+        uint32_t offset = order[i] * BENCH_BLOCK_SIZE;
+        uint32_t len = (file->size - offset < BENCH_BLOCK_SIZE) ? file->size - offset : BENCH_BLOCK_SIZE;
+
+        /* the OTA agent passes the block in a RAM buffer */
+        memcpy(buffer, file->data + offset, len);
+        ok = xOtaPalWriteBlock(&context, offset, buffer, len) == (int16_t)len;
+    }
+
+    ok = ok && xOtaPalCloseFile(&context) == OtaPalSuccess;
+    ok = ok && xOtaPalOpenFileForRead(&context) == OtaPalSuccess;
+    ok = ok && xOtaPalGetImageDigest(&context, digest) == OtaPalSuccess;
+    ok = ok && xOtaPalCloseFile(&context) == OtaPalSuccess;
+
+    mbedtls_sha256_init(&sha);
+    ok = ok && mbedtls_sha256_starts_ret(&sha, 0) == 0 && mbedtls_sha256_update_ret(&sha, file->data, file->size) == 0 &&
+         mbedtls_sha256_finish_ret(&sha, expected) == 0 && memcmp(digest, expected, sizeof(digest)) == 0;
+    mbedtls_sha256_free(&sha);
+
+    ok = ok && xOtaPalPrepareImage(&context) == OtaPalSuccess;
+
+    if (ok && file->image)
+        ok = memcmp(boot_slot_spare(), file->image, file->image_size) == 0;
+
+    bench_report(name, ok);
+    free(order);
+}
+
+
+/* Application started by the bootloader, returns to the benchmark */
+void bench_app_entry(void)
+{
+    longjmp(bench_boot_jmp, 1);
+}
+
+
+/* Runs the bootloader, returns the slot it started */
+static void *bench_boot(void)
+{
+    if (setjmp(bench_boot_jmp) == 0)
+    {
+        boot_run();
+        return NULL;
+    }
+
+    return (void *)(uintptr_t)SCB->VTOR;
+}
+
+
+/* Schedules the prepared image, boots it, then reboots without commit to roll back */
+static void bench_bootloader(void)
+{
+    void *running = boot_slot_running();
+    void *spare = boot_slot_spare();
+    bool ok;
+
+    bench_start();
+    ok = boot_update_request(spare) == 0;
+    ok = ok && bench_boot() == spare;
+    ok = ok && bench_boot() == running;
+    bench_report("boot update + rollback", ok);
+}
+
+
+int main(int argc, char **argv)
+{
+    static uint8_t base[BOOT_SLOT_SIZE];
+    static uint8_t image[BENCH_IMAGE_SIZE];
+    static uint8_t target[BENCH_IMAGE_SIZE];
+    static uint8_t patch[BENCH_IMAGE_SIZE * 2];
+    struct bench_file file;
+    const char *flash_path = NULL;
+    const char *base_path = NULL;
+    uint8_t *data;
+    uint32_t base_size = 0;
+    bool synthetic;
+    int arg;
+
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (strcmp(argv[arg], "-v") == 0)
+            bench_verbose = true;
+        else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+            flash_path = argv[++arg];
+        else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+            base_path = argv[++arg];
+        else
+        {
+            fprintf(stderr, "usage: %s [-v] [-f flash.bin] [-b base.bin] [ota_file ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    synthetic = (base_path == NULL && arg == argc);
+
+    if (mflash_sim_open(flash_path, NULL) != 0)
+    {
+        fprintf(stderr, "cannot open the simulated flash\n");
+        return 1;
+    }
+
+    /* the application runs from slot A, its image is in place before the benchmark starts */
+    SCB->VTOR = BOOT_SLOT_A_ADDR;
+    if (base_path)
+    {
+        data = bench_read_file(base_path, &base_size);
+        if (data == NULL || base_size > sizeof(base))
+        {
+            fprintf(stderr, "cannot read %s\n", base_path);
+            return 1;
+        }
+        memcpy(base, data, base_size);
+        free(data);
+    }
+    else
+    {
+        base_size = BENCH_IMAGE_SIZE;
+        bench_make_image(base, base_size, (void *)BOOT_SLOT_A_ADDR, 3);
+    }
+    mflash_sim_load(BOOT_SLOT_A_ADDR, base, base_size);
+
+    if (mflash_drv_init() != 0)
+    {
+        fprintf(stderr, "cannot initialize the flash driver\n");
+        return 1;
+    }
+
+    printf("command set: %s\n", (MFLASH_PART == MFLASH_PART_SERIAL) ? "serial" : "quad");
+    printf("%-24s %8s %8s %10s %10s %8s %8s %6s\n", "scenario", "erases", "programs", "KB", "ms", "irq us",
+           "max ers", "errors");
+
+    bench_throughput();
+    bench_file_store();
+
+    if (arg < argc)
+    {
+        for (; arg < argc; arg++)
+        {
+            memset(&file, 0, sizeof(file));
+            file.name = argv[arg];
+            file.data = bench_read_file(file.name, &file.size);
+            if (file.data == NULL || file.size == 0)
+            {
+                fprintf(stderr, "cannot read %s\n", file.name);
+                return 1;
+            }
+
+            bench_ota(file.name, &file, false);
+            bench_ota("  shuffled", &file, true);
+            free(file.data);
+        }
+    }
+    else
+    {
+        /* full image for the spare slot */
+        bench_make_image(image, sizeof(image), boot_slot_spare(), 4);
+        file = (struct bench_file){"full image", image, sizeof(image), image, sizeof(image)};
+        bench_ota(file.name, &file, false);
+        bench_ota("full image shuffled", &file, true);
+
+        /* the same as the base image but for the link address and a few modified functions */
+        memcpy(target, base, sizeof(target));
+        bench_make_image(target, BENCH_HEADER_OFFSET + sizeof(struct boot_image_header), boot_slot_spare(), 3);
+        bench_fill(target + 0x8000, 0x800, 5);
+        bench_fill(target + 0x30000, 0x1800, 6);
+        file = (struct bench_file){"delta patch", patch, 0, target, sizeof(target)};
+        file.size = bench_make_delta(patch, base, base_size, target, sizeof(target));
+        bench_ota(file.name, &file, false);
+        bench_ota("delta patch shuffled", &file, true);
+    }
+
+    /* the bootloader jumps to the entry point of the images, only the synthetic ones enter the benchmark again and
+     * the address has to fit the target bus */
+    if (synthetic && (uintptr_t)bench_app_entry <= UINT32_MAX)
+        bench_bootloader();
+    else
+        printf("%-24s skipped, %s\n", "boot update + rollback", synthetic ? "build with -no-pie" : "not a synthetic image");
+
+    /* last, the sector is in the staging slot of the OTA scenarios */
+    bench_sector_update();
+
+    mflash_sim_close();
+    return bench_failures ? 1 : 0;
+}
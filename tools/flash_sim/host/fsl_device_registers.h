@@ -0,0 +1,83 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/* Host replacement of the core registers accessed by the bootloader and the flash driver, defined by the flash
+ * simulator. The vector table offset register selects the image slot the simulated application runs from, the
+ * simulator raises the SysTick exception in the interrupt control register. */
+
+#ifndef _FSL_DEVICE_REGISTERS_H_
+#define _FSL_DEVICE_REGISTERS_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint32_t ICSR;
+    volatile uint32_t VTOR;
+} SCB_Type;
+
+typedef struct
+{
+    volatile uint32_t ICER[2];
+    volatile uint32_t ICPR[2];
+} NVIC_Type;
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+} SysTick_Type;
+
+extern SCB_Type mflash_sim_scb;
+extern NVIC_Type mflash_sim_nvic;
+extern SysTick_Type mflash_sim_systick;
+
+#define SCB (&mflash_sim_scb)
+#define NVIC (&mflash_sim_nvic)
+#define SysTick (&mflash_sim_systick)
+#define SCB_ICSR_PENDSTCLR_Msk (1UL << 25)
+#define SCB_ICSR_VECTPENDING_Pos (12U)
+#define SCB_ICSR_VECTPENDING_Msk (0x1FFUL << SCB_ICSR_VECTPENDING_Pos)
+
+#define __NVIC_PRIO_BITS 3
+
+typedef int32_t IRQn_Type;
+
+extern uint32_t mflash_sim_irq_priority(int32_t irqn);
+
+static inline uint32_t NVIC_GetPriority(IRQn_Type IRQn)
+{
+    return mflash_sim_irq_priority(IRQn);
+}
+
+static inline void __set_MSP(uint32_t topOfMainStack)
+{
+    (void)topOfMainStack;
+}
+
+static inline void __enable_irq(void)
+{
+}
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/* Host replacement of the SPIFI driver, the subset used by mflash_drv.c is forwarded to the flash simulator */
+
+#ifndef _FSL_SPIFI_H_
+#define _FSL_SPIFI_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsl_device_registers.h"
+#include "mflash_sim.h"
+
+typedef enum _spifi_spi_mode
+{
+    kSPIFI_SPISckLow  = 0x0U,
+    kSPIFI_SPISckHigh = 0x1U
+} spifi_spi_mode_t;
+
+typedef enum _spifi_dual_mode
+{
+    kSPIFI_QuadMode = 0x0U,
+    kSPIFI_DualMode = 0x1U
+} spifi_dual_mode_t;
+
+typedef enum _spifi_data_direction
+{
+    kSPIFI_DataInput  = 0x0U,
+    kSPIFI_DataOutput = 0x1U
+} spifi_data_direction_t;
+
+typedef enum _spifi_command_format
+{
+    kSPIFI_CommandAllSerial    = 0x0,
+    kSPIFI_CommandDataQuad     = 0x1U,
+    kSPIFI_CommandOpcodeSerial = 0x2U,
+    kSPIFI_CommandAllQuad      = 0x3U
+} spifi_command_format_t;
+
+typedef enum _spifi_command_type
+{
+    kSPIFI_CommandOpcodeOnly             = 0x1U,
+    kSPIFI_CommandOpcodeAddrOneByte      = 0x2U,
+    kSPIFI_CommandOpcodeAddrTwoBytes     = 0x3U,
+    kSPIFI_CommandOpcodeAddrThreeBytes   = 0x4U,
+    kSPIFI_CommandOpcodeAddrFourBytes    = 0x5U,
+    kSPIFI_CommandNoOpcodeAddrThreeBytes = 0x6U,
+    kSPIFI_CommandNoOpcodeAddrFourBytes  = 0x7U
+} spifi_command_type_t;
+
+typedef struct _spifi_command
+{
+    uint16_t dataLen;
+    bool isPollMode;
+    spifi_data_direction_t direction;
+    uint8_t intermediateBytes;
+    spifi_command_format_t format;
+    spifi_command_type_t type;
+    uint8_t opcode;
+} spifi_command_t;
+
+typedef struct _spifi_config
+{
+    uint16_t timeout;
+    uint8_t csHighTime;
+    bool disablePrefetch;
+    bool disableCachePrefech;
+    bool isFeedbackClock;
+    spifi_spi_mode_t spiMode;
+    bool isReadFullClockCycle;
+    spifi_dual_mode_t dualMode;
+} spifi_config_t;
+
+/* Controller registers, only the ones accessed directly by the driver */
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t STAT;
+} SPIFI_Type;
+
+extern SPIFI_Type mflash_sim_spifi;
+#define SPIFI0 (&mflash_sim_spifi)
+
+#define SPIFI_CTRL_TIMEOUT(x) (((uint32_t)(x) << 0U) & 0xFFFFU)
+#define SPIFI_CTRL_CSHIGH(x) (((uint32_t)(x) << 16U) & 0xF0000U)
+#define SPIFI_CTRL_D_PRFTCH_DIS(x) (((uint32_t)(x) << 21U) & 0x200000U)
+#define SPIFI_CTRL_MODE3(x) (((uint32_t)(x) << 23U) & 0x800000U)
+#define SPIFI_CTRL_PRFTCH_DIS(x) (((uint32_t)(x) << 27U) & 0x8000000U)
+#define SPIFI_CTRL_DUAL_MASK (0x10000000U)
+#define SPIFI_CTRL_DUAL(x) (((uint32_t)(x) << 28U) & SPIFI_CTRL_DUAL_MASK)
+#define SPIFI_CTRL_RFCLK(x) (((uint32_t)(x) << 29U) & 0x20000000U)
+#define SPIFI_CTRL_FBCLK(x) (((uint32_t)(x) << 30U) & 0x40000000U)
+#define SPIFI_STAT_INTRQ_MASK (0x20U)
+
+/* Core intrinsics used by the driver around flash operations, the simulator keeps track of the interrupt mask */
+static inline uint32_t __get_PRIMASK(void)
+{
+    return mflash_sim_primask();
+}
+
+static inline uint32_t __get_BASEPRI(void)
+{
+    return mflash_sim_basepri();
+}
+
+static inline void __set_BASEPRI(uint32_t basepri)
+{
+    mflash_sim_set_basepri(basepri);
+}
+
+/* Raises BASEPRI only, as the core does */
+static inline void __set_BASEPRI_MAX(uint32_t basepri)
+{
+    uint32_t current = mflash_sim_basepri();
+
+    if ((basepri != 0) && ((current == 0) || (basepri < current)))
+        mflash_sim_set_basepri(basepri);
+}
+
+static inline void __ISB(void)
+{
+}
+
+#define __asm(x) mflash_sim_asm(x)
+
+/* Unaligned word load, the target core handles it in hardware */
+static inline uint32_t __UNALIGNED_UINT32_READ(const void *addr)
+{
+    const uint8_t *bytes = (const uint8_t *)addr;
+
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/* Clock and reset of the controller, set up by the driver unless running XIP */
+#define kSPIFI_RST_SHIFT_RSTn (0)
+#define kFRO_HF_to_SPIFI_CLK (0)
+#define kCLOCK_DivSpifiClk (0)
+#define kCLOCK_Spifi (0)
+
+static inline void RESET_PeripheralReset(uint32_t peripheral)
+{
+    (void)peripheral;
+}
+
+static inline void CLOCK_AttachClk(uint32_t connection)
+{
+    (void)connection;
+}
+
+static inline uint32_t CLOCK_GetSpifiClkFreq(void)
+{
+    return 96000000;
+}
+
+static inline void CLOCK_SetClkDiv(uint32_t name, uint32_t divided_by_value, bool reset)
+{
+    (void)name;
+    (void)divided_by_value;
+    (void)reset;
+}
+
+static inline void CLOCK_EnableClock(uint32_t clock)
+{
+    (void)clock;
+}
+
+static inline void SPIFI_GetDefaultConfig(spifi_config_t *config)
+{
+    config->timeout              = 0xFFFFU;
+    config->csHighTime           = 0xFU;
+    config->disablePrefetch      = false;
+    config->disableCachePrefech  = false;
+    config->isFeedbackClock      = true;
+    config->spiMode              = kSPIFI_SPISckLow;
+    config->isReadFullClockCycle = true;
+    config->dualMode             = kSPIFI_QuadMode;
+}
+
+static inline void SPIFI_ResetCommand(SPIFI_Type *base)
+{
+    (void)base;
+    mflash_sim_reset_command();
+}
+
+static inline void SPIFI_SetMemoryCommand(SPIFI_Type *base, spifi_command_t *cmd)
+{
+    (void)base;
+    mflash_sim_memory_command(cmd);
+}
+
+static inline void SPIFI_SetCommand(SPIFI_Type *base, spifi_command_t *cmd)
+{
+    (void)base;
+    mflash_sim_command(cmd);
+}
+
+static inline void SPIFI_SetCommandAddress(SPIFI_Type *base, uint32_t addr)
+{
+    (void)base;
+    mflash_sim_command_address(addr);
+}
+
+static inline void SPIFI_WriteData(SPIFI_Type *base, uint32_t data)
+{
+    (void)base;
+    mflash_sim_write_data(data, 4);
+}
+
+static inline void SPIFI_WriteDataHalfword(SPIFI_Type *base, uint16_t data)
+{
+    (void)base;
+    mflash_sim_write_data(data, 2);
+}
+
+static inline void SPIFI_WriteDataByte(SPIFI_Type *base, uint8_t data)
+{
+    (void)base;
+    mflash_sim_write_data(data, 1);
+}
+
+static inline uint32_t SPIFI_ReadData(SPIFI_Type *base)
+{
+    (void)base;
+    return mflash_sim_read_data(4);
+}
+
+static inline uint8_t SPIFI_ReadDataByte(SPIFI_Type *base)
+{
+    (void)base;
+    return (uint8_t)mflash_sim_read_data(1);
+}
+
+#endif
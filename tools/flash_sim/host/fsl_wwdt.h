@@ -0,0 +1,54 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/* Host replacement of the windowed watchdog driver, the watchdog never fires */
+
+#ifndef _FSL_WWDT_H_
+#define _FSL_WWDT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    bool enableWatchdogReset;
+    uint32_t timeoutValue;
+} wwdt_config_t;
+
+#define WWDT ((void *)0)
+
+static inline void WWDT_GetDefaultConfig(wwdt_config_t *config)
+{
+    config->enableWatchdogReset = false;
+    config->timeoutValue = 0xFFFFFF;
+}
+
+static inline void WWDT_Init(void *base, const wwdt_config_t *config)
+{
+    (void)base;
+    (void)config;
+}
+
+#endif
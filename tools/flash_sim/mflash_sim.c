@@ -0,0 +1,821 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsl_spifi.h"
+#include "mflash_sim.h"
+
+/* Flash opcodes understood by the simulator */
+#define SIM_OP_WRITE_STATUS   0x01
+#define SIM_OP_PAGE_PROGRAM   0x02
+#define SIM_OP_READ           0x03
+#define SIM_OP_WRITE_DISABLE  0x04
+#define SIM_OP_READ_STATUS    0x05
+#define SIM_OP_WRITE_ENABLE   0x06
+#define SIM_OP_FAST_READ      0x0B
+#define SIM_OP_WRITE_STATUS3  0x11
+#define SIM_OP_READ_STATUS3   0x15
+#define SIM_OP_SECTOR_ERASE   0x20
+#define SIM_OP_WRITE_STATUS2  0x31
+#define SIM_OP_QUAD_PROGRAM   0x32
+#define SIM_OP_READ_STATUS2   0x35
+#define SIM_OP_VOLATILE_WREN  0x50
+#define SIM_OP_BLOCK32_ERASE  0x52
+#define SIM_OP_CHIP_ERASE     0x60
+#define SIM_OP_QUAD_READ      0x6B
+#define SIM_OP_READ_ID        0x9F
+#define SIM_OP_CHIP_ERASE2    0xC7
+#define SIM_OP_BLOCK64_ERASE  0xD8
+#define SIM_OP_QUAD_IO_READ   0xEB
+#define SIM_OP_SUSPEND        0x75
+#define SIM_OP_RESUME         0x7A
+
+#define SIM_SR1_BUSY 0x01
+#define SIM_SR1_WEL  0x02
+#define SIM_SR2_QE   0x02
+#define SIM_SR2_SUS  0x80
+
+/* The periodic interrupt is the Ethernet one, exception number and NVIC priority. It is above the priority of the
+ * RTOS kernel, the lowest one, which the driver keeps masked with BASEPRI while serving interrupts. */
+#define SIM_IRQ 65
+#define SIM_IRQ_PRIORITY 2
+#define SIM_PRIO_BITS 3
+
+/* Busy status polls the driver gets to react to a pending interrupt before time jumps to the end of the operation */
+#define SIM_POLL_LIMIT 1024
+
+SPIFI_Type mflash_sim_spifi;
+SCB_Type mflash_sim_scb;
+NVIC_Type mflash_sim_nvic;
+SysTick_Type mflash_sim_systick;
+
+static const struct mflash_sim_timing sim_default_timing = {
+    .sector_erase_us = 45000,
+    .block_erase_us = 150000,
+    .page_program_us = 400,
+    .register_write_us = 10000,
+    .suspend_us = 20,
+    .clock_hz = 96000000,
+    .irq_period_us = 1000,
+};
+
+static int sim_fd = -1;
+static uint8_t *sim_flash; /* read-write view of the flash, the XIP window is read-only */
+static struct mflash_sim_timing sim_timing;
+static struct mflash_sim_stats sim_stats;
+static uint32_t sim_erase_counts[MFLASH_SIM_SECTORS];
+
+static bool sim_memory_mode;
+static bool sim_xip_guard = true; /* XIP window unreadable in command mode */
+static spifi_command_t sim_memory_cmd;
+static uint8_t sim_status[3];
+static uint64_t sim_busy_until;
+static uint64_t sim_suspended_ns; /* time left of the suspended operation */
+static uint32_t sim_busy_polls;
+
+/* Interrupt mask of the core and the periodic interrupt */
+static bool sim_irq_masked;
+static uint32_t sim_basepri;
+static bool sim_irq_pending;
+static uint64_t sim_irq_pending_since;
+static uint64_t sim_irq_next;
+
+/* Command in progress */
+static spifi_command_t sim_cmd;
+static bool sim_cmd_active;
+static uint32_t sim_addr;
+static uint32_t sim_data_len; /* data bytes transferred so far */
+static uint8_t sim_page[MFLASH_SIM_PAGE_SIZE];
+static uint8_t sim_page_mask[MFLASH_SIM_PAGE_SIZE];
+
+
+/* Checks if the periodic interrupt is kept pending by PRIMASK or BASEPRI */
+static bool sim_irq_blocked(void)
+{
+    return sim_irq_masked || ((sim_basepri != 0) && ((SIM_IRQ_PRIORITY << (8 - SIM_PRIO_BITS)) >= sim_basepri));
+}
+
+
+/* Serves the pending interrupt, called once interrupts are enabled */
+static void sim_irq_serve(void)
+{
+    uint64_t latency;
+
+    if (!sim_irq_pending || sim_irq_blocked())
+        return;
+
+    latency = sim_stats.time_ns - sim_irq_pending_since;
+    if (latency > sim_stats.irq_latency_max_ns)
+        sim_stats.irq_latency_max_ns = latency;
+
+    sim_stats.irqs++;
+    sim_irq_pending = false;
+    mflash_sim_scb.ICSR &= ~SCB_ICSR_VECTPENDING_Msk;
+}
+
+
+/* Advances the simulated clock to given time, raising the periodic interrupt on the way */
+static void sim_advance_to(uint64_t time_ns)
+{
+    if (time_ns > sim_stats.time_ns)
+        sim_stats.time_ns = time_ns;
+
+    while (sim_timing.irq_period_us && sim_irq_next <= sim_stats.time_ns)
+    {
+        if (!sim_irq_blocked())
+        {
+            /* with interrupts enabled it is served right away */
+            sim_stats.irqs++;
+        }
+        else if (!sim_irq_pending)
+        {
+            sim_irq_pending = true;
+            sim_irq_pending_since = sim_irq_next;
+            sim_busy_polls = 0;
+            mflash_sim_scb.ICSR |= SIM_IRQ << SCB_ICSR_VECTPENDING_Pos;
+        }
+
+        sim_irq_next += (uint64_t)sim_timing.irq_period_us * 1000U;
+    }
+}
+
+
+/* Advances the simulated clock by given number of serial clocks */
+static void sim_clocks(uint32_t clocks)
+{
+    sim_advance_to(sim_stats.time_ns + ((uint64_t)clocks * 1000000000ULL) / sim_timing.clock_hz);
+}
+
+
+/* Returns the number of lanes used to transfer the data of a command */
+static uint32_t sim_data_lanes(const spifi_command_t *cmd)
+{
+    if (cmd->format == kSPIFI_CommandAllSerial)
+        return 1;
+
+    return (mflash_sim_spifi.CTRL & SPIFI_CTRL_DUAL_MASK) ? 2 : 4;
+}
+
+
+/* Returns the number of lanes used to transfer the address of a command */
+static uint32_t sim_addr_lanes(const spifi_command_t *cmd)
+{
+    if (cmd->format == kSPIFI_CommandAllSerial || cmd->format == kSPIFI_CommandDataQuad)
+        return 1;
+
+    return sim_data_lanes(cmd);
+}
+
+
+static uint32_t sim_addr_bytes(const spifi_command_t *cmd)
+{
+    switch (cmd->type)
+    {
+    case kSPIFI_CommandOpcodeAddrOneByte:
+        return 1;
+    case kSPIFI_CommandOpcodeAddrTwoBytes:
+        return 2;
+    case kSPIFI_CommandOpcodeAddrThreeBytes:
+    case kSPIFI_CommandNoOpcodeAddrThreeBytes:
+        return 3;
+    case kSPIFI_CommandOpcodeAddrFourBytes:
+    case kSPIFI_CommandNoOpcodeAddrFourBytes:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+
+/* Makes the flash busy for given time from now */
+static void sim_busy(uint32_t us)
+{
+    sim_busy_until = sim_stats.time_ns + (uint64_t)us * 1000U;
+    sim_stats.busy_ns += (uint64_t)us * 1000U;
+    sim_status[0] |= SIM_SR1_BUSY;
+}
+
+
+/* Waits for the operation in progress, if any, to complete */
+static void sim_wait(void)
+{
+    sim_advance_to(sim_busy_until);
+
+    if (sim_status[0] & SIM_SR1_BUSY)
+        sim_status[0] &= ~(SIM_SR1_BUSY | SIM_SR1_WEL);
+}
+
+
+/* The driver polls the status of a busy flash until the operation completes. Rather than simulating every poll,
+ * time jumps to the next event the driver could react to, the completion or an interrupt becoming pending while
+ * interrupts are disabled. Once one is pending the driver gets SIM_POLL_LIMIT polls to react to it. */
+static void sim_poll_busy(void)
+{
+    uint64_t next = sim_busy_until;
+
+    if (sim_irq_blocked() && sim_irq_pending && ++sim_busy_polls < SIM_POLL_LIMIT)
+        return;
+
+    if (sim_irq_blocked() && !sim_irq_pending && sim_timing.irq_period_us && sim_irq_next < next)
+        next = sim_irq_next;
+
+    sim_advance_to(next);
+}
+
+
+static bool sim_is_busy(void)
+{
+    if ((sim_status[0] & SIM_SR1_BUSY) && sim_stats.time_ns >= sim_busy_until)
+        sim_wait();
+
+    return (sim_status[0] & SIM_SR1_BUSY) != 0;
+}
+
+
+/* Program and erase need the write enable latch, they are ignored by the flash otherwise */
+static bool sim_write_enabled(void)
+{
+    if (sim_is_busy() || !(sim_status[0] & SIM_SR1_WEL))
+    {
+        sim_stats.protocol_errors++;
+        return false;
+    }
+
+    return true;
+}
+
+
+static void sim_erase(uint32_t addr, uint32_t len, uint32_t us)
+{
+    addr &= ~(len - 1);
+    memset(&sim_flash[addr], 0xFF, len);
+
+    for (uint32_t sector = addr / MFLASH_SIM_SECTOR_SIZE; sector < (addr + len) / MFLASH_SIM_SECTOR_SIZE; sector++)
+    {
+        sim_erase_counts[sector]++;
+        sim_stats.sector_erases++;
+    }
+
+    sim_busy(us);
+}
+
+
+/* Page program takes place once the controller has clocked all the data of the command */
+static void sim_program_commit(void)
+{
+    uint32_t page_addr = sim_addr & ~(MFLASH_SIM_PAGE_SIZE - 1);
+
+    for (uint32_t i = 0; i < MFLASH_SIM_PAGE_SIZE; i++)
+    {
+        uint8_t old_value;
+
+        if (!sim_page_mask[i])
+            continue;
+
+        old_value = sim_flash[page_addr + i];
+
+        /* bytes sent as 0xFF are padding which leaves the flash unchanged */
+        if (sim_page[i] != 0xFF)
+            sim_stats.stuck_bits += __builtin_popcount(sim_page[i] & ~old_value);
+
+        sim_flash[page_addr + i] = old_value & sim_page[i];
+    }
+
+    sim_stats.page_programs++;
+    sim_busy(sim_timing.page_program_us);
+}
+
+
+static void sim_register_commit(void)
+{
+    uint32_t first = (sim_cmd.opcode == SIM_OP_WRITE_STATUS2) ? 1 : (sim_cmd.opcode == SIM_OP_WRITE_STATUS3) ? 2 : 0;
+
+    /* busy and write enable are not writable, the latch is cleared once the write completes */
+    uint8_t flags = sim_status[0] & (SIM_SR1_BUSY | SIM_SR1_WEL);
+
+    for (uint32_t i = 0; i < sim_data_len && first + i < sizeof(sim_status); i++)
+        sim_status[first + i] = sim_page[i];
+
+    sim_status[0] = (sim_status[0] & ~(SIM_SR1_BUSY | SIM_SR1_WEL)) | flags;
+    sim_busy(sim_timing.register_write_us);
+}
+
+
+/* Completes the command in progress, the flash starts the operation when chip select goes high */
+static void sim_finish(void)
+{
+    if (!sim_cmd_active)
+        return;
+
+    sim_cmd_active = false;
+
+    switch (sim_cmd.opcode)
+    {
+    case SIM_OP_PAGE_PROGRAM:
+    case SIM_OP_QUAD_PROGRAM:
+        if (sim_data_len > 0)
+            sim_program_commit();
+        else
+            sim_status[0] &= ~SIM_SR1_WEL;
+        break;
+
+    case SIM_OP_WRITE_STATUS:
+    case SIM_OP_WRITE_STATUS2:
+    case SIM_OP_WRITE_STATUS3:
+        if (sim_data_len > 0)
+            sim_register_commit();
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+static bool sim_is_quad_command(const spifi_command_t *cmd)
+{
+    return cmd->format != kSPIFI_CommandAllSerial && !(mflash_sim_spifi.CTRL & SPIFI_CTRL_DUAL_MASK);
+}
+
+
+static void sim_set_xip(bool readable)
+{
+    if (sim_xip_guard)
+        mprotect((void *)MFLASH_SIM_BASE, MFLASH_SIM_SIZE, readable ? PROT_READ : PROT_NONE);
+}
+
+
+void mflash_sim_xip_guard(bool enable)
+{
+    sim_xip_guard = enable;
+    mprotect((void *)MFLASH_SIM_BASE, MFLASH_SIM_SIZE, (sim_memory_mode || !enable) ? PROT_READ : PROT_NONE);
+}
+
+
+void mflash_sim_reset_command(void)
+{
+    sim_finish();
+
+    if (sim_memory_mode)
+    {
+        sim_memory_mode = false;
+        sim_set_xip(false);
+    }
+}
+
+
+void mflash_sim_memory_command(const spifi_command_t *cmd)
+{
+    sim_finish();
+
+    /* the flash does not return data while it is busy, the driver has to poll the status first */
+    if (sim_is_busy())
+    {
+        sim_stats.protocol_errors++;
+        sim_wait();
+    }
+
+    if (sim_is_quad_command(cmd) && !(sim_status[1] & SIM_SR2_QE))
+        sim_stats.protocol_errors++;
+
+    sim_memory_cmd = *cmd;
+    sim_memory_mode = true;
+    sim_set_xip(true);
+}
+
+
+void mflash_sim_command(const spifi_command_t *cmd)
+{
+    sim_finish();
+
+    if (sim_memory_mode)
+    {
+        sim_memory_mode = false;
+        sim_set_xip(false);
+    }
+
+    sim_cmd = *cmd;
+    sim_cmd_active = true;
+    sim_data_len = 0;
+    sim_stats.commands++;
+
+    /* opcode, address and intermediate bytes */
+    sim_clocks(8 + (sim_addr_bytes(cmd) + cmd->intermediateBytes) * 8 / sim_addr_lanes(cmd));
+
+    if (sim_is_quad_command(cmd) && !(sim_status[1] & SIM_SR2_QE))
+        sim_stats.protocol_errors++;
+
+    mflash_sim_spifi.STAT |= SPIFI_STAT_INTRQ_MASK;
+
+    switch (cmd->opcode)
+    {
+    case SIM_OP_READ_STATUS:
+        /* the driver spins on the status until the operation completes */
+        sim_stats.status_polls++;
+        if (sim_is_busy())
+            sim_poll_busy();
+        break;
+
+    case SIM_OP_SUSPEND:
+        /* takes effect on a program or erase in progress, the flash is readable once it is not busy anymore */
+        if (sim_is_busy() && !(sim_status[1] & SIM_SR2_SUS))
+        {
+            sim_suspended_ns = sim_busy_until - sim_stats.time_ns;
+            sim_busy_until = sim_stats.time_ns + (uint64_t)sim_timing.suspend_us * 1000U;
+            sim_status[1] |= SIM_SR2_SUS;
+            sim_stats.suspends++;
+        }
+        break;
+
+    case SIM_OP_RESUME:
+        if (!sim_is_busy() && (sim_status[1] & SIM_SR2_SUS))
+        {
+            sim_status[1] &= ~SIM_SR2_SUS;
+            sim_status[0] |= SIM_SR1_BUSY | SIM_SR1_WEL;
+            sim_busy_until = sim_stats.time_ns + sim_suspended_ns;
+        }
+        break;
+
+    case SIM_OP_WRITE_ENABLE:
+    case SIM_OP_VOLATILE_WREN:
+        if (!sim_is_busy())
+            sim_status[0] |= SIM_SR1_WEL;
+        break;
+
+    case SIM_OP_WRITE_DISABLE:
+        if (!sim_is_busy())
+            sim_status[0] &= ~SIM_SR1_WEL;
+        break;
+
+    case SIM_OP_SECTOR_ERASE:
+        if (sim_write_enabled())
+            sim_erase(sim_addr, MFLASH_SIM_SECTOR_SIZE, sim_timing.sector_erase_us);
+        break;
+
+    case SIM_OP_BLOCK32_ERASE:
+        if (sim_write_enabled())
+            sim_erase(sim_addr, 0x8000, sim_timing.block_erase_us);
+        break;
+
+    case SIM_OP_BLOCK64_ERASE:
+        if (sim_write_enabled())
+            sim_erase(sim_addr, 0x10000, sim_timing.block_erase_us);
+        break;
+
+    case SIM_OP_CHIP_ERASE:
+    case SIM_OP_CHIP_ERASE2:
+        if (sim_write_enabled())
+            sim_erase(0, MFLASH_SIM_SIZE, sim_timing.block_erase_us * (MFLASH_SIM_SIZE / 0x10000));
+        break;
+
+    case SIM_OP_PAGE_PROGRAM:
+    case SIM_OP_QUAD_PROGRAM:
+    case SIM_OP_WRITE_STATUS:
+    case SIM_OP_WRITE_STATUS2:
+    case SIM_OP_WRITE_STATUS3:
+        if (!sim_write_enabled())
+        {
+            sim_cmd.opcode = 0;
+            break;
+        }
+        memset(sim_page, 0xFF, sizeof(sim_page));
+        memset(sim_page_mask, 0, sizeof(sim_page_mask));
+        break;
+
+    default:
+        break;
+    }
+
+    if (cmd->dataLen == 0)
+        sim_finish();
+}
+
+
+void mflash_sim_command_address(uint32_t addr)
+{
+    /* the flash sees the offset within the XIP window */
+    sim_addr = addr & (MFLASH_SIM_SIZE - 1);
+}
+
+
+void mflash_sim_write_data(uint32_t data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len && sim_cmd_active; i++, data >>= 8)
+    {
+        switch (sim_cmd.opcode)
+        {
+        case SIM_OP_PAGE_PROGRAM:
+        case SIM_OP_QUAD_PROGRAM:
+        {
+            /* data wraps around within the page */
+            uint32_t offset = (sim_addr + sim_data_len) & (MFLASH_SIM_PAGE_SIZE - 1);
+            sim_page[offset] &= (uint8_t)data;
+            sim_page_mask[offset] = 1;
+            sim_stats.bytes_programmed++;
+            break;
+        }
+
+        case SIM_OP_WRITE_STATUS:
+        case SIM_OP_WRITE_STATUS2:
+        case SIM_OP_WRITE_STATUS3:
+            if (sim_data_len < sizeof(sim_page))
+                sim_page[sim_data_len] = (uint8_t)data;
+            break;
+
+        default:
+            break;
+        }
+
+        sim_data_len++;
+        sim_clocks(8 / sim_data_lanes(&sim_cmd));
+
+        if (sim_data_len >= sim_cmd.dataLen)
+            sim_finish();
+    }
+}
+
+
+void mflash_sim_asm(const char *insn)
+{
+    if (strcmp(insn, "cpsid i") == 0)
+    {
+        sim_irq_masked = true;
+    }
+    else if (strcmp(insn, "cpsie i") == 0)
+    {
+        sim_irq_masked = false;
+        sim_irq_serve();
+    }
+}
+
+
+uint32_t mflash_sim_primask(void)
+{
+    return sim_irq_masked ? 1 : 0;
+}
+
+
+uint32_t mflash_sim_basepri(void)
+{
+    return sim_basepri;
+}
+
+
+void mflash_sim_set_basepri(uint32_t basepri)
+{
+    sim_basepri = basepri & 0xFFU;
+    sim_irq_serve();
+}
+
+
+uint32_t mflash_sim_irq_priority(int32_t irqn)
+{
+    if (irqn == SIM_IRQ - 16)
+        return SIM_IRQ_PRIORITY;
+
+    return (1U << SIM_PRIO_BITS) - 1U;
+}
+
+
+uint32_t mflash_sim_read_data(uint32_t len)
+{
+    static const uint8_t id[] = {0xEF, 0x40, 0x18};
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        uint8_t byte;
+
+        switch (sim_cmd.opcode)
+        {
+        case SIM_OP_READ_STATUS:
+            byte = sim_status[0];
+            break;
+        case SIM_OP_READ_STATUS2:
+            byte = sim_status[1];
+            break;
+        case SIM_OP_READ_STATUS3:
+            byte = sim_status[2];
+            break;
+        case SIM_OP_READ_ID:
+            byte = (sim_data_len < sizeof(id)) ? id[sim_data_len] : 0xFF;
+            break;
+        case SIM_OP_READ:
+        case SIM_OP_FAST_READ:
+        case SIM_OP_QUAD_READ:
+        case SIM_OP_QUAD_IO_READ:
+            byte = sim_flash[(sim_addr + sim_data_len) & (MFLASH_SIM_SIZE - 1)];
+            sim_stats.bytes_read++;
+            break;
+        default:
+            byte = 0xFF;
+            break;
+        }
+
+        value |= (uint32_t)byte << (8 * i);
+        sim_data_len++;
+        sim_clocks(8 / sim_data_lanes(&sim_cmd));
+    }
+
+    return value;
+}
+
+
+/* Reports accesses the target would not survive, reading the XIP window in command mode or writing to it */
+static void sim_fault(int sig, siginfo_t *info, void *context)
+{
+    uintptr_t addr = (uintptr_t)info->si_addr;
+
+    (void)context;
+
+    if (addr >= MFLASH_SIM_BASE && addr < MFLASH_SIM_BASE + MFLASH_SIM_SIZE)
+    {
+        fprintf(stderr,
+                "mflash_sim: access to flash at 0x%08lx %s\n",
+                (unsigned long)addr,
+                sim_memory_mode ? "through the read-only XIP window" : "while SPIFI is in command mode");
+    }
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+int32_t mflash_sim_open(const char *path, const struct mflash_sim_timing *timing)
+{
+    struct sigaction action;
+    struct stat st;
+    void *xip;
+
+    sim_timing = timing ? *timing : sim_default_timing;
+
+    if (path)
+    {
+        sim_fd = open(path, O_RDWR | O_CREAT, 0644);
+    }
+    else
+    {
+        char name[] = "/tmp/mflash_sim_XXXXXX";
+        sim_fd = mkstemp(name);
+        if (sim_fd >= 0)
+            unlink(name);
+    }
+
+    if (sim_fd < 0 || fstat(sim_fd, &st) != 0)
+        return -1;
+
+    if (st.st_size != MFLASH_SIM_SIZE && ftruncate(sim_fd, MFLASH_SIM_SIZE) != 0)
+        return -1;
+
+    sim_flash = mmap(NULL, MFLASH_SIM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, sim_fd, 0);
+    if (sim_flash == MAP_FAILED)
+        return -1;
+
+    /* a new flash file is blank */
+    if (st.st_size != MFLASH_SIM_SIZE)
+        memset(sim_flash, 0xFF, MFLASH_SIM_SIZE);
+
+    xip = mmap((void *)MFLASH_SIM_BASE, MFLASH_SIM_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED, sim_fd, 0);
+    if (xip != (void *)MFLASH_SIM_BASE)
+        return -1;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sim_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &action, NULL);
+    sigaction(SIGBUS, &action, NULL);
+
+    memset(sim_erase_counts, 0, sizeof(sim_erase_counts));
+    memset(sim_status, 0, sizeof(sim_status));
+    sim_busy_until = 0;
+    sim_irq_masked = false;
+    sim_basepri = 0;
+    sim_irq_pending = false;
+    sim_irq_next = (uint64_t)sim_timing.irq_period_us * 1000U;
+    sim_cmd_active = false;
+    sim_memory_mode = true;
+    mflash_sim_reset_stats();
+
+    /* the boot ROM leaves the controller in memory mode with serial fast read */
+    memset(&sim_memory_cmd, 0, sizeof(sim_memory_cmd));
+    sim_memory_cmd.intermediateBytes = 1;
+    sim_memory_cmd.format = kSPIFI_CommandAllSerial;
+    sim_memory_cmd.type = kSPIFI_CommandOpcodeAddrThreeBytes;
+    sim_memory_cmd.opcode = SIM_OP_FAST_READ;
+
+    return 0;
+}
+
+
+void mflash_sim_xip_read(uint32_t addr, uint32_t len)
+{
+    uint32_t first = addr & ~(MFLASH_SIM_XIP_LINE - 1);
+    uint32_t lines = (addr + len - first + MFLASH_SIM_XIP_LINE - 1) / MFLASH_SIM_XIP_LINE;
+
+    if (!sim_memory_mode || len == 0)
+        return;
+
+    /* every line is a read command with opcode, address and intermediate bytes */
+    sim_clocks(lines * (8 + (sim_addr_bytes(&sim_memory_cmd) + sim_memory_cmd.intermediateBytes) * 8 /
+                                sim_addr_lanes(&sim_memory_cmd) +
+                        MFLASH_SIM_XIP_LINE * 8 / sim_data_lanes(&sim_memory_cmd)));
+    sim_stats.bytes_read += lines * MFLASH_SIM_XIP_LINE;
+}
+
+
+void mflash_sim_close(void)
+{
+    if (sim_fd < 0)
+        return;
+
+    munmap((void *)MFLASH_SIM_BASE, MFLASH_SIM_SIZE);
+    munmap(sim_flash, MFLASH_SIM_SIZE);
+    close(sim_fd);
+    sim_fd = -1;
+}
+
+
+void mflash_sim_format(void)
+{
+    memset(sim_flash, 0xFF, MFLASH_SIM_SIZE);
+}
+
+
+void mflash_sim_load(uint32_t addr, const void *data, uint32_t len)
+{
+    memcpy(&sim_flash[addr & (MFLASH_SIM_SIZE - 1)], data, len);
+}
+
+
+void mflash_sim_get_stats(struct mflash_sim_stats *stats)
+{
+    *stats = sim_stats;
+}
+
+
+void mflash_sim_reset_stats(void)
+{
+    uint64_t time_ns = sim_stats.time_ns;
+
+    /* the clock keeps running, a pending operation still has to complete */
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    sim_stats.time_ns = time_ns;
+}
+
+
+uint32_t mflash_sim_erase_count(uint32_t addr)
+{
+    return sim_erase_counts[(addr & (MFLASH_SIM_SIZE - 1)) / MFLASH_SIM_SECTOR_SIZE];
+}
+
+
+uint32_t mflash_sim_max_erase_count(void)
+{
+    uint32_t max = 0;
+
+    for (uint32_t i = 0; i < MFLASH_SIM_SECTORS; i++)
+    {
+        if (sim_erase_counts[i] > max)
+            max = sim_erase_counts[i];
+    }
+
+    return max;
+}
+
+
+uint64_t mflash_sim_time_us(void)
+{
+    return sim_stats.time_ns / 1000U;
+}
@@ -0,0 +1,131 @@
+/*
+ * FreeRTOS version 202012.00-LTS
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+#ifndef _MFLASH_SIM_H_
+#define _MFLASH_SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host simulator of the SPIFI controller and the serial NOR flash behind it.
+ *
+ * The unmodified mflash driver is built against host/fsl_spifi.h, which forwards the SPIFI commands issued by the
+ * driver to the simulator. The flash content lives in a file mapped read-only at the XIP address, so code reading
+ * the flash through pointers works as on the target, while writes through the XIP window and reads while the
+ * controller is in command mode fault. Erase and program follow NOR rules, an erase sets a sector to 0xFF and a
+ * program can only clear bits. Every command advances a simulated clock by its bus transfer and busy time.
+ *
+ * The simulator also tracks the interrupt mask and the BASEPRI set by the driver and raises a periodic Ethernet
+ * interrupt, above the kernel priority, the time it stays pending while interrupts are disabled is the interrupt
+ * latency caused by flash operations.
+ */
+
+/* XIP window of the flash, W25Q128JV on the LPCXpresso54018 */
+#define MFLASH_SIM_BASE (0x10000000)
+#define MFLASH_SIM_SIZE (0x1000000)
+
+#define MFLASH_SIM_SECTOR_SIZE (4096)
+#define MFLASH_SIM_PAGE_SIZE (256)
+#define MFLASH_SIM_SECTORS (MFLASH_SIM_SIZE / MFLASH_SIM_SECTOR_SIZE)
+
+/* Timing of the flash operations, defaults are the typical values of the W25Q128JV datasheet */
+struct mflash_sim_timing
+{
+    uint32_t sector_erase_us;   /* 4 KB sector erase */
+    uint32_t block_erase_us;    /* 64 KB block erase */
+    uint32_t page_program_us;   /* page program, independent of the number of bytes */
+    uint32_t register_write_us; /* status register write */
+    uint32_t suspend_us;        /* program or erase suspend latency */
+    uint32_t clock_hz;          /* serial clock, one bit per clock and lane */
+    uint32_t irq_period_us;     /* period of the simulated interrupt, 0 for none */
+};
+
+struct mflash_sim_stats
+{
+    uint32_t commands;             /* commands issued to the flash, including status polls */
+    uint32_t status_polls;
+    uint32_t sector_erases;        /* 4 KB sector erases, a block erase counts as 16 */
+    uint32_t page_programs;
+    uint32_t bytes_programmed;     /* bytes clocked in by page programs */
+    uint32_t bytes_read;           /* bytes read in command mode or accounted by mflash_sim_xip_read() */
+    uint32_t stuck_bits;           /* bits a program wanted to set but could not, as they were cleared before */
+    uint32_t protocol_errors;      /* program or erase without write enable, quad data without QE, memory mode while busy */
+    uint32_t suspends;             /* program or erase suspended */
+    uint32_t irqs;                 /* interrupts served */
+    uint64_t irq_latency_max_ns;   /* longest time an interrupt was kept pending by disabled interrupts */
+    uint64_t busy_ns;              /* time the flash spent erasing or programming */
+    uint64_t time_ns;              /* simulated time since the flash was opened, kept by mflash_sim_reset_stats() */
+};
+
+/* Maps the flash backed by 'path' at MFLASH_SIM_BASE, a new file is created blank. A NULL path uses a temporary
+ * file. Timing may be NULL for the defaults. Returns 0 on success. */
+extern int32_t mflash_sim_open(const char *path, const struct mflash_sim_timing *timing);
+extern void mflash_sim_close(void);
+
+/* Erases the whole flash without accounting, e.g. to start a benchmark from a known state */
+extern void mflash_sim_format(void);
+
+/* Writes to the flash without accounting and NOR rules, e.g. to preload an image */
+extern void mflash_sim_load(uint32_t addr, const void *data, uint32_t len);
+
+extern void mflash_sim_get_stats(struct mflash_sim_stats *stats);
+extern void mflash_sim_reset_stats(void);
+
+/* Number of erases of the sector at given address since the flash was opened, and the maximum over all sectors */
+extern uint32_t mflash_sim_erase_count(uint32_t addr);
+extern uint32_t mflash_sim_max_erase_count(void);
+
+/* Simulated time in microseconds */
+extern uint64_t mflash_sim_time_us(void);
+
+/* Accounts a read of 'len' bytes through the XIP window, which the simulator does not see otherwise. The controller
+ * fetches MFLASH_SIM_XIP_LINE bytes per memory mode read command. */
+#define MFLASH_SIM_XIP_LINE (32)
+extern void mflash_sim_xip_read(uint32_t addr, uint32_t len);
+
+/* Enabled by default, reading the XIP window while the controller is in command mode faults. The guard costs a
+ * system call on every mode switch, disable it to time the host code. */
+extern void mflash_sim_xip_guard(bool enable);
+
+/* Core interface, used by host/fsl_spifi.h. Takes "cpsid i" and "cpsie i", pending interrupts are served upon the
+ * latter, and upon lowering BASEPRI. The priority is in NVIC levels, the periodic interrupt is above the kernel
+ * priority and the others, including PendSV and SysTick, are at the lowest one. */
+extern void mflash_sim_asm(const char *insn);
+extern uint32_t mflash_sim_primask(void);
+extern uint32_t mflash_sim_basepri(void);
+extern void mflash_sim_set_basepri(uint32_t basepri);
+extern uint32_t mflash_sim_irq_priority(int32_t irqn);
+
+/* SPIFI controller interface, used by host/fsl_spifi.h */
+struct _spifi_command;
+extern void mflash_sim_reset_command(void);
+extern void mflash_sim_memory_command(const struct _spifi_command *cmd);
+extern void mflash_sim_command(const struct _spifi_command *cmd);
+extern void mflash_sim_command_address(uint32_t addr);
+extern void mflash_sim_write_data(uint32_t data, uint32_t len);
+extern uint32_t mflash_sim_read_data(uint32_t len);
+
+#endif
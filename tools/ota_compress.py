@@ -0,0 +1,156 @@
+# Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+# Licensed under the Apache License, Version 2.0 (the "License").
+# You may not use this file except in compliance with the License.
+# A copy of the License is located at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# or in the "license" file accompanying this file. This file is distributed
+# on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+# express or implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+# OTA Image Compression Script
+# Creates compressed images decompressed on the device by lib/bootloader/boot_lz4.c
+# Important Note: Requires Python 3
+
+import argparse
+import struct
+import sys
+import zlib
+
+LZ4_MAGIC = 0x345A4C42
+LZ4_VERSION = 1
+HEADER_FORMAT = "<4I"
+
+MIN_MATCH = 4
+MAX_OFFSET = 0xFFFF
+# Number of previous positions with the same prefix tried for each match.
+MAX_CANDIDATES = 16
+
+
+def write_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def write_sequence(out, literals, offset, match_len):
+    literal_len = len(literals)
+    token = min(literal_len, 15) << 4
+    if offset:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if literal_len >= 15:
+        write_length(out, literal_len - 15)
+    out += literals
+    if offset:
+        out += struct.pack("<H", offset)
+        if match_len - MIN_MATCH >= 15:
+            write_length(out, match_len - MIN_MATCH - 15)
+
+
+def compress_block(data):
+    out = bytearray()
+    chains = {}
+    anchor = 0
+    position = 0
+
+    while position + MIN_MATCH <= len(data):
+        key = data[position:position + MIN_MATCH]
+        candidates = chains.setdefault(key, [])
+
+        best_offset, best_len = 0, 0
+        for candidate in reversed(candidates):
+            offset = position - candidate
+            if offset > MAX_OFFSET:
+                break
+            length = MIN_MATCH
+            while position + length < len(data) and data[candidate + length] == data[position + length]:
+                length += 1
+            if length > best_len:
+                best_offset, best_len = offset, length
+
+        candidates.append(position)
+        if len(candidates) > MAX_CANDIDATES:
+            del candidates[0]
+
+        if best_len >= MIN_MATCH:
+            write_sequence(out, data[anchor:position], best_offset, best_len)
+            position += best_len
+            anchor = position
+        else:
+            position += 1
+
+    # The last sequence carries the remaining literals only.
+    if anchor < len(data) or not out:
+        write_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def compress(image):
+    header = struct.pack(HEADER_FORMAT, LZ4_MAGIC, LZ4_VERSION, len(image), zlib.crc32(image))
+    return header + compress_block(image)
+
+
+def read_length(data, position, length):
+    if length == 15:
+        while True:
+            byte = data[position]
+            position += 1
+            length += byte
+            if byte != 255:
+                break
+    return position, length
+
+
+def decompress(data):
+    magic, version, image_size, image_crc = struct.unpack_from(HEADER_FORMAT, data)
+    if magic != LZ4_MAGIC or version != LZ4_VERSION:
+        raise ValueError("not a compressed image")
+
+    image = bytearray()
+    position = struct.calcsize(HEADER_FORMAT)
+    while len(image) < image_size:
+        token = data[position]
+        position += 1
+        position, literal_len = read_length(data, position, token >> 4)
+        image += data[position:position + literal_len]
+        position += literal_len
+        if len(image) == image_size:
+            break
+        offset = struct.unpack_from("<H", data, position)[0]
+        position += 2
+        position, match_len = read_length(data, position, token & 0x0F)
+        for _ in range(match_len + MIN_MATCH):
+            image.append(image[-offset])
+
+    if len(image) != image_size or zlib.crc32(image) != image_crc:
+        raise ValueError("decompressed image is corrupted")
+    return bytes(image)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Script to compress OTA images')
+    parser.add_argument("--image", help="Binary image to be compressed", required=True)
+    parser.add_argument("--output", help="Compressed image file to be created", required=True)
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    compressed = compress(image)
+
+    # Check the compressed image decompresses to the original before it gets shipped.
+    if decompress(compressed) != image:
+        print("Error: compressed image does not reproduce the image")
+        sys.exit(1)
+
+    with open(args.output, "wb") as f:
+        f.write(compressed)
+
+    print("Created compressed image %s: %d bytes for %d bytes image (%.1f%%)" %
+          (args.output, len(compressed), len(image), 100.0 * len(compressed) / max(len(image), 1)))
+
+
+if __name__ == "__main__":
+    main()
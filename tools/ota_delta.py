@@ -0,0 +1,135 @@
+# Copyright 2021 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+# Licensed under the Apache License, Version 2.0 (the "License").
+# You may not use this file except in compliance with the License.
+# A copy of the License is located at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# or in the "license" file accompanying this file. This file is distributed
+# on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+# express or implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+# OTA Delta Patch Script
+# Creates delta patches applied on the device by lib/bootloader/boot_delta.c
+# Important Note: Requires Python 3
+
+import argparse
+import struct
+import sys
+import zlib
+
+DELTA_MAGIC = 0x544C4442
+DELTA_VERSION = 1
+HEADER_FORMAT = "<6I"
+COMMAND_FORMAT = "<3I"
+
+# Length of the window used to find matches in the base image, and the shortest match worth a copy command.
+MATCH_WINDOW = 16
+MIN_MATCH = 24
+
+
+def build_index(base):
+    index = {}
+    for offset in range(len(base) - MATCH_WINDOW + 1):
+        index.setdefault(base[offset:offset + MATCH_WINDOW], offset)
+    return index
+
+
+def match_length(base, base_offset, image, image_offset):
+    length = 0
+    limit = min(len(base) - base_offset, len(image) - image_offset)
+    while length < limit and base[base_offset + length] == image[image_offset + length]:
+        length += 1
+    return length
+
+
+def create_patch(base, image):
+    index = build_index(base)
+    commands = []
+    literal = bytearray()
+    position = 0
+    # Offset between the image and the base image of the last match, code which only moved keeps the same delta.
+    last_delta = 0
+
+    while position < len(image):
+        best_offset, best_length = 0, 0
+
+        candidate = position + last_delta
+        if 0 <= candidate < len(base):
+            best_offset, best_length = candidate, match_length(base, candidate, image, position)
+
+        if best_length < MIN_MATCH:
+            offset = index.get(image[position:position + MATCH_WINDOW])
+            if offset is not None:
+                length = match_length(base, offset, image, position)
+                if length > best_length:
+                    best_offset, best_length = offset, length
+
+        if best_length >= MIN_MATCH:
+            commands.append((bytes(literal), best_offset, best_length))
+            literal = bytearray()
+            last_delta = best_offset - position
+            position += best_length
+        else:
+            literal.append(image[position])
+            position += 1
+
+    if literal:
+        commands.append((bytes(literal), 0, 0))
+
+    patch = bytearray(struct.pack(HEADER_FORMAT, DELTA_MAGIC, DELTA_VERSION,
+                                  len(base), zlib.crc32(base), len(image), zlib.crc32(image)))
+    for literal, offset, length in commands:
+        patch += struct.pack(COMMAND_FORMAT, len(literal), length, offset)
+        patch += literal
+    return bytes(patch)
+
+
+def apply_patch(base, patch):
+    magic, version, source_size, source_crc, target_size, target_crc = struct.unpack_from(HEADER_FORMAT, patch)
+    if magic != DELTA_MAGIC or version != DELTA_VERSION:
+        raise ValueError("not a delta patch")
+    if source_size > len(base) or zlib.crc32(base[:source_size]) != source_crc:
+        raise ValueError("patch does not match the base image")
+
+    image = bytearray()
+    position = struct.calcsize(HEADER_FORMAT)
+    while len(image) < target_size:
+        insert_len, copy_len, copy_offset = struct.unpack_from(COMMAND_FORMAT, patch, position)
+        position += struct.calcsize(COMMAND_FORMAT)
+        image += patch[position:position + insert_len]
+        position += insert_len
+        image += base[copy_offset:copy_offset + copy_len]
+
+    if len(image) != target_size or zlib.crc32(image) != target_crc:
+        raise ValueError("reconstructed image is corrupted")
+    return bytes(image)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Script to create OTA delta patches')
+    parser.add_argument("--base", help="Binary image currently running on the device", required=True)
+    parser.add_argument("--image", help="New binary image", required=True)
+    parser.add_argument("--output", help="Patch file to be created", required=True)
+    args = parser.parse_args()
+
+    with open(args.base, "rb") as f:
+        base = f.read()
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    patch = create_patch(base, image)
+
+    # Check the patch reproduces the image before it gets shipped.
+    if apply_patch(base, patch) != image:
+        print("Error: patch does not reproduce the image")
+        sys.exit(1)
+
+    with open(args.output, "wb") as f:
+        f.write(patch)
+
+    print("Created patch %s: %d bytes for %d bytes image (%.1f%%)" %
+          (args.output, len(patch), len(image), 100.0 * len(patch) / max(len(image), 1)))
+
+
+if __name__ == "__main__":
+    main()